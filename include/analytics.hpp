@@ -2,13 +2,28 @@
 #define TADS_ANALYTICS_HPP
 
 #include <atomic>
-#include <map>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <utility>
 
 #include <nvdscustomusermeta.h>
 
 #include "common.hpp"
+#include "analytics_writer.hpp"
+#include "best_shot.hpp"
+#include "date_directory.hpp"
+#include "image_save.hpp"
+#include "label_table.hpp"
+#include "latency.hpp"
+#include "meta_trace.hpp"
+#include "plate_consensus.hpp"
+#include "retention.hpp"
+#include "spsc_ring.hpp"
+#include "track_table.hpp"
 
 namespace fs = std::filesystem;
 
@@ -28,15 +43,86 @@ struct AnalyticsConfig : BaseConfig
 	std::string config_file_path{};
 	std::string output_path{};
 	int lp_min_length{ 6 };
+	/**
+	 * The plate of a track is settled once this many reads agree
+	 * with a score of at least lp_settle_score, see PlateConsensus.
+	 * */
+	uint lp_settle_reads{ 4 };
+	double lp_settle_score{ 0.75 };
+	/**
+	 * Keeps the vehicles whose plate is settled with a score of at least
+	 * lp_gate_min_score away from the secondary GIEs, see PlateGate.
+	 * Intervals and ages are in batches.
+	 * */
+	bool lp_gate_enable{};
+	double lp_gate_min_score{ 0.8 };
+	/**
+	 * A settled plate is read again this many batches later, 0 never reads it again.
+	 * */
+	uint lp_gate_reread_interval{ 50 };
+	/**
+	 * Tracks older than this are not read anymore, 0 for no cap.
+	 * */
+	uint lp_gate_max_track_age{};
 	double lines_distance;
+	/**
+	 * Maximum number of analytics records waiting to be written.
+	 * */
+	uint writer_queue_size{ 1024 };
+	/**
+	 * What to do when the writer queue is full.
+	 * 0=Block 1=Drop oldest 2=Drop newest
+	 * */
+	WriterOverflowPolicy writer_overflow_policy{ WriterOverflowPolicy::DROP_NEWEST };
+	/**
+	 * 0=Text file per vehicle 1=Event segments 2=Both
+	 * */
+	AnalyticsOutputFormat output_format{ AnalyticsOutputFormat::SEGMENTS };
+	/**
+	 * Longest time a queued record waits before being flushed.
+	 * */
+	uint writer_flush_interval_ms{ 500 };
+	/**
+	 * Number of frames after which a track that is no longer
+	 * reported by the tracker is dropped from the analytics state.
+	 * */
+	uint track_ttl_frames{ 300 };
+	/**
+	 * When set, the metadata of every batch is captured to this
+	 * file so it can be replayed offline with tads-replay.
+	 * */
+	std::string meta_trace_path{};
+	/**
+	 * Quotas of the output folder per kind of file, 0 for no limit.
+	 * The oldest files are deleted first once a quota is exceeded.
+	 * */
+	uint retention_events_max_mb{};
+	uint retention_events_max_days{};
+	uint retention_crops_max_mb{};
+	uint retention_crops_max_days{};
+	uint retention_interval_s{ 60 };
+	/**
+	 * Directory entries scanned per retention pass.
+	 * */
+	uint retention_scan_budget{ 10000 };
+	/**
+	 * Batches waiting for the analytics worker thread, 0 to run the
+	 * analytics inside the probe. A batch that finds the queue full is
+	 * dropped, the probe never waits; only its line crossings and crops
+	 * still reach the worker.
+	 * */
+	uint async_queue_size{};
 };
 
 struct LineCrossingData
 {
 	bool is_set;
-	std::string status;
+	LabelId status;
 	double timestamp;
-	std::string time_str;
+	/**
+	 * Wall clock time of the crossing in microseconds since the epoch.
+	 * */
+	int64_t time_us;
 
 	LineCrossingData();
 };
@@ -45,11 +131,8 @@ using LineCrossingPair = std::pair<LineCrossingData, LineCrossingData>;
 
 struct ClassifierData
 {
-	std::string label{ "unknown" };
+	LabelId label{ LABEL_UNKNOWN };
 	float confidence{ 0.0 };
-
-	ClassifierData() = default;
-	explicit ClassifierData(std::string label, float conf = 0.0);
 };
 
 struct TrafficAnalysisData
@@ -58,12 +141,24 @@ struct TrafficAnalysisData
 
 	uint64_t id;
 	uint64_t index;
-	std::string direction;
+	uint source_id;
+	LabelId direction;
 	LineCrossingPair crossing_pair;
 	ClassifierData classifier_data;
-	std::vector<ClassifierData> lp_data;
-	std::string output_path;
+	/**
+	 * Votes of the plate reads, see @ref PlateConsensus.
+	 * */
+	PlateConsensusState plate;
+	/**
+	 * Folder of the day the track was first seen, shared by all its tracks.
+	 * */
+	std::shared_ptr<const std::string> output_path;
 	bool has_image;
+	/**
+	 * Set once the record is written, the track is kept only to
+	 * ignore its remaining metadata until it is evicted.
+	 * */
+	bool is_saved;
 
 	TrafficAnalysisData();
 
@@ -71,9 +166,20 @@ struct TrafficAnalysisData
 	TrafficAnalysisData(const TrafficAnalysisData &) = default;
 	TrafficAnalysisData &operator=(const TrafficAnalysisData &) = default;
 
+	/**
+	 * Prepares a pooled instance for a new track.
+	 * */
+	void reset(uint64_t obj_id);
+
 	[[maybe_unused]]
 	void print_info() const;
-	void save_to_file() const;
+	void save_to_file(AnalyticsWriter *writer) const;
+
+	[[nodiscard]]
+	TrafficEvent to_event() const;
+
+	[[nodiscard]]
+	std::string to_string() const;
 
 	[[nodiscard]]
 	int get_object_speed() const;
@@ -88,8 +194,194 @@ struct TrafficAnalysisData
 	bool is_ready() const;
 };
 
-using TrafficAnalysisDataPtr = std::shared_ptr<TrafficAnalysisData>;
-using TrafficAnalysisDataMap = std::map<uint64_t, TrafficAnalysisDataPtr>;
+using TrafficAnalysisTable = TrackTable<TrafficAnalysisData>;
+
+/**
+ * What the crop of a track depends on. The crop is encoded from the frame
+ * surface, so this state is kept by the probe even when the rest of the
+ * analytics runs on the worker thread.
+ * */
+struct CropTrackState
+{
+	std::shared_ptr<const std::string> output_path;
+	/**
+	 * Score of the crop candidates seen in the capture window.
+	 * */
+	BestShotState best_shot;
+	uint8_t crossings;
+	/**
+	 * Both lines are crossed, the record of the track is written.
+	 * */
+	bool done;
+
+	void reset();
+};
+
+using CropTrackTable = TrackTable<CropTrackState>;
+
+/**
+ * Fields of one object the analytics needs, copied by the probe so that
+ * the buffer goes downstream before the object is analysed.
+ * */
+struct AnalyticsObjectSnapshot
+{
+	static constexpr uint MAX_CROSSINGS{ 2 };
+	static constexpr uint MAX_PLATES{ 2 };
+
+	/**
+	 * Track of the object, or of its parent for secondary detections.
+	 * */
+	uint64_t track_id;
+	uint source_id;
+	bool has_parent;
+	/**
+	 * The crop of the track was scheduled on this frame.
+	 * */
+	bool has_image;
+	uint8_t crossing_cnt;
+	uint8_t plate_cnt;
+	LabelId crossings[MAX_CROSSINGS];
+	LabelId direction;
+	LabelId parent_label;
+	/**
+	 * First label of the highest confidence among the parent classifiers.
+	 * */
+	ClassifierData classifier;
+	PlateRead plates[MAX_PLATES];
+};
+
+/**
+ * One batch of the probe, the slots of the worker queue are reused so the
+ * object vector keeps its capacity.
+ * */
+struct AnalyticsBatchSnapshot
+{
+	/**
+	 * Time of the line crossings on this batch, see parse_analytics_metadata.
+	 * */
+	double timestamp;
+	int64_t time_us;
+	std::shared_ptr<const std::string> output_path;
+	std::vector<AnalyticsObjectSnapshot> objects;
+};
+
+struct AnalyticsWorkerStats
+{
+	uint64_t processed;
+	uint64_t dropped;
+	/**
+	 * Objects of the dropped batches still processed, see @ref AnalyticsWorker::submit_dropped.
+	 * */
+	uint64_t kept_objects;
+	size_t queue_depth;
+	size_t max_queue_depth;
+	size_t capacity;
+};
+
+/**
+ * Runs the analytics of the batches captured by the probe on its own thread.
+ *
+ * The probe is the only producer and this thread the only consumer of a
+ * lock-free ring of preallocated batch snapshots. When the ring is full the
+ * batch is dropped and counted instead of blocking the streaming thread,
+ * but its objects with a line crossing or a crop are queued apart and
+ * processed in order, so that no vehicle loses its record.
+ * */
+class AnalyticsWorker
+{
+public:
+	using Process = std::function<void(const AnalyticsBatchSnapshot &)>;
+
+	/**
+	 * @param block_when_full wait for a free slot instead of dropping, for offline replays.
+	 * */
+	AnalyticsWorker(size_t queue_size, bool block_when_full, Process process);
+	~AnalyticsWorker();
+
+	AnalyticsWorker(const AnalyticsWorker &) = delete;
+	AnalyticsWorker &operator=(const AnalyticsWorker &) = delete;
+
+	bool start();
+
+	/**
+	 * Processes the batches still queued, then joins the thread.
+	 * */
+	void stop();
+
+	/**
+	 * Probe only.
+	 *
+	 * @return slot to capture the batch into, nullptr if the queue is full and the batch is dropped.
+	 * */
+	AnalyticsBatchSnapshot *acquire();
+
+	/**
+	 * Probe only, queues the slot returned by @ref acquire.
+	 * */
+	void submit();
+
+	/**
+	 * Probe only, queues the objects of @p batch with a line crossing or a
+	 * crop, after @ref acquire dropped it. Only copies a few objects, the
+	 * probe still never waits for the worker.
+	 * */
+	void submit_dropped(const AnalyticsBatchSnapshot &batch);
+
+	[[nodiscard]]
+	AnalyticsWorkerStats stats() const;
+
+private:
+	struct DroppedBatch
+	{
+		/**
+		 * Batches queued on the ring before this one.
+		 * */
+		uint64_t submitted_before;
+		AnalyticsBatchSnapshot batch;
+	};
+
+	void run();
+
+	/**
+	 * Processes the kept objects of the dropped batches queued after at most
+	 * @p processed batches of the ring.
+	 * */
+	void process_dropped(uint64_t processed);
+
+	[[nodiscard]]
+	bool has_work() const;
+
+private:
+	SpscRing<AnalyticsBatchSnapshot> m_ring;
+	const bool m_block_when_full;
+	Process m_process;
+	/**
+	 * Probe only, batches queued on the ring.
+	 * */
+	uint64_t m_submitted{};
+
+	std::thread m_thread;
+	std::atomic<bool> m_running{};
+	/**
+	 * Guards @ref m_dropped_batches and the sleep of the worker.
+	 * */
+	std::mutex m_lock;
+	std::condition_variable m_ready;
+	/**
+	 * The worker is about to wait, the probe takes the lock to wake it up.
+	 * */
+	std::atomic<bool> m_sleeping{};
+	/**
+	 * Kept objects of the dropped batches, oldest first.
+	 * */
+	std::deque<DroppedBatch> m_dropped_batches;
+	std::atomic<size_t> m_dropped_pending{};
+
+	std::atomic<uint64_t> m_processed{};
+	std::atomic<uint64_t> m_dropped{};
+	std::atomic<uint64_t> m_kept_objects{};
+	std::atomic<size_t> m_max_queue_depth{};
+};
 
 struct AnalyticsBin : BaseBin
 {
@@ -97,8 +389,44 @@ struct AnalyticsBin : BaseBin
 	GstElement *queue;
 	GstElement *analytics_elem;
 
-	TrafficAnalysisDataMap traffic_data_map;
-	GDateTime *date_time = nullptr;
+	TrafficAnalysisTable traffic_data_table;
+	/**
+	 * Guards the tracks of @ref traffic_data_table being added, evicted or
+	 * voted a plate, which @ref PlateGate reads on another streaming thread.
+	 * */
+	std::mutex track_lock;
+	CropTrackTable crop_track_table;
+	/**
+	 * Runs the analytics when async-queue-size is set, otherwise the probe
+	 * processes @ref sync_batch itself.
+	 * */
+	std::unique_ptr<AnalyticsWorker> worker;
+	AnalyticsBatchSnapshot sync_batch;
+	/**
+	 * Capture of the batches dropped by a full worker queue, their crops are
+	 * still encoded and their crossings still processed.
+	 * */
+	AnalyticsBatchSnapshot dropped_batch;
+	/**
+	 * Time spent in the probe per batch, in nanoseconds.
+	 * */
+	LatencyHistogram probe_latency;
+	std::atomic<uint64_t> probe_ns_total{};
+	std::atomic<uint64_t> probe_batches{};
+	/**
+	 * Output folder of the tracks when there is no date directory.
+	 * */
+	std::shared_ptr<const std::string> output_path;
+	std::unique_ptr<AnalyticsWriter> writer;
+	std::unique_ptr<MetaTraceWriter> trace_writer;
+	std::unique_ptr<DateDirectory> date_directory;
+	std::unique_ptr<RetentionManager> retention;
+	BestShotSelector best_shot_selector;
+	PlateConsensus plate_consensus;
+	std::unique_ptr<ImageSaveScheduler> image_scheduler;
+	std::unique_ptr<CropWriter> crop_writer;
+	ImageEncodeBatch image_batch;
+	std::unique_ptr<ImageEncodeStats> image_stats;
 	GTimer *timer = nullptr;
 };
 
@@ -111,4 +439,17 @@ void parse_analytics_metadata(AppContext *app_context, GstBuffer *buffer, NvDsBa
 // Function to create the bin and set properties
 bool create_analytics_bin(AnalyticsConfig *config, AnalyticsBin *analytics);
 
+/**
+ * Creates the worker thread that updates the tracks of the captured batches,
+ * it is started with AnalyticsWorker::start.
+ *
+ * @param block_when_full the probe waits for a free slot instead of dropping the batch.
+ * */
+void create_analytics_worker(AnalyticsBin *analytics, size_t queue_size, bool block_when_full, uint ttl_frames);
+
+/**
+ * @return probe time and worker queue since the last report, empty if there were no batches.
+ * */
+std::string analytics_report(AnalyticsBin *analytics);
+
 #endif // TADS_ANALYTICS_HPP
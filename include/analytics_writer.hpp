@@ -0,0 +1,158 @@
+#ifndef TADS_ANALYTICS_WRITER_HPP
+#define TADS_ANALYTICS_WRITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <sys/types.h>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "event_store.hpp"
+
+/**
+ * What to do with a new record when the writer queue is full.
+ * */
+enum class WriterOverflowPolicy : uint
+{
+	/**
+	 * Block the producer until the flush thread frees a slot.
+	 * */
+	BLOCK = 0,
+	/**
+	 * Discard the oldest queued record to make room for the new one.
+	 * */
+	DROP_OLDEST = 1,
+	/**
+	 * Discard the new record and count it as dropped.
+	 * */
+	DROP_NEWEST = 2,
+};
+
+/**
+ * Where analytics records are written.
+ * */
+enum class AnalyticsOutputFormat : uint
+{
+	/**
+	 * One text file per vehicle.
+	 * */
+	TEXT = 0,
+	/**
+	 * Hourly event segments, read back with tads-query.
+	 * */
+	SEGMENTS = 1,
+	BOTH = 2,
+};
+
+/**
+ * Single analytics record: the event and the text file it goes to when
+ * text output is enabled. The text is formatted on the flush thread.
+ * */
+struct AnalyticsRecord
+{
+	std::string filename;
+	TrafficEvent event;
+};
+
+/**
+ * Plain copy of the writer counters, safe to read from any thread.
+ * */
+struct AnalyticsWriterStats
+{
+	uint64_t queued;
+	uint64_t written;
+	uint64_t skipped;
+	uint64_t dropped;
+	uint64_t failed;
+	uint64_t batches;
+	uint64_t max_queue_depth;
+	size_t queue_depth;
+};
+
+/**
+ * Writes analytics records on a dedicated thread so that the
+ * streaming thread never touches the filesystem.
+ *
+ * Records are pushed into a bounded queue and the flush thread drains
+ * it in batches, either when the batch is full or when the flush interval
+ * expires.
+ * */
+class AnalyticsWriter
+{
+public:
+	AnalyticsWriter(size_t capacity, WriterOverflowPolicy policy, uint flush_interval_ms, size_t batch_size = 64);
+	~AnalyticsWriter();
+
+	AnalyticsWriter(const AnalyticsWriter &) = delete;
+	AnalyticsWriter &operator=(const AnalyticsWriter &) = delete;
+
+	/**
+	 * Selects the outputs, must be called before @ref start.
+	 *
+	 * @param root_path analytics output folder holding the event segments.
+	 * */
+	void set_output(AnalyticsOutputFormat format, const std::string &root_path);
+
+	bool start();
+
+	/**
+	 * Stops the flush thread after writing every record still queued.
+	 * */
+	void stop();
+
+	/**
+	 * Enqueues the record according to the overflow policy.
+	 *
+	 * @return false if the record was dropped.
+	 * */
+	bool push(AnalyticsRecord record);
+
+	[[nodiscard]]
+	AnalyticsWriterStats stats() const;
+
+private:
+	enum class TextResult
+	{
+		WRITTEN,
+		SKIPPED,
+		FAILED,
+	};
+
+	void run();
+	void flush(std::deque<AnalyticsRecord> &batch);
+	TextResult write_text(const AnalyticsRecord &record);
+
+private:
+	const size_t m_capacity;
+	const size_t m_batch_size;
+	const WriterOverflowPolicy m_policy;
+	const std::chrono::milliseconds m_flush_interval;
+	bool m_write_text{ true };
+	std::unique_ptr<EventStoreWriter> m_store;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::deque<AnalyticsRecord> m_queue;
+	std::thread m_thread;
+	bool m_running{};
+
+	std::atomic<uint64_t> m_queued{};
+	std::atomic<uint64_t> m_written{};
+	std::atomic<uint64_t> m_skipped{};
+	std::atomic<uint64_t> m_dropped{};
+	std::atomic<uint64_t> m_failed{};
+	std::atomic<uint64_t> m_batches{};
+	std::atomic<uint64_t> m_max_queue_depth{};
+	/**
+	 * Mirrors the queue size so the stats never take the lock of the producers.
+	 * */
+	std::atomic<uint64_t> m_queue_depth{};
+};
+
+#endif // TADS_ANALYTICS_WRITER_HPP
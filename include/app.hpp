@@ -25,6 +25,8 @@
 #include "secondary_preprocess.hpp"
 #include "c2d_msg.hpp"
 #include "image_save.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
 
 struct AppContext;
 
@@ -60,8 +62,8 @@ struct Pipeline : BaseBin
 	GstElement *demuxer;
 
 	SourceParentBin multi_src_bin;
-	std::vector<InstanceBin> instance_bins{ MAX_SOURCE_BINS };
-	std::vector<InstanceBin> demux_instance_bins{ MAX_SOURCE_BINS };
+	std::vector<InstanceBin> instance_bins;
+	std::vector<InstanceBin> demux_instance_bins;
 	InstanceBin common_elements;
 	TiledDisplayBin tiled_display;
 };
@@ -86,11 +88,23 @@ struct AppConfig : BaseConfig
 	std::string reid_track_dir_path;
 	std::string terminated_track_output_path;
 	std::string shadow_track_output_path;
+	/**
+	 * host:port or unix:path of the metrics endpoint, empty to disable it.
+	 * */
+	std::string metrics_address;
+	/**
+	 * Chrome trace-event file written on teardown, empty to disable span tracing.
+	 * */
+	std::string span_trace_path;
+	/**
+	 * Spans kept per thread, the oldest are overwritten.
+	 * */
+	uint span_trace_buffer_spans{ 65536 };
 
 	std::vector<std::string> uri_list;
 	std::vector<std::string> sensor_id_list;
 	std::vector<std::string> sensor_name_list;
-	std::vector<SourceConfig> multi_source_configs{ MAX_SOURCE_BINS };
+	std::vector<SourceConfig> multi_source_configs;
 	StreammuxConfig streammux_config;
 	OSDConfig osd_config;
 	PreProcessConfig preprocess_config;
@@ -98,7 +112,7 @@ struct AppConfig : BaseConfig
 	GieConfig primary_gie_config;
 	TrackerConfig tracker_config;
 	std::vector<GieConfig> secondary_gie_sub_bin_configs{ MAX_SECONDARY_GIE_BINS };
-	std::vector<SinkSubBinConfig> sink_bin_sub_bin_configs{ MAX_SINK_BINS };
+	std::vector<SinkSubBinConfig> sink_bin_sub_bin_configs;
 	MsgConsumerConfig message_consumer_configs[MAX_MESSAGE_CONSUMERS];
 	TiledDisplayConfig tiled_display_config;
 	AnalyticsConfig analytics_config;
@@ -142,12 +156,25 @@ struct AppContext
 
 	Pipeline pipeline;
 	AppConfig config;
-	std::array<InstanceData, MAX_SOURCE_BINS> instance_data{};
+	std::vector<InstanceData> instance_data;
 	std::array<C2DContextPtr, MAX_MESSAGE_CONSUMERS> c2d_contexts{};
 	AppPerfStructInt perf_struct;
 	NvDsFrameLatencyInfo *latency_info_array;
 	GMutex latency_lock;
 
+	/**
+	 * Per-stage latency histograms, created only when latency measurement is on.
+	 * */
+	std::unique_ptr<LatencyTracker> latency_tracker;
+	LatencyTracker::Stage *latency_sink_stage{};
+	LatencyTracker::Stage *latency_e2e_stage{};
+
+	/**
+	 * Created with the pipeline when a metrics address is set.
+	 * */
+	std::unique_ptr<MetricsRegistry> metrics;
+	std::unique_ptr<MetricsServer> metrics_server;
+
 	/** Hash table to save NvDsSensorInfo
 	 * obtained with REST API stream/add, remove operations
 	 * The key is souce_id */
@@ -193,6 +220,20 @@ private:
 	bool create_common_elements(GstElement **sink_elem, GstElement **src_elem);
 	bool create_demux_pipeline(uint index = 0);
 
+	/**
+	 * Adds a latency probe on the src pad of every bin boundary:
+	 * streammux, preprocess, primary infer, tracker, analytics, each
+	 * secondary infer and osd. The sink stage is recorded by the
+	 * latency measurement probes on the sinks.
+	 */
+	bool add_latency_probes();
+
+	/**
+	 * Registers the pipeline metrics and starts serving them, scrapes only
+	 * read counters and never block the streaming threads.
+	 */
+	bool start_metrics();
+
 	/**
 	 * Function to add components to pipeline which are dependent on number
 	 * of streams. These components work on single buffer. If tiling is being
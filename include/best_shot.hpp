@@ -0,0 +1,67 @@
+#ifndef TADS_BEST_SHOT_HPP
+#define TADS_BEST_SHOT_HPP
+
+/**
+ * Bounding box of a tracked object on one frame, in frame pixels.
+ * */
+struct BestShotBox
+{
+	float left;
+	float top;
+	float width;
+	float height;
+	float confidence;
+};
+
+/**
+ * Per-track state of @ref BestShotSelector, small enough to live in the track data.
+ * */
+struct BestShotState
+{
+	float best_score{};
+	bool scheduled{};
+};
+
+/**
+ * Picks the single frame on which the crop of a track is encoded.
+ *
+ * The score of a box grows with its area and confidence and falls to zero
+ * as the box reaches the frame edge, where vehicles are cut. A track is
+ * only considered inside its capture window, between the analytics lines.
+ * The encode is scheduled on the first frame past the score peak that is
+ * still within the tolerance of the peak, or when the window closes.
+ *
+ * It does not depend on DeepStream, so it can be driven by synthetic boxes.
+ * */
+class BestShotSelector
+{
+public:
+	/**
+	 * @param peak_tolerance relative score drop, below the peak, at which the peak is taken as passed.
+	 * @param edge_margin fraction of the smaller frame side over which the edge penalty applies.
+	 * */
+	explicit BestShotSelector(float peak_tolerance = 0.1f, float edge_margin = 0.05f);
+
+	/**
+	 * @return score in [0, 1].
+	 * */
+	[[nodiscard]]
+	float score(const BestShotBox &box, float frame_width, float frame_height) const;
+
+	/**
+	 * Feeds the box of the track on the current frame.
+	 *
+	 * @param armed the track is inside its capture window.
+	 * @param closing the window closes on this frame, encode now if nothing was scheduled.
+	 *
+	 * @return true exactly once per track, when the crop has to be encoded on this frame.
+	 * */
+	bool update(BestShotState &state, const BestShotBox &box, float frame_width, float frame_height, bool armed,
+							bool closing) const;
+
+private:
+	const float m_peak_tolerance;
+	const float m_edge_margin;
+};
+
+#endif // TADS_BEST_SHOT_HPP
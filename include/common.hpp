@@ -213,6 +213,11 @@ bool link_element_to_demux_src_pad(GstElement *demux, GstElement *elem, uint ind
 
 std::string get_current_date_time_str(std::string_view format = "%d-%m-%YT%H:%M:%S");
 
+/**
+ * Same format as @ref get_current_date_time_str for a wall clock time in microseconds since the epoch.
+ * */
+std::string format_date_time_str(int64_t time_us, std::string_view format = "%d-%m-%YT%H:%M:%S");
+
 bool starts_with(std::string_view view, std::string_view prefix) noexcept;
 bool starts_with(std::string_view view, std::string_view prefix, size_t length) noexcept;
 bool ends_with(std::string_view view, std::string_view suffix) noexcept;
@@ -236,6 +241,14 @@ NvOSD_ColorParams osd_color(const std::string &color_txt);
 
 std::string to_cyrillic(const std::string &text);
 
+/**
+ * Same as @ref to_cyrillic into a buffer. A character that does not fit
+ * in @p size - 1 bytes is left out with the rest, @p out is always null terminated.
+ *
+ * @return bytes written without the terminator.
+ * */
+size_t to_cyrillic(std::string_view text, char *out, size_t size);
+
 struct BaseConfig
 {
 	BaseConfig() = default;
@@ -21,8 +21,6 @@
 #define IS_TEGRA
 #endif
 
-constexpr size_t MAX_SOURCE_BINS{ 2 };
-constexpr size_t MAX_SINK_BINS{ 2 };
 constexpr size_t MAX_SECONDARY_GIE_BINS{ 5 };
 constexpr size_t MAX_SECONDARY_PREPROCESS_BINS{ 5 };
 constexpr size_t MAX_MESSAGE_CONSUMERS{ 5 };
@@ -312,6 +310,25 @@ constexpr std::string_view CONFIG_GROUP_ANALYTICS_DISTANCE{ "distance-between-li
 constexpr std::string_view CONFIG_GROUP_ANALYTICS_CONFIG_FILE{ "config-file" };
 constexpr std::string_view CONFIG_GROUP_ANALYTICS_OUTPUT_PATH{"output-path"};
 constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_MIN_LENGTH{"lp-min-length"};
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_SETTLE_READS{ "lp-settle-reads" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_SETTLE_SCORE{ "lp-settle-score" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_GATE_ENABLE{ "lp-gate-enable" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_GATE_MIN_SCORE{ "lp-gate-min-score" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_GATE_REREAD_INTERVAL{ "lp-gate-reread-interval" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_LP_GATE_MAX_TRACK_AGE{ "lp-gate-max-track-age" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_WRITER_QUEUE_SIZE{ "writer-queue-size" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_WRITER_OVERFLOW_POLICY{ "writer-overflow-policy" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_WRITER_FLUSH_INTERVAL{ "writer-flush-interval-ms" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_OUTPUT_FORMAT{ "output-format" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_TRACK_TTL_FRAMES{ "track-ttl-frames" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_META_TRACE_PATH{ "meta-trace-path" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_ASYNC_QUEUE_SIZE{ "async-queue-size" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_SIZE{ "retention-events-max-mb" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_DAYS{ "retention-events-max-days" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_SIZE{ "retention-crops-max-mb" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_DAYS{ "retention-crops-max-days" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_INTERVAL{ "retention-interval-s" };
+constexpr std::string_view CONFIG_GROUP_ANALYTICS_RETENTION_SCAN_BUDGET{ "retention-scan-budget" };
 
 // IMG_SAVE
 
@@ -320,6 +337,16 @@ constexpr std::string_view CONFIG_GROUP_IMG_SAVE_OUTPUT_FOLDER_PATH{ "output-fol
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_CROPPED_OBJECT_IMG_SAVE{ "save-img-cropped-obj" };
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_CSV_TIME_RULES_PATH{ "frame-to-skip-rules-path" };
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_SECOND_TO_SKIP_INTERVAL{ "second-to-skip-interval" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_MAX_CROPS_PER_INTERVAL{ "max-crops-per-interval" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_THREADS{ "writer-threads" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_QUEUE_SIZE{ "writer-queue-size" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_SLAB_SIZE{ "writer-slab-size-kb" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_OVERFLOW_POLICY{ "writer-overflow-policy" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_SYNC_POLICY{ "writer-sync-policy" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_WRITER_DIRECT_IO{ "writer-direct-io" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_ARCHIVE_CROPS{ "archive-crops" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_SIZE{ "archive-max-size-mb" };
+constexpr std::string_view CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_AGE{ "archive-max-age-s" };
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_QUALITY{ "quality" };
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_MIN_CONFIDENCE{ "min-confidence" };
 constexpr std::string_view CONFIG_GROUP_IMG_SAVE_MAX_CONFIDENCE{ "max-confidence" };
@@ -343,6 +370,9 @@ constexpr std::string_view CONFIG_GROUP_APP_REID_TRACK_OUTPUT_DIR{ "reid-track-o
 constexpr std::string_view CONFIG_GROUP_APP_GLOBAL_GPU_ID{ "global-gpu-id" };
 constexpr std::string_view CONFIG_GROUP_APP_TERMINATED_TRACK_OUTPUT_DIR{ "terminated-track-output-dir" };
 constexpr std::string_view CONFIG_GROUP_APP_SHADOW_TRACK_OUTPUT_DIR{ "shadow-track-output-dir" };
+constexpr std::string_view CONFIG_GROUP_APP_METRICS_ADDRESS{ "metrics-address" };
+constexpr std::string_view CONFIG_GROUP_APP_SPAN_TRACE_PATH{ "span-trace-path" };
+constexpr std::string_view CONFIG_GROUP_APP_SPAN_TRACE_BUFFER_SPANS{ "span-trace-buffer-spans" };
 
 // TESTS
 
@@ -0,0 +1,164 @@
+#ifndef TADS_CROP_ARCHIVE_HPP
+#define TADS_CROP_ARCHIVE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "event_store.hpp"
+
+/**
+ * What a crop shows, kept in the archive index.
+ * */
+struct CropInfo
+{
+	uint64_t object_id;
+	uint32_t source_id;
+	/**
+	 * Wall clock capture time, microseconds since the epoch.
+	 * */
+	int64_t time_us;
+};
+
+/**
+ * Crops are appended to tar archives in the folder of their file name,
+ * instead of one file per crop:
+ *
+ *   <folder>/crops_<HHMMSS>_<n>.tar  ustar members named as the crop files
+ *   <folder>/crops_<HHMMSS>_<n>.idx  @ref EventSegmentHeader and @ref CropIndexEntry
+ *
+ * The archives can be listed and extracted with tar. The index points at
+ * the member data and is written after it, so entries past the end of the
+ * archive are the tail of a crash and are ignored.
+ * */
+struct CropIndexEntry
+{
+	int64_t time_us;
+	uint64_t object_id;
+	/**
+	 * Offset of the member data in the archive, its header is the 512 bytes before.
+	 * */
+	uint64_t offset;
+	uint32_t source_id;
+	uint32_t size;
+};
+
+static_assert(sizeof(CropIndexEntry) == 32, "CropIndexEntry is part of the index format");
+
+/**
+ * Appends crops to the current archive and rolls to a new one when it
+ * reaches its size or age limit, or when the crops move to another folder.
+ * Not thread-safe, the crop writer serialises the calls.
+ * */
+class CropArchiveWriter
+{
+public:
+	/**
+	 * @param max_age_us age of an archive, by crop capture time, at which it is rolled.
+	 * */
+	CropArchiveWriter(uint64_t max_bytes, int64_t max_age_us);
+	~CropArchiveWriter();
+
+	CropArchiveWriter(const CropArchiveWriter &) = delete;
+	CropArchiveWriter &operator=(const CropArchiveWriter &) = delete;
+
+	/**
+	 * Writes the tar member of the crop, its index entry is buffered until @ref flush.
+	 * */
+	bool append(const std::string &filename, const CropInfo &info, const char *data, size_t size);
+
+	/**
+	 * Writes the buffered index entries.
+	 *
+	 * @param sync also fdatasync the archive and the index.
+	 * */
+	bool flush(bool sync);
+
+	/**
+	 * Terminates the current archive.
+	 * */
+	void close();
+
+	/**
+	 * @return archives and index files created.
+	 * */
+	[[nodiscard]]
+	uint64_t files_created() const
+	{
+		return m_files_created.load(std::memory_order_relaxed);
+	}
+
+private:
+	bool open_archive(const std::string &folder, int64_t time_us);
+
+private:
+	const uint64_t m_max_bytes;
+	const int64_t m_max_age_us;
+
+	std::string m_folder;
+	int m_archive_fd{ -1 };
+	int m_index_fd{ -1 };
+	uint64_t m_archive_size{};
+	int64_t m_open_time_us{};
+	std::vector<CropIndexEntry> m_pending_index;
+	std::atomic<uint64_t> m_files_created{};
+};
+
+/**
+ * Read-only view of an archive and its index, both memory mapped.
+ * */
+class CropArchiveReader
+{
+public:
+	CropArchiveReader() = default;
+	~CropArchiveReader();
+
+	CropArchiveReader(const CropArchiveReader &) = delete;
+	CropArchiveReader &operator=(const CropArchiveReader &) = delete;
+
+	/**
+	 * @param archive_path path of the .tar file, the index is found next to it.
+	 * */
+	bool open(const std::string &archive_path);
+	void close();
+
+	[[nodiscard]]
+	size_t size() const
+	{
+		return m_num_entries;
+	}
+
+	[[nodiscard]]
+	const CropIndexEntry &entry(size_t i) const
+	{
+		return m_entries[i];
+	}
+
+	/**
+	 * @return member name of the crop, i.e. the file name it would have had.
+	 * */
+	[[nodiscard]]
+	std::string_view name(size_t i) const;
+
+	[[nodiscard]]
+	std::string_view data(size_t i) const;
+
+private:
+	const char *m_archive{};
+	size_t m_archive_size{};
+	const char *m_index{};
+	size_t m_index_size{};
+	const CropIndexEntry *m_entries{};
+	size_t m_num_entries{};
+};
+
+/**
+ * Lists the archives under @p root_path and its day folders.
+ *
+ * @return archive paths sorted by name, i.e. by folder and opening time.
+ * */
+std::vector<std::string> list_crop_archives(const std::string &root_path);
+
+#endif // TADS_CROP_ARCHIVE_HPP
@@ -0,0 +1,156 @@
+#ifndef TADS_CROP_WRITER_HPP
+#define TADS_CROP_WRITER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "analytics_writer.hpp"
+#include "crop_archive.hpp"
+
+/**
+ * When the crop files are flushed to the disk.
+ * */
+enum class CropSyncPolicy : uint
+{
+	/**
+	 * Leave it to the page cache.
+	 * */
+	NONE = 0,
+	/**
+	 * fdatasync every file before counting it as written.
+	 * */
+	DATA = 1,
+};
+
+/**
+ * Plain copy of the crop writer counters, safe to read from any thread.
+ * */
+struct CropWriterStats
+{
+	uint64_t queued;
+	uint64_t written;
+	uint64_t dropped;
+	uint64_t failed;
+	uint64_t bytes;
+	/**
+	 * Files created, i.e. filesystem metadata operations.
+	 * */
+	uint64_t files;
+	uint64_t batches;
+	uint64_t max_queue_depth;
+	size_t queue_depth;
+};
+
+/**
+ * Writes encoded crops on a small pool of threads so that the streaming
+ * thread never touches the filesystem.
+ *
+ * Every crop is copied once into a slab of a fixed pool, allocated up front
+ * and aligned for O_DIRECT. The slabs also bound the queue: when all of them
+ * are queued or being written the overflow policy applies. Workers take the
+ * queued crops in batches and, with direct I/O, write the padded slab and
+ * truncate the file to the crop size. With an archive the crops of a batch
+ * are appended to it instead, under a lock shared by the workers.
+ * */
+class CropWriter
+{
+public:
+	static constexpr size_t SLAB_ALIGNMENT{ 4096 };
+
+	/**
+	 * @param slab_count crops queued or being written at most.
+	 * @param slab_size largest crop, rounded up to @ref SLAB_ALIGNMENT.
+	 * */
+	CropWriter(uint thread_count, size_t slab_count, size_t slab_size, WriterOverflowPolicy policy,
+						 CropSyncPolicy sync_policy, bool direct_io, size_t batch_size = 16);
+	~CropWriter();
+
+	CropWriter(const CropWriter &) = delete;
+	CropWriter &operator=(const CropWriter &) = delete;
+
+	/**
+	 * Appends the crops to rolling archives instead of one file each, must be called before @ref start.
+	 * */
+	void set_archive(std::unique_ptr<CropArchiveWriter> archive);
+
+	bool start();
+
+	/**
+	 * Stops the workers after writing every crop still queued.
+	 * */
+	void stop();
+
+	/**
+	 * Copies the crop into a slab and queues it according to the overflow policy.
+	 *
+	 * @return false if the crop was dropped.
+	 * */
+	bool submit(const std::string &filename, const CropInfo &info, const void *data, size_t size);
+
+	[[nodiscard]]
+	CropWriterStats stats() const;
+
+private:
+	struct Job
+	{
+		std::string filename;
+		CropInfo info;
+		char *slab;
+		size_t size;
+	};
+
+	void run();
+	bool write_file(const Job &job);
+	void write_archive(const std::vector<Job> &batch);
+
+private:
+	const uint m_thread_count;
+	const size_t m_slab_size;
+	const size_t m_batch_size;
+	const WriterOverflowPolicy m_policy;
+	const CropSyncPolicy m_sync_policy;
+	const bool m_direct_io;
+
+	std::unique_ptr<char, decltype(&std::free)> m_slabs{ nullptr, &std::free };
+
+	std::mutex m_archive_lock;
+	std::unique_ptr<CropArchiveWriter> m_archive;
+
+	mutable std::mutex m_lock;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_slab_free;
+	std::vector<char *> m_free_slabs;
+	std::deque<Job> m_queue;
+	std::vector<std::thread> m_threads;
+	bool m_running{};
+
+	std::atomic<uint64_t> m_queued{};
+	std::atomic<uint64_t> m_written{};
+	std::atomic<uint64_t> m_dropped{};
+	std::atomic<uint64_t> m_failed{};
+	std::atomic<uint64_t> m_bytes{};
+	std::atomic<uint64_t> m_files{};
+	std::atomic<uint64_t> m_batches{};
+	std::atomic<uint64_t> m_max_queue_depth{};
+	/**
+	 * Mirrors the queue size so the stats never take the lock of the producers.
+	 * */
+	std::atomic<uint64_t> m_queue_depth{};
+};
+
+/**
+ * Formats the crop writer counters and queue depth.
+ *
+ * @return empty string if no crop was queued yet.
+ * */
+std::string crop_writer_report(CropWriter *writer);
+
+#endif // TADS_CROP_WRITER_HPP
@@ -0,0 +1,70 @@
+#ifndef TADS_DATE_DIRECTORY_HPP
+#define TADS_DATE_DIRECTORY_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Day folder of the analytics output, <root>/<ddmmyyyy> in local time.
+ *
+ * The folder is created once per day: a timer thread sleeps until the next
+ * local midnight, creates the new folder and swaps the cached path. The
+ * streaming thread only loads the cached path, it never formats a date or
+ * touches the filesystem.
+ * */
+class DateDirectory
+{
+public:
+	explicit DateDirectory(std::string root_path);
+	~DateDirectory();
+
+	DateDirectory(const DateDirectory &) = delete;
+	DateDirectory &operator=(const DateDirectory &) = delete;
+
+	/**
+	 * Creates the folder of the current day and starts the midnight timer.
+	 * */
+	bool start();
+	void stop();
+
+	/**
+	 * @return folder of the current day, nullptr before @ref start.
+	 * */
+	[[nodiscard]]
+	std::shared_ptr<const std::string> path() const;
+
+	/**
+	 * Folder of the local day holding @p time_us (wall clock microseconds).
+	 * */
+	static std::string day_path(const std::string &root_path, int64_t time_us);
+
+	/**
+	 * Start of the local day following @p time_us, DST transitions included.
+	 * */
+	static int64_t next_midnight_us(int64_t time_us);
+
+private:
+	/**
+	 * Switches to the day of @p now_us, creating its folder if needed.
+	 * */
+	bool update(int64_t now_us);
+	void run();
+
+private:
+	const std::string m_root_path;
+	/**
+	 * Read and replaced with the atomic shared_ptr functions.
+	 * */
+	std::shared_ptr<const std::string> m_path;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_running{};
+};
+
+#endif // TADS_DATE_DIRECTORY_HPP
@@ -0,0 +1,262 @@
+#ifndef TADS_EVENT_STORE_HPP
+#define TADS_EVENT_STORE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * One analysed vehicle, as written to the event store or exported as text.
+ *
+ * Times are wall clock microseconds since the epoch, a line that was not
+ * crossed has a zero time.
+ * */
+struct TrafficEvent
+{
+	/**
+	 * Time of the last line crossing, or of the end of the track without one.
+	 * */
+	int64_t time_us{};
+	/**
+	 * Time the event store appended the event, set when it is read back.
+	 * */
+	int64_t append_time_us{};
+	uint64_t object_id{};
+	uint32_t source_id{};
+	std::string label;
+	float label_confidence{};
+	std::string direction;
+	std::string line1_status;
+	int64_t line1_time_us{};
+	std::string line2_status;
+	int64_t line2_time_us{};
+	std::string plate;
+	float plate_confidence{};
+	int32_t speed_kmh{};
+	/**
+	 * Folder of the object image, empty if no image was saved.
+	 * */
+	std::string image_dir;
+
+	/**
+	 * Plain-text form, the same as the per-vehicle analytics files.
+	 * */
+	[[nodiscard]]
+	std::string to_string() const;
+};
+
+/**
+ * Events are stored in segments of the local hour they were appended in,
+ * under the analytics output folder, next to the images of the day:
+ *
+ *   <output>/<ddmmyyyy>/events_<HH>.rec  header and fixed-width @ref EventRecord
+ *   <output>/<ddmmyyyy>/events_<HH>.str  header and string table
+ *   <output>/<ddmmyyyy>/events_<HH>.idx  header and sparse time index
+ *
+ * The three files are append-only. Strings are written before the records
+ * that reference them and index entries may point past the last record,
+ * so a crash leaves at most a partial tail that readers ignore and the
+ * writer truncates when it reopens the segment. Values are stored in host
+ * byte order.
+ *
+ * The append time orders the segments, the records and the index. The
+ * event time is only data: events are appended when their track ends, in
+ * no particular order of their crossings.
+ * */
+struct EventSegmentHeader
+{
+	static constexpr uint32_t VERSION{ 2 };
+
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+};
+
+constexpr uint32_t EVENT_NO_STRING{ UINT32_MAX };
+
+/**
+ * Fixed-width event, strings are indexes into the segment string table.
+ * */
+struct EventRecord
+{
+	int64_t time_us;
+	/**
+	 * Never lower than the append time of the previous record.
+	 * */
+	int64_t append_time_us;
+	uint64_t object_id;
+	int64_t line1_time_us;
+	int64_t line2_time_us;
+	uint32_t source_id;
+	uint32_t label;
+	uint32_t direction;
+	uint32_t line1_status;
+	uint32_t line2_status;
+	uint32_t plate;
+	uint32_t image_dir;
+	float label_confidence;
+	float plate_confidence;
+	int32_t speed_kmh;
+};
+
+static_assert(sizeof(EventRecord) == 80, "EventRecord is part of the segment format");
+
+/**
+ * Append time of the first record of every @ref EVENT_INDEX_STRIDE records.
+ * */
+struct EventIndexEntry
+{
+	int64_t append_time_us;
+	uint64_t record;
+};
+
+constexpr uint64_t EVENT_INDEX_STRIDE{ 64 };
+
+/**
+ * Appends events to the segment of the hour they are appended in,
+ * switching segments when the hour changes. A wall clock stepping back
+ * does not reopen an earlier segment, the append time is held at the last
+ * one until the clock catches up. Not thread-safe, it is driven by the
+ * analytics writer thread.
+ * */
+class EventStoreWriter
+{
+public:
+	explicit EventStoreWriter(std::string root_path);
+	~EventStoreWriter();
+
+	EventStoreWriter(const EventStoreWriter &) = delete;
+	EventStoreWriter &operator=(const EventStoreWriter &) = delete;
+
+	/**
+	 * @param append_time_us wall clock time of the append.
+	 * */
+	bool append(const TrafficEvent &event, int64_t append_time_us);
+
+	/**
+	 * Hands the buffered records and index entries to the kernel.
+	 * */
+	void flush();
+	void close();
+
+private:
+	/**
+	 * Appends after a restart go on from the last record of the newest segment.
+	 * */
+	void load_last_append_time();
+	bool open_segment(const std::string &base_path);
+	/**
+	 * Rebuilds the string ids of a reopened segment.
+	 *
+	 * @param[in,out] body_size size of the string table, set to the length of its complete entries.
+	 * */
+	bool load_strings(FILE *file, uint64_t &body_size);
+	uint32_t intern(const std::string &value);
+
+private:
+	const std::string m_root_path;
+	int64_t m_hour_start_us{ -1 };
+	/**
+	 * Append time of the last record, kept across segments and restarts.
+	 * */
+	int64_t m_last_append_us{ INT64_MIN };
+	FILE *m_records{};
+	FILE *m_strings{};
+	FILE *m_index{};
+	std::unordered_map<std::string, uint32_t> m_string_ids;
+	uint64_t m_num_records{};
+};
+
+/**
+ * Read-only view of a segment, the files are memory mapped.
+ * */
+class EventSegmentReader
+{
+public:
+	EventSegmentReader() = default;
+	~EventSegmentReader();
+
+	EventSegmentReader(const EventSegmentReader &) = delete;
+	EventSegmentReader &operator=(const EventSegmentReader &) = delete;
+
+	/**
+	 * @param base_path segment path without extension.
+	 * */
+	bool open(const std::string &base_path);
+	void close();
+
+	[[nodiscard]]
+	size_t size() const
+	{
+		return m_num_records;
+	}
+
+	[[nodiscard]]
+	const EventRecord &record(size_t i) const
+	{
+		return m_records[i];
+	}
+
+	/**
+	 * @return empty view for @ref EVENT_NO_STRING or an id past the table.
+	 * */
+	[[nodiscard]]
+	std::string_view string(uint32_t id) const;
+
+	/**
+	 * @return id of @p value in the string table, or @ref EVENT_NO_STRING
+	 *         when no record of the segment can reference it.
+	 * */
+	[[nodiscard]]
+	uint32_t find_string(std::string_view value) const;
+
+	/**
+	 * Index of the first record appended at or after @p append_time_us,
+	 * found with the sparse index and a short scan.
+	 * */
+	[[nodiscard]]
+	size_t lower_bound(int64_t append_time_us) const;
+
+	[[nodiscard]]
+	TrafficEvent event(size_t i) const;
+
+private:
+	struct Mapping
+	{
+		const char *data;
+		size_t size;
+	};
+
+	static bool map(const std::string &path, const char *magic, uint32_t entry_size, Mapping &mapping);
+
+	Mapping m_record_map{};
+	Mapping m_string_map{};
+	Mapping m_index_map{};
+	const EventRecord *m_records{};
+	size_t m_num_records{};
+	const EventIndexEntry *m_index{};
+	size_t m_num_index{};
+	std::vector<std::string_view> m_string_table;
+};
+
+struct EventSegmentInfo
+{
+	std::string base_path;
+	/**
+	 * Wall clock start of the hour the records of the segment were appended in.
+	 * */
+	int64_t start_us;
+};
+
+/**
+ * Lists the segments under the analytics output folder from their file
+ * names, without opening them.
+ *
+ * @return segments sorted by start time.
+ * */
+std::vector<EventSegmentInfo> list_event_segments(const std::string &root_path);
+
+#endif // TADS_EVENT_STORE_HPP
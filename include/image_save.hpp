@@ -1,9 +1,18 @@
 #ifndef TADS_IMAGE_SAVE_HPP
 #define TADS_IMAGE_SAVE_HPP
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <nvbufsurface.h>
 #include <nvds_obj_encode.h>
 
 #include "common.hpp"
+#include "crop_writer.hpp"
+#include "image_save_scheduler.hpp"
 
 struct AppContext;
 
@@ -15,6 +24,28 @@ struct ImageSaveConfig
 	bool save_image_cropped_object{ true };
 	std::string frame_to_skip_rules_path{};
 	uint second_to_skip_interval{ 600 };
+	/**
+	 * Crops per source and class allowed in second_to_skip_interval, 0 for no limit.
+	 * */
+	uint max_crops_per_interval{};
+	/**
+	 * Crop writer threads, 0 lets the encoder write the crops itself.
+	 * */
+	uint writer_threads{ 2 };
+	/**
+	 * Crops queued or being written at most, one slab each.
+	 * */
+	uint writer_queue_size{ 64 };
+	uint writer_slab_size_kb{ 512 };
+	WriterOverflowPolicy writer_overflow_policy{ WriterOverflowPolicy::DROP_NEWEST };
+	CropSyncPolicy writer_sync_policy{ CropSyncPolicy::NONE };
+	bool writer_direct_io{};
+	/**
+	 * Append the crops to rolling tar archives instead of one file each.
+	 * */
+	bool archive_crops{};
+	uint archive_max_size_mb{ 1024 };
+	uint archive_max_age_s{ 3600 };
 	uint quality{ 80 };
 	double min_confidence{};
 	double max_confidence{ 1.0 };
@@ -23,19 +54,84 @@ struct ImageSaveConfig
 };
 
 /**
- * save_detected_object_image will extract metadata received on OSD sink pad
- * and update params for drawing rectangle, object information. We also iterate
- * through the user meta of type "NVDS_CROP_IMAGE_META" to find image crop meta
- * and demonstrate how to access it.
+ * Crop encoded into the user meta of its object, handed to the crop writer
+ * once the batch is finished.
+ * */
+struct PendingCrop
+{
+	NvDsObjectMeta *obj_meta;
+	std::string filename;
+	CropInfo info;
+};
+
+/**
+ * Crops scheduled while the analytics parses one batch. They are submitted
+ * to the encoder context as they come and waited for once per batch.
+ * */
+struct ImageEncodeBatch
+{
+	/**
+	 * Surface of the batch, mapped on the first crop.
+	 * */
+	NvBufSurface *surface{};
+	uint pending{};
+	/**
+	 * Crops left to the crop writer, empty when the encoder writes the files.
+	 * */
+	std::vector<PendingCrop> crops;
+};
+
+/**
+ * Encoder submissions, drained by @ref image_encode_report.
+ * */
+struct ImageEncodeStats
+{
+	std::atomic<uint64_t> submissions{};
+	std::atomic<uint64_t> batches{};
+	/**
+	 * Monotonic time of the previous report, set when the stats are created.
+	 * */
+	int64_t report_time_us{};
+};
+
+/**
+ * @return true if the object passes the confidence and box size filters of @p config.
+ * */
+bool image_save_filters_match(const ImageSaveConfig *config, const NvDsObjectMeta *obj_meta);
+
+/**
+ * Loads the frame skip rules and sets up the rate limit of @p config.
+ *
+ * @return nullptr if the rules cannot be loaded.
+ * */
+std::unique_ptr<ImageSaveScheduler> create_image_save_scheduler(const ImageSaveConfig *config);
+
+/**
+ * Starts the crop writer pool of @p config.
+ *
+ * @return nullptr if the encoder writes the crops itself or the pool cannot start.
+ * */
+std::unique_ptr<CropWriter> create_crop_writer(const ImageSaveConfig *config);
+
+/**
+ * Submits the crop of one object to the encoder. It is written to
+ * @p filename when the batch is finished with @ref finish_image_encoding,
+ * by the crop writer if there is one and by the encoder otherwise.
+ * */
+bool encode_object_image(AppContext *app_context, GstBuffer *buffer, NvDsFrameMeta *frame_meta,
+												 NvDsObjectMeta *obj_meta, const std::string &filename);
+
+/**
+ * Waits for the crops submitted during the current batch, if any, and
+ * queues them to the crop writer.
  * */
-bool save_image(ImageSaveConfig *config, NvDsObjectMeta *obj_meta, const std::string &filename);
+void finish_image_encoding(AppContext *app_context);
 
 /**
- * encode_image will extract metadata received on pgie src pad
- * and update params for drawing rectangle, object information etc. We also
- * iterate through the object list and encode the cropped objects as jpeg
- * images and attach it as user meta to the respective objects.
+ * Formats the encoder submissions per minute since the previous report.
+ *
+ * @return empty string if nothing was submitted.
  * */
-GstPadProbeReturn encode_image(AppContext* app_context, GstBuffer *buffer);
+std::string image_encode_report(ImageEncodeStats *stats);
 
 #endif // TADS_IMAGE_SAVE_HPP
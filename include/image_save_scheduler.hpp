@@ -0,0 +1,163 @@
+#ifndef TADS_IMAGE_SAVE_SCHEDULER_HPP
+#define TADS_IMAGE_SAVE_SCHEDULER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Frames to skip between two crops of a source during a time window.
+ * Read from the CSV file of frame-to-skip-rules-path, one rule per line:
+ *
+ *   HH:MM,HH:MM,frames[,class_id]
+ *
+ * The window starts at the first time and ends, exclusive, at the second;
+ * it wraps around midnight if the end is before the start and covers the
+ * whole day if both are equal. A missing or '*' class applies to all classes.
+ * */
+struct ImageSaveRule
+{
+	uint start_minute;
+	uint end_minute;
+	uint frames_to_skip;
+	/**
+	 * -1 for all classes.
+	 * */
+	int class_id;
+};
+
+/**
+ * @return false if the file cannot be read or a line is malformed.
+ * */
+bool load_image_save_rules(const std::string &file_path, std::vector<ImageSaveRule> &rules);
+
+/**
+ * Rules compiled into a table indexed by minute of the day and class, so a
+ * lookup is two loads. Overlapping rules take the largest skip, a class rule
+ * takes precedence over an all-classes rule.
+ * */
+class ImageSaveRuleTable
+{
+public:
+	ImageSaveRuleTable() = default;
+	explicit ImageSaveRuleTable(const std::vector<ImageSaveRule> &rules);
+
+	/**
+	 * @return frames to skip after a crop of @p class_id at @p minute of the day, 0 if no rule applies.
+	 * */
+	[[nodiscard]]
+	uint frames_to_skip(uint minute, int class_id) const;
+
+	[[nodiscard]]
+	bool empty() const
+	{
+		return m_table.empty();
+	}
+
+	static constexpr uint MINUTES_PER_DAY{ 24 * 60 };
+
+private:
+	static constexpr uint32_t NO_RULE{ UINT32_MAX };
+
+	/**
+	 * MINUTES_PER_DAY rows of m_columns entries, column 0 holds the all-classes rules.
+	 * */
+	std::vector<uint32_t> m_table;
+	uint m_columns{};
+};
+
+enum class ImageSaveDecision
+{
+	ADMIT,
+	SKIP_RULE,
+	SKIP_RATE,
+};
+
+/**
+ * Crops admitted and dropped for one source, drained by @ref ImageSaveScheduler::drain.
+ * */
+struct ImageSaveSourceStats
+{
+	uint64_t admitted{};
+	uint64_t skipped_rule{};
+	uint64_t skipped_rate{};
+};
+
+/**
+ * Decides whether a scheduled crop is encoded, before it reaches the encoder.
+ *
+ * Each (source, class) pair has its own frame skip state and token bucket.
+ * The bucket holds up to @p crops_per_interval tokens and refills at that
+ * many tokens per @p interval_s, so bursts up to the capacity pass and the
+ * sustained rate is capped. Only the caller's clock and frame numbers are
+ * used, so a recorded metadata stream always gives the same decisions.
+ * */
+class ImageSaveScheduler
+{
+public:
+	/**
+	 * @param crops_per_interval 0 disables the rate limit.
+	 * */
+	ImageSaveScheduler(ImageSaveRuleTable rules, uint crops_per_interval, uint interval_s);
+
+	/**
+	 * @param frame_num frame number of the source.
+	 * @param time_us wall clock time of the frame, microseconds since the epoch.
+	 * */
+	ImageSaveDecision admit(uint source_id, int class_id, int64_t frame_num, int64_t time_us);
+
+	/**
+	 * Returns and resets the per-source counters, indexed by source id. Can be
+	 * called from another thread than @ref admit.
+	 * */
+	std::vector<ImageSaveSourceStats> drain();
+
+	/**
+	 * Counters of all sources since the start, read without a lock.
+	 * */
+	[[nodiscard]]
+	ImageSaveSourceStats totals() const;
+
+private:
+	struct Track
+	{
+		int64_t last_frame{ -1 };
+		double tokens{};
+		int64_t refill_time_us{ -1 };
+	};
+
+	bool take_token(Track &track, int64_t time_us);
+
+private:
+	const ImageSaveRuleTable m_rules;
+	const double m_capacity;
+	/**
+	 * Tokens per microsecond.
+	 * */
+	const double m_refill_rate;
+
+	/**
+	 * Keyed by source id in the upper and class id in the lower 32 bits, only used by @ref admit.
+	 * */
+	std::unordered_map<uint64_t, Track> m_tracks;
+
+	std::mutex m_stats_lock;
+	std::vector<ImageSaveSourceStats> m_stats;
+	/**
+	 * Indexed by @ref ImageSaveDecision.
+	 * */
+	std::array<std::atomic<uint64_t>, 3> m_totals{};
+};
+
+/**
+ * Formats the dropped crops per source since the previous report.
+ *
+ * @return empty string if nothing was dropped.
+ * */
+std::string image_save_drop_report(ImageSaveScheduler *scheduler);
+
+#endif // TADS_IMAGE_SAVE_SCHEDULER_HPP
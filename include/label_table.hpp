@@ -0,0 +1,31 @@
+#ifndef TADS_LABEL_TABLE_HPP
+#define TADS_LABEL_TABLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/**
+ * Id of a string repeated by many tracks: class labels, line crossing
+ * statuses and directions. The few distinct values are stored once for
+ * the whole process and a track only keeps their id.
+ * */
+using LabelId = uint16_t;
+
+/**
+ * Id of "unknown", the value of everything that was not seen yet.
+ * */
+constexpr LabelId LABEL_UNKNOWN{ 0 };
+
+/**
+ * @return id of @p name, added to the table on first use. Once the
+ *         table is full new names map to @ref LABEL_UNKNOWN.
+ * */
+LabelId label_id(std::string_view name);
+
+/**
+ * @return name of @p id, valid as long as the process.
+ * */
+const std::string &label_name(LabelId id);
+
+#endif // TADS_LABEL_TABLE_HPP
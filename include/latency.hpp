@@ -0,0 +1,184 @@
+#ifndef TADS_LATENCY_HPP
+#define TADS_LATENCY_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+class MetricsRegistry;
+
+/**
+ * Plain copy of a @ref LatencyHistogram, used to merge and to compute percentiles.
+ *
+ * Values are microseconds. Buckets are log-linear like HDR histograms:
+ * values below 16 have their own bucket, above that every power of two
+ * is split into 16 sub-buckets, so the relative error is below 6.25%.
+ * */
+struct LatencySnapshot
+{
+	static constexpr uint SUB_BUCKET_BITS{ 4 };
+	static constexpr uint SUB_BUCKETS{ 1u << SUB_BUCKET_BITS };
+	static constexpr uint NUM_BUCKETS{ (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS };
+
+	std::array<uint64_t, NUM_BUCKETS> counts{};
+	uint64_t total{};
+	uint64_t max{};
+	uint64_t sum{};
+
+	static uint bucket_index(uint64_t value);
+
+	/**
+	 * Highest value that falls into the bucket.
+	 * */
+	static uint64_t bucket_value(uint index);
+
+	void merge(const LatencySnapshot &other);
+
+	/**
+	 * @param percentile in range [0, 100].
+	 *
+	 * @return upper bound of the bucket holding the percentile, clamped to max.
+	 * */
+	[[nodiscard]]
+	uint64_t value_at(double percentile) const;
+};
+
+/**
+ * Latency histogram that is recorded without locks.
+ *
+ * Every stage boundary is a pad probe running on one streaming thread,
+ * so each histogram has a single writer and the relaxed increments never
+ * contend. The reporter drains it with atomic exchanges, so no record is
+ * lost or counted twice.
+ * */
+class LatencyHistogram
+{
+public:
+	void record(uint64_t value_us);
+
+	/**
+	 * Moves the counts recorded since the last call into @p snapshot.
+	 * */
+	void drain(LatencySnapshot &snapshot);
+
+private:
+	std::array<std::atomic<uint64_t>, LatencySnapshot::NUM_BUCKETS> m_counts{};
+	std::atomic<uint64_t> m_max{};
+	std::atomic<uint64_t> m_sum{};
+};
+
+/**
+ * Latency of each pipeline stage, per source.
+ *
+ * Frames are stamped when they cross a stage boundary. The latency of a
+ * stage is the time since the previous sequential boundary stamped the
+ * same (source, frame). Branch stages, like secondary GIEs running in
+ * parallel, are measured from the previous sequential boundary but do not
+ * restamp the frame.
+ * */
+class LatencyTracker
+{
+public:
+	struct Stage
+	{
+		LatencyTracker *tracker;
+		std::string name;
+		uint index;
+		/**
+		 * Stage timestamps frames but records nothing, used for the first boundary.
+		 * */
+		bool entry;
+		bool branch;
+		std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+		/**
+		 * Drained per source but not reported yet.
+		 * */
+		std::vector<LatencySnapshot> pending;
+		/**
+		 * All sources since the tracker was created.
+		 * */
+		LatencySnapshot totals;
+	};
+
+	explicit LatencyTracker(uint num_sources);
+
+	/**
+	 * Adds a stage boundary, stages are reported in the order they are added.
+	 *
+	 * @return stage to pass to @ref stamp, it stays valid as long as the tracker.
+	 * */
+	Stage *add_stage(const std::string &name, bool entry = false, bool branch = false);
+
+	/**
+	 * Records a frame crossing the stage boundary at @p now_ns (CLOCK_MONOTONIC).
+	 * */
+	void stamp(Stage *stage, uint source_id, uint64_t frame_num, uint64_t now_ns);
+
+	/**
+	 * Records an already measured latency, e.g. end-to-end latency reported by DeepStream.
+	 * */
+	void record(Stage *stage, uint source_id, uint64_t latency_us);
+
+	/**
+	 * Drains every histogram and formats p50/p90/p99/max per stage, and
+	 * per source when there is more than one.
+	 *
+	 * @return empty string if nothing was recorded since the last report.
+	 * */
+	std::string report();
+
+	/**
+	 * Drains every histogram, like @ref report does, and returns the latency
+	 * of each stage since the tracker was created, all sources merged.
+	 * Can be called from another thread than @ref report.
+	 * */
+	std::vector<std::pair<std::string, LatencySnapshot>> totals();
+
+	[[nodiscard]]
+	uint num_sources() const
+	{
+		return m_num_sources;
+	}
+
+	static uint64_t now_ns();
+
+private:
+	/**
+	 * Timestamps of the last sequential boundary, frames of a source are
+	 * spread over a ring indexed by frame number.
+	 * */
+	struct FrameSlot
+	{
+		std::atomic<uint64_t> frame_num{ UINT64_MAX };
+		std::atomic<uint64_t> stamp_ns{};
+	};
+
+	static constexpr uint FRAME_RING_SIZE{ 256 };
+
+	/**
+	 * Moves the counts of the histograms into the pending and total snapshots.
+	 * */
+	void drain_stages();
+
+	const uint m_num_sources;
+	std::vector<FrameSlot> m_slots;
+	std::deque<Stage> m_stages;
+	/**
+	 * Guards the snapshots, only taken by the reporters, never when recording.
+	 * */
+	std::mutex m_drain_lock;
+};
+
+/**
+ * Exports p50/p90/p99 of every stage as a summary, in seconds, since the
+ * tracker was created.
+ * */
+void add_latency_metrics(MetricsRegistry *registry, LatencyTracker *tracker);
+
+#endif // TADS_LATENCY_HPP
@@ -0,0 +1,114 @@
+#ifndef TADS_META_TRACE_HPP
+#define TADS_META_TRACE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <gstnvdsmeta.h>
+
+/**
+ * Binary trace of the batch metadata seen by the analytics, so that the
+ * analytics can be replayed without the inference pipeline.
+ *
+ * The file starts with a @ref MetaTraceFileHeader followed by one record
+ * per batch: a 32 bit payload size and the payload. The payload holds the
+ * frames of the batch, their objects with the classifier labels and the
+ * nvdsanalytics object user meta. Values are stored in host byte order.
+ * */
+struct MetaTraceFileHeader
+{
+	static constexpr char MAGIC[8]{ 'T', 'A', 'D', 'S', 'M', 'T', 'R', 'C' };
+	static constexpr uint32_t VERSION{ 1 };
+
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+};
+
+/**
+ * Appends the metadata of every batch to a trace file.
+ *
+ * Records are written with buffered stdio on the calling streaming thread,
+ * the capture is meant for recording benchmark traces, not for production.
+ * */
+class MetaTraceWriter
+{
+public:
+	MetaTraceWriter() = default;
+	~MetaTraceWriter();
+
+	MetaTraceWriter(const MetaTraceWriter &) = delete;
+	MetaTraceWriter &operator=(const MetaTraceWriter &) = delete;
+
+	bool open(const std::string &file_path);
+	void close();
+
+	/**
+	 * Serializes the frames and objects of @p batch_meta, @p buffer gives the timestamp.
+	 * */
+	bool write(GstBuffer *buffer, NvDsBatchMeta *batch_meta);
+
+	[[nodiscard]]
+	uint64_t batches() const
+	{
+		return m_batches;
+	}
+
+private:
+	FILE *m_file{};
+	std::vector<char> m_payload;
+	uint64_t m_batches{};
+};
+
+/**
+ * Reads a trace file written by @ref MetaTraceWriter and rebuilds the
+ * batch metadata with the DeepStream metadata pools.
+ * */
+class MetaTraceReader
+{
+public:
+	MetaTraceReader() = default;
+	~MetaTraceReader();
+
+	MetaTraceReader(const MetaTraceReader &) = delete;
+	MetaTraceReader &operator=(const MetaTraceReader &) = delete;
+
+	/**
+	 * Maps the trace and validates its header.
+	 * */
+	bool open(const std::string &file_path);
+	void close();
+
+	/**
+	 * Rebuilds the next batch.
+	 *
+	 * @param[out] pts timestamp of the captured buffer.
+	 * @param[out] num_objects number of objects in the batch.
+	 *
+	 * @return batch meta to release with nvds_destroy_batch_meta, or
+	 *         nullptr at the end of the trace or if the record is corrupt.
+	 * */
+	NvDsBatchMeta *next(uint64_t &pts, uint64_t &num_objects);
+
+	/**
+	 * Restarts from the first batch.
+	 * */
+	void rewind();
+
+	[[nodiscard]]
+	bool is_corrupt() const
+	{
+		return m_corrupt;
+	}
+
+private:
+	const char *m_data{};
+	size_t m_size{};
+	size_t m_offset{};
+	bool m_corrupt{};
+};
+
+#endif // TADS_META_TRACE_HPP
@@ -0,0 +1,136 @@
+#ifndef TADS_METRICS_HPP
+#define TADS_METRICS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * Builds a scrape in the Prometheus text exposition format, version 0.0.4.
+ * */
+class MetricsWriter
+{
+public:
+	/**
+	 * Starts a metric family, written once per scrape before its samples.
+	 *
+	 * @param type counter, gauge or summary.
+	 * */
+	void family(std::string_view name, std::string_view type, std::string_view help);
+
+	/**
+	 * @param labels comma separated label pairs without the braces, e.g. source="0".
+	 * */
+	void sample(std::string_view name, double value, std::string_view labels = {});
+
+	[[nodiscard]]
+	const std::string &text() const
+	{
+		return m_text;
+	}
+
+private:
+	std::string m_text;
+};
+
+using MetricsCollector = std::function<void(MetricsWriter &)>;
+
+/**
+ * @return key="value" with the value escaped for the text format.
+ * */
+std::string metrics_label(std::string_view key, std::string_view value);
+
+/**
+ * Counters updated on the hot paths and collectors run on each scrape.
+ *
+ * A counter is a plain atomic owned by the registry: the hot path holds a
+ * pointer to it and only does a relaxed increment. Collectors read state
+ * that already exists, like writer stats, and must only read atomics or
+ * take locks that the streaming threads never hold.
+ * */
+class MetricsRegistry
+{
+public:
+	/**
+	 * Registers a counter, or returns the one registered with the same name and labels.
+	 *
+	 * @return counter that stays valid as long as the registry.
+	 * */
+	std::atomic<uint64_t> *counter(const std::string &name, const std::string &help, const std::string &labels = {});
+
+	void add_collector(MetricsCollector collector);
+
+	/**
+	 * @return every counter and the output of every collector.
+	 * */
+	std::string scrape();
+
+private:
+	struct Counter
+	{
+		std::string name;
+		std::string help;
+		std::string labels;
+		std::atomic<uint64_t> value{};
+	};
+
+	/**
+	 * Guards registration and scrapes, never taken by the hot paths.
+	 * */
+	std::mutex m_lock;
+	std::deque<Counter> m_counters;
+	std::vector<MetricsCollector> m_collectors;
+};
+
+/**
+ * Serves the registry over HTTP/1.0 on a local TCP port or a Unix socket,
+ * one connection at a time on its own thread. Any GET of / or /metrics
+ * returns the scrape.
+ * */
+class MetricsServer
+{
+public:
+	/**
+	 * @param address host:port, :port for 127.0.0.1, or unix:/path/to/socket.
+	 * */
+	MetricsServer(std::string address, MetricsRegistry *registry);
+	~MetricsServer();
+
+	MetricsServer(const MetricsServer &) = delete;
+	MetricsServer &operator=(const MetricsServer &) = delete;
+
+	bool start();
+	void stop();
+
+	[[nodiscard]]
+	uint64_t scrapes() const
+	{
+		return m_scrapes.load(std::memory_order_relaxed);
+	}
+
+private:
+	bool open_socket();
+	void serve(int fd);
+	void run();
+
+private:
+	const std::string m_address;
+	MetricsRegistry *m_registry;
+	std::string m_unix_path;
+
+	int m_listen_fd{ -1 };
+	/**
+	 * Wakes the server thread on @ref stop.
+	 * */
+	int m_wake_fd{ -1 };
+	std::thread m_thread;
+	std::atomic<uint64_t> m_scrapes{};
+};
+
+#endif // TADS_METRICS_HPP
@@ -2,7 +2,10 @@
 #define TADS_PERF_HPP
 
 #include "common.hpp"
-#include <array>
+#include <atomic>
+#include <vector>
+
+class MetricsRegistry;
 
 struct FPSSensorInfo
 {
@@ -15,15 +18,19 @@ struct FPSSensorInfo
 struct AppSourceDetail
 {
 	uint source_id;
-	[[maybe_unused]] char *stream_name;
+	[[maybe_unused]] const char *stream_name;
+	double fps;
+	double fps_avg;
 };
 
 struct AppPerfStruct
 {
-	std::array<double, MAX_SOURCE_BINS> fps;
-	std::array<double, MAX_SOURCE_BINS> fps_avg;
 	uint num_instances;
-	AppSourceDetail source_detail[MAX_SOURCE_BINS];
+	/**
+	 * One entry per active source, sources that are not streaming
+	 * (e.g. not added yet to nvmultiurisrcbin) are not listed.
+	 * */
+	std::vector<AppSourceDetail> source_detail;
 	[[maybe_unused]] uint active_source_size;
 	[[maybe_unused]] bool stream_name_display;
 	[[maybe_unused]] bool use_nvmultiurisrcbin;
@@ -31,14 +38,45 @@ struct AppPerfStruct
 
 typedef void (*perf_callback)(void *ctx, AppPerfStruct *str);
 
-struct InstancePerfStruct
+/**
+ * Frame counters of one source, written by the streaming threads without a lock.
+ *
+ * The counters only grow, the reporter keeps its own snapshot of them and
+ * computes the fps from the difference, so it never has to reset them under
+ * the producers. Each source has its own cache line.
+ * */
+struct alignas(64) InstancePerfStruct
+{
+	/**
+	 * Frames counted since the start, the first frame of each run excluded.
+	 * */
+	std::atomic<uint64_t> frame_cnt{};
+	/**
+	 * CLOCK_MONOTONIC time of the first frame of the current run, 0 until then.
+	 * */
+	std::atomic<int64_t> start_ns{};
+	std::atomic<int64_t> last_ns{};
+	/**
+	 * The source was added to nvmultiurisrcbin and not removed since.
+	 * */
+	std::atomic<bool> active{};
+};
+
+/**
+ * State of one source only used by the reporter.
+ * */
+struct InstancePerfSnapshot
 {
-	uint buffer_cnt;
-	uint total_buffer_cnt;
-	struct timeval total_fps_time = {};
-	struct timeval start_fps_time = {};
-	struct timeval last_fps_time = {};
-	struct timeval last_sample_fps_time = {};
+	uint64_t frame_cnt;
+	/**
+	 * Time of the last frame at the previous report, 0 before the first report of a run.
+	 * */
+	int64_t last_ns;
+	uint64_t total_frame_cnt;
+	/**
+	 * Streaming time of the previous runs.
+	 * */
+	int64_t total_ns;
 };
 
 struct AppPerfStructInt
@@ -46,13 +84,20 @@ struct AppPerfStructInt
 	gulong measurement_interval_ms;
 	gulong perf_measurement_timeout_id;
 	uint num_instances;
-	bool stop;
+	std::atomic<bool> stop;
 	void *context;
+	/**
+	 * Protects @ref fps_info_hash and the snapshots, never taken by the streaming threads.
+	 * */
 	GMutex struct_lock;
 	perf_callback callback;
 	[[maybe_unused]] GstPad *sink_bin_pad;
 	[[maybe_unused]] gulong fps_measure_probe_id;
-	InstancePerfStruct instance_str[MAX_SOURCE_BINS];
+	/**
+	 * Indexed by source id, sized by @ref enable_perf_measurement.
+	 * */
+	std::vector<InstancePerfStruct> instance_str;
+	std::vector<InstancePerfSnapshot> instance_snapshot;
 	uint dewarper_surfaces_per_frame;
 	GHashTable *fps_info_hash;
 	bool stream_name_display;
@@ -62,6 +107,28 @@ struct AppPerfStructInt
 bool enable_perf_measurement(AppPerfStructInt *str, GstPad *sink_bin_pad, uint num_sources, gulong interval_sec,
 														 /*uint num_surfaces_per_frame,*/ perf_callback callback);
 
+/**
+ * @return CLOCK_MONOTONIC time in nanoseconds.
+ * */
+int64_t perf_now_ns();
+
+/**
+ * Counts a frame of a source, lock free. Sources may be counted from several threads.
+ * */
+void perf_count_frame(InstancePerfStruct &instance, int64_t now_ns);
+
+/**
+ * Computes the fps of every source since the previous call. Called by the
+ * perf timer, the streaming threads are never blocked.
+ * */
+void collect_perf_measurement(AppPerfStructInt *str, AppPerfStruct *perf_struct);
+
+/**
+ * Exports the frames counted per source and their rate since the previous
+ * scrape, read from the counters without a lock.
+ * */
+void add_perf_metrics(MetricsRegistry *registry, AppPerfStructInt *str);
+
 void pause_perf_measurement(AppPerfStructInt *perf_struct);
 void resume_perf_measurement(AppPerfStructInt *perf_struct);
 
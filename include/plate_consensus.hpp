@@ -0,0 +1,130 @@
+#ifndef TADS_PLATE_CONSENSUS_HPP
+#define TADS_PLATE_CONSENSUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Plate read by the LPR on one frame, in the Latin alphabet of the LPR
+ * model. It is localized only when the record of the track is written.
+ * */
+struct PlateRead
+{
+	/**
+	 * Longer reads are not plates, e.g. two plates read as one.
+	 * */
+	static constexpr size_t MAX_LENGTH{ 10 };
+
+	char text[MAX_LENGTH + 1];
+	uint8_t length;
+	float confidence;
+
+	[[nodiscard]]
+	std::string_view view() const
+	{
+		return { text, length };
+	}
+
+	/**
+	 * Copies @p plate upper cased.
+	 *
+	 * @return false if @p plate is empty or longer than @ref MAX_LENGTH.
+	 * */
+	bool assign(std::string_view plate, float conf);
+};
+
+/**
+ * Per-track state of @ref PlateConsensus, of a fixed size so that it lives
+ * in the track data without allocating.
+ *
+ * Reads are grouped by length, each position of a length keeps the weights
+ * of its few most voted characters.
+ * */
+struct PlateConsensusState
+{
+	static constexpr size_t MAX_LENGTHS{ 2 };
+	static constexpr size_t MAX_SYMBOLS{ 3 };
+
+	struct Position
+	{
+		char symbols[MAX_SYMBOLS];
+		float weights[MAX_SYMBOLS];
+	};
+
+	struct LengthVotes
+	{
+		uint8_t length;
+		uint16_t reads;
+		/**
+		 * Sum of the confidences of the reads of this length.
+		 * */
+		float weight;
+		Position positions[PlateRead::MAX_LENGTH];
+	};
+
+	LengthVotes lengths[MAX_LENGTHS];
+	/**
+	 * Sum of the confidences of all the reads, also of the lengths that were not kept.
+	 * */
+	float total_weight;
+	uint16_t reads;
+	/**
+	 * Consensus after the last read, see @ref PlateConsensus::add.
+	 * */
+	char text[PlateRead::MAX_LENGTH + 1];
+	uint8_t length;
+	float score;
+	bool settled;
+
+	[[nodiscard]]
+	std::string_view view() const
+	{
+		return { text, length };
+	}
+
+	void reset();
+};
+
+/**
+ * Votes the plate of a track out of its noisy reads, character by character.
+ *
+ * Every read votes with its confidence for its length and, within that
+ * length, for its character at every position. Only the two most voted
+ * lengths are kept, a read of another length replaces the weaker one when
+ * it outweighs it. Positions keep their three most voted characters with
+ * the weighted Misra-Gries summary, so a character voted by more than a
+ * quarter of the weight of its length is never lost. A read costs
+ * O(length), whatever the number of reads of the track.
+ *
+ * The score of the consensus is the share of the weight of its length
+ * times the smallest share of the winning character among its positions.
+ * The consensus is settled once its length has enough reads and its score
+ * reaches the threshold; a run of disagreeing reads unsettles it again.
+ *
+ * It does not depend on DeepStream, so it can be driven by recorded reads.
+ * */
+class PlateConsensus
+{
+public:
+	/**
+	 * @param settle_reads reads of the consensus length before it can settle.
+	 * @param settle_score score in [0, 1] from which the consensus is settled.
+	 * */
+	explicit PlateConsensus(uint32_t settle_reads = 4, float settle_score = 0.75f);
+
+	/**
+	 * Votes @p read and updates the consensus of @p state.
+	 *
+	 * @return false if the read was ignored, it has no confidence or is not a plate.
+	 * */
+	bool add(PlateConsensusState &state, const PlateRead &read) const;
+
+private:
+	void update_consensus(PlateConsensusState &state) const;
+
+	uint32_t m_settle_reads;
+	float m_settle_score;
+};
+
+#endif // TADS_PLATE_CONSENSUS_HPP
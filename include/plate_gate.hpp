@@ -0,0 +1,151 @@
+#ifndef TADS_PLATE_GATE_HPP
+#define TADS_PLATE_GATE_HPP
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gstnvdsmeta.h>
+
+#include "track_table.hpp"
+
+struct AnalyticsBin;
+struct AnalyticsConfig;
+
+/**
+ * Reads of a track by the secondary GIEs as scheduled by @ref PlateGate.
+ * */
+struct PlateGateTrack
+{
+	/**
+	 * Batch the track was first seen on.
+	 * */
+	uint64_t first_frame;
+	/**
+	 * Last batch the secondary GIEs ran on the track.
+	 * */
+	uint64_t read_frame;
+
+	void reset(uint64_t frame);
+};
+
+enum class PlateGateDecision
+{
+	PROCESS,
+	/**
+	 * The plate is settled and was read less than a re-read interval ago.
+	 * */
+	SKIP_SETTLED,
+	/**
+	 * The track is older than the age cap, its plate is not read anymore.
+	 * */
+	SKIP_AGE,
+};
+
+struct PlateGateStats
+{
+	uint64_t processed;
+	uint64_t skipped_settled;
+	uint64_t skipped_age;
+	size_t tracks;
+};
+
+/**
+ * Keeps the vehicles whose plate is settled away from the secondary GIEs.
+ *
+ * In front of the secondary GIEs, @ref gate decides for every tracked
+ * object of the primary GIE whether its plate still has to be read. The
+ * unique component id of a skipped object is set to @ref GATED_COMPONENT_ID
+ * so that no secondary GIE operating on the primary GIE infers on it, the
+ * secondary GIEs run in parallel on the same metadata so this is done once
+ * before they split. Once they joined, @ref observe restores the id.
+ *
+ * The gate keeps no plate of its own: it reads the consensus the analytics
+ * votes into the track, see @ref PlateConsensus, under the track lock of
+ * the analytics once per batch. The plates read on this batch reach it a
+ * few batches later, once the analytics processed them.
+ *
+ * A settled plate is read again every re-read interval, a disagreeing read
+ * unsettles it. Tracks older than the age cap are not read anymore.
+ *
+ * @ref gate and @ref observe run on different streaming threads, only
+ * @ref gate touches the tracks. The statistics are atomics.
+ * */
+class PlateGate
+{
+public:
+	/**
+	 * No GIE has a negative unique id.
+	 * */
+	static constexpr int GATED_COMPONENT_ID{ -2 };
+
+	/**
+	 * @param analytics owner of the plate consensus of the tracks.
+	 * @param vehicle_gie_id unique id of the primary GIE.
+	 * @param min_score score of a settled plate from which the vehicle is gated.
+	 * @param reread_interval batches between two reads of a settled plate, 0 to never read it again.
+	 * @param max_track_age batches after which a track is not read anymore, 0 for no cap.
+	 * @param track_ttl batches after which a track no longer seen is dropped.
+	 * */
+	PlateGate(AnalyticsBin *analytics, int vehicle_gie_id, float min_score, uint reread_interval, uint max_track_age,
+						uint track_ttl);
+
+	/**
+	 * Marks the objects of @p batch_meta that skip the secondary GIEs.
+	 * */
+	void gate(NvDsBatchMeta *batch_meta);
+
+	/**
+	 * Restores the marked objects of @p batch_meta.
+	 * */
+	void observe(NvDsBatchMeta *batch_meta);
+
+	[[nodiscard]]
+	PlateGateStats stats() const;
+
+	/**
+	 * @return objects per second sent to and kept from the secondary GIEs since the last call.
+	 * */
+	std::string report();
+
+private:
+	PlateGateDecision decide(uint source_id, uint64_t track_id);
+
+	TrackTable<PlateGateTrack> m_tracks;
+	AnalyticsBin *const m_analytics;
+	const int m_vehicle_gie_id;
+	const float m_min_score;
+	const uint m_reread_interval;
+	const uint m_max_track_age;
+	const uint m_track_ttl;
+
+	std::atomic<uint64_t> m_processed{};
+	std::atomic<uint64_t> m_skipped_settled{};
+	std::atomic<uint64_t> m_skipped_age{};
+	/**
+	 * Size of @ref m_tracks, stored by @ref gate.
+	 * */
+	std::atomic<size_t> m_track_count{};
+	/**
+	 * Totals and monotonic time of the previous report.
+	 * */
+	PlateGateStats m_reported{};
+	int64_t m_report_time_us;
+};
+
+/**
+ * @return gate configured by the lp-gate-* keys of @p config, nullptr if
+ *         it is disabled or if the analytics that vote the plates are.
+ * */
+std::unique_ptr<PlateGate> create_plate_gate(const AnalyticsConfig *config, AnalyticsBin *analytics,
+																						 int vehicle_gie_id);
+
+/**
+ * What the secondary GIEs leave of @p batch_meta behind the gate when it
+ * is replayed offline: the plates detected in the gated vehicles are
+ * removed, as if the LPD had not run on them.
+ * */
+void drop_gated_plates(NvDsBatchMeta *batch_meta, std::vector<NvDsObjectMeta *> &dropped);
+
+#endif // TADS_PLATE_GATE_HPP
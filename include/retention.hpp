@@ -0,0 +1,165 @@
+#ifndef TADS_RETENTION_HPP
+#define TADS_RETENTION_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * Kinds of files in the analytics day folders, each with its own quota.
+ * */
+enum class RetentionKind : uint
+{
+	/**
+	 * Event segments and per-vehicle text files.
+	 * */
+	EVENTS = 0,
+	/**
+	 * Crop images and crop archives.
+	 * */
+	CROPS = 1,
+};
+
+constexpr size_t RETENTION_KIND_COUNT{ 2 };
+
+/**
+ * Zero disables a limit.
+ * */
+struct RetentionQuota
+{
+	uint64_t max_bytes{};
+	/**
+	 * Day folders kept, today included.
+	 * */
+	uint max_days{};
+};
+
+/**
+ * Plain copy of the retention counters, safe to read from any thread.
+ * */
+struct RetentionStats
+{
+	uint64_t passes;
+	uint64_t scanned_entries;
+	uint64_t deleted_files;
+	uint64_t freed_bytes;
+	/**
+	 * Duration of the last pass.
+	 * */
+	uint64_t pass_time_us;
+	std::array<uint64_t, RETENTION_KIND_COUNT> usage_bytes;
+};
+
+/**
+ * Keeps the analytics output folder within its quotas.
+ *
+ * The usage of every day folder is cached. A pass only lists the output
+ * folder itself and scans at most @p scan_budget entries of the day folders
+ * not seen yet, resuming where the previous pass stopped; today's folder is
+ * rescanned once all the others are known. Past the quotas the oldest
+ * files are deleted first, listing only the day folders they are taken from.
+ * The thread runs with idle I/O priority.
+ * */
+class RetentionManager
+{
+public:
+	RetentionManager(std::string root_path, const std::array<RetentionQuota, RETENTION_KIND_COUNT> &quotas,
+									 uint interval_s, size_t scan_budget);
+	~RetentionManager();
+
+	RetentionManager(const RetentionManager &) = delete;
+	RetentionManager &operator=(const RetentionManager &) = delete;
+
+	bool start();
+	void stop();
+
+	/**
+	 * Runs one pass as of @p now_us, wall clock microseconds since the epoch.
+	 *
+	 * @return true once every day folder was scanned at least once.
+	 * */
+	bool run_pass(int64_t now_us);
+
+	[[nodiscard]]
+	RetentionStats stats() const;
+
+	/**
+	 * Returns and resets the space freed since the previous call.
+	 * */
+	uint64_t drain_freed(uint64_t &deleted_files);
+
+	/**
+	 * @return false for files the manager never deletes.
+	 * */
+	static bool classify(std::string_view name, RetentionKind &kind);
+
+private:
+	struct DayUsage
+	{
+		std::filesystem::path path;
+		std::array<uint64_t, RETENTION_KIND_COUNT> bytes{};
+		/**
+		 * The usage was scanned at least once.
+		 * */
+		bool known{};
+		/**
+		 * Waiting for a (re)scan.
+		 * */
+		bool pending{ true };
+	};
+
+	void refresh_days();
+	void scan(size_t budget);
+	void enforce(int64_t today, int64_t now_us);
+	/**
+	 * Deletes files of @p kind in @p day, oldest first, until @p bytes are freed.
+	 *
+	 * @return true if a file was deleted.
+	 * */
+	bool purge(DayUsage &day, RetentionKind kind, uint64_t bytes, int64_t now_us);
+	void run();
+
+private:
+	const std::filesystem::path m_root_path;
+	const std::array<RetentionQuota, RETENTION_KIND_COUNT> m_quotas;
+	const uint m_interval_s;
+	const size_t m_scan_budget;
+
+	/**
+	 * Keyed by date as yyyymmdd, only used by the pass.
+	 * */
+	std::map<int64_t, DayUsage> m_days;
+	int64_t m_scan_day{ -1 };
+	std::array<uint64_t, RETENTION_KIND_COUNT> m_scan_bytes{};
+	std::filesystem::directory_iterator m_scan_itr;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_running{};
+
+	std::atomic<uint64_t> m_passes{};
+	std::atomic<uint64_t> m_scanned_entries{};
+	std::atomic<uint64_t> m_deleted_files{};
+	std::atomic<uint64_t> m_freed_bytes{};
+	std::atomic<uint64_t> m_pass_time_us{};
+	std::atomic<uint64_t> m_drain_bytes{};
+	std::atomic<uint64_t> m_drain_files{};
+	std::array<std::atomic<uint64_t>, RETENTION_KIND_COUNT> m_usage_bytes{};
+};
+
+/**
+ * Formats the space freed since the previous report and the current usage.
+ *
+ * @return empty string if nothing was freed.
+ * */
+std::string retention_report(RetentionManager *manager);
+
+#endif // TADS_RETENTION_HPP
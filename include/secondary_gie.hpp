@@ -1,7 +1,12 @@
 #ifndef TADS_SECONDARY_GIE_HPP
 #define TADS_SECONDARY_GIE_HPP
 
+#include <memory>
+#include <unordered_map>
+
 #include "gie.hpp"
+#include "latency.hpp"
+#include "plate_gate.hpp"
 
 struct SecondaryGieBinSubBin : BaseBin
 {
@@ -15,6 +20,27 @@ struct SecondaryGieBinSubBin : BaseBin
 	int parent_index;
 };
 
+/**
+ * Time the joining queue waits for the secondary branches, recorded per batch.
+ * */
+struct SecondaryGieJoinStats
+{
+	LatencyHistogram wait;
+	std::atomic<uint64_t> joins{};
+	/**
+	 * Joins that gave up waiting for a branch to count down.
+	 * */
+	std::atomic<uint64_t> timeouts{};
+	/**
+	 * Joins that had to poll the buffer refcount after every branch counted down.
+	 * */
+	std::atomic<uint64_t> polls{};
+	/**
+	 * Buffers without a batch meta to carry the join sequence, joined by polling their refcount only.
+	 * */
+	std::atomic<uint64_t> fallbacks{};
+};
+
 struct SecondaryGieBin : BaseBin
 {
 	GstElement *bin;
@@ -24,6 +50,25 @@ struct SecondaryGieBin : BaseBin
 	bool stop;
 	bool flush;
 	std::vector<SecondaryGieBinSubBin> sub_bins{ MAX_SECONDARY_GIE_BINS };
+	/**
+	 * Number of leaf branches (secondary GIEs ending in a sink) each buffer goes through.
+	 * */
+	uint num_branches;
+	/**
+	 * Leaf branches that did not release a buffer yet, keyed by the join
+	 * sequence the buffer carries in its batch user meta, which a branch
+	 * copying the buffer copies with it. Protected by @ref wait_lock.
+	 * */
+	std::unordered_map<uint64_t, uint> pending_branches;
+	/**
+	 * Last join sequence given to a buffer. Protected by @ref wait_lock.
+	 * */
+	uint64_t join_sequence;
+	std::unique_ptr<SecondaryGieJoinStats> join_stats;
+	/**
+	 * Keeps the vehicles with a settled plate away from the branches, see @ref create_plate_gate.
+	 * */
+	std::unique_ptr<PlateGate> plate_gate;
 	GMutex wait_lock;
 	GCond wait_cond;
 };
@@ -44,6 +89,21 @@ struct SecondaryGieBin : BaseBin
 bool create_secondary_gie(uint num_secondary_gie, uint primary_gie_unique_id, const std::vector<GieConfig> &configs,
 													SecondaryGieBin *bin);
 
+/**
+ * Installs the probes that hold every buffer in the queue of @p bin until
+ * the leaf branches of its tee released it. The tee, the queue and the
+ * sinks of the created sub bins must exist, @ref create_secondary_gie calls
+ * it once the branches are linked.
+ */
+void attach_secondary_gie_join(SecondaryGieBin *bin);
+
+/**
+ * Drains the join statistics recorded since the last call.
+ *
+ * @return empty string if no buffer was joined.
+ */
+std::string secondary_gie_join_report(SecondaryGieBin *bin);
+
 /**
  * Release the resources.
  */
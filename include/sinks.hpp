@@ -264,7 +264,7 @@ struct SinkBin : BaseBin
 	GstElement *tee;
 
 	size_t num_bins;
-	std::vector<SinkSubBin> sub_bins{ MAX_SINK_BINS };
+	std::vector<SinkSubBin> sub_bins;
 };
 
 /**
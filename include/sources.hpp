@@ -1,6 +1,7 @@
 #ifndef TADS_SOURCES_HPP
 #define TADS_SOURCES_HPP
 
+#include <atomic>
 #include <sys/time.h>
 
 #include <gst-nvdssr.h>
@@ -114,6 +115,10 @@ struct SourceBin
 	SourceConfig *config;
 	SourceParentBin *parent_bin;
 	NvDsSRContext *record_ctx;
+	/**
+	 * Counts the resets of the source pipeline, owned by the metrics registry.
+	 * */
+	std::atomic<uint64_t> *reconnect_counter{};
 };
 
 struct SourceParentBin
@@ -122,7 +127,7 @@ struct SourceParentBin
 	GstElement *streammux;
 	GstElement *nvmultiurisrcbin;
 	[[maybe_unused]] GThread *reset_thread{};
-	std::vector<SourceBin> sub_bins{ MAX_SOURCE_BINS };
+	std::vector<SourceBin> sub_bins;
 	uint num_bins;
 	[[maybe_unused]] uint num_fr_on;
 	[[maybe_unused]] bool live_source;
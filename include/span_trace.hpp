@@ -0,0 +1,141 @@
+#ifndef TADS_SPAN_TRACE_HPP
+#define TADS_SPAN_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A finished span. The name must outlive the tracer, spans are only
+ * given string literals.
+ * */
+struct TraceSpan
+{
+	const char *name;
+	int64_t begin_ns;
+	int64_t duration_ns;
+};
+
+/**
+ * Spans of one thread, the last @p capacity ones are kept.
+ *
+ * Only the owning thread pushes. Collecting from another thread copies
+ * the slots and then discards the ones the owner may have overwritten
+ * meanwhile, so it never blocks the owner.
+ * */
+class TraceRing
+{
+public:
+	/**
+	 * @param capacity rounded up to a power of two.
+	 * */
+	TraceRing(size_t capacity, uint32_t thread_id, std::string thread_name);
+
+	void push(const char *name, int64_t begin_ns, int64_t end_ns)
+	{
+		const uint64_t head{ m_head.load(std::memory_order_relaxed) };
+		m_spans[head & m_mask] = { name, begin_ns, end_ns - begin_ns };
+		m_head.store(head + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Appends the spans pushed since the previous call to @p spans.
+	 *
+	 * @return spans overwritten before they could be collected.
+	 * */
+	uint64_t collect(std::vector<TraceSpan> &spans);
+
+	[[nodiscard]]
+	uint32_t thread_id() const
+	{
+		return m_thread_id;
+	}
+
+	[[nodiscard]]
+	const std::string &thread_name() const
+	{
+		return m_thread_name;
+	}
+
+private:
+	const uint64_t m_mask;
+	const uint32_t m_thread_id;
+	const std::string m_thread_name;
+	std::unique_ptr<TraceSpan[]> m_spans;
+	std::atomic<uint64_t> m_head{};
+	/**
+	 * Only used by @ref collect.
+	 * */
+	uint64_t m_tail{};
+};
+
+/**
+ * Tracing is off unless @ref span_trace_start was called, checked with a
+ * single predictable branch at every span.
+ * */
+extern std::atomic<bool> g_span_trace_enabled;
+
+/**
+ * Starts recording spans into per-thread rings of @p spans_per_thread.
+ * */
+void span_trace_start(size_t spans_per_thread);
+
+/**
+ * Stops recording, the rings are kept until @ref span_trace_write.
+ * */
+void span_trace_stop();
+
+/**
+ * Writes the spans recorded since the start, or since the previous write,
+ * as a Chrome trace-event JSON file loadable in chrome://tracing and
+ * ui.perfetto.dev.
+ * */
+bool span_trace_write(const std::string &path);
+
+/**
+ * Formats the spans of each thread as Chrome trace events, timestamps are
+ * relative to @p origin_ns.
+ * */
+std::string span_trace_json(const std::vector<std::pair<const TraceRing *, std::vector<TraceSpan>>> &threads,
+														int64_t origin_ns);
+
+/**
+ * Records a span of the calling thread ending now.
+ * */
+void span_trace_record(const char *name, int64_t begin_ns);
+
+int64_t span_trace_now_ns();
+
+/**
+ * Records the span of the enclosing scope.
+ * */
+class TraceSpanScope
+{
+public:
+	explicit TraceSpanScope(const char *name):
+		m_name{ name }
+	{
+		if(__builtin_expect(g_span_trace_enabled.load(std::memory_order_relaxed), 0))
+			m_begin_ns = span_trace_now_ns();
+	}
+
+	~TraceSpanScope()
+	{
+		if(__builtin_expect(m_begin_ns != 0, 0))
+			span_trace_record(m_name, m_begin_ns);
+	}
+
+	TraceSpanScope(const TraceSpanScope &) = delete;
+	TraceSpanScope &operator=(const TraceSpanScope &) = delete;
+
+private:
+	const char *m_name;
+	int64_t m_begin_ns{};
+};
+
+#define TADS_TRACE_SPAN(name) TraceSpanScope tads_trace_span{ name }
+
+#endif // TADS_SPAN_TRACE_HPP
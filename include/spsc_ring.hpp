@@ -0,0 +1,128 @@
+#ifndef TADS_SPSC_RING_HPP
+#define TADS_SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Bounded ring of preallocated slots between one producer and one consumer
+ * thread, without locks.
+ *
+ * The producer fills the slot returned by @ref producer_slot in place and
+ * hands it over with @ref publish; the consumer reads the slot returned by
+ * @ref consumer_slot and gives it back with @ref release. Slots are never
+ * destroyed, so buffers kept inside them are reused without allocating.
+ *
+ * Each side caches the last seen index of the other one, so the shared
+ * cache lines are only read when the ring looks full or empty.
+ * */
+template<typename T>
+class SpscRing
+{
+public:
+	/**
+	 * @param capacity rounded up to a power of two.
+	 * */
+	explicit SpscRing(size_t capacity)
+	{
+		size_t size{ 1 };
+		while(size < capacity)
+			size <<= 1;
+		m_slots.resize(size);
+		m_mask = size - 1;
+	}
+
+	/**
+	 * Producer only.
+	 *
+	 * @return slot to fill, nullptr if the ring is full.
+	 * */
+	T *producer_slot()
+	{
+		const uint64_t head{ m_head.load(std::memory_order_relaxed) };
+		if(head - m_tail_cache > m_mask)
+		{
+			m_tail_cache = m_tail.load(std::memory_order_acquire);
+			if(head - m_tail_cache > m_mask)
+				return nullptr;
+		}
+		return &m_slots[head & m_mask];
+	}
+
+	/**
+	 * Producer only, hands the slot returned by @ref producer_slot to the consumer.
+	 * */
+	void publish()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Consumer only.
+	 *
+	 * @return oldest published slot, nullptr if the ring is empty.
+	 * */
+	T *consumer_slot()
+	{
+		const uint64_t tail{ m_tail.load(std::memory_order_relaxed) };
+		if(tail == m_head_cache)
+		{
+			m_head_cache = m_head.load(std::memory_order_acquire);
+			if(tail == m_head_cache)
+				return nullptr;
+		}
+		return &m_slots[tail & m_mask];
+	}
+
+	/**
+	 * Consumer only, gives the slot returned by @ref consumer_slot back to the producer.
+	 * */
+	void release()
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Any thread, published slots not released yet.
+	 * */
+	[[nodiscard]]
+	size_t size() const
+	{
+		const uint64_t tail{ m_tail.load(std::memory_order_relaxed) };
+		return static_cast<size_t>(m_head.load(std::memory_order_relaxed) - tail);
+	}
+
+	[[nodiscard]]
+	size_t capacity() const
+	{
+		return m_slots.size();
+	}
+
+	/**
+	 * Not thread safe, to preallocate the slots before the threads start.
+	 * */
+	std::vector<T> &slots()
+	{
+		return m_slots;
+	}
+
+private:
+	std::vector<T> m_slots;
+	uint64_t m_mask{};
+
+	alignas(64) std::atomic<uint64_t> m_head{};
+	/**
+	 * Producer only.
+	 * */
+	uint64_t m_tail_cache{};
+
+	alignas(64) std::atomic<uint64_t> m_tail{};
+	/**
+	 * Consumer only.
+	 * */
+	uint64_t m_head_cache{};
+};
+
+#endif // TADS_SPSC_RING_HPP
@@ -0,0 +1,241 @@
+#ifndef TADS_TRACK_TABLE_HPP
+#define TADS_TRACK_TABLE_HPP
+
+#include <cassert>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+/**
+ * Open-addressing hash table of pooled per-track values keyed by
+ * (source id, tracking id).
+ *
+ * Values live in a pool that is never shrunk, so a slot freed by
+ * eviction is reused by the next new track without touching the heap.
+ * Lookups use linear probing and erase uses backward-shift deletion,
+ * so there are no tombstones and probe chains stay short.
+ *
+ * Every lookup stamps the entry with the current frame counter;
+ * @ref evict drops entries that were not seen for more than the
+ * given number of frames.
+ * */
+template<typename T>
+class TrackTable
+{
+public:
+	explicit TrackTable(size_t initial_capacity = 256)
+	{
+		size_t capacity{ 16 };
+		while(capacity < initial_capacity * 2)
+			capacity <<= 1;
+		m_slots.resize(capacity);
+		m_pool.reserve(initial_capacity);
+	}
+
+	/**
+	 * Finds the value of the track or takes one from the pool.
+	 *
+	 * @param[out] created set to true if the value was just taken from the
+	 *             pool and has to be reset by the caller.
+	 * */
+	T &acquire(uint source_id, uint64_t track_id, bool &created)
+	{
+		if((m_size + 1) * 4 > m_slots.size() * 3)
+			rehash(m_slots.size() * 2);
+
+		size_t pos{ find_slot(source_id, track_id) };
+		Slot &slot{ m_slots[pos] };
+		created = !slot.used;
+
+		if(created)
+		{
+			slot.used = true;
+			slot.source_id = source_id;
+			slot.track_id = track_id;
+			slot.value_index = take_value();
+			m_size++;
+		}
+		slot.last_seen = m_frame;
+		return m_pool[slot.value_index];
+	}
+
+	[[nodiscard]]
+	T *find(uint source_id, uint64_t track_id)
+	{
+		Slot &slot{ m_slots[find_slot(source_id, track_id)] };
+		return slot.used ? &m_pool[slot.value_index] : nullptr;
+	}
+
+	bool erase(uint source_id, uint64_t track_id)
+	{
+		size_t pos{ find_slot(source_id, track_id) };
+		if(!m_slots[pos].used)
+			return false;
+		erase_at(pos);
+		return true;
+	}
+
+	/**
+	 * Advances the frame counter used to age the entries.
+	 * */
+	void advance(uint64_t frames = 1)
+	{
+		m_frame += frames;
+	}
+
+	/**
+	 * Releases every entry not seen for more than @p max_age frames.
+	 *
+	 * @return number of evicted entries.
+	 * */
+	size_t evict(uint64_t max_age)
+	{
+		size_t evicted{};
+		size_t pos{};
+
+		while(pos < m_slots.size())
+		{
+			Slot &slot{ m_slots[pos] };
+			if(slot.used && m_frame - slot.last_seen > max_age)
+			{
+				// Backward shift may move a not yet visited entry into pos, so check it again
+				erase_at(pos);
+				evicted++;
+				continue;
+			}
+			pos++;
+		}
+		return evicted;
+	}
+
+	void clear()
+	{
+		for(Slot &slot : m_slots)
+			slot.used = false;
+		m_free.clear();
+		assert(m_pool.size() <= UINT32_MAX);
+		for(uint32_t i = static_cast<uint32_t>(m_pool.size()); i > 0; --i)
+			m_free.push_back(i - 1);
+		m_size = 0;
+	}
+
+	[[nodiscard]]
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	[[nodiscard]]
+	size_t capacity() const
+	{
+		return m_slots.size();
+	}
+
+	[[nodiscard]]
+	size_t pool_size() const
+	{
+		return m_pool.size();
+	}
+
+	[[nodiscard]]
+	uint64_t frame() const
+	{
+		return m_frame;
+	}
+
+private:
+	struct Slot
+	{
+		uint64_t track_id{};
+		uint64_t last_seen{};
+		uint source_id{};
+		uint32_t value_index{};
+		bool used{};
+	};
+
+	static uint64_t hash(uint source_id, uint64_t track_id)
+	{
+		// splitmix64 finalizer, tracker ids are sequential so they need to be spread out
+		uint64_t x{ track_id ^ (static_cast<uint64_t>(source_id) << 48) };
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ULL;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebULL;
+		x ^= x >> 31;
+		return x;
+	}
+
+	[[nodiscard]]
+	size_t find_slot(uint source_id, uint64_t track_id) const
+	{
+		const size_t mask{ m_slots.size() - 1 };
+		size_t pos{ hash(source_id, track_id) & mask };
+
+		while(m_slots[pos].used)
+		{
+			const Slot &slot{ m_slots[pos] };
+			if(slot.track_id == track_id && slot.source_id == source_id)
+				break;
+			pos = (pos + 1) & mask;
+		}
+		return pos;
+	}
+
+	uint32_t take_value()
+	{
+		if(!m_free.empty())
+		{
+			uint32_t index{ m_free.back() };
+			m_free.pop_back();
+			return index;
+		}
+		// Values are indexed by 32 bits, far more than the tracks alive at once
+		assert(m_pool.size() < UINT32_MAX);
+		m_pool.emplace_back();
+		return static_cast<uint32_t>(m_pool.size() - 1);
+	}
+
+	void erase_at(size_t pos)
+	{
+		const size_t mask{ m_slots.size() - 1 };
+
+		m_free.push_back(m_slots[pos].value_index);
+		m_slots[pos].used = false;
+		m_size--;
+
+		size_t next{ (pos + 1) & mask };
+		while(m_slots[next].used)
+		{
+			size_t ideal{ hash(m_slots[next].source_id, m_slots[next].track_id) & mask };
+			// Move the entry back if its ideal position is not within (pos, next]
+			if(((next - ideal) & mask) >= ((next - pos) & mask))
+			{
+				m_slots[pos] = m_slots[next];
+				m_slots[next].used = false;
+				pos = next;
+			}
+			next = (next + 1) & mask;
+		}
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Slot> slots(capacity);
+		slots.swap(m_slots);
+
+		for(const Slot &slot : slots)
+		{
+			if(slot.used)
+				m_slots[find_slot(slot.source_id, slot.track_id)] = slot;
+		}
+	}
+
+private:
+	std::vector<Slot> m_slots;
+	std::vector<T> m_pool;
+	std::vector<uint32_t> m_free;
+	size_t m_size{};
+	uint64_t m_frame{};
+};
+
+#endif // TADS_TRACK_TABLE_HPP
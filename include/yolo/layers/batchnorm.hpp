@@ -6,6 +6,8 @@
 
 #include <NvInfer.h>
 
+#include "weights.hpp"
+
 #include "activation.hpp"
 
 /**
@@ -20,7 +22,7 @@
  * \param network[in] - network
  * */
 bool batchnormLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-										std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
+										const DarknetWeights &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
 										nvinfer1::ITensor *input, nvinfer1::INetworkDefinition *network);
 
 #endif
\ No newline at end of file
@@ -6,10 +6,12 @@
 
 #include <NvInfer.h>
 
+#include "weights.hpp"
+
 #include "layers/activation.hpp"
 
 bool convolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-												std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
+												const DarknetWeights &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
 												int &input_channels, nvinfer1::ITensor *input, nvinfer1::INetworkDefinition *network,
 												const std::string& name = "");
 
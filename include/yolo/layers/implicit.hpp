@@ -7,8 +7,9 @@
 
 #include <NvInfer.h>
 
+#include "weights.hpp"
+
 bool implicitLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-									 std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
-									 nvinfer1::INetworkDefinition *network);
+									 const DarknetWeights &weights, int &weight_ptr, nvinfer1::INetworkDefinition *network);
 
 #endif // TADS_IMPLICIT_HPP
@@ -5,6 +5,8 @@
 #include <vector>
 #include <NvInfer.h>
 
+#include "weights.hpp"
+
 #ifndef TADS_ERR_MSG_V
 #define TADS_ERR_MSG_V(msg, ...) printf("** ERROR: <%s:%d>: " msg "\n", __func__, __LINE__, ##__VA_ARGS__)
 #endif
@@ -32,7 +34,7 @@
 	}
 #endif
 
-std::vector<float> load_weights(std::string_view weights_file_path, const std::string &modelName);
+bool load_weights(std::string_view weights_file_path, const std::string &modelName, DarknetWeights &weights);
 
 std::string dims_to_string(const nvinfer1::Dims &d);
 
@@ -0,0 +1,94 @@
+#ifndef TADS_WEIGHTS_HPP
+#define TADS_WEIGHTS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * Weights of a Darknet .weights file.
+ *
+ * Regular files are mapped read-only and the layer builders hand pointers
+ * into the mapping to TensorRT, so the object must stay open until the
+ * engine is built. Pipes and other files that can not be mapped are
+ * streamed into a heap buffer instead.
+ * */
+class DarknetWeights
+{
+public:
+	DarknetWeights() = default;
+	~DarknetWeights();
+
+	DarknetWeights(DarknetWeights &&other) noexcept;
+	DarknetWeights &operator=(DarknetWeights &&other) noexcept;
+
+	DarknetWeights(const DarknetWeights &) = delete;
+	DarknetWeights &operator=(const DarknetWeights &) = delete;
+
+	/**
+	 * Opens the file and validates the header.
+	 *
+	 * @return false if the file can not be read or is not a Darknet weights file.
+	 * */
+	bool open(std::string_view file_path);
+
+	void close();
+
+	/**
+	 * Advances @p weight_ptr past the next @p count weights.
+	 *
+	 * @return the weights, valid until close(), or nullptr if the file has less than @p count weights left.
+	 * */
+	const float *take(int &weight_ptr, int count) const;
+
+	[[nodiscard]]
+	const float *data() const
+	{
+		return m_data;
+	}
+
+	[[nodiscard]]
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	[[nodiscard]]
+	bool is_mapped() const
+	{
+		return m_mapping != nullptr;
+	}
+
+	int32_t major{};
+	int32_t minor{};
+	int32_t revision{};
+	uint64_t seen{};
+
+private:
+	bool map_file(void *mapping, size_t file_size);
+	bool stream_file(int fd);
+
+	/**
+	 * Parses the header of the file in @p data and points the weights past it.
+	 *
+	 * @return false if the header is invalid or the rest is not a whole number of weights.
+	 * */
+	bool parse(const char *data, size_t size);
+
+	/**
+	 * Parses the version and the images seen counter, whose size depends on the version.
+	 *
+	 * @return header size in bytes or 0 if the header is invalid.
+	 * */
+	size_t parse_header(const char *data, size_t size);
+
+private:
+	void *m_mapping{};
+	size_t m_mapping_size{};
+	std::vector<float> m_buffer;
+	const float *m_data{};
+	size_t m_size{};
+};
+
+#endif // TADS_WEIGHTS_HPP
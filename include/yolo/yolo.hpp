@@ -125,10 +125,12 @@ protected:
 
 	std::vector<TensorInfo> m_yolo_tensors;
 	std::vector<ConfigBlock> m_config_blocks;
+	// Batchnorm factors computed from the weights, the other layers point into m_weights
 	std::vector<nvinfer1::Weights> m_trt_weights;
+	DarknetWeights m_weights;
 
 private:
-	NvDsInferStatus buildYoloNetwork(std::vector<float> &weights, nvinfer1::INetworkDefinition &network);
+	NvDsInferStatus buildYoloNetwork(const DarknetWeights &weights, nvinfer1::INetworkDefinition &network);
 
 	std::vector<std::map<std::string, std::string>> parseConfigFile(const std::string &cfg_file_path);
 
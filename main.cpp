@@ -12,6 +12,7 @@
 
 #include "app.hpp"
 #include "config_parser.hpp"
+#include "span_trace.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "ConstantFunctionResult"
@@ -36,8 +37,6 @@ static int g_return_value{};
 static uint g_num_instances;
 [[maybe_unused]] static uint g_num_input_uris;
 static GMutex g_fps_lock;
-static gdouble g_fps[MAX_SOURCE_BINS];
-static gdouble g_fps_avg[MAX_SOURCE_BINS];
 
 static Display *g_display{};
 static Window g_windows[MAX_INSTANCES] = { 0 };
@@ -67,6 +66,7 @@ GOptionEntry entries[] = {
  * */
 static GstPadProbeReturn analytics_src_pad_buffer_probe(GstPad *, GstPadProbeInfo *info, gpointer)
 {
+	TADS_TRACE_SPAN("analytics_src_pad_buffer_probe");
 	auto *buffer = reinterpret_cast<GstBuffer *>(info->data);
 	NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta (buffer);
 	if(!batch_meta)
@@ -102,23 +102,15 @@ static void intr_handler(int)
 static void perf_cb(gpointer context, AppPerfStruct *str)
 {
 	static uint header_print_cnt{};
-	uint i;
 	auto *app_ctx = reinterpret_cast<AppContext *>(context);
-	uint num_instances{ str->num_instances };
 
 	g_mutex_lock(&g_fps_lock);
-	for(i = 0; i < num_instances; i++)
-	{
-		g_fps[i] = str->fps.at(i);
-		g_fps_avg[i] = str->fps_avg.at(i);
-	}
-
 	if(header_print_cnt % 20 == 0)
 	{
 		fmt::print("**PERF:  \n");
-		for(i = 0; i < num_instances; i++)
+		for(const AppSourceDetail &detail : str->source_detail)
 		{
-			fmt::print("FPS {} (Avg)\t", i);
+			fmt::print("FPS {} (Avg)\t", detail.source_id);
 		}
 		fmt::print("\n");
 		header_print_cnt = 0;
@@ -130,11 +122,24 @@ static void perf_cb(gpointer context, AppPerfStruct *str)
 	else
 		fmt::print("**PERF:  ");
 
-	for(i = 0; i < num_instances; i++)
+	for(const AppSourceDetail &detail : str->source_detail)
 	{
-		fmt::print("{:.2f} (Avg {:.2f})\t", g_fps[i], g_fps_avg[i]);
+		fmt::print("{:.2f} (Avg {:.2f})\t", detail.fps, detail.fps_avg);
 	}
 	fmt::print("\n");
+	fmt::print("{}", image_save_drop_report(app_ctx->pipeline.common_elements.analytics.image_scheduler.get()));
+
+	if(app_ctx->latency_tracker)
+	{
+		fmt::print("{}", app_ctx->latency_tracker->report());
+	}
+	fmt::print("{}", secondary_gie_join_report(&app_ctx->pipeline.common_elements.secondary_gie));
+	if(PlateGate *plate_gate = app_ctx->pipeline.common_elements.secondary_gie.plate_gate.get())
+		fmt::print("{}", plate_gate->report());
+	fmt::print("{}", image_encode_report(app_ctx->pipeline.common_elements.analytics.image_stats.get()));
+	fmt::print("{}", crop_writer_report(app_ctx->pipeline.common_elements.analytics.crop_writer.get()));
+	fmt::print("{}", retention_report(app_ctx->pipeline.common_elements.analytics.retention.get()));
+	fmt::print("{}", analytics_report(&app_ctx->pipeline.common_elements.analytics));
 	g_mutex_unlock(&g_fps_lock);
 }
 
@@ -601,6 +606,7 @@ int main(int argc, char *argv[])
 
 		if(g_input_uris && g_input_uris[i])
 		{
+			app->config.multi_source_configs.resize(1);
 			app->config.multi_source_configs[0].uri = g_strdup_printf("%s", g_input_uris[i]);
 			g_free(g_input_uris[i]);
 		}
@@ -1,37 +1,35 @@
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
-#include <set>
 #include <filesystem>
 #include <nvds_analytics_meta.h>
 
 #include "analytics.hpp"
 #include "image_save.hpp"
 #include "app.hpp"
+#include "span_trace.hpp"
 
 static uint64_t g_data_index{};
-static const size_t MAX_PROCESSED_OBJECTS_LIMIT{ 1000 };
-static const std::string UNKNOWN_LABEL{ "unknown" };
 
 LineCrossingData::LineCrossingData():
 	is_set{},
-	status{ UNKNOWN_LABEL },
-	timestamp{}
-{}
-
-ClassifierData::ClassifierData(std::string label, float conf):
-	label(std::move(label)),
-	confidence(conf)
+	status{ LABEL_UNKNOWN },
+	timestamp{},
+	time_us{}
 {}
 
 TrafficAnalysisData::TrafficAnalysisData():
 	id{ static_cast<uint64_t>(-1) },
+	source_id{},
+	direction{ LABEL_UNKNOWN },
 	crossing_pair{},
-	lp_data{},
-	has_image{},
+	plate{},
 	output_path{},
-	direction{ UNKNOWN_LABEL }
+	has_image{},
+	is_saved{}
 {
 	index = g_data_index++;
 }
@@ -42,148 +40,101 @@ TrafficAnalysisData::TrafficAnalysisData(uint64_t obj_id):
 	id = obj_id;
 }
 
+void TrafficAnalysisData::reset(uint64_t obj_id)
+{
+	id = obj_id;
+	index = g_data_index++;
+	direction = LABEL_UNKNOWN;
+	crossing_pair.first = LineCrossingData{};
+	crossing_pair.second = LineCrossingData{};
+	classifier_data = ClassifierData{};
+	plate.reset();
+	output_path.reset();
+	has_image = false;
+	is_saved = false;
+}
+
 [[maybe_unused]]
 void TrafficAnalysisData::print_info() const
 {
-	std::ostringstream output;
+	fmt::print(to_string());
+}
 
-	output << fmt::format("Номер    : {}\n", this->id);
-	output << fmt::format("Класс    : {}\n", this->classifier_data.label);
-	output << fmt::format("Напр.    : {}\n", this->direction);
+TrafficEvent TrafficAnalysisData::to_event() const
+{
+	TrafficEvent event;
 
-	if(this->crossing_pair.first.is_set)
-	{
-		output << fmt::format("Точка1   : {:<6} - {}\n", this->crossing_pair.first.status,
-													this->crossing_pair.first.time_str);
-	}
-	else
-	{
-		output << std::string("Точка1   : N/A\n");
-	}
-	if(this->crossing_pair.second.is_set)
-	{
-		output << fmt::format("Точка2   : {:<6} - {}\n", this->crossing_pair.second.status,
-													this->crossing_pair.second.time_str);
-	}
-	else
-	{
-		output << std::string("Точка2   : N/A\n");
-	}
+	event.object_id = id;
+	event.source_id = source_id;
+	// Strings are only built here, when the record is written
+	event.label = label_name(classifier_data.label);
+	event.label_confidence = classifier_data.confidence;
+	event.direction = label_name(direction);
 
-	if(auto speed = this->get_object_speed(); speed > 0)
+	if(crossing_pair.first.is_set)
 	{
-		output << fmt::format("Скорость : ~{} км/ч\n", speed);
+		event.line1_status = label_name(crossing_pair.first.status);
+		event.line1_time_us = crossing_pair.first.time_us;
 	}
-	else
+	if(crossing_pair.second.is_set)
 	{
-		output << std::string("Скорость : N/A\n");
+		event.line2_status = label_name(crossing_pair.second.status);
+		event.line2_time_us = crossing_pair.second.time_us;
 	}
+	event.time_us = std::max(event.line1_time_us, event.line2_time_us);
+	if(event.time_us == 0)
+		event.time_us = g_get_real_time();
 
-	if(this->has_image)
-	{
-		std::string image_file_name{ this->get_image_filename() };
-		auto chunks = split(image_file_name, "../");
-		image_file_name = join(chunks, "/");
-		output << fmt::format("Изобр.   : {}\n", image_file_name);
-	}
-	else
-	{
-		output << std::string("Изобр.   : N/A\n");
-	}
+	event.speed_kmh = get_object_speed();
 
-	if(!lp_data.empty())
-	{
-		auto iter = std::max_element(lp_data.cbegin(), lp_data.cend(),
-																 [](const auto &prev, const auto &curr) { return curr.confidence > prev.confidence; });
-		output << fmt::format("Госномер : {:>8} ({})\n", iter->label, iter->confidence);
-	}
-	else
+	if(has_image && output_path)
+		event.image_dir = *output_path;
+
+	if(plate.length > 0)
 	{
-		output << std::string("Госномер : N/A (0)\n");
+		// Localized characters take up to two bytes each
+		char localized[PlateRead::MAX_LENGTH * 2 + 1];
+		event.plate.assign(localized, to_cyrillic(plate.view(), localized, sizeof(localized)));
+		event.plate_confidence = plate.score;
 	}
 
-	fmt::print(output.str());
+	return event;
 }
 
-void TrafficAnalysisData::save_to_file() const
+std::string TrafficAnalysisData::to_string() const
 {
-	std::ostringstream output;
-	std::ofstream file;
-
-	if(output_path.empty())
-		return;
-	std::string filename = fmt::format("{}/analytics_{}.txt", output_path, id);
+	return to_event().to_string();
+}
 
-	if(fs::exists(filename))
+void TrafficAnalysisData::save_to_file(AnalyticsWriter *writer) const
+{
+	if(!output_path)
 		return;
 
-	output << fmt::format("Номер    : {}\n", this->id);
-	output << fmt::format("Класс    : {}\n", this->classifier_data.label);
-	output << fmt::format("Напр.    : {}\n", this->direction);
+	AnalyticsRecord record{ fmt::format("{}/analytics_{}.txt", *output_path, id), to_event() };
 
-	if(this->crossing_pair.first.is_set)
-	{
-		output << fmt::format("Точка1   : {:<6} - {}\n", this->crossing_pair.first.status,
-													this->crossing_pair.first.time_str);
-	}
-	else
+	if(writer != nullptr)
 	{
-		output << std::string("Точка1   : N/A\n");
-	}
-	if(this->crossing_pair.second.is_set)
-	{
-		output << fmt::format("Точка2   : {:<6} - {}\n", this->crossing_pair.second.status,
-													this->crossing_pair.second.time_str);
-	}
-	else
-	{
-		output << std::string("Точка2   : N/A\n");
-	}
-
-	if(auto speed = this->get_object_speed(); speed > 0)
-	{
-		output << fmt::format("Скорость : ~{} км/ч\n", speed);
-	}
-	else
-	{
-		output << std::string("Скорость : N/A\n");
-	}
-
-	if(this->has_image)
-	{
-		std::string image_file_name{ this->get_image_filename() };
-		auto chunks = split(image_file_name, "../");
-		image_file_name = join(chunks, "/");
-		output << fmt::format("Изобр.   : {}\n", image_file_name);
-	}
-	else
-	{
-		output << std::string("Изобр.   : N/A\n");
+#ifdef TADS_ANALYTICS_DEBUG
+		TADS_DBG_MSG_V("Queueing analytics log '%s'", record.filename.c_str());
+#endif
+		// Dropped records are accounted by the writer itself
+		writer->push(std::move(record));
+		return;
 	}
 
-	if(!lp_data.empty())
-	{
-		auto iter = std::max_element(lp_data.cbegin(), lp_data.cend(),
-																 [](const auto &prev, const auto &curr) { return curr.confidence > prev.confidence; });
-		output << fmt::format("Госномер : {:>8} ({})\n", iter->label, iter->confidence);
-	}
-	else
-	{
-		output << std::string("Госномер : N/A (0)\n");
-	}
+	if(fs::exists(record.filename))
+		return;
 
-	file.open(filename);
+	std::ofstream file(record.filename);
 
 	if(file.is_open())
 	{
 #ifdef TADS_ANALYTICS_DEBUG
-		TADS_DBG_MSG_V("Saving analytics log to '%s'", filename.c_str());
+		TADS_DBG_MSG_V("Saving analytics log to '%s'", record.filename.c_str());
 #endif
-		file << output.str();
-		output.clear();
+		file << record.event.to_string();
 	}
-
-	file.close();
 }
 
 [[nodiscard]] [[maybe_unused]]
@@ -205,7 +156,8 @@ int TrafficAnalysisData::get_object_speed() const
 
 std::string TrafficAnalysisData::get_image_filename() const
 {
-	return fmt::format("{}/obj_{}.jpg", this->output_path, this->id);
+	return fmt::format("{}/obj_{}.jpg", this->output_path ? std::string_view(*this->output_path) : std::string_view(),
+										 this->id);
 }
 
 bool TrafficAnalysisData::lines_passed() const
@@ -216,113 +168,69 @@ bool TrafficAnalysisData::lines_passed() const
 [[maybe_unused]]
 bool TrafficAnalysisData::is_ready() const
 {
-	return lines_passed() && direction != UNKNOWN_LABEL;
+	return lines_passed() && direction != LABEL_UNKNOWN;
 }
 
-static bool
-parse_user_metadata(AppContext *app_context, NvDsObjectMeta *obj_meta, GstBuffer *buffer, TrafficAnalysisData &data)
+void CropTrackState::reset()
 {
-	if(obj_meta == nullptr)
-		return false;
-
-	bool success{};
-	std::ofstream file;
-	NvDsMetaList *l_user_meta;
-	ImageSaveConfig *image_save_config = &app_context->config.image_save_config;
-	GTimer *timer = app_context->pipeline.common_elements.analytics.timer;
+	output_path.reset();
+	best_shot = BestShotState{};
+	crossings = 0;
+	done = false;
+}
 
-	auto get_timestamp = [&timer, &buffer]()
-	{
-		if(timer != nullptr)
-			return g_timer_elapsed(timer, nullptr) * 10e3;
-		return buffer->pts * 10e-6;
-	};
+/**
+ * @return @p text without the blanks around it.
+ * */
+static std::string_view trim_view(std::string_view text)
+{
+	while(!text.empty() && isspace(static_cast<unsigned char>(text.front())))
+		text.remove_prefix(1);
+	while(!text.empty() && isspace(static_cast<unsigned char>(text.back())))
+		text.remove_suffix(1);
+	return text;
+}
 
-	// Access attached user meta for each object
-	for(l_user_meta = obj_meta->obj_user_meta_list; l_user_meta != nullptr; l_user_meta = l_user_meta->next)
+/**
+ * Copies the line crossings and the direction reported by nvdsanalytics.
+ * */
+static void capture_user_metadata(NvDsObjectMeta *obj_meta, AnalyticsObjectSnapshot &object)
+{
+	for(NvDsMetaList *l_user_meta = obj_meta->obj_user_meta_list; l_user_meta != nullptr;
+			l_user_meta = l_user_meta->next)
 	{
 		auto *user_meta = reinterpret_cast<NvDsUserMeta *>(l_user_meta->data);
-		if(user_meta->base_meta.meta_type == NVDS_USER_OBJ_META_NVDSANALYTICS)
-		{
-			auto *user_meta_data = reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data);
-			bool has_lc_status{ !user_meta_data->lcStatus.empty() };
-
-			if(has_lc_status)
-			{
-				success = true;
-				for(const auto &lc_status : user_meta_data->lcStatus)
-				{
-					LineCrossingData &lc1 = data.crossing_pair.first;
-					LineCrossingData &lc2 = data.crossing_pair.second;
-					if(!lc1.is_set && lc1.status == UNKNOWN_LABEL)
-					{
-						lc1.status = lc_status;
-						lc1.timestamp = get_timestamp();
-						lc1.time_str = get_current_date_time_str();
-						lc1.is_set = true;
-#ifdef TADS_ANALYTICS_DEBUG
-						TADS_DBG_MSG_V("Object %lu crossed line %s at %s", data.id, lc1.status.c_str(), lc1.time_str.c_str());
-#endif
-					}
-					else if(!lc2.is_set && lc2.status == UNKNOWN_LABEL)
-					{
-						lc2.status = lc_status;
-						lc2.timestamp = get_timestamp();
-						lc2.time_str = get_current_date_time_str();
-						lc2.is_set = true;
-#ifdef TADS_ANALYTICS_DEBUG
-						TADS_DBG_MSG_V("Object %lu crossed line %s at %s", data.id, lc2.status.c_str(), lc2.time_str.c_str());
-#endif
-					}
-				}
-			}
-			if(data.lines_passed() && data.direction == UNKNOWN_LABEL)
-			{
-				if(!user_meta_data->dirStatus.empty())
-				{
-					auto dir_status = trim(user_meta_data->dirStatus);
-					if(starts_with(dir_status, "DIR:"))
-						dir_status = dir_status.substr(4);
-					data.direction = dir_status;
-#ifdef TADS_ANALYTICS_DEBUG
-					TADS_DBG_MSG_V("Object %lu direction: '%s'", data.id, data.direction.c_str());
-#endif
-				}
+		if(user_meta->base_meta.meta_type != NVDS_USER_OBJ_META_NVDSANALYTICS)
+			continue;
 
-				success = true;
-				if(image_save_config->enable)
-				{
-					encode_image(app_context, buffer);
-				}
-			}
+		auto *user_meta_data = reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data);
+		// A track only keeps its first two crossings
+		for(const auto &lc_status : user_meta_data->lcStatus)
+		{
+			if(object.crossing_cnt < AnalyticsObjectSnapshot::MAX_CROSSINGS)
+				object.crossings[object.crossing_cnt++] = label_id(lc_status);
 		}
-	}
 
-	if(image_save_config->enable)
-	{
-		if(data.lines_passed())
+		if(!user_meta_data->dirStatus.empty())
 		{
-			data.has_image = save_image(image_save_config, obj_meta, data.get_image_filename());
+			std::string_view dir_status{ trim_view(user_meta_data->dirStatus) };
+			if(starts_with(dir_status, "DIR:"))
+				dir_status.remove_prefix(4);
+			object.direction = label_id(dir_status);
 		}
 	}
-
-	return success;
 }
 
-static void parse_type_classifier_metadata(AppContext *, NvDsObjectMeta *obj_meta, TrafficAnalysisData &data)
+/**
+ * Copies the vehicle type of the parent, the first label of the highest confidence.
+ * */
+static void capture_type_classifier_metadata(NvDsObjectMeta *obj_meta, AnalyticsObjectSnapshot &object)
 {
-	if(obj_meta->parent == nullptr)
-		return;
-
-	data.classifier_data.label = obj_meta->parent->obj_label;
-
-	NvDsClassifierMeta *class_meta;
-	NvDsMetaList *l_class{ obj_meta->parent->classifier_meta_list };
+	object.parent_label = label_id(obj_meta->parent->obj_label);
 
-
-	for(; l_class; l_class = l_class->next)
+	for(NvDsMetaList *l_class = obj_meta->parent->classifier_meta_list; l_class; l_class = l_class->next)
 	{
-		class_meta = reinterpret_cast<NvDsClassifierMeta *>(l_class->data);
+		auto *class_meta = reinterpret_cast<NvDsClassifierMeta *>(l_class->data);
 		if(!class_meta)
 			continue;
 
@@ -332,40 +240,28 @@ static void parse_type_classifier_metadata(AppContext *, NvDsObjectMeta *obj_met
 				label_i++, l_label = l_label->next)
 		{
 			auto label_info = reinterpret_cast<NvDsLabelInfo *>(l_label->data);
-			if(label_info)
-			{
-#ifdef TADS_ANALYTICS_DEBUG
-				TADS_DBG_MSG_V("Component %d probability %f for value %s", class_meta->unique_component_id,
-											 label_info->result_prob, label_info->result_label);
-#endif
-				if(data.classifier_data.confidence < label_info->result_prob)
-				{
-					data.classifier_data.label = label_info->result_label;
-					data.classifier_data.confidence = label_info->result_prob;
+			if(!label_info)
+				continue;
 #ifdef TADS_ANALYTICS_DEBUG
-					TADS_DBG_MSG_V("Object %lu class: '%s'", data.id, data.classifier_data.label.c_str());
+			TADS_DBG_MSG_V("Component %d probability %f for value %s", class_meta->unique_component_id,
+										 label_info->result_prob, label_info->result_label);
 #endif
-				}
+			if(object.classifier.confidence < label_info->result_prob)
+			{
+				object.classifier.label = label_id(label_info->result_label);
+				object.classifier.confidence = label_info->result_prob;
 			}
 		}
 	}
 }
 
 /**
- * Parse metadata got by LPR gie.
+ * Copies the plates read by the LPR gie.
  * */
-static bool parse_lpr_classifier_metadata(AppContext *app_context, NvDsObjectMeta *obj_meta, TrafficAnalysisData &data)
+static void capture_lpr_classifier_metadata(const AnalyticsConfig *config, NvDsObjectMeta *obj_meta,
+																						AnalyticsObjectSnapshot &object)
 {
-	if(obj_meta == nullptr)
-		return false;
-	if(obj_meta->parent == nullptr)
-		return false;
-
-	bool success{};
-	NvDsClassifierMetaList *l_class{ obj_meta->classifier_meta_list };
-	AnalyticsConfig *config = &app_context->config.analytics_config;
-
-	for(; l_class; l_class = l_class->next)
+	for(NvDsClassifierMetaList *l_class = obj_meta->classifier_meta_list; l_class; l_class = l_class->next)
 	{
 		auto class_meta = reinterpret_cast<NvDsClassifierMeta *>(l_class->data);
 		if(!class_meta)
@@ -375,125 +271,334 @@ static bool parse_lpr_classifier_metadata(AppContext *app_context, NvDsObjectMet
 		for(NvDsLabelInfoList *l_label = class_meta->label_info_list; label_i < class_meta->num_labels && l_label;
 				label_i++, l_label = l_label->next)
 		{
-			if(data.id != obj_meta->parent->object_id)
+			auto label_info = reinterpret_cast<NvDsLabelInfo *>(l_label->data);
+			if(label_info == nullptr || label_info->label_id != 0 || label_info->result_class_id != 1)
 				continue;
 
-			if(auto label_info = reinterpret_cast<NvDsLabelInfo *>(l_label->data); label_info != nullptr)
+			if(label_info->result_prob > 0.0 && object.plate_cnt < AnalyticsObjectSnapshot::MAX_PLATES &&
+				 strlen(label_info->result_label) > static_cast<size_t>(config->lp_min_length) &&
+				 object.plates[object.plate_cnt].assign(label_info->result_label, label_info->result_prob))
 			{
-				if(label_info->label_id == 0 && label_info->result_class_id == 1)
-				{
-					int label_min_len = config->lp_min_length;
-					size_t label_len = strlen(label_info->result_label);
-
-					if(label_info->result_prob > 0.0 && data.lp_data.size() < 10)
-					{
-						if(label_len <= label_min_len)
-							continue;
-						data.lp_data.emplace_back(to_cyrillic(label_info->result_label), label_info->result_prob);
+				object.plate_cnt++;
+			}
+		}
+	}
+}
+
+/**
+ * Schedules the crop of the track on the best frame of its capture window, see @ref BestShotSelector.
+ *
+ * @return true if the crop was scheduled on this frame.
+ * */
+static bool select_best_shot(AppContext *app_context, GstBuffer *buffer, NvDsFrameMeta *frame_meta,
+														 NvDsObjectMeta *obj_meta, CropTrackState &state)
+{
+	const StreammuxConfig *streammux_config = &app_context->config.streammux_config;
+	AnalyticsBin *analytics = &app_context->pipeline.common_elements.analytics;
+
+	if(state.best_shot.scheduled)
+		return false;
+
+	if(!image_save_filters_match(&app_context->config.image_save_config, obj_meta))
+		return false;
+
+	const NvOSD_RectParams &rect = obj_meta->rect_params;
+	// Tracker-only frames carry no detector confidence
+	const BestShotBox box{ rect.left, rect.top, rect.width, rect.height,
+												 std::max(obj_meta->confidence, obj_meta->tracker_confidence) };
+
+	if(!analytics->best_shot_selector.update(state.best_shot, box, streammux_config->width, streammux_config->height,
+																					 state.crossings >= 1, state.crossings >= 2))
+		return false;
+
+	if(analytics->image_scheduler)
+	{
+		// The capture time keeps the decisions of a replayed trace identical to the live run
+		const int64_t time_us{ frame_meta->ntp_timestamp > 0 ? static_cast<int64_t>(frame_meta->ntp_timestamp / 1000)
+																												 : g_get_real_time() };
+		const ImageSaveDecision decision{ analytics->image_scheduler->admit(frame_meta->source_id, obj_meta->class_id,
+																																			 frame_meta->frame_num, time_us) };
+		if(decision != ImageSaveDecision::ADMIT)
+		{
 #ifdef TADS_ANALYTICS_DEBUG
-						TADS_DBG_MSG_V("Object %lu LP: '%s'", data.id, data.lp_data.back().label.c_str());
+			TADS_DBG_MSG_V("Crop of object %lu dropped by the %s", obj_meta->object_id,
+										 decision == ImageSaveDecision::SKIP_RULE ? "frame skip rules" : "rate limit");
 #endif
-						success = true;
-					}
-				}
-			}
+			return false;
 		}
 	}
 
-	return success;
+	const std::string filename{ fmt::format(
+			"{}/obj_{}.jpg", state.output_path ? std::string_view(*state.output_path) : std::string_view(),
+			obj_meta->object_id) };
+	return encode_object_image(app_context, buffer, frame_meta, obj_meta, filename);
 }
 
-void parse_object_metadata(AppContext *app_context, GstBuffer *buffer, NvDsObjectMeta *obj_meta,
-													 const std::string &output_path)
+/**
+ * Copies the object into the batch snapshot. The crop is the only part of
+ * the analytics done here, it needs the frame surface of the buffer.
+ * */
+static void capture_object_metadata(AppContext *app_context, GstBuffer *buffer, NvDsFrameMeta *frame_meta,
+																		NvDsObjectMeta *obj_meta, AnalyticsBatchSnapshot &batch)
 {
-	uint64_t obj_id;
-	std::string obj_label;
-	TrafficAnalysisDataPtr data;
-	static std::set<uint64_t> processed_objects{};
-	auto &traffic_data_map = app_context->pipeline.common_elements.analytics.traffic_data_map;
+	AnalyticsBin *analytics{ &app_context->pipeline.common_elements.analytics };
+	AnalyticsObjectSnapshot &object{ batch.objects.emplace_back() };
 
-	if(obj_meta->parent != nullptr)
+	object.track_id = obj_meta->parent != nullptr ? obj_meta->parent->object_id : obj_meta->object_id;
+	object.source_id = frame_meta->source_id;
+	object.has_parent = obj_meta->parent != nullptr;
+	object.has_image = false;
+	object.crossing_cnt = 0;
+	object.plate_cnt = 0;
+	object.direction = LABEL_UNKNOWN;
+	object.parent_label = LABEL_UNKNOWN;
+	object.classifier = ClassifierData{};
+
+	capture_user_metadata(obj_meta, object);
+	if(object.has_parent)
 	{
-		obj_id = obj_meta->parent->object_id;
+		capture_lpr_classifier_metadata(&app_context->config.analytics_config, obj_meta, object);
+		capture_type_classifier_metadata(obj_meta, object);
 	}
-	else
+
+	// Crops are taken of the tracked object itself, not of its secondary detections
+	if(!app_context->config.image_save_config.enable || object.has_parent)
+		return;
+
+	bool created;
+	CropTrackState &state{ analytics->crop_track_table.acquire(object.source_id, object.track_id, created) };
+	if(created)
+		state.reset();
+	else if(state.done)
+		return;
+
+	if(!state.output_path)
+		state.output_path = batch.output_path;
+
+	state.crossings = std::min<uint>(state.crossings + object.crossing_cnt, AnalyticsObjectSnapshot::MAX_CROSSINGS);
+	object.has_image = select_best_shot(app_context, buffer, frame_meta, obj_meta, state);
+	state.done = state.crossings >= AnalyticsObjectSnapshot::MAX_CROSSINGS;
+}
+
+static void set_line_crossing(LineCrossingData &crossing, LabelId status, const AnalyticsBatchSnapshot &batch,
+															[[maybe_unused]] uint64_t id)
+{
+	crossing.status = status;
+	crossing.timestamp = batch.timestamp;
+	crossing.time_us = batch.time_us;
+	crossing.is_set = true;
+#ifdef TADS_ANALYTICS_DEBUG
+	TADS_DBG_MSG_V("Object %lu crossed line %s at %s", id, label_name(crossing.status).c_str(),
+								 format_date_time_str(crossing.time_us).c_str());
+#endif
+}
+
+/**
+ * Updates the track of the object and queues its record once both lines are crossed.
+ * */
+static void process_object_snapshot(AnalyticsBin *analytics, const AnalyticsBatchSnapshot &batch,
+																		const AnalyticsObjectSnapshot &object)
+{
+	bool created;
+	// The plate gate reads the plates of the tracks, the rest of the track is only touched here
+	std::unique_lock<std::mutex> lock(analytics->track_lock);
+	TrafficAnalysisData &data = analytics->traffic_data_table.acquire(object.source_id, object.track_id, created);
+
+	if(created)
 	{
-		obj_id = obj_meta->object_id;
+		data.reset(object.track_id);
+		data.source_id = object.source_id;
 	}
+	else if(data.is_saved)
+		return;
 
-	if(traffic_data_map.find(obj_id) != traffic_data_map.end())
+	for(uint i = 0; i < object.plate_cnt; i++)
 	{
-		data = traffic_data_map.at(obj_id);
+		analytics->plate_consensus.add(data.plate, object.plates[i]);
+#ifdef TADS_ANALYTICS_DEBUG
+		TADS_DBG_MSG_V("Object %lu LP: '%s', consensus '%s' score %.2f%s", data.id, object.plates[i].text,
+									 data.plate.text, data.plate.score, data.plate.settled ? " settled" : "");
+#endif
 	}
-	else if(processed_objects.find(obj_id) == processed_objects.end())
+	lock.unlock();
+
+	if(!data.output_path)
+		data.output_path = batch.output_path;
+
+	for(uint i = 0; i < object.crossing_cnt; i++)
 	{
-		data = std::make_shared<TrafficAnalysisData>(obj_id);
-		traffic_data_map.emplace(obj_id, data);
+		LineCrossingData &lc1 = data.crossing_pair.first;
+		LineCrossingData &lc2 = data.crossing_pair.second;
+		if(!lc1.is_set && lc1.status == LABEL_UNKNOWN)
+			set_line_crossing(lc1, object.crossings[i], batch, data.id);
+		else if(!lc2.is_set && lc2.status == LABEL_UNKNOWN)
+			set_line_crossing(lc2, object.crossings[i], batch, data.id);
 	}
-	else
-		return;
 
-	if(data->output_path.empty())
-		data->output_path = output_path;
+	if(data.lines_passed() && data.direction == LABEL_UNKNOWN && object.direction != LABEL_UNKNOWN)
+	{
+		data.direction = object.direction;
+#ifdef TADS_ANALYTICS_DEBUG
+		TADS_DBG_MSG_V("Object %lu direction: '%s'", data.id, label_name(data.direction).c_str());
+#endif
+	}
+
+	if(object.has_parent)
+	{
+		data.classifier_data.label = object.parent_label;
+		if(data.classifier_data.confidence < object.classifier.confidence)
+		{
+			data.classifier_data = object.classifier;
+#ifdef TADS_ANALYTICS_DEBUG
+			TADS_DBG_MSG_V("Object %lu class: '%s'", data.id, label_name(data.classifier_data.label).c_str());
+#endif
+		}
+	}
+
+	if(object.has_image)
+		data.has_image = true;
 
-	parse_user_metadata(app_context, obj_meta, buffer, *data);
-	parse_lpr_classifier_metadata(app_context, obj_meta, *data);
-	parse_type_classifier_metadata(app_context, obj_meta, *data);
+	if(data.lines_passed())
+	{
+		data.save_to_file(analytics->writer.get());
+#ifdef TADS_ANALYTICS_DEBUG
+		TADS_DBG_MSG_V("Writing to file object #%lu analytics data", data.id);
+		data.print_info();
+#endif
+		// Keep the slot until the track ages out so the object is not recorded twice
+		data.is_saved = true;
+	}
+}
 
-	if(data->lines_passed())
+/**
+ * Ages the tracks in batches; sweeps a few times per TTL instead of on every batch.
+ * */
+template<typename T>
+static void age_tracks(TrackTable<T> &table, uint ttl_frames)
+{
+	table.advance();
+	if(table.frame() % std::max(1U, ttl_frames / 4) == 0)
 	{
-		data->save_to_file();
+		[[maybe_unused]] size_t evicted = table.evict(ttl_frames);
 #ifdef TADS_ANALYTICS_DEBUG
-		TADS_DBG_MSG_V("Writing to file object #%lu analytics data", obj_id);
-		data->print_info();
+		if(evicted > 0)
+		{
+			TADS_DBG_MSG_V("Evicted %lu stale tracks, %lu tracks alive", evicted, table.size());
+		}
 #endif
-		traffic_data_map.erase(obj_id);
-		if(processed_objects.size() >= MAX_PROCESSED_OBJECTS_LIMIT)
-			processed_objects.clear();
-		processed_objects.emplace(obj_id);
 	}
 }
 
+/**
+ * The analytics of a captured batch, on the worker thread or in the probe.
+ * */
+static void process_batch_snapshot(AnalyticsBin *analytics, const AnalyticsBatchSnapshot &batch, uint ttl_frames)
+{
+	for(const AnalyticsObjectSnapshot &object : batch.objects)
+		process_object_snapshot(analytics, batch, object);
+
+	std::lock_guard<std::mutex> lock(analytics->track_lock);
+	age_tracks(analytics->traffic_data_table, ttl_frames);
+}
+
 void parse_analytics_metadata(AppContext *app_context, GstBuffer *buffer, NvDsBatchMeta *batch_meta)
 {
+	TADS_TRACE_SPAN("parse_analytics_metadata");
 	NvDsMetaList *l_frame;
 	NvDsMetaList *l_obj;
-	int frame_num{}, obj_count{};
-	auto output_path = app_context->config.analytics_config.output_path;
-	GDateTime *date_time = app_context->pipeline.common_elements.analytics.date_time;
-	if(date_time)
-	{
-		char *date_string = g_date_time_format(date_time, "%d%m%Y");
-		output_path = fmt::format("{}/{}", output_path, date_string);
-		g_free(date_string);
-	}
-	else
-	{
-		TADS_WARN_MSG_V("Couldn't get GDateTime element");
-	}
+	AnalyticsBin *analytics{ &app_context->pipeline.common_elements.analytics };
+	AnalyticsBatchSnapshot *batch{ &analytics->sync_batch };
+	const uint64_t start_ns{ LatencyTracker::now_ns() };
 
-	if(!std::filesystem::exists(output_path))
+	if(TrafficAnalysisData::distance < 0)
 	{
-		std::filesystem::create_directory(output_path);
+		TrafficAnalysisData::distance = app_context->config.analytics_config.lines_distance;
 	}
 
-	if(TrafficAnalysisData::distance < 0)
+	const uint ttl_frames{ app_context->config.analytics_config.track_ttl_frames };
+
+	if(analytics->trace_writer)
+		analytics->trace_writer->write(buffer, batch_meta);
+
+	if(analytics->worker)
 	{
-		TrafficAnalysisData::distance = app_context->config.analytics_config.lines_distance;
+		batch = analytics->worker->acquire();
+		if(!batch)
+			batch = &analytics->dropped_batch;
 	}
 
-	for(l_frame = batch_meta->frame_meta_list; l_frame != nullptr; l_frame = l_frame->next, frame_num++)
+	// The day folder is created and swapped at midnight by the date directory timer
+	batch->output_path.reset();
+	if(analytics->date_directory)
+		batch->output_path = analytics->date_directory->path();
+	if(!batch->output_path)
+		batch->output_path = analytics->output_path;
+
+	// Every crossing of the batch gets the same time
+	batch->timestamp = analytics->timer != nullptr ? g_timer_elapsed(analytics->timer, nullptr) * 10e3
+																								 : static_cast<double>(buffer->pts) * 10e-6;
+	batch->time_us = g_get_real_time();
+	batch->objects.clear();
+
+	for(l_frame = batch_meta->frame_meta_list; l_frame != nullptr; l_frame = l_frame->next)
 	{
 		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
 		if(!frame_meta)
 			continue;
 
-		for(l_obj = frame_meta->obj_meta_list; l_obj != nullptr; l_obj = l_obj->next, obj_count++)
+		for(l_obj = frame_meta->obj_meta_list; l_obj != nullptr; l_obj = l_obj->next)
 		{
 			auto *obj_meta = reinterpret_cast<NvDsObjectMeta *>(l_obj->data);
-			parse_object_metadata(app_context, buffer, obj_meta, output_path);
+			if(obj_meta != nullptr)
+				capture_object_metadata(app_context, buffer, frame_meta, obj_meta, *batch);
 		}
 	}
+
+	// All crops scheduled on this batch are encoded and written in one go
+	finish_image_encoding(app_context);
+	if(app_context->config.image_save_config.enable)
+		age_tracks(analytics->crop_track_table, ttl_frames);
+
+	if(!analytics->worker)
+		process_batch_snapshot(analytics, *batch, ttl_frames);
+	else if(batch != &analytics->dropped_batch)
+		analytics->worker->submit();
+	else
+		analytics->worker->submit_dropped(*batch);
+
+	const uint64_t probe_ns{ LatencyTracker::now_ns() - start_ns };
+	analytics->probe_latency.record(probe_ns);
+	analytics->probe_ns_total.fetch_add(probe_ns, std::memory_order_relaxed);
+	analytics->probe_batches.fetch_add(1, std::memory_order_relaxed);
+}
+
+void create_analytics_worker(AnalyticsBin *analytics, size_t queue_size, bool block_when_full, uint ttl_frames)
+{
+	analytics->worker = std::make_unique<AnalyticsWorker>(queue_size, block_when_full,
+																												[analytics, ttl_frames](const AnalyticsBatchSnapshot &batch)
+																												{ process_batch_snapshot(analytics, batch, ttl_frames); });
+}
+
+std::string analytics_report(AnalyticsBin *analytics)
+{
+	LatencySnapshot probe;
+	std::string report;
+
+	analytics->probe_latency.drain(probe);
+	if(probe.total == 0)
+		return {};
+
+	report = fmt::format("**ANALYTICS: probe p50 {:.1f} us p99 {:.1f} us max {:.1f} us", probe.value_at(50) / 1000.0,
+											 probe.value_at(99) / 1000.0, probe.max / 1000.0);
+	if(analytics->worker)
+	{
+		const AnalyticsWorkerStats stats{ analytics->worker->stats() };
+		report += fmt::format(" queue {}/{} (max {}) processed {} dropped {} (objects kept {})", stats.queue_depth,
+													stats.capacity, stats.max_queue_depth, stats.processed, stats.dropped, stats.kept_objects);
+	}
+	report += '\n';
+
+	return report;
 }
 
 bool create_analytics_bin(AnalyticsConfig *config, AnalyticsBin *analytics)
@@ -544,12 +649,67 @@ bool create_analytics_bin(AnalyticsConfig *config, AnalyticsBin *analytics)
 
 	g_object_set(G_OBJECT(analytics->analytics_elem), "config-file", config->config_file_path.c_str(), nullptr);
 
+	// Tracks share the folder instead of copying it, no folder means no records as with an empty path
+	if(!config->output_path.empty() && !analytics->output_path)
+		analytics->output_path = std::make_shared<const std::string>(config->output_path);
+
+	analytics->plate_consensus = PlateConsensus(config->lp_settle_reads, static_cast<float>(config->lp_settle_score));
+
+	if(!analytics->writer)
+	{
+		analytics->writer = std::make_unique<AnalyticsWriter>(config->writer_queue_size, config->writer_overflow_policy,
+																													config->writer_flush_interval_ms);
+		analytics->writer->set_output(config->output_format, config->output_path);
+	}
+	analytics->writer->start();
+
+	// The probe only captures the batch, the tracks are updated on the worker thread
+	if(config->async_queue_size > 0 && !analytics->worker)
+	{
+		create_analytics_worker(analytics, config->async_queue_size, false, config->track_ttl_frames);
+		TADS_INFO_MSG_V("Processing analytics on a worker thread, queue of %zu batches",
+										analytics->worker->stats().capacity);
+	}
+	if(analytics->worker)
+		analytics->worker->start();
+
+	if(!config->meta_trace_path.empty() && !analytics->trace_writer)
+	{
+		analytics->trace_writer = std::make_unique<MetaTraceWriter>();
+		if(!analytics->trace_writer->open(config->meta_trace_path))
+			analytics->trace_writer.reset();
+		else
+			TADS_INFO_MSG_V("Capturing analytics metadata to '%s'", config->meta_trace_path.c_str());
+	}
+
 	success = true;
 
 	if(!analytics->timer)
 		analytics->timer = g_timer_new();
-	if(!analytics->date_time)
-		analytics->date_time = g_date_time_new_now_local();
+	if(!analytics->image_stats)
+	{
+		analytics->image_stats = std::make_unique<ImageEncodeStats>();
+		analytics->image_stats->report_time_us = g_get_monotonic_time();
+	}
+	if(!analytics->date_directory)
+	{
+		analytics->date_directory = std::make_unique<DateDirectory>(config->output_path);
+		if(!analytics->date_directory->start())
+			analytics->date_directory.reset();
+	}
+	if(!analytics->retention && (config->retention_events_max_mb > 0 || config->retention_events_max_days > 0 ||
+															 config->retention_crops_max_mb > 0 || config->retention_crops_max_days > 0))
+	{
+		std::array<RetentionQuota, RETENTION_KIND_COUNT> quotas{};
+		quotas[static_cast<size_t>(RetentionKind::EVENTS)] = { config->retention_events_max_mb * 1048576ull,
+																													 config->retention_events_max_days };
+		quotas[static_cast<size_t>(RetentionKind::CROPS)] = { config->retention_crops_max_mb * 1048576ull,
+																													config->retention_crops_max_days };
+		analytics->retention = std::make_unique<RetentionManager>(config->output_path, quotas,
+																															config->retention_interval_s,
+																															config->retention_scan_budget);
+		analytics->retention->start();
+	}
 
 done:
 	if(!success)
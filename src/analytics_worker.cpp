@@ -0,0 +1,186 @@
+#include "analytics.hpp"
+#include "span_trace.hpp"
+
+/**
+ * Objects reserved in every slot, a slot only allocates for a larger batch.
+ * */
+static constexpr size_t SNAPSHOT_RESERVED_OBJECTS{ 256 };
+
+AnalyticsWorker::AnalyticsWorker(size_t queue_size, bool block_when_full, Process process):
+	m_ring{ queue_size },
+	m_block_when_full{ block_when_full },
+	m_process{ std::move(process) }
+{
+	for(AnalyticsBatchSnapshot &batch : m_ring.slots())
+		batch.objects.reserve(SNAPSHOT_RESERVED_OBJECTS);
+}
+
+AnalyticsWorker::~AnalyticsWorker()
+{
+	stop();
+}
+
+bool AnalyticsWorker::start()
+{
+	if(m_thread.joinable())
+		return true;
+
+	m_running = true;
+	m_thread = std::thread(&AnalyticsWorker::run, this);
+	return true;
+}
+
+void AnalyticsWorker::stop()
+{
+	if(!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_running = false;
+	}
+	m_ready.notify_one();
+	m_thread.join();
+}
+
+AnalyticsBatchSnapshot *AnalyticsWorker::acquire()
+{
+	AnalyticsBatchSnapshot *batch{ m_ring.producer_slot() };
+
+	while(!batch && m_block_when_full && m_running.load(std::memory_order_relaxed))
+	{
+		std::this_thread::yield();
+		batch = m_ring.producer_slot();
+	}
+
+	if(!batch)
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+	return batch;
+}
+
+void AnalyticsWorker::submit()
+{
+	m_ring.publish();
+	m_submitted++;
+
+	const size_t depth{ m_ring.size() };
+	size_t max_depth{ m_max_queue_depth.load(std::memory_order_relaxed) };
+	while(depth > max_depth && !m_max_queue_depth.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed))
+	{
+	}
+
+	// Pairs with the fence of the worker: either it sees the batch or the probe sees it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(m_sleeping.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_ready.notify_one();
+	}
+}
+
+void AnalyticsWorker::submit_dropped(const AnalyticsBatchSnapshot &batch)
+{
+	size_t kept{};
+
+	for(const AnalyticsObjectSnapshot &object : batch.objects)
+		kept += object.crossing_cnt > 0 || object.has_image;
+	if(kept == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		DroppedBatch &entry = m_dropped_batches.emplace_back();
+		AnalyticsBatchSnapshot &dropped = entry.batch;
+		entry.submitted_before = m_submitted;
+		dropped.timestamp = batch.timestamp;
+		dropped.time_us = batch.time_us;
+		dropped.output_path = batch.output_path;
+		dropped.objects.reserve(kept);
+		for(const AnalyticsObjectSnapshot &object : batch.objects)
+		{
+			if(object.crossing_cnt > 0 || object.has_image)
+				dropped.objects.push_back(object);
+		}
+		m_dropped_pending.store(m_dropped_batches.size(), std::memory_order_relaxed);
+	}
+	m_kept_objects.fetch_add(kept, std::memory_order_relaxed);
+	m_ready.notify_one();
+}
+
+void AnalyticsWorker::process_dropped(uint64_t processed)
+{
+	std::deque<AnalyticsBatchSnapshot> batches;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		while(!m_dropped_batches.empty() && m_dropped_batches.front().submitted_before <= processed)
+		{
+			batches.push_back(std::move(m_dropped_batches.front().batch));
+			m_dropped_batches.pop_front();
+		}
+		m_dropped_pending.store(m_dropped_batches.size(), std::memory_order_relaxed);
+	}
+
+	for(const AnalyticsBatchSnapshot &batch : batches)
+	{
+		TADS_TRACE_SPAN("analytics_worker_dropped_batch");
+		m_process(batch);
+	}
+}
+
+bool AnalyticsWorker::has_work() const
+{
+	return m_ring.size() > 0 || m_dropped_pending.load(std::memory_order_relaxed) > 0 ||
+				 !m_running.load(std::memory_order_relaxed);
+}
+
+void AnalyticsWorker::run()
+{
+	while(true)
+	{
+		// A dropped batch comes right after the batches queued before it
+		if(m_dropped_pending.load(std::memory_order_relaxed) > 0)
+			process_dropped(m_processed.load(std::memory_order_relaxed));
+
+		AnalyticsBatchSnapshot *batch{ m_ring.consumer_slot() };
+		if(batch)
+		{
+			{
+				TADS_TRACE_SPAN("analytics_worker_batch");
+				m_process(*batch);
+			}
+			m_ring.release();
+			m_processed.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		// Batches queued before stop are still processed
+		if(!m_running.load(std::memory_order_relaxed))
+		{
+			if(m_ring.size() == 0 && m_dropped_pending.load(std::memory_order_relaxed) == 0)
+				break;
+			continue;
+		}
+
+		// No timeout, a batch published after the check finds the worker sleeping and wakes it up
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_ready.wait(lock, [this] { return has_work(); });
+		m_sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+AnalyticsWorkerStats AnalyticsWorker::stats() const
+{
+	AnalyticsWorkerStats stats{};
+
+	stats.processed = m_processed.load(std::memory_order_relaxed);
+	stats.dropped = m_dropped.load(std::memory_order_relaxed);
+	stats.kept_objects = m_kept_objects.load(std::memory_order_relaxed);
+	stats.queue_depth = m_ring.size();
+	stats.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+	stats.capacity = m_ring.capacity();
+
+	return stats;
+}
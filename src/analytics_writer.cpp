@@ -0,0 +1,236 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "analytics_writer.hpp"
+#include "common.hpp"
+#include "span_trace.hpp"
+
+AnalyticsWriter::AnalyticsWriter(size_t capacity, WriterOverflowPolicy policy, uint flush_interval_ms,
+																 size_t batch_size):
+	m_capacity{ capacity > 0 ? capacity : 1 },
+	m_batch_size{ batch_size > 0 ? batch_size : 1 },
+	m_policy{ policy },
+	m_flush_interval{ flush_interval_ms }
+{}
+
+AnalyticsWriter::~AnalyticsWriter()
+{
+	stop();
+}
+
+void AnalyticsWriter::set_output(AnalyticsOutputFormat format, const std::string &root_path)
+{
+	m_write_text = format != AnalyticsOutputFormat::SEGMENTS;
+	if(format != AnalyticsOutputFormat::TEXT)
+		m_store = std::make_unique<EventStoreWriter>(root_path);
+	else
+		m_store.reset();
+}
+
+bool AnalyticsWriter::start()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_running)
+		return true;
+
+	m_running = true;
+	m_thread = std::thread(&AnalyticsWriter::run, this);
+	return true;
+}
+
+void AnalyticsWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(!m_running)
+			return;
+		m_running = false;
+	}
+	m_not_empty.notify_all();
+	m_not_full.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+
+	if(m_store)
+		m_store->close();
+}
+
+bool AnalyticsWriter::push(AnalyticsRecord record)
+{
+	TADS_TRACE_SPAN("analytics_writer_push");
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	if(!m_running)
+	{
+		m_dropped++;
+		return false;
+	}
+
+	if(m_queue.size() >= m_capacity)
+	{
+		switch(m_policy)
+		{
+			case WriterOverflowPolicy::BLOCK:
+				m_not_full.wait(lock, [this] { return m_queue.size() < m_capacity || !m_running; });
+				if(!m_running)
+				{
+					m_dropped++;
+					return false;
+				}
+				break;
+			case WriterOverflowPolicy::DROP_OLDEST:
+				m_queue.pop_front();
+				m_dropped++;
+				break;
+			case WriterOverflowPolicy::DROP_NEWEST:
+			default:
+				m_dropped++;
+				return false;
+		}
+	}
+
+	m_queue.push_back(std::move(record));
+	m_queued++;
+
+	const uint64_t depth{ m_queue.size() };
+	m_queue_depth.store(depth, std::memory_order_relaxed);
+	if(depth > m_max_queue_depth.load(std::memory_order_relaxed))
+		m_max_queue_depth.store(depth, std::memory_order_relaxed);
+
+	const bool wake{ m_queue.size() >= m_batch_size };
+	lock.unlock();
+
+	if(wake)
+		m_not_empty.notify_one();
+
+	return true;
+}
+
+AnalyticsWriterStats AnalyticsWriter::stats() const
+{
+	AnalyticsWriterStats stats{};
+	stats.queued = m_queued.load(std::memory_order_relaxed);
+	stats.written = m_written.load(std::memory_order_relaxed);
+	stats.skipped = m_skipped.load(std::memory_order_relaxed);
+	stats.dropped = m_dropped.load(std::memory_order_relaxed);
+	stats.failed = m_failed.load(std::memory_order_relaxed);
+	stats.batches = m_batches.load(std::memory_order_relaxed);
+	stats.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+	stats.queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void AnalyticsWriter::run()
+{
+	std::deque<AnalyticsRecord> batch;
+
+	while(true)
+	{
+		bool running;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_not_empty.wait_for(lock, m_flush_interval, [this] { return m_queue.size() >= m_batch_size || !m_running; });
+
+			running = m_running;
+			batch.swap(m_queue);
+			m_queue_depth.store(0, std::memory_order_relaxed);
+		}
+		m_not_full.notify_all();
+
+		if(!batch.empty())
+		{
+			flush(batch);
+			batch.clear();
+		}
+
+		if(!running)
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if(m_queue.empty())
+				break;
+		}
+	}
+}
+
+AnalyticsWriter::TextResult AnalyticsWriter::write_text(const AnalyticsRecord &record)
+{
+	// O_EXCL replaces the separate exists() check: a record for the same object is never overwritten
+	int fd = open(record.filename.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd < 0)
+	{
+		if(errno == EEXIST)
+			return TextResult::SKIPPED;
+
+		TADS_ERR_MSG_V("Could not open '%s' for writing: %s", record.filename.c_str(), strerror(errno));
+		return TextResult::FAILED;
+	}
+
+	const std::string content{ record.event.to_string() };
+	const char *data{ content.data() };
+	size_t remaining{ content.size() };
+	TextResult result{ TextResult::WRITTEN };
+
+	while(remaining > 0)
+	{
+		ssize_t written = write(fd, data, remaining);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			TADS_ERR_MSG_V("Could not write '%s': %s", record.filename.c_str(), strerror(errno));
+			result = TextResult::FAILED;
+			break;
+		}
+		data += written;
+		remaining -= written;
+	}
+	if(close(fd) != 0 && result == TextResult::WRITTEN)
+	{
+		TADS_ERR_MSG_V("Could not close '%s': %s", record.filename.c_str(), strerror(errno));
+		result = TextResult::FAILED;
+	}
+
+	// A partial file would make every retry of the record skip it as already written
+	if(result == TextResult::FAILED)
+		unlink(record.filename.c_str());
+
+	return result;
+}
+
+void AnalyticsWriter::flush(std::deque<AnalyticsRecord> &batch)
+{
+	TADS_TRACE_SPAN("analytics_writer_flush");
+	for(const AnalyticsRecord &record : batch)
+	{
+		bool success{ true };
+
+		if(m_store)
+			success = m_store->append(record.event, g_get_real_time());
+
+		if(m_write_text)
+		{
+			const TextResult result{ write_text(record) };
+			if(result == TextResult::FAILED)
+			{
+				success = false;
+			}
+			else if(result == TextResult::SKIPPED && !m_store)
+			{
+				m_skipped++;
+				continue;
+			}
+		}
+
+		if(success)
+			m_written++;
+		else
+			m_failed++;
+	}
+
+	if(m_store)
+		m_store->flush();
+	m_batches++;
+}
@@ -8,11 +8,10 @@
 #include <sstream>
 
 #include "app.hpp"
+#include "span_trace.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "ConstantFunctionResult"
-static uint demux_batch_num = 0;
-
 GST_DEBUG_CATEGORY_EXTERN(NVDS_APP);
 
 [[maybe_unused]] GQuark g_dsmeta_quark;
@@ -147,6 +146,8 @@ static void s_fps_sensor_info_callback_stream_added(AppContext *app_ctx, FPSSens
 	/** save the sensor info into the hash map */
 	g_hash_table_insert(app_ctx->perf_struct.fps_info_hash, GUINT_TO_POINTER(fps_sensor_info->source_id),
 											fps_sensor_info_to_hash);
+	if(fps_sensor_info->source_id < app_ctx->perf_struct.instance_str.size())
+		app_ctx->perf_struct.instance_str[fps_sensor_info->source_id].active = true;
 }
 
 FPSSensorInfo *get_fps_sensor_info(AppContext *app_ctx, uint source_id)
@@ -164,6 +165,8 @@ static void s_fps_sensor_info_callback_stream_removed(AppContext *app_ctx, FPSSe
 	if(fps_ensor_info_from_hash)
 	{
 		g_hash_table_remove(app_ctx->perf_struct.fps_info_hash, GUINT_TO_POINTER(fps_sensor_info->source_id));
+		if(fps_sensor_info->source_id < app_ctx->perf_struct.instance_str.size())
+			app_ctx->perf_struct.instance_str[fps_sensor_info->source_id].active = false;
 		s_fps_sensor_info_destroy(fps_ensor_info_from_hash);
 	}
 }
@@ -572,6 +575,7 @@ static void process_buffer(GstBuffer *buffer, AppContext *app_ctx, uint index)
  */
 static GstPadProbeReturn gie_processing_done_buf_prob([[maybe_unused]] GstPad *pad, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("gie_processing_done_buf_prob");
 	auto *buffer = reinterpret_cast<GstBuffer *>(info->data);
 	auto *instance_bin = reinterpret_cast<InstanceBin *>(data);
 	uint index = instance_bin->index;
@@ -587,6 +591,7 @@ static GstPadProbeReturn gie_processing_done_buf_prob([[maybe_unused]] GstPad *p
  */
 static GstPadProbeReturn analytics_done_buf_prob(GstPad *, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("analytics_done_buf_prob");
 	auto common_elements = reinterpret_cast<InstanceBin *>(data);
 	AppContext *app_ctx = common_elements->app_ctx;
 	auto *buffer = reinterpret_cast<GstBuffer *>(info->data);
@@ -601,54 +606,63 @@ static GstPadProbeReturn analytics_done_buf_prob(GstPad *, GstPadProbeInfo *info
 	return GST_PAD_PROBE_OK;
 }
 
-static GstPadProbeReturn latency_measurement_buf_prob(GstPad *pad, GstPadProbeInfo *info, void *data)
+static void stamp_latency_stage(LatencyTracker::Stage *stage, GstBuffer *buffer)
 {
-	auto *app_ctx = reinterpret_cast<AppContext *>(data);
-	uint i, num_sources_in_batch;
-	if(nvds_enable_latency_measurement)
-	{
-		auto *buffer = reinterpret_cast<GstBuffer *>(info->data);
-		NvDsFrameLatencyInfo *latency_info;
-		g_mutex_lock(&app_ctx->latency_lock);
-		latency_info = app_ctx->latency_info_array;
-		uint64_t batch_num = GPOINTER_TO_SIZE(g_object_get_data(G_OBJECT(pad), "latency-batch-num"));
-		g_print("\n*********** BATCH-NUM = %lu *************\n", batch_num);
+	NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buffer);
 
-		num_sources_in_batch = nvds_measure_buffer_latency(buffer, latency_info);
+	if(!batch_meta)
+		return;
 
-		for(i = 0; i < num_sources_in_batch; i++)
-		{
-			g_print("Source id = %d Frame_num = %d Frame latency = %lf (ms) \n", latency_info[i].source_id,
-							latency_info[i].frame_num, latency_info[i].latency);
-		}
-		g_mutex_unlock(&app_ctx->latency_lock);
-		g_object_set_data(G_OBJECT(pad), "latency-batch-num", GSIZE_TO_POINTER(batch_num + 1));
+	const uint64_t now_ns{ LatencyTracker::now_ns() };
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
+	{
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+		stage->tracker->stamp(stage, frame_meta->source_id, frame_meta->frame_num, now_ns);
 	}
+}
 
+/**
+ * Stamps every frame of the batch crossing a stage boundary.
+ * */
+static GstPadProbeReturn latency_stage_buf_prob(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	TADS_TRACE_SPAN("latency_stage_buf_prob");
+	stamp_latency_stage(reinterpret_cast<LatencyTracker::Stage *>(data), reinterpret_cast<GstBuffer *>(info->data));
 	return GST_PAD_PROBE_OK;
 }
 
-static GstPadProbeReturn
-demux_latency_measurement_buf_prob([[maybe_unused]] GstPad *pad, GstPadProbeInfo *info, void *data)
+/**
+ * Measures the end-to-end latency of the frames reaching a sink. Instead of
+ * printing every batch, the sink stage and the end-to-end latency are added
+ * to the latency histograms, which are printed with the perf report.
+ * */
+static GstPadProbeReturn latency_measurement_buf_prob(GstPad *, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("latency_measurement_buf_prob");
 	auto *app_ctx = reinterpret_cast<AppContext *>(data);
 	uint i, num_sources_in_batch;
 	if(nvds_enable_latency_measurement)
 	{
 		auto *buffer = reinterpret_cast<GstBuffer *>(info->data);
+		LatencyTracker *tracker{ app_ctx->latency_tracker.get() };
 		NvDsFrameLatencyInfo *latency_info;
+
+		if(tracker)
+			stamp_latency_stage(app_ctx->latency_sink_stage, buffer);
+
 		g_mutex_lock(&app_ctx->latency_lock);
 		latency_info = app_ctx->latency_info_array;
-		g_print("\n************DEMUX BATCH-NUM = %d**************\n", demux_batch_num);
 		num_sources_in_batch = nvds_measure_buffer_latency(buffer, latency_info);
 
-		for(i = 0; i < num_sources_in_batch; i++)
+		if(tracker)
 		{
-			g_print("Source id = %d Frame_num = %d Frame latency = %lf (ms) \n", latency_info[i].source_id,
-							latency_info[i].frame_num, latency_info[i].latency);
+			for(i = 0; i < num_sources_in_batch; i++)
+			{
+				tracker->record(app_ctx->latency_e2e_stage, latency_info[i].source_id,
+												static_cast<uint64_t>(latency_info[i].latency * 1000));
+			}
 		}
 		g_mutex_unlock(&app_ctx->latency_lock);
-		demux_batch_num++;
 	}
 
 	return GST_PAD_PROBE_OK;
@@ -818,6 +832,11 @@ bool AppContext::create_pipeline(perf_callback perf_cb)
 	}
 	gst_bin_add(GST_BIN(pipeline.pipeline), multi_src_bin->bin);
 
+	// The number of sources is final here, one processing instance per source at most
+	pipeline.instance_bins = std::vector<InstanceBin>(std::max<uint>(config.num_source_sub_bins, 1));
+	pipeline.demux_instance_bins = std::vector<InstanceBin>(std::max<uint>(config.num_source_sub_bins, 1));
+	instance_data = std::vector<InstanceData>(pipeline.instance_bins.size());
+
 	if(config.streammux_config.is_parsed)
 	{
 		if(config.use_nvmultiurisrcbin)
@@ -907,7 +926,7 @@ bool AppContext::create_pipeline(perf_callback perf_cb)
 			gst_object_unref(demux_src_pad);
 
 			TADS_ELEM_ADD_PROBE(latency_probe_id, this->pipeline.demux_instance_bins.at(i).demux_sink.bin, "sink",
-													demux_latency_measurement_buf_prob, GST_PAD_PROBE_TYPE_BUFFER, this);
+													latency_measurement_buf_prob, GST_PAD_PROBE_TYPE_BUFFER, this);
 			latency_probe_id = latency_probe_id;
 		}
 
@@ -1028,6 +1047,11 @@ bool AppContext::create_pipeline(perf_callback perf_cb)
 		goto done;
 	}
 
+	if(nvds_enable_latency_measurement && !this->add_latency_probes())
+	{
+		goto done;
+	}
+
 	if(tmp_elem2)
 	{
 		TADS_LINK_ELEMENT(tmp_elem2, last_elem);
@@ -1069,6 +1093,17 @@ bool AppContext::create_pipeline(perf_callback perf_cb)
 		}
 	}
 
+	if(!config.metrics_address.empty() && !this->start_metrics())
+	{
+		goto done;
+	}
+
+	if(!config.span_trace_path.empty())
+	{
+		span_trace_start(config.span_trace_buffer_spans);
+		TADS_INFO_MSG_V("Tracing spans to '%s'", config.span_trace_path.c_str());
+	}
+
 	GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(this->pipeline.pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "ds-app-null");
 
 	g_mutex_init(&this->app_lock);
@@ -1173,6 +1208,17 @@ void AppContext::destroy_pipeline()
 
 	end_time = g_get_monotonic_time() + G_TIME_SPAN_SECOND;
 
+	// Scrapes read the writers and trackers destroyed below
+	if(this->metrics_server)
+	{
+		this->metrics_server->stop();
+		TADS_INFO_MSG_V("Metrics: %lu scrapes", this->metrics_server->scrapes());
+		this->metrics_server.reset();
+	}
+	for(SourceBin &sub_bin : this->pipeline.multi_src_bin.sub_bins)
+		sub_bin.reconnect_counter = nullptr;
+	this->metrics.reset();
+
 	if(this->pipeline.demuxer)
 	{
 		GstPad *gstpad = gst_element_get_static_pad(this->pipeline.demuxer, "sink");
@@ -1197,7 +1243,7 @@ void AppContext::destroy_pipeline()
 			}
 		}
 	}
-	else if(this->pipeline.instance_bins[0].sink.bin)
+	else if(!this->pipeline.instance_bins.empty() && this->pipeline.instance_bins[0].sink.bin)
 	{
 		GstPad *gstpad = gst_element_get_static_pad(this->pipeline.instance_bins[0].sink.bin, "sink");
 		gst_pad_send_event(gstpad, gst_event_new_eos());
@@ -1230,7 +1276,8 @@ void AppContext::destroy_pipeline()
 	g_cond_wait_until(&this->app_cond, &this->app_lock, end_time);
 	g_mutex_unlock(&this->app_lock);
 
-	for(i = 0; i < this->config.num_source_sub_bins; i++)
+	// Instance bins are only sized once the source bin was created
+	for(i = 0; i < std::min<size_t>(this->config.num_source_sub_bins, this->pipeline.instance_bins.size()); i++)
 	{
 		InstanceBin *instance_bin{ &this->pipeline.instance_bins.at(i) };
 		if(config.osd_config.enable)
@@ -1256,9 +1303,49 @@ void AppContext::destroy_pipeline()
 	if(this->config.analytics_config.enable)
 	{
 		AnalyticsBin *analytics_bin{ &this->pipeline.common_elements.analytics };
+		// The worker still pushes records for the queued batches, it stops before the writer
+		if(analytics_bin->worker)
+		{
+			analytics_bin->worker->stop();
+			AnalyticsWorkerStats stats{ analytics_bin->worker->stats() };
+			TADS_INFO_MSG_V("Analytics worker: processed %lu batches, dropped %lu (objects kept %lu), "
+											"max queue depth %lu of %lu",
+											stats.processed, stats.dropped, stats.kept_objects, stats.max_queue_depth, stats.capacity);
+			analytics_bin->worker.reset();
+		}
+		if(analytics_bin->retention)
+		{
+			analytics_bin->retention->stop();
+			RetentionStats stats{ analytics_bin->retention->stats() };
+			TADS_INFO_MSG_V("Retention: %lu passes, %lu entries scanned, %lu files deleted, %lu bytes freed",
+											stats.passes, stats.scanned_entries, stats.deleted_files, stats.freed_bytes);
+		}
+		if(analytics_bin->writer)
+		{
+			analytics_bin->writer->stop();
+			AnalyticsWriterStats stats{ analytics_bin->writer->stats() };
+			TADS_INFO_MSG_V("Analytics writer: queued %lu, written %lu, skipped %lu, dropped %lu, failed %lu, "
+											"batches %lu, max queue depth %lu",
+											stats.queued, stats.written, stats.skipped, stats.dropped, stats.failed, stats.batches,
+											stats.max_queue_depth);
+		}
+		if(analytics_bin->trace_writer)
+		{
+			TADS_INFO_MSG_V("Captured %lu batches of analytics metadata", analytics_bin->trace_writer->batches());
+			analytics_bin->trace_writer.reset();
+		}
+		if(analytics_bin->crop_writer)
+		{
+			analytics_bin->crop_writer->stop();
+			CropWriterStats stats{ analytics_bin->crop_writer->stats() };
+			TADS_INFO_MSG_V("Crop writer: queued %lu, written %lu, dropped %lu, failed %lu, batches %lu, "
+											"max queue depth %lu",
+											stats.queued, stats.written, stats.dropped, stats.failed, stats.batches,
+											stats.max_queue_depth);
+		}
 		g_timer_stop(analytics_bin->timer);
 		g_timer_destroy(analytics_bin->timer);
-		g_date_time_unref(analytics_bin->date_time);
+		analytics_bin->date_directory.reset();
 	}
 
 	destroy_sink_bin();
@@ -1273,6 +1360,10 @@ void AppContext::destroy_pipeline()
 		this->pipeline.pipeline = nullptr;
 		pause_perf_measurement(&this->perf_struct);
 
+		// Probes are gone with the pipeline
+		this->latency_sink_stage = this->latency_e2e_stage = nullptr;
+		this->latency_tracker.reset();
+
 		// for pipeline-recreate, reset rtsp srouce's depay, such as rtph264depay.
 		SourceParentBin *pbin = &this->pipeline.multi_src_bin;
 		if(pbin)
@@ -1287,6 +1378,13 @@ void AppContext::destroy_pipeline()
 		}
 	}
 
+	// The probes and writers are gone, no span of this pipeline is still open
+	if(!config.span_trace_path.empty())
+	{
+		span_trace_stop();
+		span_trace_write(config.span_trace_path);
+	}
+
 	if(config.num_message_consumers)
 	{
 		for(i = 0; i < config.num_message_consumers; i++)
@@ -1311,6 +1409,10 @@ bool AppContext::overlay_graphics(GstBuffer *, NvDsBatchMeta *batch_meta, uint i
 	if(src_index == -1)
 		return true;
 
+	NvDsFrameMeta *frame_meta = nvds_get_nth_frame_meta(batch_meta->frame_meta_list, 0);
+	if(!frame_meta)
+		return true;
+
 	NvDsFrameLatencyInfo *latency_info;
 	NvDsDisplayMeta *display_meta = nvds_acquire_display_meta_from_pool(batch_meta);
 
@@ -1344,7 +1446,220 @@ bool AppContext::overlay_graphics(GstBuffer *, NvDsBatchMeta *batch_meta, uint i
 		display_meta->text_params[1].text_bg_clr = { 0, 0, 0, 1.0 };
 	}
 
-	nvds_add_display_meta_to_frame(nvds_get_nth_frame_meta(batch_meta->frame_meta_list, 0), display_meta);
+	nvds_add_display_meta_to_frame(frame_meta, display_meta);
+	return true;
+}
+
+bool AppContext::add_latency_probes()
+{
+	bool success{};
+	[[maybe_unused]] gulong probe_id;
+	InstanceBin *common_elements{ &pipeline.common_elements };
+	SecondaryGieBin *secondary_gie{ &common_elements->secondary_gie };
+	LatencyTracker *tracker;
+
+	latency_tracker = std::make_unique<LatencyTracker>(
+			std::max<uint>(config.num_source_sub_bins, config.streammux_config.batch_size));
+	tracker = latency_tracker.get();
+
+	if(!config.enable_perf_measurement)
+	{
+		TADS_WARN_MSG_V("Latency histograms are printed with the perf report, enable perf measurement to see them");
+	}
+
+	if(pipeline.multi_src_bin.streammux)
+	{
+		TADS_ELEM_ADD_PROBE(probe_id, pipeline.multi_src_bin.streammux, "src", latency_stage_buf_prob,
+												GST_PAD_PROBE_TYPE_BUFFER, tracker->add_stage("streammux", true));
+	}
+
+	if(config.preprocess_config.enable)
+	{
+		TADS_ELEM_ADD_PROBE(probe_id, common_elements->preprocess.bin, "src", latency_stage_buf_prob,
+												GST_PAD_PROBE_TYPE_BUFFER, tracker->add_stage("preprocess"));
+	}
+
+	if(config.primary_gie_config.enable)
+	{
+		TADS_ELEM_ADD_PROBE(probe_id, common_elements->primary_gie.bin, "src", latency_stage_buf_prob,
+												GST_PAD_PROBE_TYPE_BUFFER, tracker->add_stage("pgie"));
+	}
+
+	if(config.tracker_config.enable)
+	{
+		TADS_ELEM_ADD_PROBE(probe_id, common_elements->tracker.bin, "src", latency_stage_buf_prob,
+												GST_PAD_PROBE_TYPE_BUFFER, tracker->add_stage("tracker"));
+	}
+
+	if(config.analytics_config.enable)
+	{
+		TADS_ELEM_ADD_PROBE(probe_id, common_elements->analytics.bin, "src", latency_stage_buf_prob,
+												GST_PAD_PROBE_TYPE_BUFFER, tracker->add_stage("analytics"));
+	}
+
+	if(config.primary_gie_config.enable && config.num_secondary_gie_sub_bins > 0)
+	{
+		// Secondary infers run in parallel branches, each one is measured from the previous stage
+		for(uint i = 0; i < config.num_secondary_gie_sub_bins; i++)
+		{
+			if(!secondary_gie->sub_bins.at(i).create || !secondary_gie->sub_bins.at(i).gie)
+				continue;
+
+			TADS_ELEM_ADD_PROBE(
+					probe_id, secondary_gie->sub_bins.at(i).gie, "src", latency_stage_buf_prob, GST_PAD_PROBE_TYPE_BUFFER,
+					tracker->add_stage(fmt::format("sgie-{}", config.secondary_gie_sub_bin_configs.at(i).unique_id), false, true));
+		}
+
+		TADS_ELEM_ADD_PROBE(probe_id, secondary_gie->bin, "src", latency_stage_buf_prob, GST_PAD_PROBE_TYPE_BUFFER,
+												tracker->add_stage("sgie"));
+	}
+
+	{
+		LatencyTracker::Stage *osd_stage{ tracker->add_stage("osd") };
+		for(InstanceBin &instance_bin : pipeline.instance_bins)
+		{
+			if(instance_bin.bin && instance_bin.osd.bin)
+			{
+				TADS_ELEM_ADD_PROBE(probe_id, instance_bin.osd.bin, "src", latency_stage_buf_prob, GST_PAD_PROBE_TYPE_BUFFER,
+														osd_stage);
+			}
+		}
+	}
+
+	latency_sink_stage = tracker->add_stage("sink");
+	latency_e2e_stage = tracker->add_stage("end-to-end");
+
+	success = true;
+
+done:
+	return success;
+}
+
+bool AppContext::start_metrics()
+{
+	metrics = std::make_unique<MetricsRegistry>();
+
+	for(SourceBin &sub_bin : pipeline.multi_src_bin.sub_bins)
+	{
+		sub_bin.reconnect_counter = metrics->counter("tads_source_reconnects_total",
+																								 "Resets of the source pipeline after a stall or an error",
+																								 metrics_label("source", std::to_string(sub_bin.source_id)));
+	}
+
+	if(config.enable_perf_measurement)
+		add_perf_metrics(metrics.get(), &perf_struct);
+
+	metrics->add_collector(
+			[this](MetricsWriter &writer)
+			{
+				AnalyticsBin *analytics{ &pipeline.common_elements.analytics };
+				struct Writer
+				{
+					std::string label;
+					uint64_t written, dropped, failed, queue_depth, capacity;
+				};
+				std::vector<Writer> writers;
+
+				if(analytics->writer)
+				{
+					const AnalyticsWriterStats stats{ analytics->writer->stats() };
+					writers.push_back({ metrics_label("writer", "analytics"), stats.written, stats.dropped, stats.failed,
+															stats.queue_depth, config.analytics_config.writer_queue_size });
+				}
+				if(analytics->crop_writer)
+				{
+					const CropWriterStats stats{ analytics->crop_writer->stats() };
+					writers.push_back({ metrics_label("writer", "crops"), stats.written, stats.dropped, stats.failed,
+															stats.queue_depth, config.image_save_config.writer_queue_size });
+				}
+
+				if(!writers.empty())
+				{
+					writer.family("tads_records_written_total", "counter", "Records written by the writer threads");
+					for(const Writer &item : writers)
+						writer.sample("tads_records_written_total", static_cast<double>(item.written), item.label);
+					writer.family("tads_records_dropped_total", "counter", "Records dropped by a full writer queue");
+					for(const Writer &item : writers)
+						writer.sample("tads_records_dropped_total", static_cast<double>(item.dropped), item.label);
+					writer.family("tads_records_failed_total", "counter", "Records that could not be written");
+					for(const Writer &item : writers)
+						writer.sample("tads_records_failed_total", static_cast<double>(item.failed), item.label);
+					writer.family("tads_queue_depth", "gauge", "Records waiting in the writer queue");
+					for(const Writer &item : writers)
+						writer.sample("tads_queue_depth", static_cast<double>(item.queue_depth), item.label);
+					writer.family("tads_queue_capacity", "gauge", "Capacity of the writer queue");
+					for(const Writer &item : writers)
+						writer.sample("tads_queue_capacity", static_cast<double>(item.capacity), item.label);
+				}
+
+				writer.family("tads_analytics_probe_seconds_total", "counter", "Time spent in the analytics probe");
+				writer.sample("tads_analytics_probe_seconds_total",
+											static_cast<double>(analytics->probe_ns_total.load(std::memory_order_relaxed)) / 1e9);
+				writer.family("tads_analytics_probe_batches_total", "counter", "Batches seen by the analytics probe");
+				writer.sample("tads_analytics_probe_batches_total",
+											static_cast<double>(analytics->probe_batches.load(std::memory_order_relaxed)));
+
+				if(analytics->worker)
+				{
+					const AnalyticsWorkerStats stats{ analytics->worker->stats() };
+					writer.family("tads_analytics_batches_total", "counter", "Batches handed to the analytics worker, by result");
+					writer.sample("tads_analytics_batches_total", static_cast<double>(stats.processed),
+												metrics_label("result", "processed"));
+					writer.sample("tads_analytics_batches_total", static_cast<double>(stats.dropped),
+												metrics_label("result", "dropped"));
+					writer.family("tads_analytics_kept_objects_total", "counter",
+												"Objects with a line crossing or a crop kept from the dropped batches");
+					writer.sample("tads_analytics_kept_objects_total", static_cast<double>(stats.kept_objects));
+					writer.family("tads_analytics_queue_depth", "gauge", "Batches waiting for the analytics worker");
+					writer.sample("tads_analytics_queue_depth", static_cast<double>(stats.queue_depth));
+					writer.family("tads_analytics_queue_capacity", "gauge", "Capacity of the analytics worker queue");
+					writer.sample("tads_analytics_queue_capacity", static_cast<double>(stats.capacity));
+				}
+
+				if(analytics->image_scheduler)
+				{
+					const ImageSaveSourceStats totals{ analytics->image_scheduler->totals() };
+					writer.family("tads_image_save_crops_total", "counter", "Crops scheduled for encoding, by decision");
+					writer.sample("tads_image_save_crops_total", static_cast<double>(totals.admitted),
+												metrics_label("decision", "admitted"));
+					writer.sample("tads_image_save_crops_total", static_cast<double>(totals.skipped_rule),
+												metrics_label("decision", "skipped_rule"));
+					writer.sample("tads_image_save_crops_total", static_cast<double>(totals.skipped_rate),
+												metrics_label("decision", "skipped_rate"));
+				}
+
+				if(analytics->retention)
+				{
+					const RetentionStats stats{ analytics->retention->stats() };
+					writer.family("tads_retention_deleted_bytes_total", "counter", "Bytes deleted to stay within the quotas");
+					writer.sample("tads_retention_deleted_bytes_total", static_cast<double>(stats.freed_bytes));
+				}
+
+				if(PlateGate *plate_gate = pipeline.common_elements.secondary_gie.plate_gate.get())
+				{
+					const PlateGateStats stats{ plate_gate->stats() };
+					writer.family("tads_plate_gate_objects_total", "counter",
+												"Vehicles sent to or kept from the secondary GIEs, by decision");
+					writer.sample("tads_plate_gate_objects_total", static_cast<double>(stats.processed),
+												metrics_label("decision", "processed"));
+					writer.sample("tads_plate_gate_objects_total", static_cast<double>(stats.skipped_settled),
+												metrics_label("decision", "skipped_settled"));
+					writer.sample("tads_plate_gate_objects_total", static_cast<double>(stats.skipped_age),
+												metrics_label("decision", "skipped_age"));
+					writer.family("tads_plate_gate_tracks", "gauge", "Tracks followed by the gate");
+					writer.sample("tads_plate_gate_tracks", static_cast<double>(stats.tracks));
+				}
+			});
+
+	if(latency_tracker)
+		add_latency_metrics(metrics.get(), latency_tracker.get());
+
+	metrics_server = std::make_unique<MetricsServer>(config.metrics_address, metrics.get());
+	if(!metrics_server->start())
+	{
+		metrics_server.reset();
+		return false;
+	}
 	return true;
 }
 
@@ -1377,6 +1692,15 @@ bool AppContext::create_common_elements(GstElement **sink_elem, GstElement **src
 				goto done;
 			}
 
+			secondary_gie->plate_gate = create_plate_gate(&config.analytics_config, &pipeline.common_elements.analytics,
+																										config.primary_gie_config.unique_id);
+			if(secondary_gie->plate_gate)
+			{
+				TADS_INFO_MSG_V("Gating the secondary GIEs of the vehicles with a settled plate, score %.2f, "
+												"re-read every %u batches",
+												config.analytics_config.lp_gate_min_score, config.analytics_config.lp_gate_reread_interval);
+			}
+
 #ifdef TADS_APP_DEBUG
 			TADS_DBG_MSG_V("Adding secondary_gie bin to pipeline");
 #endif
@@ -1578,6 +1902,17 @@ bool AppContext::create_common_elements(GstElement **sink_elem, GstElement **src
 			TADS_ERR_MSG_V("Unable to create context");
 			goto done;
 		}
+
+		pipeline.common_elements.analytics.image_scheduler = create_image_save_scheduler(&config.image_save_config);
+		if(!pipeline.common_elements.analytics.image_scheduler)
+			goto done;
+
+		if(config.image_save_config.writer_threads > 0)
+		{
+			pipeline.common_elements.analytics.crop_writer = create_crop_writer(&config.image_save_config);
+			if(!pipeline.common_elements.analytics.crop_writer)
+				goto done;
+		}
 	}
 
 	if(*src_elem)
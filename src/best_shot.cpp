@@ -0,0 +1,57 @@
+#include <algorithm>
+
+#include "best_shot.hpp"
+
+BestShotSelector::BestShotSelector(float peak_tolerance, float edge_margin):
+	m_peak_tolerance{ std::clamp(peak_tolerance, 0.0f, 1.0f) },
+	m_edge_margin{ std::max(edge_margin, 0.0f) }
+{}
+
+float BestShotSelector::score(const BestShotBox &box, float frame_width, float frame_height) const
+{
+	if(frame_width <= 0 || frame_height <= 0 || box.width <= 0 || box.height <= 0)
+		return 0;
+
+	const float area{ std::min(box.width * box.height / (frame_width * frame_height), 1.0f) };
+	const float confidence{ std::clamp(box.confidence, 0.0f, 1.0f) };
+
+	const float edge_distance{ std::min({ box.left, box.top, frame_width - (box.left + box.width),
+																				frame_height - (box.top + box.height) }) };
+	const float margin{ m_edge_margin * std::min(frame_width, frame_height) };
+	const float edge{ margin > 0 ? std::clamp(edge_distance / margin, 0.0f, 1.0f) : 1.0f };
+
+	return area * confidence * edge;
+}
+
+bool BestShotSelector::update(BestShotState &state, const BestShotBox &box, float frame_width, float frame_height,
+															bool armed, bool closing) const
+{
+	if(state.scheduled || !armed)
+		return false;
+
+	const float current{ score(box, frame_width, frame_height) };
+
+	if(closing)
+	{
+		state.best_score = std::max(state.best_score, current);
+		state.scheduled = true;
+		return true;
+	}
+
+	// Still rising, a better frame may follow
+	if(current >= state.best_score)
+	{
+		state.best_score = current;
+		return false;
+	}
+
+	// Just past the peak: this frame is as good as the peak within the tolerance
+	if(current >= state.best_score * (1.0f - m_peak_tolerance))
+	{
+		state.scheduled = true;
+		return true;
+	}
+
+	// Sharp drop, e.g. an occlusion, wait for the object to recover or for the window to close
+	return false;
+}
@@ -2,6 +2,10 @@
 #include <algorithm>
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <sstream>
 #include <unordered_map>
 
 #include "common.hpp"
@@ -237,19 +241,50 @@ done:
 } // namespace gst
 
 std::string get_current_date_time_str(std::string_view format)
+{
+	auto time_point = std::chrono::system_clock::now();
+	return format_date_time_str(
+			std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count(), format);
+}
+
+std::string format_date_time_str(int64_t time_us, std::string_view format)
 {
 	if(format.empty())
 		return "";
 
-	auto time_point = std::chrono::system_clock::now();
-	std::time_t in_time_t = std::chrono::system_clock::to_time_t(time_point);
-
-	std::stringstream ss;
-	ss << std::put_time(std::localtime(&in_time_t), format.data());
-	auto duration =
-			std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()) % std::chrono::seconds{ 1 };
-	ss << fmt::format(".{:06}", duration.count());
-	return ss.str();
+	// Consecutive timestamps mostly share their second, so the localtime and strftime part is cached per thread
+	thread_local std::string cached_format;
+	thread_local std::time_t cached_seconds{ -1 };
+	thread_local std::string prefix;
+
+	const std::time_t seconds = time_us / 1000000;
+	if(seconds != cached_seconds || format != cached_format)
+	{
+		std::tm local_tm{};
+		char buffer[64];
+		localtime_r(&seconds, &local_tm);
+
+		cached_format = format;
+		// strftime returns 0 when the date does not fit, longer formats go through put_time
+		const size_t length{ strftime(buffer, sizeof(buffer), cached_format.c_str(), &local_tm) };
+		if(length > 0)
+		{
+			prefix.assign(buffer, length);
+		}
+		else
+		{
+			std::ostringstream ss;
+			ss << std::put_time(&local_tm, cached_format.c_str());
+			prefix = ss.str();
+		}
+		cached_seconds = seconds;
+	}
+
+	std::string result;
+	result.reserve(prefix.length() + 7);
+	result.append(prefix);
+	fmt::format_to(std::back_inserter(result), ".{:06}", time_us % 1000000);
+	return result;
 }
 
 bool starts_with(std::string_view view, std::string_view prefix) noexcept
@@ -409,4 +444,28 @@ std::string to_cyrillic(const std::string &text)
 	}
 
 	return localized;
+}
+
+size_t to_cyrillic(std::string_view text, char *out, size_t size)
+{
+	size_t length{};
+
+	if(size == 0)
+		return 0;
+
+	for(char c : text)
+	{
+		const char c1 = std::toupper(c);
+		std::string_view localized{ &c1, 1 };
+		if(auto at = CHAR_DICT_MAP.find(c1); at != CHAR_DICT_MAP.end())
+			localized = at->second;
+
+		if(length + localized.size() >= size)
+			break;
+		memcpy(out + length, localized.data(), localized.size());
+		length += localized.size();
+	}
+	out[length] = '\0';
+
+	return length;
 }
\ No newline at end of file
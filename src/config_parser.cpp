@@ -391,10 +391,23 @@ done:
 	return success;
 }
 
+/**
+ * Grows @p configs to hold at least @p count entries, the number of sources
+ * and sinks is only limited by the config file.
+ * */
+template<typename T>
+static void ensure_config_count(std::vector<T> &configs, size_t count)
+{
+	if(configs.size() < count)
+		configs.resize(count);
+}
+
 static bool set_source_all_configs(AppConfig *config, std::string_view cfg_file_path)
 {
 	SourceConfig *multi_source_config;
 
+	ensure_config_count(config->multi_source_configs, config->total_num_sources);
+
 	for(uint i{}; i < config->total_num_sources; i++)
 	{
 		multi_source_config = &config->multi_source_configs.at(i);
@@ -580,6 +593,7 @@ bool ConfigParser::parse_ini(AppConfig *config)
 		}
 		config->num_source_sub_bins = config->total_num_sources;
 		config->source_list_enabled = true;
+		ensure_config_count(config->multi_source_configs, config->total_num_sources);
 		if(!glib::key_file_has_group(m_key_file, CONFIG_GROUP_SOURCE_ALL))
 		{
 			TADS_ERR_MSG_V("[source-attr-all] group not present.");
@@ -598,12 +612,6 @@ bool ConfigParser::parse_ini(AppConfig *config)
 
 		if(starts_with(group_name, CONFIG_GROUP_SOURCE))
 		{
-			if(config->num_source_sub_bins == MAX_SOURCE_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-				success = false;
-				goto done;
-			}
 			std::string_view index_str = get_suffix(group_name, CONFIG_GROUP_SOURCE);
 			if(index_str.empty())
 			{
@@ -629,6 +637,7 @@ bool ConfigParser::parse_ini(AppConfig *config)
 			{
 				source_id = config->num_source_sub_bins;
 			}
+			ensure_config_count(config->multi_source_configs, source_id + 1);
 			/**  set gpu_id for source component using global_gpu_id(if available) */
 			if(config->global_gpu_id != -1)
 			{
@@ -742,12 +751,7 @@ bool ConfigParser::parse_ini(AppConfig *config)
 		}
 		else if(starts_with(group_name, CONFIG_GROUP_SINK))
 		{
-			if(config->num_sink_sub_bins == MAX_SINK_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sinks", MAX_SINK_BINS);
-				success = false;
-				goto done;
-			}
+			ensure_config_count(config->sink_bin_sub_bin_configs, config->num_sink_sub_bins + 1);
 			/** set gpu_id for sink component using global_gpu_id(if available) */
 			if(config->global_gpu_id != -1)
 			{
@@ -866,15 +870,12 @@ bool ConfigParser::parse_ini(AppConfig *config)
 			{
 				multi_source_config->num_sources = 1;
 			}
+			// Growing the list may move the config being expanded
+			ensure_config_count(config->multi_source_configs,
+													config->num_source_sub_bins + multi_source_config->num_sources - 1);
+			multi_source_config = &config->multi_source_configs.at(i);
 			for(j = 1; j < multi_source_config->num_sources; j++)
 			{
-				if(config->num_source_sub_bins == MAX_SOURCE_BINS)
-				{
-					TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-					success = false;
-					goto done;
-				}
-
 				config->multi_source_configs[config->num_source_sub_bins] = { *multi_source_config };
 				config->multi_source_configs[config->num_source_sub_bins].type = SourceType::URI;
 				config->multi_source_configs[config->num_source_sub_bins].uri =
@@ -941,13 +942,8 @@ bool ConfigParser::parse_yaml(AppConfig *config)
 					SourceConfig *multi_source_config;
 					std::vector<std::string> source_values = split_csv_entries(line);
 
-					if(config->num_source_sub_bins == MAX_SOURCE_BINS)
-					{
-						TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-						success = false;
-						goto done;
-					}
 					size_t source_id{ config->num_source_sub_bins };
+					ensure_config_count(config->multi_source_configs, source_id + 1);
 					multi_source_config = &config->multi_source_configs.at(source_id);
 					/** set gpu_id for source component using global_gpu_id(if available) */
 					if(config->global_gpu_id != -1)
@@ -1041,12 +1037,7 @@ bool ConfigParser::parse_yaml(AppConfig *config)
 		}
 		else if(starts_with(group, CONFIG_GROUP_SINK))
 		{
-			if(config->num_sink_sub_bins == MAX_SINK_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sinks", MAX_SINK_BINS);
-				success = false;
-				goto done;
-			}
+			ensure_config_count(config->sink_bin_sub_bin_configs, config->num_sink_sub_bins + 1);
 
 			node = m_file_yml[group];
 
@@ -1165,15 +1156,12 @@ bool ConfigParser::parse_yaml(AppConfig *config)
 			{
 				multi_source_config->num_sources = 1;
 			}
+			// Growing the list may move the config being expanded
+			ensure_config_count(config->multi_source_configs,
+													config->num_source_sub_bins + multi_source_config->num_sources - 1);
+			multi_source_config = &config->multi_source_configs.at(i);
 			for(j = 1; j < multi_source_config->num_sources; j++)
 			{
-				if(config->num_source_sub_bins == MAX_SOURCE_BINS)
-				{
-					TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-					success = false;
-					goto done;
-				}
-
 				config->multi_source_configs[config->num_source_sub_bins] = { *multi_source_config };
 				config->multi_source_configs[config->num_source_sub_bins].type = SourceType::URI;
 				config->multi_source_configs[config->num_source_sub_bins].uri =
@@ -1297,6 +1285,31 @@ bool ConfigParser::parse_app(AppConfig *config)
 			CHECK_ERROR(error)
 #ifdef TADS_CONFIG_PARSER_DEBUG
 			TADS_DBG_MSG_V("set config '%s=%s'", key.data(), config->shadow_track_output_path.c_str());
+#endif
+		}
+		else if(key == CONFIG_GROUP_APP_METRICS_ADDRESS)
+		{
+			config->metrics_address = glib::key_file_get_string(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%s'", key.data(), config->metrics_address.c_str());
+#endif
+		}
+		else if(key == CONFIG_GROUP_APP_SPAN_TRACE_PATH)
+		{
+			config->span_trace_path = get_absolute_file_path(
+					m_file_path, glib::key_file_get_string(m_key_file, group_name, key, &error));
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%s'", key.data(), config->span_trace_path.c_str());
+#endif
+		}
+		else if(key == CONFIG_GROUP_APP_SPAN_TRACE_BUFFER_SPANS)
+		{
+			config->span_trace_buffer_spans = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->span_trace_buffer_spans);
 #endif
 		}
 		else
@@ -1371,6 +1384,19 @@ bool ConfigParser::parse_app_yaml(AppConfig *config)
 			auto file_path = itr->second.as<std::string>();
 			get_absolute_file_path_yaml(m_file_path, file_path, config->shadow_track_output_path);
 		}
+		else if(key == CONFIG_GROUP_APP_METRICS_ADDRESS)
+		{
+			config->metrics_address = itr->second.as<std::string>();
+		}
+		else if(key == CONFIG_GROUP_APP_SPAN_TRACE_PATH)
+		{
+			auto file_path = itr->second.as<std::string>();
+			get_absolute_file_path_yaml(m_file_path, file_path, config->span_trace_path);
+		}
+		else if(key == CONFIG_GROUP_APP_SPAN_TRACE_BUFFER_SPANS)
+		{
+			config->span_trace_buffer_spans = itr->second.as<uint>();
+		}
 		else
 		{
 			TADS_WARN_MSG_V("Unknown key '%s' for group '%s'", key.c_str(), group_name);
@@ -1988,33 +2014,18 @@ bool ConfigParser::parse_source_list(AppConfig *config)
 		{
 			config->uri_list = glib::key_file_get_string_list(m_key_file, CONFIG_GROUP_SOURCE_LIST,
 																												CONFIG_GROUP_SOURCE_LIST_URI_LIST, &num_strings, &error);
-			if(num_strings > MAX_SOURCE_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-				goto done;
-			}
 			CHECK_ERROR(error)
 		}
 		else if(key == CONFIG_GROUP_SOURCE_LIST_SENSOR_ID_LIST)
 		{
 			config->sensor_id_list = glib::key_file_get_string_list(
 					m_key_file, CONFIG_GROUP_SOURCE_LIST, CONFIG_GROUP_SOURCE_LIST_SENSOR_ID_LIST, &num_strings, &error);
-			if(num_strings > MAX_SOURCE_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-				goto done;
-			}
 			CHECK_ERROR(error)
 		}
 		else if(key == CONFIG_GROUP_SOURCE_LIST_SENSOR_NAME_LIST)
 		{
 			config->sensor_name_list = glib::key_file_get_string_list(
 					m_key_file, CONFIG_GROUP_SOURCE_LIST, CONFIG_GROUP_SOURCE_LIST_SENSOR_NAME_LIST, &num_strings, &error);
-			if(num_strings > MAX_SOURCE_BINS)
-			{
-				TADS_ERR_MSG_V("App supports max %ld sources", MAX_SOURCE_BINS);
-				goto done;
-			}
 			CHECK_ERROR(error)
 		}
 		else if(key == CONFIG_GROUP_SOURCE_LIST_USE_NVMULTIURISRCBIN)
@@ -3346,6 +3357,161 @@ bool ConfigParser::parse_analytics(AnalyticsConfig *config)
 			CHECK_ERROR(error)
 #ifdef TADS_CONFIG_PARSER_DEBUG
 			TADS_DBG_MSG_V("set config '%s=%f'", key.data(), config->lp_min_length);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_SETTLE_READS)
+		{
+			config->lp_settle_reads = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->lp_settle_reads);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_SETTLE_SCORE)
+		{
+			config->lp_settle_score = glib::key_file_get_double(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%f'", key.data(), config->lp_settle_score);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_ENABLE)
+		{
+			config->lp_gate_enable = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%d'", key.data(), config->lp_gate_enable);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_MIN_SCORE)
+		{
+			config->lp_gate_min_score = glib::key_file_get_double(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%f'", key.data(), config->lp_gate_min_score);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_REREAD_INTERVAL)
+		{
+			config->lp_gate_reread_interval = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->lp_gate_reread_interval);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_MAX_TRACK_AGE)
+		{
+			config->lp_gate_max_track_age = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->lp_gate_max_track_age);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_QUEUE_SIZE)
+		{
+			config->writer_queue_size = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->writer_queue_size);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_OVERFLOW_POLICY)
+		{
+			config->writer_overflow_policy =
+					static_cast<WriterOverflowPolicy>(glib::key_file_get_integer(m_key_file, group_name, key, &error));
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), static_cast<uint>(config->writer_overflow_policy));
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_FLUSH_INTERVAL)
+		{
+			config->writer_flush_interval_ms = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->writer_flush_interval_ms);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_OUTPUT_FORMAT)
+		{
+			config->output_format =
+					static_cast<AnalyticsOutputFormat>(glib::key_file_get_integer(m_key_file, group_name, key, &error));
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), static_cast<uint>(config->output_format));
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_TRACK_TTL_FRAMES)
+		{
+			config->track_ttl_frames = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->track_ttl_frames);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_ASYNC_QUEUE_SIZE)
+		{
+			config->async_queue_size = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->async_queue_size);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_META_TRACE_PATH)
+		{
+			std::string meta_trace_path = glib::key_file_get_string(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+			config->meta_trace_path = get_absolute_file_path(m_file_path, meta_trace_path);
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%s'", key.data(), config->meta_trace_path.c_str());
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_SIZE)
+		{
+			config->retention_events_max_mb = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_events_max_mb);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_DAYS)
+		{
+			config->retention_events_max_days = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_events_max_days);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_SIZE)
+		{
+			config->retention_crops_max_mb = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_crops_max_mb);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_DAYS)
+		{
+			config->retention_crops_max_days = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_crops_max_days);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_INTERVAL)
+		{
+			config->retention_interval_s = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_interval_s);
+#endif
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_SCAN_BUDGET)
+		{
+			config->retention_scan_budget = glib::key_file_get_integer(m_key_file, group_name, key, &error);
+			CHECK_ERROR(error)
+#ifdef TADS_CONFIG_PARSER_DEBUG
+			TADS_DBG_MSG_V("set config '%s=%u'", key.data(), config->retention_scan_budget);
 #endif
 		}
 		else
@@ -3406,6 +3572,87 @@ bool ConfigParser::parse_analytics_yaml(AnalyticsConfig *config)
 		{
 			config->lp_min_length = itr->second.as<int>();
 		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_SETTLE_READS)
+		{
+			config->lp_settle_reads = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_SETTLE_SCORE)
+		{
+			config->lp_settle_score = itr->second.as<double>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_ENABLE)
+		{
+			config->lp_gate_enable = itr->second.as<bool>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_MIN_SCORE)
+		{
+			config->lp_gate_min_score = itr->second.as<double>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_REREAD_INTERVAL)
+		{
+			config->lp_gate_reread_interval = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_LP_GATE_MAX_TRACK_AGE)
+		{
+			config->lp_gate_max_track_age = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_QUEUE_SIZE)
+		{
+			config->writer_queue_size = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_OVERFLOW_POLICY)
+		{
+			config->writer_overflow_policy = static_cast<WriterOverflowPolicy>(itr->second.as<uint>());
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_WRITER_FLUSH_INTERVAL)
+		{
+			config->writer_flush_interval_ms = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_OUTPUT_FORMAT)
+		{
+			config->output_format = static_cast<AnalyticsOutputFormat>(itr->second.as<uint>());
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_TRACK_TTL_FRAMES)
+		{
+			config->track_ttl_frames = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_ASYNC_QUEUE_SIZE)
+		{
+			config->async_queue_size = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_META_TRACE_PATH)
+		{
+			auto temp = itr->second.as<std::string>();
+			if(!get_absolute_file_path_yaml(m_file_path, temp, config->meta_trace_path))
+			{
+				TADS_ERR_MSG_V("Could not parse '%s' in group '%s'", key.c_str(), group_name);
+				goto done;
+			}
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_SIZE)
+		{
+			config->retention_events_max_mb = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_EVENTS_MAX_DAYS)
+		{
+			config->retention_events_max_days = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_SIZE)
+		{
+			config->retention_crops_max_mb = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_CROPS_MAX_DAYS)
+		{
+			config->retention_crops_max_days = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_INTERVAL)
+		{
+			config->retention_interval_s = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_ANALYTICS_RETENTION_SCAN_BUDGET)
+		{
+			config->retention_scan_budget = itr->second.as<uint>();
+		}
 		else
 		{
 			TADS_WARN_MSG_V("Unknown param '%s' found in group '%s'", key.c_str(), group_name);
@@ -4837,7 +5084,8 @@ bool ConfigParser::parse_image_save(ImageSaveConfig *config, std::string_view gr
 		}
 		else if(key == CONFIG_GROUP_IMG_SAVE_CSV_TIME_RULES_PATH)
 		{
-			config->frame_to_skip_rules_path = glib::key_file_get_string(m_key_file, group, key, &error);
+			std::string rules_path = glib::key_file_get_string(m_key_file, group, key, &error);
+			config->frame_to_skip_rules_path = get_absolute_file_path(m_file_path, rules_path);
 			CHECK_ERROR(error)
 		}
 		else if(key == CONFIG_GROUP_IMG_SAVE_CROPPED_OBJECT_IMG_SAVE)
@@ -4850,6 +5098,58 @@ bool ConfigParser::parse_image_save(ImageSaveConfig *config, std::string_view gr
 			config->second_to_skip_interval = glib::key_file_get_double(m_key_file, group, key, &error);
 			CHECK_ERROR(error)
 		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_MAX_CROPS_PER_INTERVAL)
+		{
+			config->max_crops_per_interval = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_THREADS)
+		{
+			config->writer_threads = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_QUEUE_SIZE)
+		{
+			config->writer_queue_size = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_SLAB_SIZE)
+		{
+			config->writer_slab_size_kb = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_OVERFLOW_POLICY)
+		{
+			config->writer_overflow_policy =
+					static_cast<WriterOverflowPolicy>(glib::key_file_get_integer(m_key_file, group, key, &error));
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_SYNC_POLICY)
+		{
+			config->writer_sync_policy =
+					static_cast<CropSyncPolicy>(glib::key_file_get_integer(m_key_file, group, key, &error));
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_DIRECT_IO)
+		{
+			config->writer_direct_io = glib::key_file_get_boolean(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_CROPS)
+		{
+			config->archive_crops = glib::key_file_get_boolean(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_SIZE)
+		{
+			config->archive_max_size_mb = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_AGE)
+		{
+			config->archive_max_age_s = glib::key_file_get_integer(m_key_file, group, key, &error);
+			CHECK_ERROR(error)
+		}
 		else if(key == CONFIG_GROUP_IMG_SAVE_QUALITY)
 		{
 			config->quality = glib::key_file_get_integer(m_key_file, group, key, &error);
@@ -4927,6 +5227,46 @@ bool ConfigParser::parse_image_save_yaml(ImageSaveConfig *config)
 		{
 			config->second_to_skip_interval = itr->second.as<uint>();
 		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_MAX_CROPS_PER_INTERVAL)
+		{
+			config->max_crops_per_interval = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_THREADS)
+		{
+			config->writer_threads = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_QUEUE_SIZE)
+		{
+			config->writer_queue_size = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_SLAB_SIZE)
+		{
+			config->writer_slab_size_kb = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_OVERFLOW_POLICY)
+		{
+			config->writer_overflow_policy = static_cast<WriterOverflowPolicy>(itr->second.as<uint>());
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_SYNC_POLICY)
+		{
+			config->writer_sync_policy = static_cast<CropSyncPolicy>(itr->second.as<uint>());
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_WRITER_DIRECT_IO)
+		{
+			config->writer_direct_io = itr->second.as<bool>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_CROPS)
+		{
+			config->archive_crops = itr->second.as<bool>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_SIZE)
+		{
+			config->archive_max_size_mb = itr->second.as<uint>();
+		}
+		else if(key == CONFIG_GROUP_IMG_SAVE_ARCHIVE_MAX_AGE)
+		{
+			config->archive_max_age_s = itr->second.as<uint>();
+		}
 		else if(key == CONFIG_GROUP_IMG_SAVE_QUALITY)
 		{
 			config->quality = itr->second.as<uint>();
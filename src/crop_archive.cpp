@@ -0,0 +1,392 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+
+#include "common.hpp"
+#include "crop_archive.hpp"
+
+static constexpr char INDEX_MAGIC[8]{ 'T', 'A', 'D', 'S', 'C', 'R', 'P', 'X' };
+
+static constexpr const char *ARCHIVE_PREFIX{ "crops_" };
+static constexpr const char *ARCHIVE_EXTENSION{ ".tar" };
+static constexpr const char *INDEX_EXTENSION{ ".idx" };
+
+static constexpr size_t TAR_BLOCK_SIZE{ 512 };
+static constexpr char TAR_ZERO_BLOCKS[2 * TAR_BLOCK_SIZE]{};
+
+/**
+ * POSIX ustar member header.
+ * */
+struct TarHeader
+{
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char checksum[8];
+	char type_flag;
+	char link_name[100];
+	char magic[6];
+	char version[2];
+	char user_name[32];
+	char group_name[32];
+	char dev_major[8];
+	char dev_minor[8];
+	char prefix[155];
+	char padding[12];
+};
+
+static_assert(sizeof(TarHeader) == TAR_BLOCK_SIZE, "TarHeader is one tar block");
+
+static uint64_t tar_padded(uint64_t size)
+{
+	return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+}
+
+static void make_tar_header(TarHeader &header, const std::string &name, uint64_t size, int64_t time_us)
+{
+	memset(&header, 0, sizeof(header));
+	snprintf(header.name, sizeof(header.name), "%s", name.c_str());
+	snprintf(header.mode, sizeof(header.mode), "%07o", 0644);
+	snprintf(header.uid, sizeof(header.uid), "%07o", 0);
+	snprintf(header.gid, sizeof(header.gid), "%07o", 0);
+	// The size and time fields keep their terminating NUL from the memset
+	fmt::format_to_n(header.size, sizeof(header.size) - 1, "{:011o}", size);
+	fmt::format_to_n(header.mtime, sizeof(header.mtime) - 1, "{:011o}", std::max<int64_t>(time_us, 0) / 1000000);
+	header.type_flag = '0';
+	memcpy(header.magic, "ustar", 6);
+	memcpy(header.version, "00", 2);
+
+	// The checksum is computed with its own field filled with spaces
+	memset(header.checksum, ' ', sizeof(header.checksum));
+	unsigned int checksum{};
+	for(size_t i = 0; i < sizeof(header); ++i)
+		checksum += reinterpret_cast<const unsigned char *>(&header)[i];
+	snprintf(header.checksum, sizeof(header.checksum), "%06o", checksum);
+	header.checksum[7] = ' ';
+}
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+	const char *bytes{ static_cast<const char *>(data) };
+
+	while(size > 0)
+	{
+		ssize_t written = write(fd, bytes, size);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		bytes += written;
+		size -= written;
+	}
+	return true;
+}
+
+CropArchiveWriter::CropArchiveWriter(uint64_t max_bytes, int64_t max_age_us):
+	m_max_bytes{ max_bytes },
+	m_max_age_us{ max_age_us }
+{}
+
+CropArchiveWriter::~CropArchiveWriter()
+{
+	close();
+}
+
+bool CropArchiveWriter::open_archive(const std::string &folder, int64_t time_us)
+{
+	std::time_t seconds = time_us / 1000000;
+	std::tm local_tm{};
+	char time_str[16];
+	std::string base_path;
+
+	localtime_r(&seconds, &local_tm);
+	strftime(time_str, sizeof(time_str), "%H%M%S", &local_tm);
+
+	// O_EXCL picks the next free sequence number, archives are never appended to after a restart
+	for(uint sequence = 0; m_archive_fd < 0; ++sequence)
+	{
+		base_path = fmt::format("{}/{}{}_{}", folder, ARCHIVE_PREFIX, time_str, sequence);
+		m_archive_fd = ::open((base_path + ARCHIVE_EXTENSION).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if(m_archive_fd < 0 && errno != EEXIST)
+		{
+			TADS_ERR_MSG_V("Could not create crop archive '%s%s': %s", base_path.c_str(), ARCHIVE_EXTENSION,
+										 strerror(errno));
+			return false;
+		}
+	}
+
+	m_index_fd = ::open((base_path + INDEX_EXTENSION).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if(m_index_fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not create crop index '%s%s': %s", base_path.c_str(), INDEX_EXTENSION, strerror(errno));
+		::close(m_archive_fd);
+		m_archive_fd = -1;
+		return false;
+	}
+
+	EventSegmentHeader header{};
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = EventSegmentHeader::VERSION;
+	header.entry_size = sizeof(CropIndexEntry);
+	if(!write_all(m_index_fd, &header, sizeof(header)))
+	{
+		TADS_ERR_MSG_V("Could not write crop index '%s%s': %s", base_path.c_str(), INDEX_EXTENSION, strerror(errno));
+		close();
+		return false;
+	}
+
+#ifdef TADS_CROP_WRITER_DEBUG
+	TADS_DBG_MSG_V("Opened crop archive '%s%s'", base_path.c_str(), ARCHIVE_EXTENSION);
+#endif
+	m_files_created.fetch_add(2, std::memory_order_relaxed);
+	m_folder = folder;
+	m_archive_size = 0;
+	m_open_time_us = time_us;
+	return true;
+}
+
+bool CropArchiveWriter::append(const std::string &filename, const CropInfo &info, const char *data, size_t size)
+{
+	const size_t separator{ filename.rfind('/') };
+	const std::string folder{ separator == std::string::npos ? "." : filename.substr(0, separator) };
+	const std::string name{ separator == std::string::npos ? filename : filename.substr(separator + 1) };
+	const uint64_t member_size{ TAR_BLOCK_SIZE + tar_padded(size) };
+
+	const bool full{ m_archive_size > 0 && m_archive_size + member_size > m_max_bytes };
+	const bool expired{ m_max_age_us > 0 && info.time_us - m_open_time_us >= m_max_age_us };
+	if(m_archive_fd < 0 || folder != m_folder || full || expired)
+	{
+		close();
+		if(!open_archive(folder, info.time_us))
+			return false;
+	}
+
+	TarHeader header;
+	make_tar_header(header, name, size, info.time_us);
+
+	iovec parts[3]{
+		{ &header, sizeof(header) },
+		{ const_cast<char *>(data), size },
+		{ const_cast<char *>(TAR_ZERO_BLOCKS), tar_padded(size) - size },
+	};
+	ssize_t written;
+	do
+	{
+		written = writev(m_archive_fd, parts, 3);
+	} while(written < 0 && errno == EINTR);
+
+	if(written != static_cast<ssize_t>(member_size))
+	{
+		TADS_ERR_MSG_V("Could not append '%s' to the crop archive: %s", name.c_str(),
+									 written < 0 ? strerror(errno) : "short write");
+		// Cut the partial member so that the archive stays readable
+		if(ftruncate(m_archive_fd, static_cast<off_t>(m_archive_size)) != 0 ||
+			 lseek(m_archive_fd, static_cast<off_t>(m_archive_size), SEEK_SET) < 0)
+			close();
+		return false;
+	}
+
+	m_pending_index.push_back(CropIndexEntry{ info.time_us, info.object_id, m_archive_size + TAR_BLOCK_SIZE,
+																						info.source_id, static_cast<uint32_t>(size) });
+	m_archive_size += member_size;
+	return true;
+}
+
+bool CropArchiveWriter::flush(bool sync)
+{
+	if(m_index_fd < 0)
+		return m_pending_index.empty();
+
+	bool success{ write_all(m_index_fd, m_pending_index.data(), m_pending_index.size() * sizeof(CropIndexEntry)) };
+	if(!success)
+		TADS_ERR_MSG_V("Could not write the crop index: %s", strerror(errno));
+	m_pending_index.clear();
+
+	if(sync && (fdatasync(m_archive_fd) != 0 || fdatasync(m_index_fd) != 0))
+	{
+		TADS_ERR_MSG_V("Could not sync the crop archive: %s", strerror(errno));
+		success = false;
+	}
+
+	return success;
+}
+
+void CropArchiveWriter::close()
+{
+	if(m_archive_fd >= 0)
+	{
+		flush(false);
+		// End of archive marker
+		if(!write_all(m_archive_fd, TAR_ZERO_BLOCKS, sizeof(TAR_ZERO_BLOCKS)))
+			TADS_ERR_MSG_V("Could not terminate the crop archive: %s", strerror(errno));
+		::close(m_archive_fd);
+		m_archive_fd = -1;
+	}
+	if(m_index_fd >= 0)
+	{
+		::close(m_index_fd);
+		m_index_fd = -1;
+	}
+	m_pending_index.clear();
+	m_folder.clear();
+	m_archive_size = 0;
+}
+
+CropArchiveReader::~CropArchiveReader()
+{
+	close();
+}
+
+static const char *map_file(const std::string &path, size_t &size)
+{
+	struct stat st{};
+	void *data;
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	size = 0;
+	if(fd < 0)
+		return nullptr;
+
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return nullptr;
+	}
+
+	data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+	{
+		TADS_ERR_MSG_V("Could not map '%s': %s", path.c_str(), strerror(errno));
+		return nullptr;
+	}
+
+	size = st.st_size;
+	return static_cast<const char *>(data);
+}
+
+bool CropArchiveReader::open(const std::string &archive_path)
+{
+	const std::string base_path{ ends_with(archive_path, ARCHIVE_EXTENSION)
+																	 ? archive_path.substr(0, archive_path.size() - strlen(ARCHIVE_EXTENSION))
+																	 : archive_path };
+	EventSegmentHeader header{};
+
+	close();
+
+	m_index = map_file(base_path + INDEX_EXTENSION, m_index_size);
+	if(!m_index || m_index_size < sizeof(header))
+	{
+		TADS_ERR_MSG_V("Could not open crop index '%s%s'", base_path.c_str(), INDEX_EXTENSION);
+		close();
+		return false;
+	}
+
+	memcpy(&header, m_index, sizeof(header));
+	if(memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 || header.version != EventSegmentHeader::VERSION ||
+		 header.entry_size != sizeof(CropIndexEntry))
+	{
+		TADS_ERR_MSG_V("'%s%s' is not a crop index of version %u", base_path.c_str(), INDEX_EXTENSION,
+									 EventSegmentHeader::VERSION);
+		close();
+		return false;
+	}
+
+	// An archive still empty cannot be mapped, its index has no entries either
+	m_archive = map_file(base_path + ARCHIVE_EXTENSION, m_archive_size);
+	m_entries = reinterpret_cast<const CropIndexEntry *>(m_index + sizeof(header));
+	m_num_entries = (m_index_size - sizeof(header)) / sizeof(CropIndexEntry);
+	m_num_entries = std::find_if(m_entries, m_entries + m_num_entries,
+															 [this](const CropIndexEntry &entry)
+															 {
+																 return entry.offset < TAR_BLOCK_SIZE || entry.offset + entry.size > m_archive_size;
+															 }) -
+									m_entries;
+
+	return true;
+}
+
+void CropArchiveReader::close()
+{
+	if(m_archive)
+		munmap(const_cast<char *>(m_archive), m_archive_size);
+	if(m_index)
+		munmap(const_cast<char *>(m_index), m_index_size);
+	m_archive = nullptr;
+	m_archive_size = 0;
+	m_index = nullptr;
+	m_index_size = 0;
+	m_entries = nullptr;
+	m_num_entries = 0;
+}
+
+std::string_view CropArchiveReader::name(size_t i) const
+{
+	const auto *header = reinterpret_cast<const TarHeader *>(m_archive + m_entries[i].offset - TAR_BLOCK_SIZE);
+	return { header->name, strnlen(header->name, sizeof(header->name)) };
+}
+
+std::string_view CropArchiveReader::data(size_t i) const
+{
+	return { m_archive + m_entries[i].offset, m_entries[i].size };
+}
+
+/**
+ * Orders day folders, named ddmmyyyy, by date and anything else after them by name.
+ * */
+static std::string archive_sort_key(const std::filesystem::path &path)
+{
+	const std::string folder{ path.parent_path().filename().string() };
+	std::string key{ folder };
+
+	if(folder.size() == 8 && std::all_of(folder.cbegin(), folder.cend(), ::isdigit))
+		key = folder.substr(4, 4) + folder.substr(2, 2) + folder.substr(0, 2);
+
+	return key + "/" + path.filename().string();
+}
+
+std::vector<std::string> list_crop_archives(const std::string &root_path)
+{
+	std::vector<std::filesystem::path> archives;
+	std::error_code ec;
+
+	auto add_archives = [&archives](const std::filesystem::path &folder)
+	{
+		std::error_code ec;
+		for(const auto &entry : std::filesystem::directory_iterator(folder, ec))
+		{
+			const std::string name{ entry.path().filename().string() };
+			if(entry.is_regular_file(ec) && starts_with(name, ARCHIVE_PREFIX) && ends_with(name, ARCHIVE_EXTENSION))
+				archives.push_back(entry.path());
+		}
+	};
+
+	add_archives(root_path);
+	for(const auto &entry : std::filesystem::directory_iterator(root_path, ec))
+	{
+		if(entry.is_directory(ec))
+			add_archives(entry.path());
+	}
+
+	std::sort(archives.begin(), archives.end(),
+						[](const std::filesystem::path &a, const std::filesystem::path &b)
+						{ return archive_sort_key(a) < archive_sort_key(b); });
+
+	std::vector<std::string> paths;
+	paths.reserve(archives.size());
+	for(const std::filesystem::path &path : archives)
+		paths.push_back(path.string());
+	return paths;
+}
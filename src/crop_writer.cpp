@@ -0,0 +1,312 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "common.hpp"
+#include "crop_writer.hpp"
+#include "span_trace.hpp"
+
+static size_t align_up(size_t size)
+{
+	return (size + CropWriter::SLAB_ALIGNMENT - 1) / CropWriter::SLAB_ALIGNMENT * CropWriter::SLAB_ALIGNMENT;
+}
+
+CropWriter::CropWriter(uint thread_count, size_t slab_count, size_t slab_size, WriterOverflowPolicy policy,
+											 CropSyncPolicy sync_policy, bool direct_io, size_t batch_size):
+	m_thread_count{ thread_count > 0 ? thread_count : 1 },
+	m_slab_size{ align_up(slab_size > 0 ? slab_size : 1) },
+	m_batch_size{ batch_size > 0 ? batch_size : 1 },
+	m_policy{ policy },
+	m_sync_policy{ sync_policy },
+	m_direct_io{ direct_io }
+{
+	if(slab_count == 0)
+		slab_count = 1;
+
+	m_slabs.reset(static_cast<char *>(std::aligned_alloc(SLAB_ALIGNMENT, slab_count * m_slab_size)));
+	if(!m_slabs)
+	{
+		TADS_ERR_MSG_V("Could not allocate %lu crop slabs of %lu bytes", slab_count, m_slab_size);
+		return;
+	}
+
+	m_free_slabs.reserve(slab_count);
+	for(size_t i = 0; i < slab_count; ++i)
+		m_free_slabs.push_back(m_slabs.get() + i * m_slab_size);
+}
+
+CropWriter::~CropWriter()
+{
+	stop();
+}
+
+void CropWriter::set_archive(std::unique_ptr<CropArchiveWriter> archive)
+{
+	std::lock_guard<std::mutex> lock(m_archive_lock);
+	m_archive = std::move(archive);
+}
+
+bool CropWriter::start()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_running)
+		return true;
+	if(!m_slabs)
+		return false;
+
+	m_running = true;
+	for(uint i = 0; i < m_thread_count; ++i)
+		m_threads.emplace_back(&CropWriter::run, this);
+	return true;
+}
+
+void CropWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(!m_running)
+			return;
+		m_running = false;
+	}
+	m_not_empty.notify_all();
+	m_slab_free.notify_all();
+
+	for(std::thread &thread : m_threads)
+	{
+		if(thread.joinable())
+			thread.join();
+	}
+	m_threads.clear();
+
+	std::lock_guard<std::mutex> lock(m_archive_lock);
+	if(m_archive)
+		m_archive->close();
+}
+
+bool CropWriter::submit(const std::string &filename, const CropInfo &info, const void *data, size_t size)
+{
+	TADS_TRACE_SPAN("crop_writer_submit");
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	if(!m_running || size > m_slab_size)
+	{
+#ifdef TADS_CROP_WRITER_DEBUG
+		if(size > m_slab_size)
+			TADS_DBG_MSG_V("Crop '%s' of %lu bytes does not fit a %lu bytes slab", filename.c_str(), size, m_slab_size);
+#endif
+		m_dropped++;
+		return false;
+	}
+
+	if(m_free_slabs.empty())
+	{
+		switch(m_policy)
+		{
+			case WriterOverflowPolicy::BLOCK:
+				m_slab_free.wait(lock, [this] { return !m_free_slabs.empty() || !m_running; });
+				if(!m_running)
+				{
+					m_dropped++;
+					return false;
+				}
+				break;
+			case WriterOverflowPolicy::DROP_OLDEST:
+				// Slabs already taken by a worker cannot be reclaimed, the new crop is dropped then
+				if(!m_queue.empty())
+				{
+					m_free_slabs.push_back(m_queue.front().slab);
+					m_queue.pop_front();
+					m_dropped++;
+					break;
+				}
+				[[fallthrough]];
+			case WriterOverflowPolicy::DROP_NEWEST:
+			default:
+				m_dropped++;
+				return false;
+		}
+	}
+
+	char *slab{ m_free_slabs.back() };
+	m_free_slabs.pop_back();
+
+	// The copy runs unlocked, the slab belongs to this producer until it is queued
+	lock.unlock();
+	memcpy(slab, data, size);
+	lock.lock();
+
+	m_queue.push_back(Job{ filename, info, slab, size });
+	m_queued++;
+
+	const uint64_t depth{ m_queue.size() };
+	m_queue_depth.store(depth, std::memory_order_relaxed);
+	if(depth > m_max_queue_depth.load(std::memory_order_relaxed))
+		m_max_queue_depth.store(depth, std::memory_order_relaxed);
+	lock.unlock();
+
+	m_not_empty.notify_one();
+	return true;
+}
+
+CropWriterStats CropWriter::stats() const
+{
+	CropWriterStats stats{};
+	stats.queued = m_queued.load(std::memory_order_relaxed);
+	stats.written = m_written.load(std::memory_order_relaxed);
+	stats.dropped = m_dropped.load(std::memory_order_relaxed);
+	stats.failed = m_failed.load(std::memory_order_relaxed);
+	stats.bytes = m_bytes.load(std::memory_order_relaxed);
+	stats.files = m_files.load(std::memory_order_relaxed);
+	stats.batches = m_batches.load(std::memory_order_relaxed);
+	stats.max_queue_depth = m_max_queue_depth.load(std::memory_order_relaxed);
+	stats.queue_depth = m_queue_depth.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void CropWriter::run()
+{
+	std::vector<Job> batch;
+	batch.reserve(m_batch_size);
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_not_empty.wait(lock, [this] { return !m_queue.empty() || !m_running; });
+
+			// Queued crops are still written on stop
+			if(m_queue.empty())
+				break;
+
+			while(!m_queue.empty() && batch.size() < m_batch_size)
+			{
+				batch.push_back(std::move(m_queue.front()));
+				m_queue.pop_front();
+			}
+			m_queue_depth.store(m_queue.size(), std::memory_order_relaxed);
+		}
+
+		if(m_archive)
+		{
+			write_archive(batch);
+		}
+		else
+		{
+			for(const Job &job : batch)
+			{
+				if(write_file(job))
+				{
+					m_written++;
+					m_bytes += job.size;
+				}
+				else
+				{
+					m_failed++;
+				}
+			}
+		}
+		m_batches++;
+
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			for(const Job &job : batch)
+				m_free_slabs.push_back(job.slab);
+		}
+		m_slab_free.notify_all();
+		batch.clear();
+	}
+}
+
+bool CropWriter::write_file(const Job &job)
+{
+	TADS_TRACE_SPAN("crop_writer_write_file");
+	const int flags{ O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC };
+	bool direct{ m_direct_io };
+
+	int fd = direct ? open(job.filename.c_str(), flags | O_DIRECT, 0644) : -1;
+	if(fd < 0)
+	{
+		// Filesystems such as tmpfs reject O_DIRECT, fall back to buffered writes
+		direct = false;
+		fd = open(job.filename.c_str(), flags, 0644);
+	}
+	if(fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not open '%s' for writing: %s", job.filename.c_str(), strerror(errno));
+		return false;
+	}
+	m_files++;
+
+	// Direct writes cover whole aligned blocks of the slab, the padding is truncated afterwards
+	const char *data{ job.slab };
+	size_t remaining{ direct ? align_up(job.size) : job.size };
+	bool success{ true };
+
+	while(remaining > 0)
+	{
+		ssize_t written = write(fd, data, remaining);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			TADS_ERR_MSG_V("Could not write '%s': %s", job.filename.c_str(), strerror(errno));
+			success = false;
+			break;
+		}
+		data += written;
+		remaining -= written;
+	}
+
+	if(success && direct && ftruncate(fd, static_cast<off_t>(job.size)) != 0)
+	{
+		TADS_ERR_MSG_V("Could not truncate '%s': %s", job.filename.c_str(), strerror(errno));
+		success = false;
+	}
+
+	if(success && m_sync_policy == CropSyncPolicy::DATA && fdatasync(fd) != 0)
+	{
+		TADS_ERR_MSG_V("Could not sync '%s': %s", job.filename.c_str(), strerror(errno));
+		success = false;
+	}
+
+	close(fd);
+	return success;
+}
+
+void CropWriter::write_archive(const std::vector<Job> &batch)
+{
+	TADS_TRACE_SPAN("crop_writer_write_archive");
+	std::lock_guard<std::mutex> lock(m_archive_lock);
+	const uint64_t files_created{ m_archive->files_created() };
+
+	for(const Job &job : batch)
+	{
+		if(m_archive->append(job.filename, job.info, job.slab, job.size))
+		{
+			m_written++;
+			m_bytes += job.size;
+		}
+		else
+		{
+			m_failed++;
+		}
+	}
+
+	// One index write, and sync if requested, per batch
+	m_archive->flush(m_sync_policy == CropSyncPolicy::DATA);
+	m_files += m_archive->files_created() - files_created;
+}
+
+std::string crop_writer_report(CropWriter *writer)
+{
+	if(!writer)
+		return {};
+
+	const CropWriterStats stats{ writer->stats() };
+	if(stats.queued == 0 && stats.dropped == 0)
+		return {};
+
+	return fmt::format("**CROP WRITER: queue {} (max {}) written {} dropped {} failed {} {:.1f} MB\n", stats.queue_depth,
+										 stats.max_queue_depth, stats.written, stats.dropped, stats.failed, stats.bytes / 1048576.0);
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+
+#include "common.hpp"
+#include "date_directory.hpp"
+
+/**
+ * Longest sleep of the timer thread, so that wall clock changes are noticed within the hour.
+ * */
+static constexpr int64_t MAX_TIMER_SLEEP_US{ 3600ll * 1000000 };
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+			.count();
+}
+
+DateDirectory::DateDirectory(std::string root_path):
+	m_root_path{ std::move(root_path) }
+{}
+
+DateDirectory::~DateDirectory()
+{
+	stop();
+}
+
+std::string DateDirectory::day_path(const std::string &root_path, int64_t time_us)
+{
+	std::time_t seconds = time_us / 1000000;
+	std::tm local_tm{};
+	char date[16];
+
+	localtime_r(&seconds, &local_tm);
+	strftime(date, sizeof(date), "%d%m%Y", &local_tm);
+	return fmt::format("{}/{}", root_path, date);
+}
+
+int64_t DateDirectory::next_midnight_us(int64_t time_us)
+{
+	std::time_t seconds = time_us / 1000000;
+	std::tm local_tm{};
+
+	localtime_r(&seconds, &local_tm);
+	local_tm.tm_mday++;
+	local_tm.tm_hour = 0;
+	local_tm.tm_min = 0;
+	local_tm.tm_sec = 0;
+	// Let mktime pick the DST offset of the next day
+	local_tm.tm_isdst = -1;
+
+	return static_cast<int64_t>(mktime(&local_tm)) * 1000000;
+}
+
+bool DateDirectory::update(int64_t time_us)
+{
+	std::shared_ptr<const std::string> current{ path() };
+	std::string next{ day_path(m_root_path, time_us) };
+	std::error_code ec;
+
+	if(current && *current == next)
+		return true;
+
+	std::filesystem::create_directories(next, ec);
+	if(ec)
+	{
+		TADS_ERR_MSG_V("Could not create '%s': %s", next.c_str(), ec.message().c_str());
+		return false;
+	}
+
+#ifdef TADS_DATE_DIRECTORY_DEBUG
+	TADS_DBG_MSG_V("Analytics output folder is now '%s'", next.c_str());
+#endif
+	std::atomic_store(&m_path, std::shared_ptr<const std::string>(std::make_shared<std::string>(std::move(next))));
+	return true;
+}
+
+bool DateDirectory::start()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_running)
+		return true;
+
+	if(!update(now_us()))
+		return false;
+
+	m_running = true;
+	m_thread = std::thread(&DateDirectory::run, this);
+	return true;
+}
+
+void DateDirectory::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(!m_running)
+			return;
+		m_running = false;
+	}
+	m_wake.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+}
+
+std::shared_ptr<const std::string> DateDirectory::path() const
+{
+	return std::atomic_load(&m_path);
+}
+
+void DateDirectory::run()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while(m_running)
+	{
+		const int64_t now{ now_us() };
+		const int64_t sleep_us{ std::clamp<int64_t>(next_midnight_us(now) - now, 0, MAX_TIMER_SLEEP_US) };
+
+		if(m_wake.wait_for(lock, std::chrono::microseconds(sleep_us), [this] { return !m_running; }))
+			break;
+
+		// The previous folder stays in use if the new one cannot be created, it is retried on the next wake
+		lock.unlock();
+		update(now_us());
+		lock.lock();
+	}
+}
@@ -0,0 +1,570 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <sstream>
+
+#include "common.hpp"
+#include "event_store.hpp"
+
+static constexpr char RECORDS_MAGIC[8]{ 'T', 'A', 'D', 'S', 'E', 'V', 'R', 'C' };
+static constexpr char STRINGS_MAGIC[8]{ 'T', 'A', 'D', 'S', 'E', 'V', 'S', 'T' };
+static constexpr char INDEX_MAGIC[8]{ 'T', 'A', 'D', 'S', 'E', 'V', 'I', 'X' };
+
+static constexpr const char *RECORDS_EXTENSION{ ".rec" };
+static constexpr const char *STRINGS_EXTENSION{ ".str" };
+static constexpr const char *INDEX_EXTENSION{ ".idx" };
+
+static constexpr const char *SEGMENT_PREFIX{ "events_" };
+static constexpr size_t MAX_STRING_LENGTH{ UINT16_MAX };
+
+std::string TrafficEvent::to_string() const
+{
+	std::ostringstream output;
+
+	output << fmt::format("Номер    : {}\n", object_id);
+	output << fmt::format("Класс    : {}\n", label);
+	output << fmt::format("Напр.    : {}\n", direction);
+
+	if(line1_time_us != 0)
+		output << fmt::format("Точка1   : {:<6} - {}\n", line1_status, format_date_time_str(line1_time_us));
+	else
+		output << std::string("Точка1   : N/A\n");
+
+	if(line2_time_us != 0)
+		output << fmt::format("Точка2   : {:<6} - {}\n", line2_status, format_date_time_str(line2_time_us));
+	else
+		output << std::string("Точка2   : N/A\n");
+
+	if(speed_kmh > 0)
+		output << fmt::format("Скорость : ~{} км/ч\n", speed_kmh);
+	else
+		output << std::string("Скорость : N/A\n");
+
+	if(!image_dir.empty())
+	{
+		auto chunks = split(fmt::format("{}/obj_{}.jpg", image_dir, object_id), "../");
+		output << fmt::format("Изобр.   : {}\n", join(chunks, "/"));
+	}
+	else
+	{
+		output << std::string("Изобр.   : N/A\n");
+	}
+
+	if(!plate.empty())
+		output << fmt::format("Госномер : {:>8} ({})\n", plate, plate_confidence);
+	else
+		output << std::string("Госномер : N/A (0)\n");
+
+	return output.str();
+}
+
+/**
+ * Start of the local hour holding @p time_us, @p local_tm receives its broken down time.
+ * */
+static int64_t segment_start(int64_t time_us, std::tm &local_tm)
+{
+	std::time_t seconds = time_us / 1000000;
+	localtime_r(&seconds, &local_tm);
+	local_tm.tm_min = 0;
+	local_tm.tm_sec = 0;
+
+	std::tm hour_tm{ local_tm };
+	return static_cast<int64_t>(mktime(&hour_tm)) * 1000000;
+}
+
+static std::string segment_base_path(const std::string &root_path, const std::tm &local_tm)
+{
+	char date[16];
+	strftime(date, sizeof(date), "%d%m%Y", &local_tm);
+	return fmt::format("{}/{}/{}{:02}", root_path, date, SEGMENT_PREFIX, local_tm.tm_hour);
+}
+
+/**
+ * Opens or creates a segment file and checks its header.
+ *
+ * @param[out] body_size bytes after the header, rounded down to whole entries.
+ *
+ * @return stream positioned nowhere in particular, see @ref seek_to.
+ * */
+static FILE *open_segment_file(const std::string &path, const char *magic, uint32_t entry_size, uint64_t &body_size)
+{
+	EventSegmentHeader header{};
+	struct stat st{};
+	FILE *file{};
+	int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+	if(fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not open '%s': %s", path.c_str(), strerror(errno));
+		return nullptr;
+	}
+
+	if(fstat(fd, &st) != 0)
+		goto fail;
+
+	if(static_cast<size_t>(st.st_size) < sizeof(header))
+	{
+		memcpy(header.magic, magic, sizeof(header.magic));
+		header.version = EventSegmentHeader::VERSION;
+		header.entry_size = entry_size;
+
+		if(ftruncate(fd, 0) != 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+			goto fail;
+		body_size = 0;
+	}
+	else
+	{
+		if(pread(fd, &header, sizeof(header), 0) != sizeof(header))
+			goto fail;
+
+		if(memcmp(header.magic, magic, sizeof(header.magic)) != 0 || header.version != EventSegmentHeader::VERSION ||
+			 header.entry_size != entry_size)
+		{
+			TADS_ERR_MSG_V("'%s' is not an event segment of version %u", path.c_str(), EventSegmentHeader::VERSION);
+			::close(fd);
+			return nullptr;
+		}
+
+		body_size = st.st_size - sizeof(header);
+		if(entry_size > 0)
+			body_size -= body_size % entry_size;
+	}
+
+	file = fdopen(fd, "r+b");
+	if(file != nullptr)
+		return file;
+
+fail:
+	TADS_ERR_MSG_V("Could not prepare '%s': %s", path.c_str(), strerror(errno));
+	::close(fd);
+	return nullptr;
+}
+
+/**
+ * Drops a partial tail left by a crash and moves the stream to the end.
+ * */
+static bool seek_to(FILE *file, uint64_t body_size)
+{
+	const off_t end{ static_cast<off_t>(sizeof(EventSegmentHeader) + body_size) };
+	return ftruncate(fileno(file), end) == 0 && fseeko(file, end, SEEK_SET) == 0;
+}
+
+EventStoreWriter::EventStoreWriter(std::string root_path):
+	m_root_path{ std::move(root_path) }
+{
+	load_last_append_time();
+}
+
+void EventStoreWriter::load_last_append_time()
+{
+	const std::vector<EventSegmentInfo> segments{ list_event_segments(m_root_path) };
+	EventSegmentHeader header{};
+	EventRecord last{};
+	struct stat st{};
+
+	if(segments.empty())
+		return;
+
+	const std::string path{ segments.back().base_path + RECORDS_EXTENSION };
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+		return;
+
+	if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(header) + sizeof(last) &&
+		 pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+		 memcmp(header.magic, RECORDS_MAGIC, sizeof(header.magic)) == 0 &&
+		 header.version == EventSegmentHeader::VERSION && header.entry_size == sizeof(last))
+	{
+		const off_t records{ static_cast<off_t>((st.st_size - sizeof(header)) / sizeof(last)) };
+		if(pread(fd, &last, sizeof(last), sizeof(header) + (records - 1) * sizeof(last)) == sizeof(last))
+			m_last_append_us = last.append_time_us;
+	}
+	::close(fd);
+}
+
+EventStoreWriter::~EventStoreWriter()
+{
+	close();
+}
+
+bool EventStoreWriter::load_strings(FILE *file, uint64_t &body_size)
+{
+	std::vector<char> body(body_size);
+	uint64_t offset{};
+
+	if(body_size > 0 && pread(fileno(file), body.data(), body_size, sizeof(EventSegmentHeader)) !=
+												static_cast<ssize_t>(body_size))
+	{
+		return false;
+	}
+
+	while(offset + sizeof(uint16_t) <= body_size)
+	{
+		uint16_t length;
+		memcpy(&length, body.data() + offset, sizeof(length));
+		if(offset + sizeof(length) + length > body_size)
+			break;
+
+		m_string_ids.emplace(std::string(body.data() + offset + sizeof(length), length), m_string_ids.size());
+		offset += sizeof(length) + length;
+	}
+	body_size = offset;
+
+	return true;
+}
+
+bool EventStoreWriter::open_segment(const std::string &base_path)
+{
+	uint64_t records_size, strings_size, index_size;
+	std::vector<EventIndexEntry> index;
+	std::error_code ec;
+
+	std::filesystem::create_directories(std::filesystem::path(base_path).parent_path(), ec);
+	if(ec)
+	{
+		TADS_ERR_MSG_V("Could not create the folder of '%s': %s", base_path.c_str(), ec.message().c_str());
+		return false;
+	}
+
+	m_strings = open_segment_file(base_path + STRINGS_EXTENSION, STRINGS_MAGIC, 0, strings_size);
+	m_records = open_segment_file(base_path + RECORDS_EXTENSION, RECORDS_MAGIC, sizeof(EventRecord), records_size);
+	m_index = open_segment_file(base_path + INDEX_EXTENSION, INDEX_MAGIC, sizeof(EventIndexEntry), index_size);
+	if(!m_strings || !m_records || !m_index)
+		goto fail;
+
+	m_string_ids.clear();
+	if(!load_strings(m_strings, strings_size))
+		goto fail;
+	m_num_records = records_size / sizeof(EventRecord);
+
+	// Entries of records lost in a crash would point at the records appended now
+	index.resize(index_size / sizeof(EventIndexEntry));
+	if(!index.empty() && pread(fileno(m_index), index.data(), index_size, sizeof(EventSegmentHeader)) !=
+												 static_cast<ssize_t>(index_size))
+	{
+		goto fail;
+	}
+	index_size = std::find_if(index.begin(), index.end(),
+														[this](const EventIndexEntry &entry) { return entry.record >= m_num_records; }) -
+							 index.begin();
+	index_size *= sizeof(EventIndexEntry);
+
+	if(!seek_to(m_strings, strings_size) || !seek_to(m_records, records_size) || !seek_to(m_index, index_size))
+		goto fail;
+
+#ifdef TADS_EVENT_STORE_DEBUG
+	TADS_DBG_MSG_V("Appending to segment '%s' after %lu records and %zu strings", base_path.c_str(), m_num_records,
+								 m_string_ids.size());
+#endif
+	return true;
+
+fail:
+	TADS_ERR_MSG_V("Could not open event segment '%s'", base_path.c_str());
+	close();
+	return false;
+}
+
+uint32_t EventStoreWriter::intern(const std::string &value)
+{
+	if(value.empty())
+		return EVENT_NO_STRING;
+
+	if(auto itr = m_string_ids.find(value); itr != m_string_ids.end())
+		return itr->second;
+
+	const uint16_t length{ static_cast<uint16_t>(std::min(value.size(), MAX_STRING_LENGTH)) };
+	const uint32_t id{ static_cast<uint32_t>(m_string_ids.size()) };
+
+	fwrite(&length, sizeof(length), 1, m_strings);
+	fwrite(value.data(), 1, length, m_strings);
+	m_string_ids.emplace(value, id);
+
+	return id;
+}
+
+bool EventStoreWriter::append(const TrafficEvent &event, int64_t append_time_us)
+{
+	std::tm local_tm{};
+	// Keeps the records, the index and the segments in append order if the clock steps back
+	append_time_us = std::max(append_time_us, m_last_append_us);
+	const int64_t hour_start_us{ segment_start(append_time_us, local_tm) };
+
+	if(hour_start_us != m_hour_start_us || !m_records)
+	{
+		close();
+		if(!open_segment(segment_base_path(m_root_path, local_tm)))
+			return false;
+		m_hour_start_us = hour_start_us;
+	}
+
+	const size_t num_strings{ m_string_ids.size() };
+	EventRecord record{};
+	record.time_us = event.time_us;
+	record.append_time_us = append_time_us;
+	record.object_id = event.object_id;
+	record.line1_time_us = event.line1_time_us;
+	record.line2_time_us = event.line2_time_us;
+	record.source_id = event.source_id;
+	record.label = intern(event.label);
+	record.direction = intern(event.direction);
+	record.line1_status = intern(event.line1_status);
+	record.line2_status = intern(event.line2_status);
+	record.plate = intern(event.plate);
+	record.image_dir = intern(event.image_dir);
+	record.label_confidence = event.label_confidence;
+	record.plate_confidence = event.plate_confidence;
+	record.speed_kmh = event.speed_kmh;
+
+	// New strings reach the file before the first record referencing them
+	if(m_string_ids.size() != num_strings && fflush(m_strings) != 0)
+	{
+		TADS_ERR_MSG_V("Could not write the string table: %s", strerror(errno));
+		return false;
+	}
+
+	if(m_num_records % EVENT_INDEX_STRIDE == 0)
+	{
+		const EventIndexEntry entry{ append_time_us, m_num_records };
+		fwrite(&entry, sizeof(entry), 1, m_index);
+	}
+
+	if(fwrite(&record, sizeof(record), 1, m_records) != 1)
+	{
+		TADS_ERR_MSG_V("Could not append event %lu: %s", event.object_id, strerror(errno));
+		return false;
+	}
+	m_num_records++;
+	m_last_append_us = append_time_us;
+
+	return true;
+}
+
+void EventStoreWriter::flush()
+{
+	if(m_index)
+		fflush(m_index);
+	if(m_records)
+		fflush(m_records);
+}
+
+void EventStoreWriter::close()
+{
+	for(FILE **file : { &m_index, &m_records, &m_strings })
+	{
+		if(*file)
+		{
+			fclose(*file);
+			*file = nullptr;
+		}
+	}
+	m_string_ids.clear();
+	m_num_records = 0;
+	m_hour_start_us = -1;
+}
+
+EventSegmentReader::~EventSegmentReader()
+{
+	close();
+}
+
+bool EventSegmentReader::map(const std::string &path, const char *magic, uint32_t entry_size, Mapping &mapping)
+{
+	EventSegmentHeader header{};
+	struct stat st{};
+	void *data;
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if(fd < 0)
+		return false;
+
+	if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(data == MAP_FAILED)
+	{
+		TADS_ERR_MSG_V("Could not map '%s': %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if(memcmp(header.magic, magic, sizeof(header.magic)) != 0 || header.version != EventSegmentHeader::VERSION ||
+		 header.entry_size != entry_size)
+	{
+		TADS_ERR_MSG_V("'%s' is not an event segment of version %u", path.c_str(), EventSegmentHeader::VERSION);
+		munmap(data, st.st_size);
+		return false;
+	}
+
+	mapping.data = static_cast<const char *>(data);
+	mapping.size = st.st_size;
+	return true;
+}
+
+bool EventSegmentReader::open(const std::string &base_path)
+{
+	close();
+
+	if(!map(base_path + RECORDS_EXTENSION, RECORDS_MAGIC, sizeof(EventRecord), m_record_map) ||
+		 !map(base_path + STRINGS_EXTENSION, STRINGS_MAGIC, 0, m_string_map))
+	{
+		TADS_ERR_MSG_V("Could not open event segment '%s'", base_path.c_str());
+		close();
+		return false;
+	}
+
+	m_records = reinterpret_cast<const EventRecord *>(m_record_map.data + sizeof(EventSegmentHeader));
+	m_num_records = (m_record_map.size - sizeof(EventSegmentHeader)) / sizeof(EventRecord);
+
+	for(size_t offset{ sizeof(EventSegmentHeader) }; offset + sizeof(uint16_t) <= m_string_map.size;)
+	{
+		uint16_t length;
+		memcpy(&length, m_string_map.data + offset, sizeof(length));
+		if(offset + sizeof(length) + length > m_string_map.size)
+			break;
+
+		m_string_table.emplace_back(m_string_map.data + offset + sizeof(length), length);
+		offset += sizeof(length) + length;
+	}
+
+	// Without an index lookups scan the segment from the start
+	if(map(base_path + INDEX_EXTENSION, INDEX_MAGIC, sizeof(EventIndexEntry), m_index_map))
+	{
+		m_index = reinterpret_cast<const EventIndexEntry *>(m_index_map.data + sizeof(EventSegmentHeader));
+		m_num_index = (m_index_map.size - sizeof(EventSegmentHeader)) / sizeof(EventIndexEntry);
+		m_num_index = std::find_if(m_index, m_index + m_num_index,
+															 [this](const EventIndexEntry &entry) { return entry.record >= m_num_records; }) -
+									m_index;
+	}
+
+	return true;
+}
+
+void EventSegmentReader::close()
+{
+	for(Mapping *mapping : { &m_record_map, &m_string_map, &m_index_map })
+	{
+		if(mapping->data)
+			munmap(const_cast<char *>(mapping->data), mapping->size);
+		*mapping = Mapping{};
+	}
+	m_records = nullptr;
+	m_num_records = 0;
+	m_index = nullptr;
+	m_num_index = 0;
+	m_string_table.clear();
+}
+
+std::string_view EventSegmentReader::string(uint32_t id) const
+{
+	if(id >= m_string_table.size())
+		return {};
+	return m_string_table[id];
+}
+
+uint32_t EventSegmentReader::find_string(std::string_view value) const
+{
+	auto itr = std::find(m_string_table.cbegin(), m_string_table.cend(), value);
+	if(itr == m_string_table.cend())
+		return EVENT_NO_STRING;
+	return static_cast<uint32_t>(itr - m_string_table.cbegin());
+}
+
+size_t EventSegmentReader::lower_bound(int64_t append_time_us) const
+{
+	auto before = [append_time_us](const EventIndexEntry &entry) { return entry.append_time_us < append_time_us; };
+	const EventIndexEntry *entry{ std::partition_point(m_index, m_index + m_num_index, before) };
+	size_t i{ entry == m_index ? 0 : static_cast<size_t>((entry - 1)->record) };
+
+	while(i < m_num_records && m_records[i].append_time_us < append_time_us)
+		i++;
+	return i;
+}
+
+TrafficEvent EventSegmentReader::event(size_t i) const
+{
+	const EventRecord &record{ m_records[i] };
+	TrafficEvent event;
+
+	event.time_us = record.time_us;
+	event.append_time_us = record.append_time_us;
+	event.object_id = record.object_id;
+	event.source_id = record.source_id;
+	event.label = string(record.label);
+	event.label_confidence = record.label_confidence;
+	event.direction = string(record.direction);
+	event.line1_status = string(record.line1_status);
+	event.line1_time_us = record.line1_time_us;
+	event.line2_status = string(record.line2_status);
+	event.line2_time_us = record.line2_time_us;
+	event.plate = string(record.plate);
+	event.plate_confidence = record.plate_confidence;
+	event.speed_kmh = record.speed_kmh;
+	event.image_dir = string(record.image_dir);
+
+	return event;
+}
+
+static bool is_digits(std::string_view text)
+{
+	return std::all_of(text.begin(), text.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+}
+
+std::vector<EventSegmentInfo> list_event_segments(const std::string &root_path)
+{
+	std::vector<EventSegmentInfo> segments;
+	std::error_code ec;
+
+	for(const auto &day : std::filesystem::directory_iterator(root_path, ec))
+	{
+		const std::string day_name{ day.path().filename().string() };
+		std::tm local_tm{};
+
+		if(!day.is_directory() || day_name.size() != 8 || !is_digits(day_name))
+		{
+			continue;
+		}
+		local_tm.tm_mday = std::stoi(day_name.substr(0, 2));
+		local_tm.tm_mon = std::stoi(day_name.substr(2, 2)) - 1;
+		local_tm.tm_year = std::stoi(day_name.substr(4, 4)) - 1900;
+
+		for(const auto &file : std::filesystem::directory_iterator(day.path(), ec))
+		{
+			const std::string name{ file.path().filename().string() };
+			const size_t prefix_length{ strlen(SEGMENT_PREFIX) };
+
+			if(!starts_with(name, SEGMENT_PREFIX) || !ends_with(name, RECORDS_EXTENSION) ||
+				 name.size() < prefix_length + 2)
+			{
+				continue;
+			}
+
+			const std::string_view hour{ std::string_view(name).substr(prefix_length, 2) };
+			if(!is_digits(hour))
+				continue;
+
+			std::tm hour_tm{ local_tm };
+			hour_tm.tm_hour = (hour[0] - '0') * 10 + (hour[1] - '0');
+			hour_tm.tm_isdst = -1;
+
+			std::string base_path{ file.path().string() };
+			base_path.resize(base_path.size() - strlen(RECORDS_EXTENSION));
+			segments.push_back({ std::move(base_path), static_cast<int64_t>(mktime(&hour_tm)) * 1000000 });
+		}
+	}
+
+	std::sort(segments.begin(), segments.end(),
+						[](const EventSegmentInfo &a, const EventSegmentInfo &b) { return a.start_us < b.start_us; });
+	return segments;
+}
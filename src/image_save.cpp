@@ -1,5 +1,4 @@
 #include <cstring>
-#include <fstream>
 #include <glib.h>
 #include <gst/gst.h>
 #include <gstnvdsmeta.h>
@@ -9,113 +8,166 @@
 #include "image_save.hpp"
 #include "app.hpp"
 
-bool save_image(ImageSaveConfig *config, NvDsObjectMeta *obj_meta, const std::string &filename)
+bool image_save_filters_match(const ImageSaveConfig *config, const NvDsObjectMeta *obj_meta)
 {
-	NvDsUserMetaList *user_meta_list;
-	std::ofstream file;
+	const NvBbox_Coords &bbox_coords = obj_meta->detector_bbox_info.org_bbox_coords;
 
-	bool success{};
+	bool matches_conf_reqs{ (config->min_confidence <= obj_meta->confidence) &&
+													(obj_meta->confidence <= config->max_confidence) };
+	bool matches_coord_reqs{ (bbox_coords.width >= config->min_box_width) &&
+													 (bbox_coords.height >= config->min_box_height) };
 
-	if(config->output_folder_path.empty())
-		return false;
+	return matches_conf_reqs && matches_coord_reqs;
+}
+
+std::unique_ptr<ImageSaveScheduler> create_image_save_scheduler(const ImageSaveConfig *config)
+{
+	std::vector<ImageSaveRule> rules;
 
-	/* To verify  encoded metadata of cropped objects, we iterate through the
-	 * user metadata of each object and if a metadata of the type
-	 * 'NVDS_CROP_IMAGE_META' is found then we write that to a file as
-	 * implemented below.
-	 */
-	/* write metadata to jpeg images of vehicles. */
-	if(config->save_image_cropped_object)
+	if(!config->frame_to_skip_rules_path.empty())
 	{
-		user_meta_list = obj_meta->obj_user_meta_list;
-		for(; user_meta_list != nullptr; user_meta_list = user_meta_list->next)
-		{
-			auto *user_meta = reinterpret_cast<NvDsUserMeta *>(user_meta_list->data);
-			if(user_meta && user_meta->base_meta.meta_type == NVDS_CROP_IMAGE_META)
-			{
-				auto *enc_jpeg_image = reinterpret_cast<NvDsObjEncOutParams *>(user_meta->user_meta_data);
-
-				if(!enc_jpeg_image)
-					continue;
-
-				if(!fs::exists(filename))
-				{
-					file.open(filename, std::ios::binary);
-					if(file.is_open())
-					{
-#ifdef TADS_ANALYTICS_DEBUG
-						TADS_DBG_MSG_V("Saving cropped image to '%s'", filename.c_str());
-#endif
-						file.write(reinterpret_cast<char *>(enc_jpeg_image->outBuffer), enc_jpeg_image->outLen);
-						success = true;
-					}
-					file.close();
-					break;
-				}
-			}
-		}
+		if(!load_image_save_rules(config->frame_to_skip_rules_path, rules))
+			return nullptr;
+		TADS_INFO_MSG_V("Loaded %lu frame skip rules from '%s'", rules.size(), config->frame_to_skip_rules_path.c_str());
+	}
+
+	return std::make_unique<ImageSaveScheduler>(ImageSaveRuleTable(rules), config->max_crops_per_interval,
+																							config->second_to_skip_interval);
+}
+
+std::unique_ptr<CropWriter> create_crop_writer(const ImageSaveConfig *config)
+{
+	if(config->writer_threads == 0)
+		return nullptr;
+
+	auto writer = std::make_unique<CropWriter>(config->writer_threads, config->writer_queue_size,
+																						 static_cast<size_t>(config->writer_slab_size_kb) * 1024,
+																						 config->writer_overflow_policy, config->writer_sync_policy,
+																						 config->writer_direct_io);
+	if(config->archive_crops)
+	{
+		writer->set_archive(std::make_unique<CropArchiveWriter>(
+				static_cast<uint64_t>(config->archive_max_size_mb) * 1024 * 1024,
+				static_cast<int64_t>(config->archive_max_age_s) * 1000000));
 	}
 
-	return success;
+	if(!writer->start())
+		return nullptr;
+
+	return writer;
 }
 
-GstPadProbeReturn encode_image(AppContext *app_context, GstBuffer *buffer)
+bool encode_object_image(AppContext *app_context, GstBuffer *buffer, NvDsFrameMeta *frame_meta,
+												 NvDsObjectMeta *obj_meta, const std::string &filename)
 {
 	const ImageSaveConfig *config = &app_context->config.image_save_config;
+	AnalyticsBin *analytics = &app_context->pipeline.common_elements.analytics;
 	NvDsObjEncCtxHandle ctx_handle = app_context->pipeline.common_elements.obj_enc_ctx_handle;
 
-	if(!config->enable)
-		return GST_PAD_PROBE_OK;
+	if(!config->enable || !config->save_image_cropped_object || !ctx_handle)
+		return false;
 
-	GstMapInfo inmap = GST_MAP_INFO_INIT;
-	NvDsObjectMeta *obj_meta;
-	NvDsMetaList *l_frame;
-	NvDsMetaList *l_obj;
-	NvDsBatchMeta *batch_meta;
+	if(!analytics->image_batch.surface)
+	{
+		GstMapInfo inmap = GST_MAP_INFO_INIT;
+		if(!gst_buffer_map(buffer, &inmap, GST_MAP_READ))
+		{
+			GST_ERROR("input buffer mapinfo failed");
+			return false;
+		}
+		analytics->image_batch.surface = reinterpret_cast<NvBufSurface *>(inmap.data);
+		gst_buffer_unmap(buffer, &inmap);
+	}
 
-	if(!gst_buffer_map(buffer, &inmap, GST_MAP_READ))
+	NvDsObjEncUsrArgs obj_meta_data{};
+	// With a crop writer the JPEG is attached to the object and written off the streaming thread
+	obj_meta_data.saveImg = !analytics->crop_writer;
+	obj_meta_data.attachUsrMeta = analytics->crop_writer != nullptr;
+	obj_meta_data.quality = config->quality;
+	if(analytics->crop_writer)
 	{
-		GST_ERROR("input buffer mapinfo failed");
-		return GST_PAD_PROBE_DROP;
+		const int64_t time_us{ frame_meta->ntp_timestamp > 0 ? static_cast<int64_t>(frame_meta->ntp_timestamp / 1000)
+																												 : g_get_real_time() };
+		analytics->image_batch.crops.push_back(
+				PendingCrop{ obj_meta, filename, CropInfo{ obj_meta->object_id, frame_meta->source_id, time_us } });
 	}
-	auto *ip_surf = reinterpret_cast<NvBufSurface *>(inmap.data);
-	gst_buffer_unmap(buffer, &inmap);
+	else
+		snprintf(obj_meta_data.fileNameImg, FILE_NAME_SIZE, "%s", filename.c_str());
 
-	batch_meta = gst_buffer_get_nvds_batch_meta(buffer);
+#ifdef TADS_ANALYTICS_DEBUG
+	TADS_DBG_MSG_V("Encoding object %lu to '%s'", obj_meta->object_id, filename.c_str());
+#endif
+	nvds_obj_enc_process(ctx_handle, &obj_meta_data, analytics->image_batch.surface, obj_meta, frame_meta);
 
-	for(l_frame = batch_meta->frame_meta_list; l_frame != nullptr; l_frame = l_frame->next)
+	analytics->image_batch.pending++;
+	if(analytics->image_stats)
+		analytics->image_stats->submissions.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+/**
+ * @return JPEG attached to @p obj_meta by the encoder, nullptr if there is none.
+ * */
+static const NvDsObjEncOutParams *find_crop_meta(NvDsObjectMeta *obj_meta)
+{
+	const NvDsObjEncOutParams *crop{};
+
+	for(NvDsMetaList *l_user_meta = obj_meta->obj_user_meta_list; l_user_meta != nullptr;
+			l_user_meta = l_user_meta->next)
 	{
-		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+		auto *user_meta = reinterpret_cast<NvDsUserMeta *>(l_user_meta->data);
+		if(user_meta->base_meta.meta_type == NVDS_CROP_IMAGE_META)
+			crop = reinterpret_cast<const NvDsObjEncOutParams *>(user_meta->user_meta_data);
+	}
 
-		int obj_num{};
-		for(l_obj = frame_meta->obj_meta_list; l_obj != nullptr; l_obj = l_obj->next, obj_num++)
+	return crop;
+}
+
+void finish_image_encoding(AppContext *app_context)
+{
+	AnalyticsBin *analytics = &app_context->pipeline.common_elements.analytics;
+	ImageEncodeBatch &batch = analytics->image_batch;
+
+	if(batch.pending > 0)
+	{
+		nvds_obj_enc_finish(app_context->pipeline.common_elements.obj_enc_ctx_handle);
+		if(analytics->image_stats)
+			analytics->image_stats->batches.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// The crop is copied into a writer slab, the user meta is released with the batch
+	for(const PendingCrop &pending : batch.crops)
+	{
+		const NvDsObjEncOutParams *crop{ find_crop_meta(pending.obj_meta) };
+		if(crop == nullptr || crop->outLen == 0)
 		{
-			obj_meta = reinterpret_cast<NvDsObjectMeta *>(l_obj->data);
-			NvBbox_Coords bbox_coords = obj_meta->detector_bbox_info.org_bbox_coords;
-
-			if(config->save_image_cropped_object)
-			{
-				bool matches_conf_reqs{ (config->min_confidence <= obj_meta->confidence) &&
-																(obj_meta->confidence <= config->max_confidence) };
-				bool matches_coord_reqs{ (bbox_coords.width >= config->min_box_width) &&
-																 (bbox_coords.height >= config->min_box_height) };
-
-				if(matches_coord_reqs && matches_conf_reqs)
-				{
-					NvDsObjEncUsrArgs obj_meta_data{};
-					// To be set by user
-					obj_meta_data.objNum = obj_num;
-					obj_meta_data.saveImg = false;
-					obj_meta_data.attachUsrMeta = true;
-					obj_meta_data.quality = config->quality;
-					snprintf(obj_meta_data.fileNameImg, FILE_NAME_SIZE, "%s/obj_%ld.jpg", config->output_folder_path.c_str(),
-									 obj_meta->object_id);
-					nvds_obj_enc_process(ctx_handle, &obj_meta_data, ip_surf, obj_meta, frame_meta);
-				}
-			}
+			TADS_WARN_MSG_V("No encoded crop for '%s'", pending.filename.c_str());
+			continue;
 		}
+		analytics->crop_writer->submit(pending.filename, pending.info, crop->outBuffer, crop->outLen);
 	}
 
-	nvds_obj_enc_finish(ctx_handle);
-	return GST_PAD_PROBE_OK;
-}
\ No newline at end of file
+	// Keep the crop list allocation across batches
+	batch.surface = nullptr;
+	batch.pending = 0;
+	batch.crops.clear();
+}
+
+std::string image_encode_report(ImageEncodeStats *stats)
+{
+	if(!stats)
+		return {};
+
+	const int64_t now_us{ g_get_monotonic_time() };
+	const int64_t elapsed_us{ now_us - stats->report_time_us };
+	const uint64_t submissions{ stats->submissions.exchange(0, std::memory_order_relaxed) };
+	const uint64_t batches{ stats->batches.exchange(0, std::memory_order_relaxed) };
+
+	stats->report_time_us = now_us;
+	if(submissions == 0 || elapsed_us <= 0)
+		return {};
+
+	return fmt::format("**IMAGE ENCODE: {:.1f} crops/min, {} crops in {} batches\n", submissions * 60e6 / elapsed_us,
+										 submissions, batches);
+}
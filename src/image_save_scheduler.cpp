@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+#include "common.hpp"
+#include "image_save_scheduler.hpp"
+
+static std::string trim(const std::string &str)
+{
+	const size_t first{ str.find_first_not_of(" \t\r") };
+	if(first == std::string::npos)
+		return {};
+	return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}
+
+static bool parse_minute(const std::string &str, uint &minute)
+{
+	uint hours, minutes;
+	char extra;
+
+	if(sscanf(str.c_str(), "%u:%u%c", &hours, &minutes, &extra) != 2 || hours > 24 || minutes > 59)
+		return false;
+
+	minute = hours * 60 + minutes;
+	// 24:00 is the end of the day
+	return minute <= ImageSaveRuleTable::MINUTES_PER_DAY;
+}
+
+static bool parse_uint(const std::string &str, uint &value)
+{
+	char extra;
+	// %u takes a sign and wraps negative values around
+	return !str.empty() && isdigit(static_cast<unsigned char>(str[0])) &&
+				 sscanf(str.c_str(), "%u%c", &value, &extra) == 1;
+}
+
+bool load_image_save_rules(const std::string &file_path, std::vector<ImageSaveRule> &rules)
+{
+	std::ifstream file(file_path);
+	std::string line;
+	uint line_num{};
+
+	if(!file.is_open())
+	{
+		TADS_ERR_MSG_V("Could not open frame skip rules '%s'", file_path.c_str());
+		return false;
+	}
+
+	while(std::getline(file, line))
+	{
+		line_num++;
+		line = trim(line);
+		if(line.empty() || line[0] == '#')
+			continue;
+
+		std::vector<std::string> fields;
+		std::stringstream stream(line);
+		std::string field;
+		while(std::getline(stream, field, ','))
+			fields.push_back(trim(field));
+
+		ImageSaveRule rule{ 0, 0, 0, -1 };
+		uint class_id{};
+		bool valid{ (fields.size() == 3 || fields.size() == 4) && parse_minute(fields[0], rule.start_minute) &&
+								parse_minute(fields[1], rule.end_minute) && parse_uint(fields[2], rule.frames_to_skip) };
+
+		if(valid && fields.size() == 4 && fields[3] != "*")
+		{
+			valid = parse_uint(fields[3], class_id);
+			rule.class_id = static_cast<int>(class_id);
+		}
+
+		if(!valid)
+		{
+			TADS_ERR_MSG_V("Invalid frame skip rule at %s:%u, expected 'HH:MM,HH:MM,frames[,class_id]'",
+										 file_path.c_str(), line_num);
+			return false;
+		}
+
+		rule.start_minute %= ImageSaveRuleTable::MINUTES_PER_DAY;
+		rule.end_minute %= ImageSaveRuleTable::MINUTES_PER_DAY;
+		rules.push_back(rule);
+	}
+
+	return true;
+}
+
+ImageSaveRuleTable::ImageSaveRuleTable(const std::vector<ImageSaveRule> &rules)
+{
+	if(rules.empty())
+		return;
+
+	int max_class_id{ -1 };
+	for(const ImageSaveRule &rule : rules)
+		max_class_id = std::max(max_class_id, rule.class_id);
+
+	m_columns = static_cast<uint>(max_class_id + 2);
+	m_table.assign(MINUTES_PER_DAY * m_columns, NO_RULE);
+
+	for(const ImageSaveRule &rule : rules)
+	{
+		const uint column{ static_cast<uint>(rule.class_id + 1) };
+		uint length{ (rule.end_minute + MINUTES_PER_DAY - rule.start_minute) % MINUTES_PER_DAY };
+		if(length == 0)
+			length = MINUTES_PER_DAY;
+
+		for(uint i = 0; i < length; ++i)
+		{
+			uint32_t &entry = m_table[((rule.start_minute + i) % MINUTES_PER_DAY) * m_columns + column];
+			entry = entry == NO_RULE ? rule.frames_to_skip : std::max(entry, rule.frames_to_skip);
+		}
+	}
+}
+
+uint ImageSaveRuleTable::frames_to_skip(uint minute, int class_id) const
+{
+	if(m_table.empty())
+		return 0;
+
+	const uint32_t *row{ &m_table[(minute % MINUTES_PER_DAY) * m_columns] };
+	if(class_id >= 0 && static_cast<uint>(class_id) + 1 < m_columns && row[class_id + 1] != NO_RULE)
+		return row[class_id + 1];
+
+	return row[0] != NO_RULE ? row[0] : 0;
+}
+
+ImageSaveScheduler::ImageSaveScheduler(ImageSaveRuleTable rules, uint crops_per_interval, uint interval_s):
+	m_rules{ std::move(rules) },
+	m_capacity{ static_cast<double>(crops_per_interval) },
+	m_refill_rate{ interval_s > 0 ? m_capacity / (interval_s * 1e6) : 0.0 }
+{}
+
+bool ImageSaveScheduler::take_token(Track &track, int64_t time_us)
+{
+	if(m_capacity <= 0)
+		return true;
+
+	// Buckets start full; a clock going backwards, e.g. a replay loop, only restarts the refill
+	if(track.refill_time_us < 0)
+		track.tokens = m_capacity;
+	else if(time_us > track.refill_time_us)
+		track.tokens = std::min(m_capacity, track.tokens + (time_us - track.refill_time_us) * m_refill_rate);
+	track.refill_time_us = time_us;
+
+	if(track.tokens < 1.0)
+		return false;
+
+	track.tokens -= 1.0;
+	return true;
+}
+
+ImageSaveDecision ImageSaveScheduler::admit(uint source_id, int class_id, int64_t frame_num, int64_t time_us)
+{
+	const uint64_t key{ (static_cast<uint64_t>(source_id) << 32) | static_cast<uint32_t>(class_id) };
+	Track &track = m_tracks[key];
+	ImageSaveDecision decision{ ImageSaveDecision::ADMIT };
+
+	if(!m_rules.empty() && track.last_frame >= 0 && frame_num > track.last_frame)
+	{
+		std::time_t seconds = time_us / 1000000;
+		std::tm local_tm{};
+		localtime_r(&seconds, &local_tm);
+
+		const uint skip{ m_rules.frames_to_skip(local_tm.tm_hour * 60 + local_tm.tm_min, class_id) };
+		if(frame_num - track.last_frame <= skip)
+			decision = ImageSaveDecision::SKIP_RULE;
+	}
+
+	if(decision == ImageSaveDecision::ADMIT && !take_token(track, time_us))
+		decision = ImageSaveDecision::SKIP_RATE;
+
+	if(decision == ImageSaveDecision::ADMIT)
+		track.last_frame = frame_num;
+
+	m_totals[static_cast<size_t>(decision)].fetch_add(1, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(m_stats_lock);
+	if(source_id >= m_stats.size())
+		m_stats.resize(source_id + 1);
+
+	ImageSaveSourceStats &stats = m_stats[source_id];
+	switch(decision)
+	{
+		case ImageSaveDecision::ADMIT:
+			stats.admitted++;
+			break;
+		case ImageSaveDecision::SKIP_RULE:
+			stats.skipped_rule++;
+			break;
+		case ImageSaveDecision::SKIP_RATE:
+			stats.skipped_rate++;
+			break;
+	}
+
+	return decision;
+}
+
+std::vector<ImageSaveSourceStats> ImageSaveScheduler::drain()
+{
+	std::lock_guard<std::mutex> lock(m_stats_lock);
+	std::vector<ImageSaveSourceStats> stats(m_stats.size());
+	stats.swap(m_stats);
+	return stats;
+}
+
+ImageSaveSourceStats ImageSaveScheduler::totals() const
+{
+	ImageSaveSourceStats totals;
+	totals.admitted = m_totals[static_cast<size_t>(ImageSaveDecision::ADMIT)].load(std::memory_order_relaxed);
+	totals.skipped_rule = m_totals[static_cast<size_t>(ImageSaveDecision::SKIP_RULE)].load(std::memory_order_relaxed);
+	totals.skipped_rate = m_totals[static_cast<size_t>(ImageSaveDecision::SKIP_RATE)].load(std::memory_order_relaxed);
+	return totals;
+}
+
+std::string image_save_drop_report(ImageSaveScheduler *scheduler)
+{
+	if(!scheduler)
+		return {};
+
+	const std::vector<ImageSaveSourceStats> stats{ scheduler->drain() };
+	std::string report;
+	bool dropped{};
+
+	for(size_t source_id = 0; source_id < stats.size(); ++source_id)
+	{
+		const ImageSaveSourceStats &source = stats[source_id];
+		dropped |= source.skipped_rule > 0 || source.skipped_rate > 0;
+		report += fmt::format("{} (rule {} rate {})\t", source.admitted, source.skipped_rule, source.skipped_rate);
+	}
+
+	if(!dropped)
+		return {};
+
+	return fmt::format("**IMAGE SAVE: {}\n", report);
+}
@@ -0,0 +1,81 @@
+#include <array>
+#include <atomic>
+#include <mutex>
+
+#include "common.hpp"
+#include "label_table.hpp"
+
+/**
+ * Distinct labels of the process, far more than the classes, statuses and directions.
+ * */
+static constexpr size_t LABEL_TABLE_CAPACITY{ 1024 };
+
+/**
+ * Names are appended to a fixed array and published by the release store of
+ * the size, an entry below the size is never written again. Readers only
+ * load the size, adding a name is the only path that locks.
+ * */
+struct LabelTable
+{
+	std::mutex lock;
+	std::array<std::string, LABEL_TABLE_CAPACITY> names{ "unknown" };
+	std::atomic<size_t> size{ 1 };
+	std::atomic<bool> full{};
+};
+
+static LabelTable &label_table()
+{
+	static LabelTable table;
+	return table;
+}
+
+/**
+ * @return id of @p name among the names [@p begin, @p end), @p end if it is not there.
+ * */
+static size_t find_label(const LabelTable &table, std::string_view name, size_t begin, size_t end)
+{
+	for(size_t id = begin; id < end; id++)
+	{
+		if(table.names[id] == name)
+			return id;
+	}
+	return end;
+}
+
+LabelId label_id(std::string_view name)
+{
+	LabelTable &table{ label_table() };
+
+	// The labels are few, scanning them is cheaper than a lock shared by every streaming thread
+	const size_t size{ table.size.load(std::memory_order_acquire) };
+	if(const size_t id{ find_label(table, name, 0, size) }; id < size)
+		return static_cast<LabelId>(id);
+
+	if(table.full.load(std::memory_order_relaxed))
+		return LABEL_UNKNOWN;
+
+	std::lock_guard<std::mutex> lock(table.lock);
+
+	// Another thread may have added it in the meantime
+	const size_t current{ table.size.load(std::memory_order_relaxed) };
+	if(const size_t id{ find_label(table, name, size, current) }; id < current)
+		return static_cast<LabelId>(id);
+
+	if(current == LABEL_TABLE_CAPACITY)
+	{
+		if(!table.full.exchange(true, std::memory_order_relaxed))
+			TADS_WARN_MSG_V("Label table is full, new labels are recorded as unknown");
+		return LABEL_UNKNOWN;
+	}
+
+	table.names[current] = name;
+	table.size.store(current + 1, std::memory_order_release);
+	return static_cast<LabelId>(current);
+}
+
+const std::string &label_name(LabelId id)
+{
+	const LabelTable &table{ label_table() };
+
+	return id < table.size.load(std::memory_order_acquire) ? table.names[id] : table.names[LABEL_UNKNOWN];
+}
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <ctime>
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "latency.hpp"
+#include "metrics.hpp"
+
+uint LatencySnapshot::bucket_index(uint64_t value)
+{
+	if(value < SUB_BUCKETS)
+		return value;
+
+	const uint magnitude{ 63u - static_cast<uint>(__builtin_clzll(value)) };
+	if(magnitude > 31)
+		return NUM_BUCKETS - 1;
+
+	return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+				 ((value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencySnapshot::bucket_value(uint index)
+{
+	if(index < SUB_BUCKETS)
+		return index;
+
+	const uint magnitude{ index / SUB_BUCKETS + SUB_BUCKET_BITS - 1 };
+	const uint64_t sub_bucket{ index % SUB_BUCKETS };
+	const uint64_t lower{ (SUB_BUCKETS + sub_bucket) << (magnitude - SUB_BUCKET_BITS) };
+
+	return lower + (1ull << (magnitude - SUB_BUCKET_BITS)) - 1;
+}
+
+void LatencySnapshot::merge(const LatencySnapshot &other)
+{
+	for(uint i = 0; i < NUM_BUCKETS; ++i)
+		counts[i] += other.counts[i];
+	total += other.total;
+	max = std::max(max, other.max);
+	sum += other.sum;
+}
+
+uint64_t LatencySnapshot::value_at(double percentile) const
+{
+	if(total == 0)
+		return 0;
+
+	const uint64_t target{ std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * total))) };
+	uint64_t seen{};
+
+	for(uint i = 0; i < NUM_BUCKETS; ++i)
+	{
+		seen += counts[i];
+		if(seen >= target)
+			return std::min(bucket_value(i), max);
+	}
+	return max;
+}
+
+void LatencyHistogram::record(uint64_t value_us)
+{
+	m_counts[LatencySnapshot::bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value_us, std::memory_order_relaxed);
+
+	uint64_t max{ m_max.load(std::memory_order_relaxed) };
+	while(value_us > max && !m_max.compare_exchange_weak(max, value_us, std::memory_order_relaxed))
+	{}
+}
+
+void LatencyHistogram::drain(LatencySnapshot &snapshot)
+{
+	for(uint i = 0; i < LatencySnapshot::NUM_BUCKETS; ++i)
+	{
+		const uint64_t count{ m_counts[i].exchange(0, std::memory_order_relaxed) };
+		snapshot.counts[i] += count;
+		snapshot.total += count;
+	}
+	snapshot.max = std::max(snapshot.max, m_max.exchange(0, std::memory_order_relaxed));
+	snapshot.sum += m_sum.exchange(0, std::memory_order_relaxed);
+}
+
+LatencyTracker::LatencyTracker(uint num_sources):
+	m_num_sources{ num_sources },
+	m_slots(static_cast<size_t>(num_sources) * FRAME_RING_SIZE)
+{}
+
+LatencyTracker::Stage *LatencyTracker::add_stage(const std::string &name, bool entry, bool branch)
+{
+	Stage &stage{ m_stages.emplace_back() };
+	stage.tracker = this;
+	stage.name = name;
+	stage.index = m_stages.size() - 1;
+	stage.entry = entry;
+	stage.branch = branch;
+
+	if(!entry)
+	{
+		stage.histograms.reserve(m_num_sources);
+		for(uint i = 0; i < m_num_sources; ++i)
+			stage.histograms.emplace_back(std::make_unique<LatencyHistogram>());
+		stage.pending.resize(m_num_sources);
+	}
+	return &stage;
+}
+
+void LatencyTracker::stamp(Stage *stage, uint source_id, uint64_t frame_num, uint64_t now_ns)
+{
+	if(source_id >= m_num_sources)
+		return;
+
+	FrameSlot &slot{ m_slots[static_cast<size_t>(source_id) * FRAME_RING_SIZE + frame_num % FRAME_RING_SIZE] };
+
+	if(stage->entry)
+	{
+		slot.stamp_ns.store(now_ns, std::memory_order_relaxed);
+		slot.frame_num.store(frame_num, std::memory_order_release);
+		return;
+	}
+
+	// The slot was reused by a newer frame or the frame entered before the tracker existed
+	if(slot.frame_num.load(std::memory_order_acquire) != frame_num)
+		return;
+
+	const uint64_t previous_ns{ slot.stamp_ns.load(std::memory_order_relaxed) };
+	if(now_ns >= previous_ns)
+		stage->histograms[source_id]->record((now_ns - previous_ns) / 1000);
+
+	if(!stage->branch)
+		slot.stamp_ns.store(now_ns, std::memory_order_relaxed);
+}
+
+void LatencyTracker::record(Stage *stage, uint source_id, uint64_t latency_us)
+{
+	if(source_id >= m_num_sources || stage->entry)
+		return;
+
+	stage->histograms[source_id]->record(latency_us);
+}
+
+static void format_snapshot(fmt::memory_buffer &out, const std::string &name, const LatencySnapshot &snapshot)
+{
+	fmt::format_to(std::back_inserter(out), "  {:<16}{:>9.2f}{:>9.2f}{:>9.2f}{:>9.2f}{:>9}\n", name,
+								 snapshot.value_at(50) / 1000.0, snapshot.value_at(90) / 1000.0, snapshot.value_at(99) / 1000.0,
+								 snapshot.max / 1000.0, snapshot.total);
+}
+
+void LatencyTracker::drain_stages()
+{
+	for(Stage &stage : m_stages)
+	{
+		if(stage.entry)
+			continue;
+
+		for(uint i = 0; i < m_num_sources; ++i)
+		{
+			LatencySnapshot drained;
+			stage.histograms[i]->drain(drained);
+			stage.pending[i].merge(drained);
+			stage.totals.merge(drained);
+		}
+	}
+}
+
+std::string LatencyTracker::report()
+{
+	fmt::memory_buffer out;
+	bool recorded{};
+
+	std::lock_guard<std::mutex> lock(m_drain_lock);
+	drain_stages();
+
+	for(Stage &stage : m_stages)
+	{
+		if(stage.entry)
+			continue;
+
+		LatencySnapshot merged;
+		for(const LatencySnapshot &snapshot : stage.pending)
+			merged.merge(snapshot);
+
+		if(merged.total == 0)
+			continue;
+
+		if(!recorded)
+		{
+			fmt::format_to(std::back_inserter(out), "**LATENCY(ms):\n  {:<16}{:>9}{:>9}{:>9}{:>9}{:>9}\n", "stage", "p50",
+										 "p90", "p99", "max", "frames");
+			recorded = true;
+		}
+
+		format_snapshot(out, stage.name, merged);
+		if(m_num_sources > 1)
+		{
+			for(uint i = 0; i < m_num_sources; ++i)
+			{
+				if(stage.pending[i].total > 0)
+					format_snapshot(out, fmt::format("{}[{}]", stage.name, i), stage.pending[i]);
+			}
+		}
+	}
+
+	for(Stage &stage : m_stages)
+		std::fill(stage.pending.begin(), stage.pending.end(), LatencySnapshot{});
+
+	return fmt::to_string(out);
+}
+
+std::vector<std::pair<std::string, LatencySnapshot>> LatencyTracker::totals()
+{
+	std::vector<std::pair<std::string, LatencySnapshot>> totals;
+
+	std::lock_guard<std::mutex> lock(m_drain_lock);
+	drain_stages();
+
+	for(const Stage &stage : m_stages)
+	{
+		if(!stage.entry)
+			totals.emplace_back(stage.name, stage.totals);
+	}
+	return totals;
+}
+
+uint64_t LatencyTracker::now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void add_latency_metrics(MetricsRegistry *registry, LatencyTracker *tracker)
+{
+	registry->add_collector(
+			[tracker](MetricsWriter &writer)
+			{
+				const std::vector<std::pair<std::string, LatencySnapshot>> totals{ tracker->totals() };
+				if(totals.empty())
+					return;
+
+				writer.family("tads_stage_latency_seconds", "summary", "Latency of each pipeline stage, all sources");
+				for(const auto &[stage, snapshot] : totals)
+				{
+					const std::string label{ metrics_label("stage", stage) };
+					for(const double quantile : { 0.5, 0.9, 0.99 })
+					{
+						writer.sample("tads_stage_latency_seconds", snapshot.value_at(quantile * 100) / 1e6,
+													fmt::format("{},quantile=\"{}\"", label, quantile));
+					}
+					writer.sample("tads_stage_latency_seconds_sum", snapshot.sum / 1e6, label);
+					writer.sample("tads_stage_latency_seconds_count", static_cast<double>(snapshot.total), label);
+				}
+			});
+}
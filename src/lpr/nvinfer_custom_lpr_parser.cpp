@@ -1,12 +1,14 @@
 #include <glib.h>
 
 #include <algorithm>
-#include <string>
-#include <unordered_map>
+#include <cctype>
+#include <clocale>
+#include <cstdint>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <string>
 #include <vector>
-#include <fstream>
 
 #include <nvdsinfer.h>
 
@@ -15,98 +17,145 @@ using std::string;
 using std::vector;
 
 static const size_t SOFTMAX_SIZE = 16;
-static const char *TADS_DICT_PATH_ENV = g_getenv("TADS_DICT_PATH");
-static const char *TADS_LPR_MIN_CONF = g_getenv("TADS_LPR_MIN_CONF");
 const size_t MINIMAL_CHAR_LEN{ 3 };
 
-static const std::string DICT_PATH = TADS_DICT_PATH_ENV != nullptr ? TADS_DICT_PATH_ENV : "../data/configs/dict.txt";
+/**
+ * Maximum size of a decoded plate in bytes, dictionary glyphs may be multibyte.
+ * */
+static const size_t MAX_LABEL_BYTES{ SOFTMAX_SIZE * 8 };
+
+static const char *DEFAULT_DICT_PATH{ "../data/configs/dict.txt" };
+static const float DEFAULT_LPR_MIN_CONF{ 0.45f };
+
+/**
+ * Parser state shared by every call, created once on first use.
+ *
+ * The dictionary is stored as a flat table: the localized glyph of label
+ * i is glyphs[glyph_offsets[i]] .. glyphs[glyph_offsets[i + 1]].
+ * */
+struct LprParserContext
+{
+	bool ready{};
+	float min_confidence{ DEFAULT_LPR_MIN_CONF };
+	std::vector<char> glyphs;
+	std::vector<uint32_t> glyph_offsets;
 
-const unordered_map<std::string, std::string> g_replace_chars{
-	{ "Q", "O" },
-	{ "J", "1" },
+	[[nodiscard]]
+	int labels_size() const
+	{
+		return static_cast<int>(glyph_offsets.size()) - 1;
+	}
 };
 
-static std::string &transform_attr_string(std::string &label)
+static std::string localize(const std::string &text)
+{
+	std::string localized_str(text.length(), '\0');
+	std::transform(text.cbegin(), text.cend(), localized_str.begin(),
+								 [](char c) { return std::toupper(static_cast<unsigned char>(c)); });
+
+	if(localized_str == "Q")
+		localized_str = "O";
+	else if(localized_str == "J")
+		localized_str = "1";
+
+	return localized_str;
+}
+
+static LprParserContext create_context()
 {
-	std::vector<bool> mask;
+	LprParserContext context;
+	const char *dict_path{ g_getenv("TADS_DICT_PATH") };
+	const char *min_conf{ g_getenv("TADS_LPR_MIN_CONF") };
+	ifstream dict_file;
+
+	setlocale(LC_CTYPE, "");
 
-	std::transform(label.begin(), label.end(), label.begin(), [](char &c) { return std::isalnum(c) ? c : char(); });
+	if(min_conf != nullptr)
+		context.min_confidence = std::strtof(min_conf, nullptr);
 
-	for(char c : label)
+	dict_file.open(dict_path != nullptr ? dict_path : DEFAULT_DICT_PATH);
+	if(!dict_file.is_open())
 	{
-		mask.push_back(std::isdigit(c));
+		cerr << "open dictionary file failed." << endl;
+		return context;
 	}
 
-	if(!mask.empty())
+	context.glyph_offsets.push_back(0);
+	string str_line_ansi;
+	while(getline(dict_file, str_line_ansi))
 	{
-		bool matches_mask = std::all_of(mask.begin() + 1, mask.begin() + 4, [](bool item) { return item; });
-
-		if(matches_mask)
-		{
-			if(label.front() == '0' || label.front() == '6')
-			{
-				label.front() = 'O';
-			}
-			else if(label.front() == '8')
-			{
-				label.front() = 'B';
-			}
-			else if(label.front() == '1')
-			{
-				label.front() = 'T';
-			}
+		const std::string glyph{ localize(str_line_ansi) };
+		context.glyphs.insert(context.glyphs.end(), glyph.begin(), glyph.end());
+		context.glyph_offsets.push_back(context.glyphs.size());
+	}
+	context.ready = true;
 
-			if(mask.size() > 4 and mask.at(4))
-			{
-				char &item = label.at(4);
-				if(item == '0')
-				{
-					item = 'O';
-				}
-				else if(item == '8')
-				{
-					item = 'B';
-				}
-			}
+	return context;
+}
 
-			if(mask.size() > 5 && mask.at(5))
-			{
-				char &item = label.at(5);
-
-				if(item == '0')
-				{
-					item = 'O';
-				}
-				else if(item == '8')
-				{
-					item = 'B';
-				}
-				else if(item == '7')
-				{
-					item = 'T';
-				}
-			}
-		}
-	}
+static const LprParserContext &get_context()
+{
+	// Initialization of a function local static is thread-safe
+	static const LprParserContext context{ create_context() };
+	return context;
+}
 
-	return label;
+static bool is_digit(char c)
+{
+	return std::isdigit(static_cast<unsigned char>(c));
 }
 
-std::string localize(const std::string &text)
+static void transform_attr_string(char *label, size_t length)
 {
-	std::string localized_str(text.length(), '\0');
-	std::transform(text.cbegin(), text.cend(), localized_str.begin(), [](char c) { return std::toupper(c); });
+	std::replace_if(label, label + length, [](char c) { return !std::isalnum(static_cast<unsigned char>(c)); }, '\0');
 
-	for(const auto &[k, v] : g_replace_chars)
+	if(length < 4 || !(is_digit(label[1]) && is_digit(label[2]) && is_digit(label[3])))
+		return;
+
+	if(label[0] == '0' || label[0] == '6')
 	{
-		if(localized_str == k)
-			localized_str = v;
+		label[0] = 'O';
+	}
+	else if(label[0] == '8')
+	{
+		label[0] = 'B';
+	}
+	else if(label[0] == '1')
+	{
+		label[0] = 'T';
 	}
-	return localized_str;
-}
 
-static bool g_dict_ready{};
-static std::vector<string> g_dict_table;
+	if(length > 4 && is_digit(label[4]))
+	{
+		char &item = label[4];
+		if(item == '0')
+		{
+			item = 'O';
+		}
+		else if(item == '8')
+		{
+			item = 'B';
+		}
+	}
+
+	if(length > 5 && is_digit(label[5]))
+	{
+		char &item = label[5];
+
+		if(item == '0')
+		{
+			item = 'O';
+		}
+		else if(item == '8')
+		{
+			item = 'B';
+		}
+		else if(item == '7')
+		{
+			item = 'T';
+		}
+	}
+}
 
 extern "C" [[maybe_unused]]
 bool NvDsInferParseCustomNVPlate(std::vector<NvDsInferLayerInfo> const &output_layers_info,
@@ -118,129 +167,76 @@ bool NvDsInferParseCustomNVPlate(std::vector<NvDsInferLayerInfo> const &output_l
 																 NvDsInferNetworkInfo const &network_info, float,
 																 std::vector<NvDsInferAttribute> &attributes, std::string &attribute_label)
 {
+	const LprParserContext &context{ get_context() };
+
+	if(!context.ready)
+		return false;
+
 	int *output_str_buffer{};
 	float *output_conf_buffer{};
-	float min_threshold = TADS_LPR_MIN_CONF != nullptr ? std::strtof(TADS_LPR_MIN_CONF, nullptr) : 0.45;
-	NvDsInferAttribute lpr_attr;
 	float attribute_confidence{ 1 };
 
-	int seq_len;
-
-	// Get list
-	vector<int> label_indexes;
-	int prev = 100;
+	// Greedy CTC decode into fixed buffers, nothing is allocated per plate
+	char label[MAX_LABEL_BYTES + 1];
+	size_t label_length{};
+	float bank_softmax_max[SOFTMAX_SIZE];
+	uint valid_bank_count{};
+	uint char_count{};
 
-	// For confidence
-	std::vector<double> bank_softmax_max(SOFTMAX_SIZE, 0.0);
-	uint valid_bank_count{ 0 };
-	bool do_softmax{};
-	ifstream dict_file;
+	const int labels_size{ context.labels_size() };
+	const int seq_len = network_info.width / 4;
+	int prev{ -1 };
 
-	setlocale(LC_CTYPE, "");
-
-	if(!g_dict_ready)
+	for(const NvDsInferLayerInfo &layer_info : output_layers_info)
 	{
-		dict_file.open(DICT_PATH);
-		if(!dict_file.is_open())
-		{
-			cerr << "open dictionary file failed." << endl;
-			return false;
-		}
-		while(!dict_file.eof())
-		{
-			string str_line_ansi;
-			if(getline(dict_file, str_line_ansi))
-			{
-				g_dict_table.push_back(str_line_ansi);
-			}
-		}
-		g_dict_ready = true;
-		dict_file.close();
-	}
-
-	const int labels_size = g_dict_table.size();
-	int layer_size = output_layers_info.size();
-
-	seq_len = network_info.width / 4;
+		if(layer_info.isInput)
+			continue;
 
-	for(int layer_index = 0; layer_index < layer_size; layer_index++)
-	{
-		if(!output_layers_info[layer_index].isInput)
-		{
-			if(output_layers_info[layer_index].dataType == NvDsInferDataType::FLOAT)
-			{
-				if(output_conf_buffer == nullptr)
-					output_conf_buffer = static_cast<float *>(output_layers_info[layer_index].buffer);
-			}
-			else if(output_layers_info[layer_index].dataType == NvDsInferDataType::INT32)
-			{
-				if(output_str_buffer == nullptr)
-					output_str_buffer = static_cast<int *>(output_layers_info[layer_index].buffer);
-			}
-		}
+		if(layer_info.dataType == NvDsInferDataType::FLOAT && output_conf_buffer == nullptr)
+			output_conf_buffer = static_cast<float *>(layer_info.buffer);
+		else if(layer_info.dataType == NvDsInferDataType::INT32 && output_str_buffer == nullptr)
+			output_str_buffer = static_cast<int *>(layer_info.buffer);
 	}
 
+	if(output_str_buffer == nullptr)
+		return true;
+
 	for(int seq_id = 0; seq_id < seq_len; seq_id++)
 	{
-
-		if(output_str_buffer == nullptr)
-			continue;
-
-		int curr_data = output_str_buffer[seq_id];
+		const int curr_data = output_str_buffer[seq_id];
 		if(curr_data < 0 || curr_data > labels_size)
-		{
 			continue;
-		}
-		if(seq_id == 0)
-		{
-			prev = curr_data;
-			label_indexes.push_back(curr_data);
-			if(curr_data != labels_size)
-			{
-				do_softmax = true;
-			}
-		}
-		else
-		{
-			if(curr_data != prev)
-			{
-				label_indexes.push_back(curr_data);
-				if(curr_data != labels_size)
-				{
-					do_softmax = true;
-				}
-			}
-			prev = curr_data;
-		}
 
-		// Do softmax
-		if(do_softmax)
+		// A new non-blank label starts a character, repeats collapse into the previous one
+		if(curr_data != prev && curr_data != labels_size)
 		{
-			if(output_conf_buffer != nullptr)
-			{
-				bank_softmax_max.at(valid_bank_count++) = output_conf_buffer[seq_id];
-			}
-			do_softmax = false;
-		}
-	}
+			const char *glyph{ context.glyphs.data() + context.glyph_offsets[curr_data] };
+			const size_t glyph_length{ context.glyph_offsets[curr_data + 1] - context.glyph_offsets[curr_data] };
 
-	for(int label_index : label_indexes)
-	{
-		if(label_index != labels_size)
-		{
-			attribute_label.append(localize(g_dict_table[label_index]));
+			// Longer than any plate, drop it
+			if(char_count >= SOFTMAX_SIZE || label_length + glyph_length > MAX_LABEL_BYTES)
+				return true;
+
+			memcpy(label + label_length, glyph, glyph_length);
+			label_length += glyph_length;
+			char_count++;
+
+			if(output_conf_buffer != nullptr)
+				bank_softmax_max[valid_bank_count++] = output_conf_buffer[seq_id];
 		}
+		prev = curr_data;
 	}
+	label[label_length] = '\0';
 
 	// Ignore the short string, it may be wrong plate string
-	if(valid_bank_count > MINIMAL_CHAR_LEN && !attribute_label.empty())
+	if(valid_bank_count > MINIMAL_CHAR_LEN && label_length > 0)
 	{
-		transform_attr_string(attribute_label);
+		transform_attr_string(label, label_length);
 
 		for(uint i{}; i < valid_bank_count; i++)
 		{
-			float conf = bank_softmax_max.at(i);
-			if(conf < min_threshold)
+			float conf = bank_softmax_max[i];
+			if(conf < context.min_confidence)
 			{
 				attribute_confidence = 0.0;
 				break;
@@ -250,11 +246,12 @@ bool NvDsInferParseCustomNVPlate(std::vector<NvDsInferLayerInfo> const &output_l
 
 		if(attribute_confidence > 0.0)
 		{
-			char *label = strdup(attribute_label.c_str());
-			lpr_attr = NvDsInferAttribute{ 0, 1, attribute_confidence, label };
-			attributes.emplace_back(lpr_attr);
+			// Owned by nvinfer, which frees it with free()
+			attributes.emplace_back(NvDsInferAttribute{ 0, 1, attribute_confidence, strdup(label) });
 		}
 	}
 
+	attribute_label.append(label, label_length);
+
 	return true;
 }
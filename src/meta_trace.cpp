@@ -0,0 +1,492 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <nvds_analytics_meta.h>
+
+#include "common.hpp"
+#include "meta_trace.hpp"
+
+/**
+ * Largest batch record accepted by the reader, guards against corrupt sizes.
+ * */
+static constexpr uint32_t MAX_TRACE_RECORD_SIZE{ 64 << 20 };
+
+namespace
+{
+class TraceEncoder
+{
+public:
+	explicit TraceEncoder(std::vector<char> &out):
+		m_out{ out }
+	{}
+
+	template<typename T>
+	void put(const T &value)
+	{
+		const char *bytes{ reinterpret_cast<const char *>(&value) };
+		m_out.insert(m_out.end(), bytes, bytes + sizeof(T));
+	}
+
+	void put_string(std::string_view str)
+	{
+		const auto length{ static_cast<uint16_t>(std::min<size_t>(str.size(), UINT16_MAX)) };
+		put(length);
+		m_out.insert(m_out.end(), str.data(), str.data() + length);
+	}
+
+	void put_strings(const std::vector<std::string> &strings)
+	{
+		put(static_cast<uint16_t>(std::min<size_t>(strings.size(), UINT16_MAX)));
+		for(size_t i = 0; i < strings.size() && i < UINT16_MAX; ++i)
+			put_string(strings[i]);
+	}
+
+	/**
+	 * Reserves a counter that is filled once the number of items is known.
+	 * */
+	size_t put_count()
+	{
+		put<uint16_t>(0);
+		return m_out.size() - sizeof(uint16_t);
+	}
+
+	void set_count(size_t offset, uint16_t count)
+	{
+		memcpy(m_out.data() + offset, &count, sizeof(count));
+	}
+
+private:
+	std::vector<char> &m_out;
+};
+
+class TraceDecoder
+{
+public:
+	TraceDecoder(const char *data, size_t size):
+		m_data{ data },
+		m_size{ size }
+	{}
+
+	template<typename T>
+	bool get(T &value)
+	{
+		if(m_pos + sizeof(T) > m_size)
+			return false;
+		memcpy(&value, m_data + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return true;
+	}
+
+	bool get_string(std::string_view &str)
+	{
+		uint16_t length;
+		if(!get(length) || m_pos + length > m_size)
+			return false;
+		str = { m_data + m_pos, length };
+		m_pos += length;
+		return true;
+	}
+
+	bool get_strings(std::vector<std::string> &strings)
+	{
+		uint16_t count;
+		std::string_view str;
+		if(!get(count))
+			return false;
+		strings.clear();
+		strings.reserve(count);
+		for(uint16_t i = 0; i < count; ++i)
+		{
+			if(!get_string(str))
+				return false;
+			strings.emplace_back(str);
+		}
+		return true;
+	}
+
+private:
+	const char *m_data;
+	size_t m_size;
+	size_t m_pos{};
+};
+} // namespace
+
+static void copy_label(std::string_view label, char *dst, size_t dst_size)
+{
+	const size_t length{ std::min(label.size(), dst_size - 1) };
+	memcpy(dst, label.data(), length);
+	dst[length] = '\0';
+}
+
+static gpointer copy_analytics_obj_info(gpointer data, gpointer)
+{
+	auto *user_meta = reinterpret_cast<NvDsUserMeta *>(data);
+	return new NvDsAnalyticsObjInfo(*reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data));
+}
+
+static void release_analytics_obj_info(gpointer data, gpointer)
+{
+	auto *user_meta = reinterpret_cast<NvDsUserMeta *>(data);
+	delete reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data);
+	user_meta->user_meta_data = nullptr;
+}
+
+static void encode_object(TraceEncoder &encoder, NvDsObjectMeta *obj_meta, int32_t parent_index)
+{
+	encoder.put<uint64_t>(obj_meta->object_id);
+	encoder.put<int32_t>(obj_meta->class_id);
+	encoder.put<int32_t>(obj_meta->unique_component_id);
+	encoder.put<float>(obj_meta->confidence);
+	encoder.put<float>(obj_meta->tracker_confidence);
+	encoder.put<float>(obj_meta->rect_params.left);
+	encoder.put<float>(obj_meta->rect_params.top);
+	encoder.put<float>(obj_meta->rect_params.width);
+	encoder.put<float>(obj_meta->rect_params.height);
+	encoder.put<int32_t>(parent_index);
+	encoder.put_string(obj_meta->obj_label);
+
+	size_t classifier_count_offset{ encoder.put_count() };
+	uint16_t num_classifiers{};
+	for(NvDsMetaList *l_class = obj_meta->classifier_meta_list; l_class; l_class = l_class->next)
+	{
+		auto *class_meta = reinterpret_cast<NvDsClassifierMeta *>(l_class->data);
+		if(!class_meta)
+			continue;
+
+		encoder.put<int32_t>(class_meta->unique_component_id);
+		size_t label_count_offset{ encoder.put_count() };
+		uint16_t num_labels{};
+		for(NvDsLabelInfoList *l_label = class_meta->label_info_list; l_label; l_label = l_label->next)
+		{
+			auto *label_info = reinterpret_cast<NvDsLabelInfo *>(l_label->data);
+			if(!label_info)
+				continue;
+
+			encoder.put<uint32_t>(label_info->label_id);
+			encoder.put<uint32_t>(label_info->result_class_id);
+			encoder.put<float>(label_info->result_prob);
+			encoder.put_string(label_info->pResult_label ? label_info->pResult_label : label_info->result_label);
+			num_labels++;
+		}
+		encoder.set_count(label_count_offset, num_labels);
+		num_classifiers++;
+	}
+	encoder.set_count(classifier_count_offset, num_classifiers);
+
+	size_t analytics_count_offset{ encoder.put_count() };
+	uint16_t num_analytics{};
+	for(NvDsMetaList *l_user = obj_meta->obj_user_meta_list; l_user; l_user = l_user->next)
+	{
+		auto *user_meta = reinterpret_cast<NvDsUserMeta *>(l_user->data);
+		if(!user_meta || user_meta->base_meta.meta_type != NVDS_USER_OBJ_META_NVDSANALYTICS)
+			continue;
+
+		auto *obj_info = reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data);
+		encoder.put<uint32_t>(obj_info->unique_id);
+		encoder.put_string(obj_info->dirStatus);
+		encoder.put_strings(obj_info->lcStatus);
+		encoder.put_strings(obj_info->roiStatus);
+		encoder.put_strings(obj_info->ocStatus);
+		num_analytics++;
+	}
+	encoder.set_count(analytics_count_offset, num_analytics);
+}
+
+MetaTraceWriter::~MetaTraceWriter()
+{
+	close();
+}
+
+bool MetaTraceWriter::open(const std::string &file_path)
+{
+	MetaTraceFileHeader header{};
+
+	close();
+
+	m_file = fopen(file_path.c_str(), "wb");
+	if(!m_file)
+	{
+		TADS_ERR_MSG_V("Could not open metadata trace '%s': %s", file_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	memcpy(header.magic, MetaTraceFileHeader::MAGIC, sizeof(header.magic));
+	header.version = MetaTraceFileHeader::VERSION;
+	if(fwrite(&header, sizeof(header), 1, m_file) != 1)
+	{
+		TADS_ERR_MSG_V("Could not write metadata trace '%s': %s", file_path.c_str(), strerror(errno));
+		close();
+		return false;
+	}
+	m_batches = 0;
+	return true;
+}
+
+void MetaTraceWriter::close()
+{
+	if(m_file)
+		fclose(m_file);
+	m_file = nullptr;
+}
+
+bool MetaTraceWriter::write(GstBuffer *buffer, NvDsBatchMeta *batch_meta)
+{
+	if(!m_file || !batch_meta)
+		return false;
+
+	m_payload.clear();
+	TraceEncoder encoder{ m_payload };
+	std::vector<NvDsObjectMeta *> objects;
+
+	encoder.put<uint64_t>(buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE);
+	size_t frame_count_offset{ encoder.put_count() };
+	uint16_t num_frames{};
+
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
+	{
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+		if(!frame_meta)
+			continue;
+
+		objects.clear();
+		for(NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj; l_obj = l_obj->next)
+			objects.push_back(reinterpret_cast<NvDsObjectMeta *>(l_obj->data));
+
+		encoder.put<uint32_t>(frame_meta->source_id);
+		encoder.put<uint32_t>(frame_meta->batch_id);
+		encoder.put<int32_t>(frame_meta->frame_num);
+		encoder.put<uint64_t>(frame_meta->buf_pts);
+		encoder.put<uint64_t>(frame_meta->ntp_timestamp);
+		encoder.put<uint32_t>(objects.size());
+
+		for(NvDsObjectMeta *obj_meta : objects)
+		{
+			// Parents are referenced by their position in the frame object list
+			int32_t parent_index{ -1 };
+			if(obj_meta->parent)
+			{
+				auto parent = std::find(objects.cbegin(), objects.cend(), obj_meta->parent);
+				if(parent != objects.cend())
+					parent_index = static_cast<int32_t>(parent - objects.cbegin());
+			}
+			encode_object(encoder, obj_meta, parent_index);
+		}
+		num_frames++;
+	}
+	encoder.set_count(frame_count_offset, num_frames);
+
+	const auto payload_size{ static_cast<uint32_t>(m_payload.size()) };
+	if(fwrite(&payload_size, sizeof(payload_size), 1, m_file) != 1 ||
+		 fwrite(m_payload.data(), 1, m_payload.size(), m_file) != m_payload.size())
+	{
+		TADS_ERR_MSG_V("Could not write metadata trace: %s, capture stopped", strerror(errno));
+		close();
+		return false;
+	}
+	m_batches++;
+	return true;
+}
+
+MetaTraceReader::~MetaTraceReader()
+{
+	close();
+}
+
+bool MetaTraceReader::open(const std::string &file_path)
+{
+	struct stat file_stat{};
+	MetaTraceFileHeader header{};
+
+	close();
+
+	int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not open metadata trace '%s': %s", file_path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if(fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(header))
+	{
+		TADS_ERR_MSG_V("'%s' is not a metadata trace", file_path.c_str());
+		::close(fd);
+		return false;
+	}
+
+	void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED)
+	{
+		TADS_ERR_MSG_V("Could not map metadata trace '%s': %s", file_path.c_str(), strerror(errno));
+		return false;
+	}
+	madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+
+	m_data = static_cast<const char *>(mapping);
+	m_size = file_stat.st_size;
+
+	memcpy(&header, m_data, sizeof(header));
+	if(memcmp(header.magic, MetaTraceFileHeader::MAGIC, sizeof(header.magic)) != 0 ||
+		 header.version != MetaTraceFileHeader::VERSION)
+	{
+		TADS_ERR_MSG_V("'%s' is not a metadata trace of version %u", file_path.c_str(), MetaTraceFileHeader::VERSION);
+		close();
+		return false;
+	}
+
+	rewind();
+	return true;
+}
+
+void MetaTraceReader::close()
+{
+	if(m_data)
+		munmap(const_cast<char *>(m_data), m_size);
+	m_data = nullptr;
+	m_size = 0;
+	m_offset = 0;
+}
+
+void MetaTraceReader::rewind()
+{
+	m_offset = sizeof(MetaTraceFileHeader);
+	m_corrupt = false;
+}
+
+NvDsBatchMeta *MetaTraceReader::next(uint64_t &pts, uint64_t &num_objects)
+{
+	uint32_t payload_size;
+	uint16_t num_frames;
+	NvDsBatchMeta *batch_meta{};
+	std::vector<NvDsObjectMeta *> objects;
+	std::vector<int32_t> parents;
+
+	if(!m_data || m_offset + sizeof(payload_size) > m_size)
+		return nullptr;
+
+	memcpy(&payload_size, m_data + m_offset, sizeof(payload_size));
+	if(payload_size > MAX_TRACE_RECORD_SIZE || m_offset + sizeof(payload_size) + payload_size > m_size)
+	{
+		TADS_ERR_MSG_V("Metadata trace is truncated at offset %zu", m_offset);
+		m_corrupt = true;
+		return nullptr;
+	}
+
+	TraceDecoder decoder{ m_data + m_offset + sizeof(payload_size), payload_size };
+	m_offset += sizeof(payload_size) + payload_size;
+	num_objects = 0;
+
+	if(!decoder.get(pts) || !decoder.get(num_frames))
+		goto corrupt;
+
+	batch_meta = nvds_create_batch_meta(std::max<uint16_t>(num_frames, 1));
+
+	for(uint16_t f = 0; f < num_frames; ++f)
+	{
+		NvDsFrameMeta *frame_meta = nvds_acquire_frame_meta_from_pool(batch_meta);
+		uint32_t num_frame_objects;
+
+		if(!decoder.get(frame_meta->source_id) || !decoder.get(frame_meta->batch_id) ||
+			 !decoder.get(frame_meta->frame_num) || !decoder.get(frame_meta->buf_pts) ||
+			 !decoder.get(frame_meta->ntp_timestamp) || !decoder.get(num_frame_objects))
+		{
+			goto corrupt;
+		}
+		frame_meta->pad_index = frame_meta->source_id;
+		nvds_add_frame_meta_to_batch(batch_meta, frame_meta);
+
+		objects.clear();
+		parents.clear();
+		for(uint32_t o = 0; o < num_frame_objects; ++o)
+		{
+			NvDsObjectMeta *obj_meta = nvds_acquire_obj_meta_from_pool(batch_meta);
+			int32_t parent_index;
+			uint16_t num_classifiers, num_analytics;
+			std::string_view label;
+
+			objects.push_back(obj_meta);
+			if(!decoder.get(obj_meta->object_id) || !decoder.get(obj_meta->class_id) ||
+				 !decoder.get(obj_meta->unique_component_id) || !decoder.get(obj_meta->confidence) ||
+				 !decoder.get(obj_meta->tracker_confidence) || !decoder.get(obj_meta->rect_params.left) ||
+				 !decoder.get(obj_meta->rect_params.top) || !decoder.get(obj_meta->rect_params.width) ||
+				 !decoder.get(obj_meta->rect_params.height) || !decoder.get(parent_index) || !decoder.get_string(label))
+			{
+				goto corrupt;
+			}
+			copy_label(label, obj_meta->obj_label, sizeof(obj_meta->obj_label));
+			parents.push_back(parent_index);
+
+			if(!decoder.get(num_classifiers))
+				goto corrupt;
+			for(uint16_t c = 0; c < num_classifiers; ++c)
+			{
+				NvDsClassifierMeta *class_meta = nvds_acquire_classifier_meta_from_pool(batch_meta);
+				uint16_t num_labels;
+
+				if(!decoder.get(class_meta->unique_component_id) || !decoder.get(num_labels))
+					goto corrupt;
+
+				for(uint16_t l = 0; l < num_labels; ++l)
+				{
+					NvDsLabelInfo *label_info = nvds_acquire_label_info_meta_from_pool(batch_meta);
+					if(!decoder.get(label_info->label_id) || !decoder.get(label_info->result_class_id) ||
+						 !decoder.get(label_info->result_prob) || !decoder.get_string(label))
+					{
+						goto corrupt;
+					}
+					copy_label(label, label_info->result_label, sizeof(label_info->result_label));
+					label_info->pResult_label = nullptr;
+					nvds_add_label_info_meta_to_classifier(class_meta, label_info);
+				}
+				class_meta->num_labels = num_labels;
+				nvds_add_classifier_meta_to_object(obj_meta, class_meta);
+			}
+
+			if(!decoder.get(num_analytics))
+				goto corrupt;
+			for(uint16_t a = 0; a < num_analytics; ++a)
+			{
+				auto *obj_info = new NvDsAnalyticsObjInfo();
+				if(!decoder.get(obj_info->unique_id) || !decoder.get_string(label) ||
+					 !decoder.get_strings(obj_info->lcStatus) || !decoder.get_strings(obj_info->roiStatus) ||
+					 !decoder.get_strings(obj_info->ocStatus))
+				{
+					delete obj_info;
+					goto corrupt;
+				}
+				obj_info->dirStatus = label;
+
+				NvDsUserMeta *user_meta = nvds_acquire_user_meta_from_pool(batch_meta);
+				user_meta->user_meta_data = obj_info;
+				user_meta->base_meta.meta_type = NVDS_USER_OBJ_META_NVDSANALYTICS;
+				user_meta->base_meta.copy_func = copy_analytics_obj_info;
+				user_meta->base_meta.release_func = release_analytics_obj_info;
+				nvds_add_user_meta_to_obj(obj_meta, user_meta);
+			}
+		}
+
+		// Parents may come after their children, so objects are added once all are decoded
+		for(size_t o = 0; o < objects.size(); ++o)
+		{
+			NvDsObjectMeta *parent{};
+			if(parents[o] >= 0 && static_cast<size_t>(parents[o]) < objects.size())
+				parent = objects[parents[o]];
+			nvds_add_obj_meta_to_frame(frame_meta, objects[o], parent);
+		}
+		num_objects += objects.size();
+	}
+
+	return batch_meta;
+
+corrupt:
+	TADS_ERR_MSG_V("Metadata trace record at offset %zu is corrupt", m_offset - payload_size - sizeof(payload_size));
+	m_corrupt = true;
+	if(batch_meta)
+		nvds_destroy_batch_meta(batch_meta);
+	return nullptr;
+}
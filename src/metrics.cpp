@@ -0,0 +1,351 @@
+#include <map>
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include "common.hpp"
+#include "metrics.hpp"
+
+static constexpr size_t MAX_REQUEST_SIZE{ 8192 };
+static constexpr int CONNECTION_TIMEOUT_MS{ 2000 };
+
+static void append_escaped(std::string &out, std::string_view text, bool quotes)
+{
+	for(const char c : text)
+	{
+		if(c == '\\')
+			out += "\\\\";
+		else if(c == '\n')
+			out += "\\n";
+		else if(c == '"' && quotes)
+			out += "\\\"";
+		else
+			out += c;
+	}
+}
+
+std::string metrics_label(std::string_view key, std::string_view value)
+{
+	std::string label{ key };
+	label += "=\"";
+	append_escaped(label, value, true);
+	label += '"';
+	return label;
+}
+
+void MetricsWriter::family(std::string_view name, std::string_view type, std::string_view help)
+{
+	m_text += "# HELP ";
+	m_text += name;
+	m_text += ' ';
+	append_escaped(m_text, help, false);
+	m_text += "\n# TYPE ";
+	m_text += name;
+	m_text += ' ';
+	m_text += type;
+	m_text += '\n';
+}
+
+void MetricsWriter::sample(std::string_view name, double value, std::string_view labels)
+{
+	m_text += name;
+	if(!labels.empty())
+	{
+		m_text += '{';
+		m_text += labels;
+		m_text += '}';
+	}
+	m_text += ' ';
+
+	if(std::isnan(value))
+		m_text += "NaN";
+	else if(std::isinf(value))
+		m_text += value > 0 ? "+Inf" : "-Inf";
+	else
+		fmt::format_to(std::back_inserter(m_text), "{}", value);
+	m_text += '\n';
+}
+
+std::atomic<uint64_t> *MetricsRegistry::counter(const std::string &name, const std::string &help,
+																								const std::string &labels)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	for(Counter &counter : m_counters)
+	{
+		if(counter.name == name && counter.labels == labels)
+			return &counter.value;
+	}
+
+	Counter &counter{ m_counters.emplace_back() };
+	counter.name = name;
+	counter.help = help;
+	counter.labels = labels;
+	return &counter.value;
+}
+
+void MetricsRegistry::add_collector(MetricsCollector collector)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_collectors.push_back(std::move(collector));
+}
+
+std::string MetricsRegistry::scrape()
+{
+	MetricsWriter writer;
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	// Samples of a family must follow its header, counters are grouped by name
+	std::map<std::string_view, std::vector<const Counter *>> families;
+	for(const Counter &counter : m_counters)
+		families[counter.name].push_back(&counter);
+
+	for(const auto &[name, counters] : families)
+	{
+		writer.family(name, "counter", counters.front()->help);
+		for(const Counter *counter : counters)
+			writer.sample(name, static_cast<double>(counter->value.load(std::memory_order_relaxed)), counter->labels);
+	}
+
+	for(const MetricsCollector &collector : m_collectors)
+		collector(writer);
+
+	return writer.text();
+}
+
+MetricsServer::MetricsServer(std::string address, MetricsRegistry *registry):
+	m_address{ std::move(address) },
+	m_registry{ registry }
+{}
+
+MetricsServer::~MetricsServer()
+{
+	stop();
+}
+
+bool MetricsServer::open_socket()
+{
+	constexpr std::string_view unix_prefix{ "unix:" };
+
+	if(starts_with(m_address, unix_prefix))
+	{
+		sockaddr_un address{};
+		m_unix_path = m_address.substr(unix_prefix.size());
+		if(m_unix_path.empty() || m_unix_path.size() >= sizeof(address.sun_path))
+		{
+			TADS_ERR_MSG_V("Invalid metrics socket path '%s'", m_unix_path.c_str());
+			return false;
+		}
+
+		address.sun_family = AF_UNIX;
+		memcpy(address.sun_path, m_unix_path.c_str(), m_unix_path.size() + 1);
+		// A socket left by a previous run would make bind fail
+		unlink(m_unix_path.c_str());
+
+		m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if(m_listen_fd < 0 || bind(m_listen_fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+			 listen(m_listen_fd, 16) != 0)
+		{
+			TADS_ERR_MSG_V("Could not listen on '%s': %s", m_unix_path.c_str(), strerror(errno));
+			return false;
+		}
+		return true;
+	}
+
+	const size_t separator{ m_address.rfind(':') };
+	if(separator == std::string::npos)
+	{
+		TADS_ERR_MSG_V("Invalid metrics address '%s', expected host:port or unix:path", m_address.c_str());
+		return false;
+	}
+
+	std::string host{ m_address.substr(0, separator) };
+	const std::string port{ m_address.substr(separator + 1) };
+	if(host.empty())
+		host = "127.0.0.1";
+	else if(host.size() > 2 && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+
+	addrinfo hints{};
+	addrinfo *addresses{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+
+	const int result{ getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) };
+	if(result != 0)
+	{
+		TADS_ERR_MSG_V("Could not resolve metrics address '%s': %s", m_address.c_str(), gai_strerror(result));
+		return false;
+	}
+
+	for(addrinfo *itr = addresses; itr; itr = itr->ai_next)
+	{
+		const int fd{ socket(itr->ai_family, itr->ai_socktype | SOCK_CLOEXEC, itr->ai_protocol) };
+		if(fd < 0)
+			continue;
+
+		const int reuse{ 1 };
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		if(bind(fd, itr->ai_addr, itr->ai_addrlen) == 0 && listen(fd, 16) == 0)
+		{
+			m_listen_fd = fd;
+			break;
+		}
+		close(fd);
+	}
+	freeaddrinfo(addresses);
+
+	if(m_listen_fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not listen on '%s': %s", m_address.c_str(), strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+bool MetricsServer::start()
+{
+	if(m_thread.joinable())
+		return true;
+
+	if(!open_socket())
+	{
+		stop();
+		return false;
+	}
+
+	m_wake_fd = eventfd(0, EFD_CLOEXEC);
+	if(m_wake_fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not create the metrics wake fd: %s", strerror(errno));
+		stop();
+		return false;
+	}
+
+	m_thread = std::thread(&MetricsServer::run, this);
+	TADS_INFO_MSG_V("Serving metrics on '%s'", m_address.c_str());
+	return true;
+}
+
+void MetricsServer::stop()
+{
+	if(m_thread.joinable())
+	{
+		const uint64_t value{ 1 };
+		if(write(m_wake_fd, &value, sizeof(value)) != sizeof(value))
+			TADS_WARN_MSG_V("Could not wake the metrics server: %s", strerror(errno));
+		m_thread.join();
+	}
+
+	if(m_listen_fd >= 0)
+	{
+		close(m_listen_fd);
+		m_listen_fd = -1;
+		if(!m_unix_path.empty())
+			unlink(m_unix_path.c_str());
+	}
+	if(m_wake_fd >= 0)
+	{
+		close(m_wake_fd);
+		m_wake_fd = -1;
+	}
+}
+
+static bool send_all(int fd, std::string_view data)
+{
+	while(!data.empty())
+	{
+		const ssize_t sent{ send(fd, data.data(), data.size(), MSG_NOSIGNAL) };
+		if(sent < 0 && errno == EINTR)
+			continue;
+		if(sent <= 0)
+			return false;
+		data.remove_prefix(static_cast<size_t>(sent));
+	}
+	return true;
+}
+
+void MetricsServer::serve(int fd)
+{
+	const timeval timeout{ CONNECTION_TIMEOUT_MS / 1000, (CONNECTION_TIMEOUT_MS % 1000) * 1000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	// Only the request line matters, the headers are read to avoid resetting the connection
+	std::string request;
+	char buffer[1024];
+	while(request.size() < MAX_REQUEST_SIZE && request.find("\r\n\r\n") == std::string::npos &&
+				request.find("\n\n") == std::string::npos)
+	{
+		const ssize_t received{ recv(fd, buffer, sizeof(buffer), 0) };
+		if(received < 0 && errno == EINTR)
+			continue;
+		if(received <= 0)
+			break;
+		request.append(buffer, static_cast<size_t>(received));
+	}
+
+	const std::string_view line{ std::string_view(request).substr(0, request.find_first_of("\r\n")) };
+	const size_t method_end{ line.find(' ') };
+	const std::string_view method{ line.substr(0, method_end) };
+	std::string_view path{ method_end != std::string_view::npos ? line.substr(method_end + 1) : std::string_view() };
+	path = path.substr(0, path.find_first_of(" ?"));
+
+	std::string status{ "200 OK" };
+	std::string body;
+	if(method != "GET" && method != "HEAD")
+	{
+		status = "405 Method Not Allowed";
+	}
+	else if(path != "/" && path != "/metrics")
+	{
+		status = "404 Not Found";
+	}
+	else
+	{
+		body = m_registry->scrape();
+		m_scrapes.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	const std::string header{ fmt::format("HTTP/1.0 {}\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+																				"Content-Length: {}\r\nConnection: close\r\n\r\n",
+																				status, body.size()) };
+	if(send_all(fd, header) && method != "HEAD")
+		send_all(fd, body);
+}
+
+void MetricsServer::run()
+{
+	pollfd fds[2]{ { m_listen_fd, POLLIN, 0 }, { m_wake_fd, POLLIN, 0 } };
+
+	while(true)
+	{
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			TADS_ERR_MSG_V("Metrics server stopped: %s", strerror(errno));
+			break;
+		}
+
+		if(fds[1].revents != 0)
+			break;
+
+		if(fds[0].revents & POLLIN)
+		{
+			const int fd{ accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC) };
+			if(fd < 0)
+				continue;
+
+			serve(fd);
+			close(fd);
+		}
+	}
+}
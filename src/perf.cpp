@@ -1,9 +1,36 @@
-#include <cmath>
-#include <sys/time.h>
+#include <ctime>
 
 #include <gstnvdsmeta.h>
 
+#include "metrics.hpp"
 #include "perf.hpp"
+#include "span_trace.hpp"
+
+int64_t perf_now_ns()
+{
+	timespec now{};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+void perf_count_frame(InstancePerfStruct &instance, int64_t now_ns)
+{
+	int64_t start_ns{ instance.start_ns.load(std::memory_order_relaxed) };
+	// The first frame of a run only starts the clock, there is no interval before it
+	if(start_ns == 0 && instance.start_ns.compare_exchange_strong(start_ns, now_ns, std::memory_order_relaxed))
+	{
+		instance.last_ns.store(now_ns, std::memory_order_relaxed);
+		return;
+	}
+
+	// Several threads may count the same source, the last time never goes back
+	int64_t last_ns{ instance.last_ns.load(std::memory_order_relaxed) };
+	while(last_ns < now_ns && !instance.last_ns.compare_exchange_weak(last_ns, now_ns, std::memory_order_relaxed))
+	{
+	}
+	// Pairs with the acquire of the reporter, which then sees a last time at least as recent
+	instance.frame_cnt.fetch_add(1, std::memory_order_release);
+}
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "ConstantFunctionResult"
@@ -12,163 +39,101 @@
  */
 static GstPadProbeReturn sink_bin_buf_probe([[maybe_unused]] GstPad *pad, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("sink_bin_buf_probe");
 	auto *str = reinterpret_cast<AppPerfStructInt *>(data);
 	NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_BUFFER(info->data));
 
-	if(!batch_meta)
+	if(!batch_meta || str->stop.load(std::memory_order_relaxed))
 		return GST_PAD_PROBE_OK;
 
-	if(!str->stop)
+	// One clock read for the whole batch, its frames leave the pipeline together
+	const int64_t now_ns{ perf_now_ns() };
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
 	{
-		g_mutex_lock(&str->struct_lock);
-		for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
-		{
-			auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
-			InstancePerfStruct *str1 = &str->instance_str[frame_meta->pad_index];
-			gettimeofday(&str1->last_fps_time, nullptr);
-			if(str1->start_fps_time.tv_sec == 0 && str1->start_fps_time.tv_usec == 0)
-			{
-				str1->start_fps_time = str1->last_fps_time;
-			}
-			else
-			{
-				str1->buffer_cnt++;
-			}
-		}
-		g_mutex_unlock(&str->struct_lock);
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+		if(frame_meta->pad_index >= str->instance_str.size())
+			continue;
+
+		perf_count_frame(str->instance_str[frame_meta->pad_index], now_ns);
 	}
 	return GST_PAD_PROBE_OK;
 }
 #pragma clang diagnostic pop
 
-static bool perf_measurement_callback(void *data)
+/**
+ * Computes the fps of one source over the last interval and appends it to @p perf_struct.
+ */
+static void update_instance_fps(AppPerfStructInt *str, AppPerfStruct *perf_struct, uint source_id,
+																const char *stream_name, int64_t now_ns)
 {
-	auto *str = reinterpret_cast<AppPerfStructInt *>(data);
-	std::array<uint, MAX_SOURCE_BINS> buffer_cnt{ 0 };
-	AppPerfStruct perf_struct;
-	struct timeval current_fps_time;
-	uint i;
-	g_mutex_lock(&str->struct_lock);
-	if(str->stop)
-	{
-		g_mutex_unlock(&str->struct_lock);
-		return false;
-	}
-	perf_struct.use_nvmultiurisrcbin = str->use_nvmultiurisrcbin;
-	perf_struct.stream_name_display = str->stream_name_display;
-	/*if (str->use_nvmultiurisrcbin) {
-		perf_struct.num_instances =  g_hash_table_size(str->FPSInfoHash);
-	} else {
-		perf_struct.num_instances = str->num_instances;
-	}*/
-
-	if(!str->use_nvmultiurisrcbin)
-	{
-		for(i = 0; i < str->num_instances; i++)
-		{
-			buffer_cnt.at(i) = str->instance_str[i].buffer_cnt / str->dewarper_surfaces_per_frame;
-			str->instance_str[i].buffer_cnt = 0;
-		}
-	}
-	else
-	{
-		GList *active_source_id_list = g_hash_table_get_keys(str->fps_info_hash);
-		GList *temp = active_source_id_list;
-		for(uint j = 0; j < g_hash_table_size(str->fps_info_hash); j++)
-		{
-			(perf_struct.source_detail[j]).source_id = GPOINTER_TO_UINT(temp->data);
-			auto *fps_sensor_info = static_cast<FPSSensorInfo *>(
-					g_hash_table_lookup(str->fps_info_hash, GUINT_TO_POINTER((perf_struct.source_detail[j]).source_id)));
-			(perf_struct.source_detail[j]).stream_name = (char *)fps_sensor_info->uri;
-			temp = temp->next;
-		}
-
-		if(temp)
-			g_list_free(temp);
-
-		if(active_source_id_list)
-			g_list_free(active_source_id_list);
-		perf_struct.active_source_size = g_hash_table_size(str->fps_info_hash);
+	InstancePerfStruct &instance = str->instance_str[source_id];
+	InstancePerfSnapshot &snapshot = str->instance_snapshot[source_id];
 
-		for(uint j = 0; j < g_hash_table_size(str->fps_info_hash); j++)
-		{
-			i = perf_struct.source_detail[j].source_id;
-			buffer_cnt.at(i) = str->instance_str[i].buffer_cnt / str->dewarper_surfaces_per_frame;
-			str->instance_str[i].buffer_cnt = 0;
-		}
-	}
+	const uint64_t frame_cnt{ instance.frame_cnt.load(std::memory_order_acquire) };
+	const int64_t last_ns{ instance.last_ns.load(std::memory_order_relaxed) };
+	const int64_t start_ns{ instance.start_ns.load(std::memory_order_relaxed) };
 
-	perf_struct.num_instances = str->num_instances;
-	gettimeofday(&current_fps_time, nullptr);
+	const uint64_t buffer_cnt{ (frame_cnt - snapshot.frame_cnt) / str->dewarper_surfaces_per_frame };
+	snapshot.frame_cnt = frame_cnt;
+	snapshot.total_frame_cnt += buffer_cnt;
 
-	if(!str->use_nvmultiurisrcbin)
-	{
-		for(i = 0; i < str->num_instances; i++)
-		{
-			InstancePerfStruct *str1 = &str->instance_str[i];
-			double time1 = (str1->total_fps_time.tv_sec + str1->total_fps_time.tv_usec / 1000000.0) +
-										 (current_fps_time.tv_sec + current_fps_time.tv_usec / 1000000.0) -
-										 (str1->start_fps_time.tv_sec + str1->start_fps_time.tv_usec / 1000000.0);
+	const double time1{ (snapshot.total_ns + (start_ns != 0 ? now_ns - start_ns : 0)) / 1e9 };
+	const double time2{ start_ns != 0 ? (last_ns - (snapshot.last_ns != 0 ? snapshot.last_ns : start_ns)) / 1e9 : 0 };
 
-			double time2;
+	AppSourceDetail &detail = perf_struct->source_detail.emplace_back();
+	detail.source_id = source_id;
+	detail.stream_name = stream_name;
+	detail.fps = time2 > 0 ? buffer_cnt / time2 : 0;
+	detail.fps_avg = time1 > 0 ? snapshot.total_frame_cnt / time1 : 0;
 
-			if(str1->last_sample_fps_time.tv_sec == 0 && str1->last_sample_fps_time.tv_usec == 0)
-			{
-				time2 = (str1->last_fps_time.tv_sec + str1->last_fps_time.tv_usec / 1000000.0) -
-								(str1->start_fps_time.tv_sec + str1->start_fps_time.tv_usec / 1000000.0);
-			}
-			else
-			{
-				time2 = (str1->last_fps_time.tv_sec + str1->last_fps_time.tv_usec / 1000000.0) -
-								(str1->last_sample_fps_time.tv_sec + str1->last_sample_fps_time.tv_usec / 1000000.0);
-			}
-			str1->total_buffer_cnt += buffer_cnt.at(i);
-			perf_struct.fps.at(i) = buffer_cnt.at(i) / time2;
-			if(std::isnan(perf_struct.fps.at(i)))
-				perf_struct.fps[i] = 0;
+	snapshot.last_ns = start_ns != 0 ? last_ns : 0;
+}
 
-			perf_struct.fps_avg.at(i) = str1->total_buffer_cnt / time1;
-			if(std::isnan(perf_struct.fps_avg.at(i)))
-				perf_struct.fps_avg.at(i) = 0;
+void collect_perf_measurement(AppPerfStructInt *str, AppPerfStruct *perf_struct)
+{
+	g_mutex_lock(&str->struct_lock);
+	perf_struct->use_nvmultiurisrcbin = str->use_nvmultiurisrcbin;
+	perf_struct->stream_name_display = str->stream_name_display;
+	perf_struct->num_instances = str->num_instances;
+	const int64_t now_ns{ perf_now_ns() };
 
-			str1->last_sample_fps_time = str1->last_fps_time;
-		}
-	}
-	else
+	perf_struct->source_detail.reserve(str->num_instances);
+	for(uint i{}; i < str->num_instances; i++)
 	{
-		for(uint j = 0; j < g_hash_table_size(str->fps_info_hash); j++)
-		{
-			i = perf_struct.source_detail[j].source_id;
-			InstancePerfStruct *str1 = &str->instance_str[i];
-			double time1 = (str1->total_fps_time.tv_sec + str1->total_fps_time.tv_usec / 1000000.0) +
-										 (current_fps_time.tv_sec + current_fps_time.tv_usec / 1000000.0) -
-										 (str1->start_fps_time.tv_sec + str1->start_fps_time.tv_usec / 1000000.0);
+		const char *stream_name{};
 
-			double time2;
+		// Only sources added to nvmultiurisrcbin are listed, not the whole batch
+		if(str->use_nvmultiurisrcbin)
+		{
+			if(!str->instance_str[i].active.load(std::memory_order_relaxed))
+				continue;
 
-			if(str1->last_sample_fps_time.tv_sec == 0 && str1->last_sample_fps_time.tv_usec == 0)
+			if(str->stream_name_display && str->fps_info_hash)
 			{
-				time2 = (str1->last_fps_time.tv_sec + str1->last_fps_time.tv_usec / 1000000.0) -
-								(str1->start_fps_time.tv_sec + str1->start_fps_time.tv_usec / 1000000.0);
+				auto *sensor_info =
+						static_cast<FPSSensorInfo *>(g_hash_table_lookup(str->fps_info_hash, GUINT_TO_POINTER(i)));
+				stream_name = sensor_info ? sensor_info->uri : nullptr;
 			}
-			else
-			{
-				time2 = (str1->last_fps_time.tv_sec + str1->last_fps_time.tv_usec / 1000000.0) -
-								(str1->last_sample_fps_time.tv_sec + str1->last_sample_fps_time.tv_usec / 1000000.0);
-			}
-			str1->total_buffer_cnt += buffer_cnt.at(i);
-			perf_struct.fps.at(i) = buffer_cnt.at(i) / time2;
-			if(std::isnan(perf_struct.fps.at(i)))
-				perf_struct.fps.at(i) = 0;
-
-			perf_struct.fps_avg.at(i) = str1->total_buffer_cnt / time1;
-			if(std::isnan(perf_struct.fps_avg.at(i)))
-				perf_struct.fps_avg.at(i) = 0;
-
-			str1->last_sample_fps_time = str1->last_fps_time;
 		}
+		update_instance_fps(str, perf_struct, i, stream_name, now_ns);
 	}
+	perf_struct->active_source_size = perf_struct->source_detail.size();
 	g_mutex_unlock(&str->struct_lock);
+}
+
+static bool perf_measurement_callback(void *data)
+{
+	auto *str = reinterpret_cast<AppPerfStructInt *>(data);
+	AppPerfStruct perf_struct;
+
+	if(str->stop.load(std::memory_order_relaxed))
+	{
+		// The source is removed, resume adds a new one
+		str->perf_measurement_timeout_id = 0;
+		return false;
+	}
+
+	collect_perf_measurement(str, &perf_struct);
 
 	if(str->callback != nullptr)
 		str->callback(str->context, &perf_struct);
@@ -176,24 +141,60 @@ static bool perf_measurement_callback(void *data)
 	return true;
 }
 
-void pause_perf_measurement(AppPerfStructInt *perf_struct)
+void add_perf_metrics(MetricsRegistry *registry, AppPerfStructInt *str)
 {
-	uint i;
+	struct Previous
+	{
+		int64_t time_ns{};
+		std::vector<uint64_t> frame_cnt;
+	};
 
+	registry->add_collector(
+			[str, previous = Previous{}](MetricsWriter &writer) mutable
+			{
+				const int64_t now_ns{ perf_now_ns() };
+				const double elapsed_s{ previous.time_ns != 0 ? (now_ns - previous.time_ns) / 1e9 : 0 };
+				std::vector<std::pair<std::string, uint64_t>> frame_cnts;
+				std::vector<double> fps;
+
+				previous.frame_cnt.resize(str->instance_str.size());
+				for(uint i{}; i < str->instance_str.size(); i++)
+				{
+					const InstancePerfStruct &instance = str->instance_str[i];
+					if(str->use_nvmultiurisrcbin && !instance.active.load(std::memory_order_relaxed))
+						continue;
+
+					const uint64_t frame_cnt{ instance.frame_cnt.load(std::memory_order_relaxed) };
+					frame_cnts.emplace_back(metrics_label("source", std::to_string(i)), frame_cnt);
+					fps.push_back(elapsed_s > 0 ? (frame_cnt - previous.frame_cnt[i]) / elapsed_s : 0);
+					previous.frame_cnt[i] = frame_cnt;
+				}
+				previous.time_ns = now_ns;
+
+				if(frame_cnts.empty())
+					return;
+
+				writer.family("tads_source_frames_total", "counter", "Frames that reached the sink, per source");
+				for(const auto &[label, frame_cnt] : frame_cnts)
+					writer.sample("tads_source_frames_total", static_cast<double>(frame_cnt), label);
+
+				writer.family("tads_source_fps", "gauge", "Frames per second per source since the previous scrape");
+				for(size_t i = 0; i < frame_cnts.size(); ++i)
+					writer.sample("tads_source_fps", fps[i], frame_cnts[i].first);
+			});
+}
+
+void pause_perf_measurement(AppPerfStructInt *perf_struct)
+{
 	g_mutex_lock(&perf_struct->struct_lock);
 	perf_struct->stop = true;
 
-	for(i = 0; i < perf_struct->num_instances; i++)
+	for(uint i{}; i < perf_struct->num_instances; i++)
 	{
-		InstancePerfStruct *str1 = &perf_struct->instance_str[i];
-		str1->total_fps_time.tv_sec += str1->last_fps_time.tv_sec - str1->start_fps_time.tv_sec;
-		str1->total_fps_time.tv_usec += str1->last_fps_time.tv_usec - str1->start_fps_time.tv_usec;
-		if(str1->total_fps_time.tv_usec < 0)
-		{
-			str1->total_fps_time.tv_sec--;
-			str1->total_fps_time.tv_usec += 1000000;
-		}
-		str1->start_fps_time.tv_sec = str1->start_fps_time.tv_usec = 0;
+		InstancePerfStruct &instance = perf_struct->instance_str[i];
+		const int64_t start_ns{ instance.start_ns.exchange(0, std::memory_order_relaxed) };
+		if(start_ns != 0)
+			perf_struct->instance_snapshot[i].total_ns += instance.last_ns.load(std::memory_order_relaxed) - start_ns;
 	}
 
 	g_mutex_unlock(&perf_struct->struct_lock);
@@ -208,13 +209,16 @@ void resume_perf_measurement(AppPerfStructInt *perf_struct)
 		return;
 	}
 
-	perf_struct->stop = false;
-
+	// Frames counted while paused are not part of the next interval
 	for(uint i{}; i < perf_struct->num_instances; i++)
 	{
-		perf_struct->instance_str[i].buffer_cnt = 0;
+		perf_struct->instance_snapshot[i].frame_cnt =
+				perf_struct->instance_str[i].frame_cnt.load(std::memory_order_relaxed);
+		perf_struct->instance_snapshot[i].last_ns = 0;
 	}
 
+	perf_struct->stop = false;
+
 	if(!perf_struct->perf_measurement_timeout_id)
 		perf_struct->perf_measurement_timeout_id = g_timeout_add(
 				perf_struct->measurement_interval_ms, reinterpret_cast<GSourceFunc>(perf_measurement_callback), perf_struct);
@@ -242,10 +246,8 @@ bool enable_perf_measurement(AppPerfStructInt *str, GstPad *sink_bin_pad, uint n
 //		str->dewarper_surfaces_per_frame = num_surfaces_per_frame;
 //	}
 
-	for(uint i{}; i < num_sources; i++)
-	{
-		str->instance_str[i].buffer_cnt = 0;
-	}
+	str->instance_str = std::vector<InstancePerfStruct>(num_sources);
+	str->instance_snapshot = std::vector<InstancePerfSnapshot>(num_sources);
 	str->sink_bin_pad = sink_bin_pad;
 	str->fps_measure_probe_id =
 			gst_pad_add_probe(sink_bin_pad, GST_PAD_PROBE_TYPE_BUFFER, sink_bin_buf_probe, str, nullptr);
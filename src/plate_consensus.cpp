@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "plate_consensus.hpp"
+
+bool PlateRead::assign(std::string_view plate, float conf)
+{
+	if(plate.empty() || plate.size() > MAX_LENGTH)
+		return false;
+
+	for(size_t i = 0; i < plate.size(); i++)
+		text[i] = static_cast<char>(toupper(static_cast<unsigned char>(plate[i])));
+	text[plate.size()] = '\0';
+	length = static_cast<uint8_t>(plate.size());
+	confidence = conf;
+	return true;
+}
+
+void PlateConsensusState::reset()
+{
+	memset(this, 0, sizeof(*this));
+}
+
+PlateConsensus::PlateConsensus(uint32_t settle_reads, float settle_score):
+	m_settle_reads{ std::max(settle_reads, 1U) },
+	m_settle_score{ std::clamp(settle_score, 0.0f, 1.0f) }
+{}
+
+/**
+ * Weighted Misra-Gries update of one position. When the symbol has no slot
+ * and all are taken, every slot loses the weight the weakest one can absorb
+ * and the symbol takes the weakest slot with what is left of its weight.
+ * */
+static void vote(PlateConsensusState::Position &position, char symbol, float weight)
+{
+	size_t weakest{};
+
+	for(size_t s = 0; s < PlateConsensusState::MAX_SYMBOLS; s++)
+	{
+		if(position.weights[s] > 0 && position.symbols[s] == symbol)
+		{
+			position.weights[s] += weight;
+			return;
+		}
+		if(position.weights[s] < position.weights[weakest])
+			weakest = s;
+	}
+
+	if(position.weights[weakest] > 0)
+	{
+		const float absorbed{ std::min(weight, position.weights[weakest]) };
+		for(float &slot_weight : position.weights)
+			slot_weight -= absorbed;
+		weight -= absorbed;
+	}
+
+	if(weight > 0)
+	{
+		position.symbols[weakest] = symbol;
+		position.weights[weakest] = weight;
+	}
+}
+
+bool PlateConsensus::add(PlateConsensusState &state, const PlateRead &read) const
+{
+	using LengthVotes = PlateConsensusState::LengthVotes;
+
+	if(read.length == 0 || read.length > PlateRead::MAX_LENGTH || !(read.confidence > 0))
+		return false;
+
+	const float weight{ std::min(read.confidence, 1.0f) };
+	LengthVotes *votes{};
+	LengthVotes *weakest{ &state.lengths[0] };
+
+	if(state.reads < UINT16_MAX)
+		state.reads++;
+	state.total_weight += weight;
+
+	for(LengthVotes &length_votes : state.lengths)
+	{
+		if(length_votes.length == read.length)
+		{
+			votes = &length_votes;
+			break;
+		}
+		if(length_votes.length == 0 || (weakest->length != 0 && length_votes.weight < weakest->weight))
+			weakest = &length_votes;
+	}
+
+	// A length that is not kept replaces the weaker one once a single read outweighs it
+	if(!votes && (weakest->length == 0 || weakest->weight < weight))
+	{
+		memset(weakest, 0, sizeof(*weakest));
+		weakest->length = read.length;
+		votes = weakest;
+	}
+
+	if(votes)
+	{
+		if(votes->reads < UINT16_MAX)
+			votes->reads++;
+		votes->weight += weight;
+		for(size_t p = 0; p < read.length; p++)
+			vote(votes->positions[p], read.text[p], weight);
+	}
+
+	update_consensus(state);
+	return true;
+}
+
+void PlateConsensus::update_consensus(PlateConsensusState &state) const
+{
+	const PlateConsensusState::LengthVotes *best{};
+
+	for(const PlateConsensusState::LengthVotes &length_votes : state.lengths)
+	{
+		if(length_votes.length != 0 && (!best || length_votes.weight > best->weight))
+			best = &length_votes;
+	}
+
+	if(!best)
+	{
+		state.text[0] = '\0';
+		state.length = 0;
+		state.score = 0;
+		state.settled = false;
+		return;
+	}
+
+	float min_share{ 1.0f };
+	for(size_t p = 0; p < best->length; p++)
+	{
+		const PlateConsensusState::Position &position{ best->positions[p] };
+		const size_t winner = std::max_element(position.weights, position.weights + PlateConsensusState::MAX_SYMBOLS) -
+													position.weights;
+
+		state.text[p] = position.symbols[winner];
+		min_share = std::min(min_share, position.weights[winner] / best->weight);
+	}
+	state.text[best->length] = '\0';
+	state.length = best->length;
+
+	state.score = best->weight / state.total_weight * min_share;
+	state.settled = best->reads >= m_settle_reads && state.score >= m_settle_score;
+}
@@ -0,0 +1,167 @@
+#include <algorithm>
+
+#include <fmt/format.h>
+
+#include "analytics.hpp"
+#include "plate_gate.hpp"
+
+void PlateGateTrack::reset(uint64_t frame)
+{
+	first_frame = frame;
+	read_frame = frame;
+}
+
+PlateGate::PlateGate(AnalyticsBin *analytics, int vehicle_gie_id, float min_score, uint reread_interval,
+										 uint max_track_age, uint track_ttl):
+	m_analytics{ analytics },
+	m_vehicle_gie_id{ vehicle_gie_id },
+	m_min_score{ min_score },
+	m_reread_interval{ reread_interval },
+	m_max_track_age{ max_track_age },
+	m_track_ttl{ std::max(track_ttl, 1U) },
+	m_report_time_us{ g_get_monotonic_time() }
+{}
+
+PlateGateDecision PlateGate::decide(uint source_id, uint64_t track_id)
+{
+	bool created;
+	PlateGateTrack &track{ m_tracks.acquire(source_id, track_id, created) };
+	const uint64_t frame{ m_tracks.frame() };
+
+	if(created)
+		track.reset(frame);
+
+	// Looking the track up does not keep it alive in the analytics
+	const TrafficAnalysisData *data{ m_analytics->traffic_data_table.find(source_id, track_id) };
+	const bool settled{ data && data->plate.settled && data->plate.score >= m_min_score };
+
+	if(settled && (m_reread_interval == 0 || frame - track.read_frame < m_reread_interval))
+		return PlateGateDecision::SKIP_SETTLED;
+
+	if(m_max_track_age > 0 && frame - track.first_frame > m_max_track_age)
+		return PlateGateDecision::SKIP_AGE;
+
+	track.read_frame = frame;
+	return PlateGateDecision::PROCESS;
+}
+
+void PlateGate::gate(NvDsBatchMeta *batch_meta)
+{
+	uint64_t processed{}, skipped_settled{}, skipped_age{};
+	std::lock_guard<std::mutex> lock(m_analytics->track_lock);
+
+	m_tracks.advance();
+	if(m_tracks.frame() % std::max(1U, m_track_ttl / 4) == 0)
+		m_tracks.evict(m_track_ttl);
+
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
+	{
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+
+		for(NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj; l_obj = l_obj->next)
+		{
+			auto *obj_meta = reinterpret_cast<NvDsObjectMeta *>(l_obj->data);
+
+			// Untracked objects have no read history
+			if(obj_meta->unique_component_id != m_vehicle_gie_id || obj_meta->parent != nullptr ||
+				 obj_meta->object_id == UNTRACKED_OBJECT_ID)
+				continue;
+
+			switch(decide(frame_meta->source_id, obj_meta->object_id))
+			{
+				case PlateGateDecision::PROCESS:
+					processed++;
+					continue;
+				case PlateGateDecision::SKIP_SETTLED:
+					skipped_settled++;
+					break;
+				case PlateGateDecision::SKIP_AGE:
+					skipped_age++;
+					break;
+			}
+			obj_meta->unique_component_id = GATED_COMPONENT_ID;
+		}
+	}
+
+	m_processed.fetch_add(processed, std::memory_order_relaxed);
+	m_skipped_settled.fetch_add(skipped_settled, std::memory_order_relaxed);
+	m_skipped_age.fetch_add(skipped_age, std::memory_order_relaxed);
+	m_track_count.store(m_tracks.size(), std::memory_order_relaxed);
+}
+
+void PlateGate::observe(NvDsBatchMeta *batch_meta)
+{
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
+	{
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+
+		for(NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj; l_obj = l_obj->next)
+		{
+			auto *obj_meta = reinterpret_cast<NvDsObjectMeta *>(l_obj->data);
+			if(obj_meta->unique_component_id == GATED_COMPONENT_ID)
+				obj_meta->unique_component_id = m_vehicle_gie_id;
+		}
+	}
+}
+
+PlateGateStats PlateGate::stats() const
+{
+	return { m_processed.load(std::memory_order_relaxed), m_skipped_settled.load(std::memory_order_relaxed),
+					 m_skipped_age.load(std::memory_order_relaxed), m_track_count.load(std::memory_order_relaxed) };
+}
+
+std::string PlateGate::report()
+{
+	const int64_t now_us{ g_get_monotonic_time() };
+	const double elapsed_s{ static_cast<double>(now_us - m_report_time_us) / 1e6 };
+	const PlateGateStats current{ stats() };
+	const PlateGateStats previous{ m_reported };
+
+	m_reported = current;
+	m_report_time_us = now_us;
+
+	const uint64_t processed{ current.processed - previous.processed };
+	const uint64_t skipped{ current.skipped_settled + current.skipped_age - previous.skipped_settled -
+													previous.skipped_age };
+	if(processed + skipped == 0 || elapsed_s <= 0)
+		return {};
+
+	return fmt::format("**PLATE GATE: {:.1f} SGIE objects/s, {:.1f} skipped/s ({:.0f}%), {} tracks\n",
+										 processed / elapsed_s, skipped / elapsed_s, 100.0 * skipped / (processed + skipped),
+										 current.tracks);
+}
+
+std::unique_ptr<PlateGate> create_plate_gate(const AnalyticsConfig *config, AnalyticsBin *analytics,
+																						 int vehicle_gie_id)
+{
+	if(!config->lp_gate_enable)
+		return nullptr;
+
+	if(!config->enable)
+	{
+		TADS_WARN_MSG_V("The plate gate needs the analytics to vote the plates, it is disabled");
+		return nullptr;
+	}
+
+	return std::make_unique<PlateGate>(analytics, vehicle_gie_id, static_cast<float>(config->lp_gate_min_score),
+																		 config->lp_gate_reread_interval, config->lp_gate_max_track_age,
+																		 config->track_ttl_frames);
+}
+
+void drop_gated_plates(NvDsBatchMeta *batch_meta, std::vector<NvDsObjectMeta *> &dropped)
+{
+	for(NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame; l_frame = l_frame->next)
+	{
+		auto *frame_meta = reinterpret_cast<NvDsFrameMeta *>(l_frame->data);
+
+		dropped.clear();
+		for(NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj; l_obj = l_obj->next)
+		{
+			auto *obj_meta = reinterpret_cast<NvDsObjectMeta *>(l_obj->data);
+			if(obj_meta->parent && obj_meta->parent->unique_component_id == PlateGate::GATED_COMPONENT_ID)
+				dropped.push_back(obj_meta);
+		}
+		for(NvDsObjectMeta *obj_meta : dropped)
+			nvds_remove_obj_meta_from_frame(frame_meta, obj_meta);
+	}
+}
@@ -0,0 +1,427 @@
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "retention.hpp"
+
+/**
+ * Files younger than this are still being written: open segments, archives and crops.
+ * */
+static constexpr int64_t MIN_FILE_AGE_US{ 10ll * 60 * 1000000 };
+
+/**
+ * Delay between passes while day folders are still being scanned.
+ * */
+static constexpr std::chrono::seconds SCAN_INTERVAL{ 1 };
+
+static constexpr int IOPRIO_WHO_PROCESS{ 1 };
+static constexpr int IOPRIO_CLASS_IDLE{ 3 };
+static constexpr int IOPRIO_CLASS_SHIFT{ 13 };
+
+static int64_t now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+			.count();
+}
+
+/**
+ * @return local date of @p time_us as yyyymmdd.
+ * */
+static int64_t day_key(int64_t time_us)
+{
+	std::time_t seconds = time_us / 1000000;
+	std::tm local_tm{};
+
+	localtime_r(&seconds, &local_tm);
+	return (local_tm.tm_year + 1900) * 10000ll + (local_tm.tm_mon + 1) * 100 + local_tm.tm_mday;
+}
+
+/**
+ * @return date key of a ddmmyyyy day folder, -1 for any other name.
+ * */
+static int64_t folder_day_key(const std::string &name)
+{
+	if(name.size() != 8 || !std::all_of(name.cbegin(), name.cend(), ::isdigit))
+		return -1;
+
+	return std::stoll(name.substr(4, 4)) * 10000 + std::stoll(name.substr(2, 2)) * 100 + std::stoll(name.substr(0, 2));
+}
+
+/**
+ * Files written together are deleted together: the three files of an event
+ * segment, an archive and its index.
+ * */
+static std::string_view group_name(std::string_view name)
+{
+	if(starts_with(name, "events_") || starts_with(name, "crops_"))
+		return name.substr(0, name.rfind('.'));
+	return name;
+}
+
+RetentionManager::RetentionManager(std::string root_path,
+																	 const std::array<RetentionQuota, RETENTION_KIND_COUNT> &quotas, uint interval_s,
+																	 size_t scan_budget):
+	m_root_path{ std::move(root_path) },
+	m_quotas{ quotas },
+	m_interval_s{ interval_s > 0 ? interval_s : 1 },
+	m_scan_budget{ scan_budget > 0 ? scan_budget : 1 }
+{}
+
+RetentionManager::~RetentionManager()
+{
+	stop();
+}
+
+bool RetentionManager::classify(std::string_view name, RetentionKind &kind)
+{
+	if(starts_with(name, "events_") || (starts_with(name, "analytics_") && ends_with(name, ".txt")))
+	{
+		kind = RetentionKind::EVENTS;
+		return true;
+	}
+	if(starts_with(name, "crops_") || (starts_with(name, "obj_") && ends_with(name, ".jpg")))
+	{
+		kind = RetentionKind::CROPS;
+		return true;
+	}
+	return false;
+}
+
+bool RetentionManager::start()
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	if(m_running)
+		return true;
+
+	m_running = true;
+	m_thread = std::thread(&RetentionManager::run, this);
+	return true;
+}
+
+void RetentionManager::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		if(!m_running)
+			return;
+		m_running = false;
+	}
+	m_wake.notify_all();
+
+	if(m_thread.joinable())
+		m_thread.join();
+}
+
+RetentionStats RetentionManager::stats() const
+{
+	RetentionStats stats{};
+	stats.passes = m_passes.load(std::memory_order_relaxed);
+	stats.scanned_entries = m_scanned_entries.load(std::memory_order_relaxed);
+	stats.deleted_files = m_deleted_files.load(std::memory_order_relaxed);
+	stats.freed_bytes = m_freed_bytes.load(std::memory_order_relaxed);
+	stats.pass_time_us = m_pass_time_us.load(std::memory_order_relaxed);
+	for(size_t kind = 0; kind < RETENTION_KIND_COUNT; ++kind)
+		stats.usage_bytes[kind] = m_usage_bytes[kind].load(std::memory_order_relaxed);
+	return stats;
+}
+
+uint64_t RetentionManager::drain_freed(uint64_t &deleted_files)
+{
+	deleted_files = m_drain_files.exchange(0, std::memory_order_relaxed);
+	return m_drain_bytes.exchange(0, std::memory_order_relaxed);
+}
+
+void RetentionManager::refresh_days()
+{
+	std::error_code ec;
+	std::map<int64_t, DayUsage> days;
+
+	// Only the output folder itself is listed on every pass, the day folders keep their cached usage
+	for(const auto &entry : std::filesystem::directory_iterator(m_root_path, ec))
+	{
+		const int64_t key{ folder_day_key(entry.path().filename().string()) };
+		if(key < 0 || !entry.is_directory(ec))
+			continue;
+
+		auto itr = m_days.find(key);
+		if(itr != m_days.end())
+			days.emplace(key, std::move(itr->second));
+		else
+			days.emplace(key, DayUsage{ entry.path() });
+	}
+
+	if(m_scan_day >= 0 && days.find(m_scan_day) == days.end())
+	{
+		m_scan_day = -1;
+		m_scan_itr = {};
+	}
+	m_days.swap(days);
+}
+
+void RetentionManager::scan(size_t budget)
+{
+	std::error_code ec;
+
+	while(budget > 0)
+	{
+		if(m_scan_day < 0)
+		{
+			auto itr = std::find_if(m_days.begin(), m_days.end(), [](const auto &day) { return day.second.pending; });
+			if(itr == m_days.end())
+				return;
+
+			m_scan_day = itr->first;
+			m_scan_bytes = {};
+			m_scan_itr = std::filesystem::directory_iterator(itr->second.path, ec);
+			if(ec)
+				m_scan_itr = {};
+		}
+
+		for(; m_scan_itr != std::filesystem::directory_iterator() && budget > 0; --budget)
+		{
+			RetentionKind kind;
+			const std::filesystem::directory_entry &entry = *m_scan_itr;
+
+			m_scanned_entries.fetch_add(1, std::memory_order_relaxed);
+			if(classify(entry.path().filename().string(), kind))
+			{
+				const uintmax_t size{ entry.file_size(ec) };
+				if(!ec)
+					m_scan_bytes[static_cast<size_t>(kind)] += size;
+			}
+
+			m_scan_itr.increment(ec);
+			if(ec)
+				m_scan_itr = {};
+		}
+
+		if(m_scan_itr == std::filesystem::directory_iterator())
+		{
+			DayUsage &day = m_days[m_scan_day];
+			day.bytes = m_scan_bytes;
+			day.known = true;
+			day.pending = false;
+			m_scan_day = -1;
+		}
+	}
+}
+
+bool RetentionManager::purge(DayUsage &day, RetentionKind kind, uint64_t bytes, int64_t now_us)
+{
+	struct Group
+	{
+		int64_t mtime_us{};
+		uint64_t size{};
+		std::vector<std::filesystem::path> paths;
+	};
+
+	std::unordered_map<std::string, Group> groups;
+	std::error_code ec;
+	uint64_t total{}, freed{};
+	bool deleted{};
+
+	for(const auto &entry : std::filesystem::directory_iterator(day.path, ec))
+	{
+		const std::string name{ entry.path().filename().string() };
+		RetentionKind file_kind;
+		struct stat st{};
+
+		if(!classify(name, file_kind) || file_kind != kind || stat(entry.path().c_str(), &st) != 0)
+			continue;
+
+		Group &group = groups[std::string(group_name(name))];
+		group.mtime_us = std::max<int64_t>(group.mtime_us, st.st_mtim.tv_sec * 1000000ll + st.st_mtim.tv_nsec / 1000);
+		group.size += st.st_size;
+		group.paths.push_back(entry.path());
+		total += st.st_size;
+	}
+
+	std::vector<Group *> order;
+	order.reserve(groups.size());
+	for(auto &group : groups)
+		order.push_back(&group.second);
+	std::sort(order.begin(), order.end(), [](const Group *a, const Group *b) { return a->mtime_us < b->mtime_us; });
+
+	for(Group *group : order)
+	{
+		if(freed >= bytes || now_us - group->mtime_us < MIN_FILE_AGE_US)
+			break;
+
+		for(const std::filesystem::path &path : group->paths)
+		{
+			struct stat st{};
+			if(stat(path.c_str(), &st) != 0 || unlink(path.c_str()) != 0)
+				continue;
+
+			freed += st.st_size;
+			deleted = true;
+			m_deleted_files.fetch_add(1, std::memory_order_relaxed);
+			m_drain_files.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+#ifdef TADS_RETENTION_DEBUG
+	TADS_DBG_MSG_V("Freed %lu of %lu bytes of kind %u in '%s'", freed, total, static_cast<uint>(kind), day.path.c_str());
+#endif
+	m_freed_bytes.fetch_add(freed, std::memory_order_relaxed);
+	m_drain_bytes.fetch_add(freed, std::memory_order_relaxed);
+
+	// The listing gives the exact usage of the kind, other kinds keep their cached value
+	day.bytes[static_cast<size_t>(kind)] = total - std::min(freed, total);
+	return deleted;
+}
+
+void RetentionManager::enforce(int64_t today, int64_t now_us)
+{
+	const bool all_known{ std::all_of(m_days.cbegin(), m_days.cend(), [](const auto &day)
+																		{ return day.second.known; }) };
+	bool scan_day_purged{};
+
+	for(size_t i = 0; i < RETENTION_KIND_COUNT; ++i)
+	{
+		const RetentionKind kind{ static_cast<RetentionKind>(i) };
+		const RetentionQuota &quota = m_quotas[i];
+
+		if(quota.max_days > 0)
+		{
+			// mktime normalises the day of month going below 1
+			std::time_t seconds = now_us / 1000000;
+			std::tm cutoff_tm{};
+			localtime_r(&seconds, &cutoff_tm);
+			cutoff_tm.tm_mday -= static_cast<int>(quota.max_days) - 1;
+			cutoff_tm.tm_isdst = -1;
+			const int64_t cutoff{ day_key(static_cast<int64_t>(mktime(&cutoff_tm)) * 1000000) };
+
+			for(auto &[key, day] : m_days)
+			{
+				if(key >= cutoff)
+					break;
+				if((!day.known || day.bytes[i] > 0) && purge(day, kind, UINT64_MAX, now_us))
+					scan_day_purged |= key == m_scan_day;
+			}
+		}
+
+		// Without the usage of every day the oldest files cannot be told apart from unscanned ones
+		if(quota.max_bytes > 0 && all_known)
+		{
+			uint64_t usage{ std::accumulate(m_days.cbegin(), m_days.cend(), uint64_t{},
+																			[i](uint64_t sum, const auto &day) { return sum + day.second.bytes[i]; }) };
+
+			for(auto &[key, day] : m_days)
+			{
+				if(usage <= quota.max_bytes)
+					break;
+				if(day.bytes[i] == 0)
+					continue;
+
+				const uint64_t before{ day.bytes[i] };
+				if(purge(day, kind, usage - quota.max_bytes, now_us))
+					scan_day_purged |= key == m_scan_day;
+				usage -= before - day.bytes[i];
+			}
+		}
+	}
+
+	// A day being scanned restarts if files were deleted from it, its partial usage may count them
+	if(scan_day_purged)
+	{
+		m_days[m_scan_day].pending = true;
+		m_scan_day = -1;
+		m_scan_itr = {};
+	}
+
+	// Past day folders left empty are removed, remove() fails on anything not empty
+	for(auto itr = m_days.begin(); itr != m_days.end();)
+	{
+		std::error_code ec;
+		const DayUsage &day = itr->second;
+		const bool empty{ day.known && std::all_of(day.bytes.cbegin(), day.bytes.cend(), [](uint64_t b) { return b == 0; }) };
+
+		if(itr->first < today && empty && std::filesystem::remove(day.path, ec))
+			itr = m_days.erase(itr);
+		else
+			++itr;
+	}
+}
+
+bool RetentionManager::run_pass(int64_t now_us)
+{
+	const auto start{ std::chrono::steady_clock::now() };
+	const int64_t today{ day_key(now_us) };
+
+	refresh_days();
+	scan(m_scan_budget);
+
+	const bool scanned{ m_scan_day < 0 && std::none_of(m_days.cbegin(), m_days.cend(), [](const auto &day)
+																											 { return day.second.pending; }) };
+
+	enforce(today, now_us);
+
+	// Today keeps growing, it is rescanned once everything else is known
+	if(scanned)
+	{
+		auto itr = m_days.find(today);
+		if(itr != m_days.end())
+			itr->second.pending = true;
+	}
+
+	for(size_t i = 0; i < RETENTION_KIND_COUNT; ++i)
+	{
+		m_usage_bytes[i].store(std::accumulate(m_days.cbegin(), m_days.cend(), uint64_t{},
+																					 [i](uint64_t sum, const auto &day) { return sum + day.second.bytes[i]; }),
+													 std::memory_order_relaxed);
+	}
+
+	m_passes.fetch_add(1, std::memory_order_relaxed);
+	m_pass_time_us.store(
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(),
+			std::memory_order_relaxed);
+
+	return scanned;
+}
+
+void RetentionManager::run()
+{
+	// Deleting old output must never compete with the writers for the disk
+	if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) != 0)
+		TADS_WARN_MSG_V("Could not lower the I/O priority of the retention thread: %s", strerror(errno));
+	setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while(m_running)
+	{
+		lock.unlock();
+		const bool scanned{ run_pass(now_us()) };
+		lock.lock();
+
+		const std::chrono::seconds interval{ scanned ? std::chrono::seconds(m_interval_s) : SCAN_INTERVAL };
+		m_wake.wait_for(lock, interval, [this] { return !m_running; });
+	}
+}
+
+std::string retention_report(RetentionManager *manager)
+{
+	if(!manager)
+		return {};
+
+	uint64_t deleted_files;
+	const uint64_t freed{ manager->drain_freed(deleted_files) };
+	if(deleted_files == 0)
+		return {};
+
+	const RetentionStats stats{ manager->stats() };
+	return fmt::format("**RETENTION: freed {:.1f} MB in {} files, events {:.1f} MB crops {:.1f} MB, pass {} us\n",
+										 freed / 1048576.0, deleted_files,
+										 stats.usage_bytes[static_cast<size_t>(RetentionKind::EVENTS)] / 1048576.0,
+										 stats.usage_bytes[static_cast<size_t>(RetentionKind::CROPS)] / 1048576.0, stats.pass_time_us);
+}
@@ -2,21 +2,98 @@
 #include <fstream>
 
 #include "secondary_gie.hpp"
+#include "span_trace.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "ConstantFunctionResult"
 #pragma ide diagnostic ignored "misc-no-recursion"
 #define TADS_GET_FILE_PATH(path) ((path) + (((path) && strstr((path), "file://")) ? 7 : 0))
 
+/**
+ * Longest wait for the branches to count a buffer down before falling back
+ * to polling its refcount, e.g. if a branch dropped the buffer.
+ */
+static constexpr gint64 SECONDARY_GIE_JOIN_TIMEOUT_US{ G_TIME_SPAN_SECOND / 10 };
+
+static NvDsMetaType join_meta_type()
+{
+	static const NvDsMetaType meta_type{ nvds_get_user_meta_type(const_cast<gchar *>("TADS.SGIE_JOIN")) };
+	return meta_type;
+}
+
+/**
+ * The sequence is stored in the pointer itself, a copied batch carries the same one.
+ * */
+static gpointer copy_join_sequence(gpointer data, gpointer)
+{
+	return reinterpret_cast<NvDsUserMeta *>(data)->user_meta_data;
+}
+
+static void release_join_sequence(gpointer data, gpointer)
+{
+	reinterpret_cast<NvDsUserMeta *>(data)->user_meta_data = nullptr;
+}
+
+static NvDsUserMeta *find_join_meta(NvDsBatchMeta *batch_meta)
+{
+	const NvDsMetaType meta_type{ join_meta_type() };
+
+	for(NvDsMetaList *l_user_meta = batch_meta->batch_user_meta_list; l_user_meta != nullptr;
+			l_user_meta = l_user_meta->next)
+	{
+		auto *user_meta = reinterpret_cast<NvDsUserMeta *>(l_user_meta->data);
+		if(user_meta->base_meta.meta_type == meta_type)
+			return user_meta;
+	}
+	return nullptr;
+}
+
+/**
+ * Gives @p sequence to the batch, replacing the one of a previous join.
+ * */
+static void set_join_sequence(NvDsBatchMeta *batch_meta, uint64_t sequence)
+{
+	NvDsUserMeta *user_meta{ find_join_meta(batch_meta) };
+
+	if(!user_meta)
+	{
+		user_meta = nvds_acquire_user_meta_from_pool(batch_meta);
+		user_meta->base_meta.meta_type = join_meta_type();
+		user_meta->base_meta.copy_func = copy_join_sequence;
+		user_meta->base_meta.release_func = release_join_sequence;
+		nvds_add_user_meta_to_batch(batch_meta, user_meta);
+	}
+	user_meta->user_meta_data = reinterpret_cast<gpointer>(static_cast<uintptr_t>(sequence));
+}
+
+/**
+ * @return false if @p buffer carries no join sequence.
+ * */
+static bool get_join_sequence(GstBuffer *buffer, uint64_t &sequence)
+{
+	NvDsBatchMeta *batch_meta{ gst_buffer_get_nvds_batch_meta(buffer) };
+	NvDsUserMeta *user_meta{ batch_meta ? find_join_meta(batch_meta) : nullptr };
+
+	if(!user_meta)
+		return false;
+
+	sequence = reinterpret_cast<uintptr_t>(user_meta->user_meta_data);
+	return true;
+}
+
 /**
  * Wait for all secondary inferences to complete the processing and then send
  * the processed buffer to downstream.
  * This is way of synchronization between all secondary infers and sending
  * buffer once meta data from all secondary infer components got attached.
  * This is needed because all secondary infers process same buffer in parallel.
+ *
+ * Every leaf branch counts the buffer down in ::branch_done_buf_probe once it
+ * released its reference, the last one wakes this probe up.
  */
 static GstPadProbeReturn wait_queue_buf_probe(GstPad *, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("wait_queue_buf_probe");
 	auto *bin = reinterpret_cast<SecondaryGieBin *>(data);
 	if(info->type & GST_PAD_PROBE_TYPE_EVENT_BOTH)
 	{
@@ -29,39 +106,147 @@ static GstPadProbeReturn wait_queue_buf_probe(GstPad *, GstPadProbeInfo *info, v
 
 	if(info->type & GST_PAD_PROBE_TYPE_BUFFER)
 	{
+		GstBuffer *buffer = GST_BUFFER(info->data);
+		const uint64_t start_ns{ LatencyTracker::now_ns() };
+		uint64_t sequence{};
+		const bool keyed{ get_join_sequence(buffer, sequence) };
+		bool timed_out{}, polled{};
+
 		g_mutex_lock(&bin->wait_lock);
-		while(GST_OBJECT_REFCOUNT_VALUE(GST_BUFFER(info->data)) > 1 && !bin->stop && !bin->flush)
+		const gint64 join_end_time{ g_get_monotonic_time() + SECONDARY_GIE_JOIN_TIMEOUT_US };
+		while(keyed && !bin->stop && !bin->flush)
+		{
+			// Looked up on every wake up, a flush clears the pending branches
+			auto pending = bin->pending_branches.find(sequence);
+			if(pending == bin->pending_branches.end() || pending->second == 0)
+				break;
+
+			if(!g_cond_wait_until(&bin->wait_cond, &bin->wait_lock, join_end_time))
+			{
+				timed_out = true;
+				break;
+			}
+		}
+		if(keyed)
+			bin->pending_branches.erase(sequence);
+
+		// A tee may still hold the buffer for a moment after the last branch counted down
+		while(GST_OBJECT_REFCOUNT_VALUE(buffer) > 1 && !bin->stop && !bin->flush)
 		{
 			gint64 end_time;
 			end_time = g_get_monotonic_time() + G_TIME_SPAN_SECOND / 1000;
 			g_cond_wait_until(&bin->wait_cond, &bin->wait_lock, end_time);
+			polled = true;
 		}
 		g_mutex_unlock(&bin->wait_lock);
+
+		if(bin->join_stats)
+		{
+			bin->join_stats->wait.record((LatencyTracker::now_ns() - start_ns) / 1000);
+			bin->join_stats->joins.fetch_add(1, std::memory_order_relaxed);
+			if(timed_out)
+				bin->join_stats->timeouts.fetch_add(1, std::memory_order_relaxed);
+			if(polled)
+				bin->join_stats->polls.fetch_add(1, std::memory_order_relaxed);
+			if(!keyed)
+				bin->join_stats->fallbacks.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// Every branch released the buffer, the gated objects can be restored
+		if(bin->plate_gate)
+		{
+			if(NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buffer))
+				bin->plate_gate->observe(batch_meta);
+		}
 	}
 
 	return GST_PAD_PROBE_OK;
 }
 
 /**
- * Probe function on sink pad of tee element. It is being used to
- * capture EOS event. So that wait for all secondary to finish can be stopped.
+ * Probe function on sink pad of tee element. It registers every buffer with
+ * the number of branches it goes through and captures EOS and flush events,
+ * so that wait for all secondary to finish can be stopped.
  * see ::wait_queue_buf_probe
  */
 static GstPadProbeReturn wait_queue_buf_probe1(GstPad *, GstPadProbeInfo *info, void *data)
 {
+	TADS_TRACE_SPAN("wait_queue_buf_probe1");
 	auto *bin = reinterpret_cast<SecondaryGieBin *>(data);
+	if(info->type & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(GST_BUFFER(info->data));
+
+		// The branches share the metadata, so the objects are gated once before they split
+		if(bin->plate_gate && batch_meta)
+			bin->plate_gate->gate(batch_meta);
+
+		// Without a batch meta the join falls back to polling the refcount
+		if(bin->num_branches > 0 && batch_meta)
+		{
+			g_mutex_lock(&bin->wait_lock);
+			const uint64_t sequence{ ++bin->join_sequence };
+			bin->pending_branches[sequence] = bin->num_branches;
+			g_mutex_unlock(&bin->wait_lock);
+			set_join_sequence(batch_meta, sequence);
+		}
+	}
+
 	if(info->type & GST_PAD_PROBE_TYPE_EVENT_BOTH)
 	{
 		auto *event = reinterpret_cast<GstEvent *>(info->data);
+		g_mutex_lock(&bin->wait_lock);
 		if(event->type == GST_EVENT_EOS)
 		{
 			bin->stop = true;
 		}
+		else if(event->type == GST_EVENT_FLUSH_START)
+		{
+			bin->flush = true;
+		}
+		else if(event->type == GST_EVENT_FLUSH_STOP)
+		{
+			// Flushed buffers never reach the joining queue
+			bin->pending_branches.clear();
+			bin->flush = false;
+		}
+		g_cond_broadcast(&bin->wait_cond);
+		g_mutex_unlock(&bin->wait_lock);
 	}
 
 	return GST_PAD_PROBE_OK;
 }
 
+/**
+ * Probe function on sink pad of the fakesink ending a secondary branch.
+ * The branch is done with the buffer here, so the reference is dropped
+ * before counting it down, the sink itself would only drop it.
+ * see ::wait_queue_buf_probe
+ */
+static GstPadProbeReturn branch_done_buf_probe(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	TADS_TRACE_SPAN("branch_done_buf_probe");
+	auto *bin = reinterpret_cast<SecondaryGieBin *>(data);
+	uint64_t sequence{};
+
+	// The branch may have copied the buffer, the sequence is copied with the batch meta
+	const bool keyed{ get_join_sequence(GST_BUFFER(info->data), sequence) };
+	gst_buffer_unref(GST_BUFFER(info->data));
+	info->data = nullptr;
+	if(!keyed)
+		return GST_PAD_PROBE_HANDLED;
+
+	g_mutex_lock(&bin->wait_lock);
+	auto pending = bin->pending_branches.find(sequence);
+	if(pending != bin->pending_branches.end() && pending->second > 0 && --pending->second == 0)
+	{
+		g_cond_broadcast(&bin->wait_cond);
+	}
+	g_mutex_unlock(&bin->wait_lock);
+
+	return GST_PAD_PROBE_HANDLED;
+}
+
 static void write_infer_output_to_file(GstBuffer *, NvDsInferNetworkInfo *, NvDsInferLayerInfo *layers_info,
 																			 uint num_layers, uint batch_size, void *data)
 {
@@ -416,6 +601,40 @@ done:
 	return success;
 }
 
+void attach_secondary_gie_join(SecondaryGieBin *bin)
+{
+	GstPad *pad;
+
+	g_mutex_init(&bin->wait_lock);
+	g_cond_init(&bin->wait_cond);
+	bin->join_stats = std::make_unique<SecondaryGieJoinStats>();
+	bin->join_sequence = 0;
+
+	pad = gst_element_get_static_pad(bin->queue, "src");
+	bin->wait_for_sgie_process_buf_probe_id =
+			gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_BOTH),
+												wait_queue_buf_probe, bin, nullptr);
+	gst_object_unref(pad);
+	pad = gst_element_get_static_pad(bin->tee, "sink");
+	gst_pad_add_probe(
+			pad,
+			(GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_BOTH | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+			wait_queue_buf_probe1, bin, nullptr);
+	gst_object_unref(pad);
+
+	bin->num_branches = 0;
+	for(SecondaryGieBinSubBin &sub_bin : bin->sub_bins)
+	{
+		if(sub_bin.create && sub_bin.sink)
+		{
+			pad = gst_element_get_static_pad(sub_bin.sink, "sink");
+			gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, branch_done_buf_probe, bin, nullptr);
+			gst_object_unref(pad);
+			bin->num_branches++;
+		}
+	}
+}
+
 bool create_secondary_gie(uint num_secondary_gie, uint primary_gie_unique_id, const std::vector<GieConfig> &configs,
 													SecondaryGieBin *bin)
 {
@@ -461,15 +680,6 @@ bool create_secondary_gie(uint num_secondary_gie, uint primary_gie_unique_id, co
 
 	gst_bin_add(GST_BIN(bin->bin), bin->queue);
 
-	pad = gst_element_get_static_pad(bin->queue, "src");
-	bin->wait_for_sgie_process_buf_probe_id =
-			gst_pad_add_probe(pad, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_BOTH),
-												wait_queue_buf_probe, bin, nullptr);
-	gst_object_unref(pad);
-	pad = gst_element_get_static_pad(bin->tee, "sink");
-	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_BOTH, wait_queue_buf_probe1, bin, nullptr);
-	gst_object_unref(pad);
-
 #ifdef TADS_SECONDARY_GIE_DEBUG
 	TADS_DBG_MSG_V("Add ghost pad bin element with tee element sink pad");
 #endif
@@ -524,8 +734,7 @@ bool create_secondary_gie(uint num_secondary_gie, uint primary_gie_unique_id, co
 		}
 	}
 
-	g_mutex_init(&bin->wait_lock);
-	g_cond_init(&bin->wait_cond);
+	attach_secondary_gie_join(bin);
 
 	success = true;
 done:
@@ -536,6 +745,24 @@ done:
 	return success;
 }
 
+std::string secondary_gie_join_report(SecondaryGieBin *bin)
+{
+	if(!bin->join_stats)
+		return {};
+
+	LatencySnapshot snapshot;
+	bin->join_stats->wait.drain(snapshot);
+	if(snapshot.total == 0)
+		return {};
+
+	return fmt::format("**SGIE JOIN(us): p50 {} p99 {} max {} joins {} timeouts {} polls {} fallbacks {}\n",
+										 snapshot.value_at(50), snapshot.value_at(99), snapshot.max,
+										 bin->join_stats->joins.exchange(0, std::memory_order_relaxed),
+										 bin->join_stats->timeouts.exchange(0, std::memory_order_relaxed),
+										 bin->join_stats->polls.exchange(0, std::memory_order_relaxed),
+										 bin->join_stats->fallbacks.exchange(0, std::memory_order_relaxed));
+}
+
 [[maybe_unused]]
 void destroy_secondary_gie(SecondaryGieBin *bin)
 {
@@ -545,4 +772,5 @@ void destroy_secondary_gie(SecondaryGieBin *bin)
 		gst_pad_remove_probe(pad, bin->wait_for_sgie_process_buf_probe_id);
 		gst_object_unref(pad);
 	}
+	bin->pending_branches.clear();
 }
\ No newline at end of file
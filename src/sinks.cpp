@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include <algorithm>
 #include <cstdio>
 #include <cuda_runtime_api.h>
 #include <gst/rtsp-server/rtsp-server.h>
@@ -7,8 +8,7 @@
 #include "sinks.hpp"
 
 static uint g_uid{};
-static GstRTSPServer *g_servers[MAX_SINK_BINS];
-static uint g_server_count{};
+static std::vector<GstRTSPServer *> g_servers;
 static GMutex g_server_cnt_lock;
 
 GST_DEBUG_CATEGORY_EXTERN(NVDS_APP);
@@ -555,6 +555,7 @@ done:
 static bool
 start_rtsp_streaming(uint rtsp_port_num, uint updsink_port_num, EncoderCodecType enctype, uint64_t udp_buffer_size)
 {
+	GstRTSPServer *server;
 	GstRTSPMountPoints *mounts;
 	GstRTSPMediaFactory *factory;
 	std::string udpsrc_pipeline;
@@ -587,10 +588,10 @@ start_rtsp_streaming(uint rtsp_port_num, uint updsink_port_num, EncoderCodecType
 
 	g_mutex_lock(&g_server_cnt_lock);
 
-	g_servers[g_server_count] = gst_rtsp_server_new();
-	g_object_set(g_servers[g_server_count], "service", port_num_Str, nullptr);
+	server = g_servers.emplace_back(gst_rtsp_server_new());
+	g_object_set(server, "service", port_num_Str, nullptr);
 
-	mounts = gst_rtsp_server_get_mount_points(g_servers[g_server_count]);
+	mounts = gst_rtsp_server_get_mount_points(server);
 
 	factory = gst_rtsp_media_factory_new();
 	gst_rtsp_media_factory_set_launch(factory, udpsrc_pipeline.c_str());
@@ -599,9 +600,7 @@ start_rtsp_streaming(uint rtsp_port_num, uint updsink_port_num, EncoderCodecType
 
 	g_object_unref(mounts);
 
-	gst_rtsp_server_attach(g_servers[g_server_count], nullptr);
-
-	g_server_count++;
+	gst_rtsp_server_attach(server, nullptr);
 
 	g_mutex_unlock(&g_server_cnt_lock);
 
@@ -838,6 +837,9 @@ bool create_sink_bin(uint num_sub_bins, std::vector<SinkSubBinConfig> &configs,
 
 	g_object_set(G_OBJECT(sink->tee), "allow-not-linked", true, nullptr);
 
+	// Falls back to a fakesink in sub bin 0 when no sink is enabled
+	sink->sub_bins = std::vector<SinkSubBin>(std::max<size_t>(num_sub_bins, 1));
+
 	for(uint i{}; i < num_sub_bins; i++)
 	{
 		sub_bin_config = &configs.at(i);
@@ -962,6 +964,8 @@ bool create_demux_sink_bin(uint num_sub_bins, std::vector<SinkSubBinConfig> &con
 
 	TADS_LINK_ELEMENT(bin->queue, bin->tee);
 
+	bin->sub_bins = std::vector<SinkSubBin>(std::max<size_t>(num_sub_bins, 1));
+
 	for(uint i = 0; i < num_sub_bins; i++)
 	{
 		sub_bin = &bin->sub_bins.at(i);
@@ -1041,13 +1045,13 @@ void destroy_sink_bin()
 {
 	GstRTSPMountPoints *mounts;
 	GstRTSPSessionPool *pool;
-	for(uint i{}; i < g_server_count; i++)
+	for(GstRTSPServer *server : g_servers)
 	{
-		mounts = gst_rtsp_server_get_mount_points(g_servers[i]);
+		mounts = gst_rtsp_server_get_mount_points(server);
 		gst_rtsp_mount_points_remove_factory(mounts, "/ds-test");
 		g_object_unref(mounts);
-		gst_rtsp_server_client_filter(g_servers[i], client_filter, nullptr);
-		pool = gst_rtsp_server_get_session_pool(g_servers[i]);
+		gst_rtsp_server_client_filter(server, client_filter, nullptr);
+		pool = gst_rtsp_server_get_session_pool(server);
 		gst_rtsp_session_pool_cleanup(pool);
 		g_object_unref(pool);
 	}
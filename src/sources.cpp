@@ -1211,6 +1211,7 @@ bool create_multi_source_bin(uint num_sub_bins, std::vector<SourceConfig> &confi
 	SourceConfig *config;
 
 	source_parent->reset_thread = nullptr;
+	source_parent->sub_bins = std::vector<SourceBin>(num_sub_bins);
 
 	source_parent->bin = gst::bin_new(elem_name);
 	if(!source_parent->bin)
@@ -1413,6 +1414,9 @@ bool reset_source_pipeline(void *data)
 	gettimeofday(&src_bin->last_reconnect_time, nullptr);
 	g_mutex_unlock(&src_bin->bin_lock);
 
+	if(src_bin->reconnect_counter)
+		src_bin->reconnect_counter->fetch_add(1, std::memory_order_relaxed);
+
 	gst_element_send_event(GST_ELEMENT(src_bin->cap_filter1), gst_event_new_flush_start());
 	gst_element_send_event(GST_ELEMENT(src_bin->cap_filter1), gst_event_new_flush_stop(true));
 	if(gst_element_set_state(src_bin->bin, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
@@ -0,0 +1,213 @@
+#include <deque>
+#include <mutex>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "common.hpp"
+#include "span_trace.hpp"
+
+std::atomic<bool> g_span_trace_enabled{};
+
+/**
+ * Rings of every thread that recorded a span. They live until the process
+ * exits, so a span that ends after @ref span_trace_stop never touches a
+ * freed ring.
+ * */
+static std::mutex g_rings_lock;
+static std::deque<std::unique_ptr<TraceRing>> g_rings;
+static size_t g_ring_capacity{ 65536 };
+static int64_t g_start_ns{};
+static uint64_t g_overwritten{};
+
+static thread_local TraceRing *t_ring{};
+
+TraceRing::TraceRing(size_t capacity, uint32_t thread_id, std::string thread_name):
+	m_mask{ (capacity < 2 ? 1 : 1ull << (64 - __builtin_clzll(capacity - 1))) - 1 },
+	m_thread_id{ thread_id },
+	m_thread_name{ std::move(thread_name) },
+	m_spans{ std::make_unique<TraceSpan[]>(m_mask + 1) }
+{}
+
+uint64_t TraceRing::collect(std::vector<TraceSpan> &spans)
+{
+	const uint64_t capacity{ m_mask + 1 };
+	// Pairs with the release of push, the slots below head are written
+	const uint64_t head{ m_head.load(std::memory_order_acquire) };
+	uint64_t overwritten{};
+
+	if(head - m_tail > capacity)
+	{
+		overwritten = head - m_tail - capacity;
+		m_tail = head - capacity;
+	}
+
+	const size_t first{ spans.size() };
+	for(uint64_t i = m_tail; i < head; i++)
+		spans.push_back(m_spans[i & m_mask]);
+
+	// The owner kept pushing while copying, the slots it reached again are not the spans read
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t reached{ m_head.load(std::memory_order_relaxed) };
+	if(reached - m_tail > capacity)
+	{
+		const uint64_t torn{ std::min(reached - m_tail - capacity, head - m_tail) };
+		spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(first),
+								spans.begin() + static_cast<std::ptrdiff_t>(first + torn));
+		overwritten += torn;
+	}
+
+	m_tail = head;
+	return overwritten;
+}
+
+int64_t span_trace_now_ns()
+{
+	timespec now{};
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ll + now.tv_nsec;
+}
+
+void span_trace_record(const char *name, int64_t begin_ns)
+{
+	const int64_t end_ns{ span_trace_now_ns() };
+
+	if(!t_ring)
+	{
+		char thread_name[16]{};
+		pthread_getname_np(pthread_self(), thread_name, sizeof(thread_name));
+
+		std::lock_guard<std::mutex> lock(g_rings_lock);
+		t_ring = g_rings
+								 .emplace_back(std::make_unique<TraceRing>(
+										 g_ring_capacity, static_cast<uint32_t>(syscall(SYS_gettid)), thread_name))
+								 .get();
+	}
+
+	t_ring->push(name, begin_ns, end_ns);
+}
+
+void span_trace_start(size_t spans_per_thread)
+{
+	std::lock_guard<std::mutex> lock(g_rings_lock);
+	if(g_span_trace_enabled.load(std::memory_order_relaxed))
+		return;
+
+	// Rings of threads that already recorded keep their capacity
+	g_ring_capacity = spans_per_thread;
+	g_start_ns = span_trace_now_ns();
+	g_overwritten = 0;
+	for(const std::unique_ptr<TraceRing> &ring : g_rings)
+	{
+		std::vector<TraceSpan> discarded;
+		ring->collect(discarded);
+	}
+	g_span_trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void span_trace_stop()
+{
+	g_span_trace_enabled.store(false, std::memory_order_relaxed);
+}
+
+static void append_escaped(std::string &out, std::string_view text)
+{
+	for(const char c : text)
+	{
+		if(c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if(static_cast<unsigned char>(c) < 0x20)
+		{
+			fmt::format_to(std::back_inserter(out), "\\u{:04x}", static_cast<int>(c));
+		}
+		else
+		{
+			out += c;
+		}
+	}
+}
+
+std::string span_trace_json(const std::vector<std::pair<const TraceRing *, std::vector<TraceSpan>>> &threads,
+														int64_t origin_ns)
+{
+	const int pid{ getpid() };
+	std::string json{ "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" };
+	bool first{ true };
+
+	for(const auto &[ring, spans] : threads)
+	{
+		json += first ? "\n" : ",\n";
+		first = false;
+		fmt::format_to(std::back_inserter(json),
+									 R"({{"name":"thread_name","ph":"M","pid":{},"tid":{},"args":{{"name":")", pid,
+									 ring->thread_id());
+		append_escaped(json, ring->thread_name());
+		json += "\"}}";
+
+		for(const TraceSpan &span : spans)
+		{
+			json += ",\n{\"name\":\"";
+			append_escaped(json, span.name);
+			// Complete events in microseconds, the fraction keeps the nanoseconds
+			fmt::format_to(std::back_inserter(json), R"(","ph":"X","pid":{},"tid":{},"ts":{:.3f},"dur":{:.3f}}})", pid,
+										 ring->thread_id(), static_cast<double>(span.begin_ns - origin_ns) / 1e3,
+										 static_cast<double>(span.duration_ns) / 1e3);
+		}
+	}
+
+	json += "\n]}\n";
+	return json;
+}
+
+bool span_trace_write(const std::string &path)
+{
+	std::vector<std::pair<const TraceRing *, std::vector<TraceSpan>>> threads;
+	uint64_t span_cnt{};
+	uint64_t overwritten;
+	int64_t origin_ns;
+	std::string json;
+	FILE *file;
+
+	{
+		std::lock_guard<std::mutex> lock(g_rings_lock);
+		origin_ns = g_start_ns;
+		for(const std::unique_ptr<TraceRing> &ring : g_rings)
+		{
+			std::vector<TraceSpan> spans;
+			g_overwritten += ring->collect(spans);
+			if(spans.empty())
+				continue;
+			span_cnt += spans.size();
+			threads.emplace_back(ring.get(), std::move(spans));
+		}
+		overwritten = g_overwritten;
+	}
+
+	json = span_trace_json(threads, origin_ns);
+
+	file = fopen(path.c_str(), "w");
+	if(!file)
+	{
+		TADS_ERR_MSG_V("Could not open span trace '%s': %s", path.c_str(), strerror(errno));
+		return false;
+	}
+	if(fwrite(json.data(), 1, json.size(), file) != json.size())
+	{
+		TADS_ERR_MSG_V("Could not write span trace '%s': %s", path.c_str(), strerror(errno));
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+
+	TADS_INFO_MSG_V("Wrote %lu spans of %lu threads to '%s', %lu overwritten", span_cnt, threads.size(), path.c_str(),
+									overwritten);
+	return true;
+}
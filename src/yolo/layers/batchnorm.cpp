@@ -6,14 +6,14 @@
 #include "layers/batchnorm.hpp"
 
 bool batchnormLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-										std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
+										const DarknetWeights &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
 										nvinfer1::ITensor *input, nvinfer1::INetworkDefinition *network)
 {
 	bool success{};
 	std::string layer_name, activation;
 	nvinfer1::IScaleLayer *batchnorm;
 	int filters, size;
-	std::vector<float> bn_biases, bn_weights, bn_running_mean, bn_running_var;
+	const float *bn_biases, *bn_weights, *bn_running_mean, *bn_running_var;
 	float *shift_wt, *scale_wt, *power_wt;
 	nvinfer1::Weights shift, scale, power;
 
@@ -32,38 +32,26 @@ bool batchnormLayer(nvinfer1::ITensor *&output, int index, const std::map<std::s
 	filters = std::stoi(block.at("filters"));
 	activation = block.at("activation");
 
-	for(int i = 0; i < filters; ++i)
-	{
-		bn_biases.push_back(weights[weight_ptr]);
-		++weight_ptr;
-	}
-	for(int i = 0; i < filters; ++i)
-	{
-		bn_weights.push_back(weights[weight_ptr]);
-		++weight_ptr;
-	}
-	for(int i = 0; i < filters; ++i)
-	{
-		bn_running_mean.push_back(weights[weight_ptr]);
-		++weight_ptr;
-	}
-	for(int i = 0; i < filters; ++i)
-	{
-		bn_running_var.push_back(sqrt(weights[weight_ptr] + 1.0e-5));
-		++weight_ptr;
-	}
+	bn_biases = weights.take(weight_ptr, filters);
+	bn_weights = weights.take(weight_ptr, filters);
+	bn_running_mean = weights.take(weight_ptr, filters);
+	bn_running_var = weights.take(weight_ptr, filters);
+	if(!bn_biases || !bn_weights || !bn_running_mean || !bn_running_var)
+		goto done;
 
 	size = filters;
 	shift = { nvinfer1::DataType::kFLOAT, nullptr, size };
 	scale = { nvinfer1::DataType::kFLOAT, nullptr, size };
 	power = { nvinfer1::DataType::kFLOAT, nullptr, size };
 	shift_wt = new float[size];
-	for(int i = 0; i < size; ++i)
-		shift_wt[i] = bn_biases.at(i) - ((bn_running_mean.at(i) * bn_weights.at(i)) / bn_running_var.at(i));
-	shift.values = shift_wt;
 	scale_wt = new float[size];
 	for(int i = 0; i < size; ++i)
-		scale_wt[i] = bn_weights.at(i) / bn_running_var[i];
+	{
+		const float running_var{ static_cast<float>(sqrt(bn_running_var[i] + 1.0e-5)) };
+		shift_wt[i] = bn_biases[i] - ((bn_running_mean[i] * bn_weights[i]) / running_var);
+		scale_wt[i] = bn_weights[i] / running_var;
+	}
+	shift.values = shift_wt;
 	scale.values = scale_wt;
 	power_wt = new float[size];
 	for(int i = 0; i < size; ++i)
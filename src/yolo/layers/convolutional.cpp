@@ -5,7 +5,7 @@
 #include "layers/convolutional.hpp"
 
 bool convolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-												std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
+												const DarknetWeights &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
 												int &input_channels, nvinfer1::ITensor *input, nvinfer1::INetworkDefinition *network,
 												const std::string &name)
 {
@@ -16,10 +16,10 @@ bool convolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<st
 
 	std::string layer_name;
 	std::string activation;
-	std::vector<float> bn_biases;
-	std::vector<float> bn_weights;
-	std::vector<float> bn_running_mean;
-	std::vector<float> bn_running_var;
+	const float *bn_biases{};
+	const float *bn_weights{};
+	const float *bn_running_mean{};
+	const float *bn_running_var{};
 
 	nvinfer1::Weights conv_wt;
 	nvinfer1::Weights conv_bias;
@@ -95,72 +95,36 @@ bool convolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<st
 	conv_wt = { nvinfer1::DataType::kFLOAT, nullptr, size };
 	conv_bias = { nvinfer1::DataType::kFLOAT, nullptr, bias };
 
+	// The weights and biases point into the weights file, only the batchnorm factors are computed
 	if(!batch_normalize)
 	{
-		float *val;
 		if(bias != 0)
 		{
-			val = new float[filters];
-			for(int i = 0; i < filters; ++i)
-			{
-				val[i] = weights[weight_ptr];
-				++weight_ptr;
-			}
-			conv_bias.values = val;
-			trt_weights.push_back(conv_bias);
+			conv_bias.values = weights.take(weight_ptr, filters);
+			if(!conv_bias.values)
+				goto done;
 		}
-		val = new float[size];
-		for(int i = 0; i < size; ++i)
-		{
-			val[i] = weights[weight_ptr];
-			++weight_ptr;
-		}
-		conv_wt.values = val;
-		trt_weights.push_back(conv_wt);
+		conv_wt.values = weights.take(weight_ptr, size);
+		if(!conv_wt.values)
+			goto done;
 	}
 	else
 	{
-		for(int i = 0; i < filters; ++i)
-		{
-			bn_biases.push_back(weights[weight_ptr]);
-			++weight_ptr;
-		}
-		for(int i = 0; i < filters; ++i)
-		{
-			bn_weights.push_back(weights[weight_ptr]);
-			++weight_ptr;
-		}
-		for(int i = 0; i < filters; ++i)
-		{
-			bn_running_mean.push_back(weights[weight_ptr]);
-			++weight_ptr;
-		}
-		for(int i = 0; i < filters; ++i)
-		{
-			bn_running_var.push_back(sqrt(weights[weight_ptr] + 1.0e-5));
-			++weight_ptr;
-		}
-		float *val;
+		bn_biases = weights.take(weight_ptr, filters);
+		bn_weights = weights.take(weight_ptr, filters);
+		bn_running_mean = weights.take(weight_ptr, filters);
+		bn_running_var = weights.take(weight_ptr, filters);
+		if(!bn_biases || !bn_weights || !bn_running_mean || !bn_running_var)
+			goto done;
 		if(bias != 0)
 		{
-			val = new float[filters];
-			for(int i = 0; i < filters; ++i)
-			{
-				val[i] = weights[weight_ptr];
-				++weight_ptr;
-			}
-			conv_bias.values = val;
-		}
-		val = new float[size];
-		for(int i = 0; i < size; ++i)
-		{
-			val[i] = weights[weight_ptr];
-			++weight_ptr;
+			conv_bias.values = weights.take(weight_ptr, filters);
+			if(!conv_bias.values)
+				goto done;
 		}
-		conv_wt.values = val;
-		trt_weights.push_back(conv_wt);
-		if(bias != 0)
-			trt_weights.push_back(conv_bias);
+		conv_wt.values = weights.take(weight_ptr, size);
+		if(!conv_wt.values)
+			goto done;
 	}
 
 	conv = network->addConvolutionNd(*input, filters,
@@ -196,12 +160,14 @@ bool convolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<st
 		nvinfer1::Weights scale{ nvinfer1::DataType::kFLOAT, nullptr, size };
 		nvinfer1::Weights power{ nvinfer1::DataType::kFLOAT, nullptr, size };
 		auto *shift_wt = new float[size];
-		for(int i = 0; i < size; ++i)
-			shift_wt[i] = bn_biases.at(i) - ((bn_running_mean.at(i) * bn_weights.at(i)) / bn_running_var.at(i));
-		shift.values = shift_wt;
 		auto *scale_wt = new float[size];
 		for(int i = 0; i < size; ++i)
-			scale_wt[i] = bn_weights.at(i) / bn_running_var[i];
+		{
+			const float running_var{ static_cast<float>(sqrt(bn_running_var[i] + 1.0e-5)) };
+			shift_wt[i] = bn_biases[i] - ((bn_running_mean[i] * bn_weights[i]) / running_var);
+			scale_wt[i] = bn_weights[i] / running_var;
+		}
+		shift.values = shift_wt;
 		scale.values = scale_wt;
 		auto *power_wt = new float[size];
 		for(int i = 0; i < size; ++i)
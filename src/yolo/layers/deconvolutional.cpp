@@ -4,8 +4,8 @@
 #include "layers/deconvolutional.hpp"
 
 bool deconvolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-													std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
-													int &input_channels, nvinfer1::ITensor *input, nvinfer1::INetworkDefinition *network,
+													const DarknetWeights &weights, int &weight_ptr, int &input_channels, nvinfer1::ITensor *input,
+													nvinfer1::INetworkDefinition *network,
 													const std::string &name)
 {
 	bool success{};
@@ -13,10 +13,6 @@ bool deconvolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<
 
 	nvinfer1::IDeconvolutionLayer *conv;
 	std::string layer_name;
-	std::vector<float> bn_biases;
-	std::vector<float> bn_weights;
-	std::vector<float> bn_running_mean;
-	std::vector<float> bn_running_var;
 
 	nvinfer1::Weights conv_wt;
 	nvinfer1::Weights conv_bias;
@@ -29,7 +25,6 @@ bool deconvolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<
 	int bias;
 	int size;
 	int pad{};
-	float *val;
 
 	if(block_type != "deconvolutional")
 	{
@@ -79,25 +74,16 @@ bool deconvolutionalLayer(nvinfer1::ITensor *&output, int index, const std::map<
 	conv_wt = { nvinfer1::DataType::kFLOAT, nullptr, size };
 	conv_bias = { nvinfer1::DataType::kFLOAT, nullptr, bias };
 
+	// The weights and biases point into the weights file
 	if(bias != 0)
 	{
-		val = new float[filters];
-		for(int i = 0; i < filters; ++i)
-		{
-			val[i] = weights[weight_ptr];
-			++weight_ptr;
-		}
-		conv_bias.values = val;
-		trt_weights.push_back(conv_bias);
+		conv_bias.values = weights.take(weight_ptr, filters);
+		if(!conv_bias.values)
+			goto done;
 	}
-	val = new float[size];
-	for(int i = 0; i < size; ++i)
-	{
-		val[i] = weights[weight_ptr];
-		++weight_ptr;
-	}
-	conv_wt.values = val;
-	trt_weights.push_back(conv_wt);
+	conv_wt.values = weights.take(weight_ptr, size);
+	if(!conv_wt.values)
+		goto done;
 
 	conv = network->addDeconvolutionNd(*input, filters,
 																		 nvinfer1::Dims{
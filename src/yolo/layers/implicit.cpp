@@ -4,8 +4,7 @@
 #include "layers/implicit.hpp"
 
 bool implicitLayer(nvinfer1::ITensor *&output, int index, const std::map<std::string, std::string> &block,
-									 std::vector<float> &weights, std::vector<nvinfer1::Weights> &trt_weights, int &weight_ptr,
-									 nvinfer1::INetworkDefinition *network)
+									 const DarknetWeights &weights, int &weight_ptr, nvinfer1::INetworkDefinition *network)
 {
 	bool success{};
 	std::string_view block_type{ block.at("type") };
@@ -13,7 +12,6 @@ bool implicitLayer(nvinfer1::ITensor *&output, int index, const std::map<std::st
 
 	nvinfer1::IConstantLayer *implicit;
 
-	float *val;
 	nvinfer1::Weights conv_wt;
 
 	int filters;
@@ -33,14 +31,9 @@ bool implicitLayer(nvinfer1::ITensor *&output, int index, const std::map<std::st
 
 	conv_wt = { nvinfer1::DataType::kFLOAT, nullptr, filters };
 
-	val = new float[filters];
-	for(int i = 0; i < filters; ++i)
-	{
-		val[i] = weights[weight_ptr];
-		++weight_ptr;
-	}
-	conv_wt.values = val;
-	trt_weights.push_back(conv_wt);
+	conv_wt.values = weights.take(weight_ptr, filters);
+	if(!conv_wt.values)
+		goto done;
 
 	implicit = network->addConstant(
 			nvinfer1::Dims{
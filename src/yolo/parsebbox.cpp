@@ -1,3 +1,11 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include <nvdsinfer_custom_impl.h>
 
 #include "utils.hpp"
@@ -12,6 +20,16 @@ extern "C" bool NvDsInferParseYoloE(std::vector<NvDsInferLayerInfo> const &outpu
 																		NvDsInferParseDetectionParams const &detectionParams,
 																		std::vector<NvDsInferParseObjectInfo> &objectList);
 
+extern "C" bool NvDsInferParseYoloNms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			NvDsInferNetworkInfo const &networkInfo,
+																			NvDsInferParseDetectionParams const &detectionParams,
+																			std::vector<NvDsInferParseObjectInfo> &objectList);
+
+extern "C" bool NvDsInferParseYoloENms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			 NvDsInferNetworkInfo const &networkInfo,
+																			 NvDsInferParseDetectionParams const &detectionParams,
+																			 std::vector<NvDsInferParseObjectInfo> &objectList);
+
 static NvDsInferParseObjectInfo
 convertBBox(const float &bx1, const float &by1, const float &bx2, const float &by2, const uint &netW, const uint &netH)
 {
@@ -36,9 +54,13 @@ convertBBox(const float &bx1, const float &by1, const float &bx2, const float &b
 }
 
 static void addBBoxProposal(const float bx1, const float by1, const float bx2, const float by2, const uint &net_width,
-														const uint &net_height, const int max_index, const float max_prob,
-														std::vector<NvDsInferParseObjectInfo> &binfo)
+														const uint &net_height, const float class_value, const uint num_classes,
+														const float max_prob, std::vector<NvDsInferParseObjectInfo> &binfo)
 {
+	// The filter clamps the class only to look up its threshold, a class the model does not have is garbage
+	if(!(class_value >= 0 && class_value < static_cast<float>(num_classes)))
+		return;
+
 	NvDsInferParseObjectInfo bbi = convertBBox(bx1, by1, bx2, by2, net_width, net_height);
 
 	if(bbi.width < 1 || bbi.height < 1)
@@ -47,25 +69,135 @@ static void addBBoxProposal(const float bx1, const float by1, const float bx2, c
 	}
 
 	bbi.detectionConfidence = max_prob;
-	bbi.classId = max_index;
+	bbi.classId = static_cast<uint>(class_value);
 	binfo.push_back(bbi);
 }
 
-static std::vector<NvDsInferParseObjectInfo>
-decodeTensorYolo(const float *boxes, const float *scores, const float *classes, const uint &output_size,
-								 const uint &net_width, const uint &net_height, const std::vector<float> &precluster_threshold)
+/**
+ * Writes the indices of the anchors whose score passes the threshold of
+ * their class into @p indices and returns how many were written.
+ * */
+using CandidateFilter = uint (*)(const float *scores, const float *classes, uint count, const float *thresholds,
+																 int num_classes, uint *indices);
+
+static uint filterCandidatesScalar(const float *scores, const float *classes, uint count, const float *thresholds,
+																	 int num_classes, uint *indices)
 {
-	std::vector<NvDsInferParseObjectInfo> binfo;
+	uint num_candidates{};
 
-	for(uint b = 0; b < output_size; ++b)
+	for(uint b = 0; b < count; ++b)
 	{
-		float max_prob = scores[b];
-		int max_index = (int)classes[b];
+		// Checked as a float, casting NaN or a value out of the int range is undefined
+		const float class_value{ classes[b] };
+		const bool valid{ class_value >= 0 && class_value < static_cast<float>(num_classes) };
+		const int class_index{ valid ? static_cast<int>(class_value) : 0 };
+		// Branchless: the index is always written and kept only if the class is valid and the score passes
+		indices[num_candidates] = b;
+		num_candidates += valid && scores[b] >= thresholds[class_index];
+	}
+
+	return num_candidates;
+}
+
+#if defined(__x86_64__)
+/**
+ * AVX2 version of filterCandidatesScalar: compares 8 anchors at a time
+ * against the gathered per-class thresholds and compress-stores the
+ * indices of the passing lanes by walking the comparison mask.
+ * */
+__attribute__((target("avx2,bmi"))) static uint filterCandidatesAvx2(const float *scores, const float *classes,
+																																			 uint count, const float *thresholds,
+																																			 int num_classes, uint *indices)
+{
+	uint num_candidates{};
+	uint b{};
 
-		if(max_prob < precluster_threshold[max_index])
+	const __m256 min_class{ _mm256_setzero_ps() };
+	const __m256 max_class{ _mm256_set1_ps(static_cast<float>(num_classes)) };
+
+	for(; b + 8 <= count; b += 8)
+	{
+		__m256 score = _mm256_loadu_ps(scores + b);
+		__m256 class_value = _mm256_loadu_ps(classes + b);
+		// Ordered compares, a NaN class is invalid as in the scalar version
+		__m256 valid = _mm256_and_ps(_mm256_cmp_ps(class_value, min_class, _CMP_GE_OQ),
+																 _mm256_cmp_ps(class_value, max_class, _CMP_LT_OQ));
+		// Invalid lanes gather the threshold of class 0, their mask bit is cleared anyway
+		__m256i class_index = _mm256_cvttps_epi32(_mm256_and_ps(class_value, valid));
+		__m256 threshold = _mm256_i32gather_ps(thresholds, class_index, 4);
+
+		uint mask = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_cmp_ps(score, threshold, _CMP_GE_OQ)));
+		while(mask)
 		{
-			continue;
+			indices[num_candidates++] = b + _tzcnt_u32(mask);
+			mask &= mask - 1;
 		}
+	}
+
+	// Tail of less than 8 anchors
+	uint tail{ filterCandidatesScalar(scores + b, classes + b, count - b, thresholds, num_classes,
+																		indices + num_candidates) };
+	for(uint i = num_candidates; i < num_candidates + tail; ++i)
+		indices[i] += b;
+
+	return num_candidates + tail;
+}
+#endif
+
+/**
+ * Picks the candidate filter once per process. Setting
+ * TADS_YOLO_DISABLE_SIMD=1 forces the scalar path.
+ * */
+static CandidateFilter selectCandidateFilter()
+{
+	const char *disable_simd{ getenv("TADS_YOLO_DISABLE_SIMD") };
+	if(disable_simd != nullptr && disable_simd[0] == '1')
+	{
+		TADS_INFO_MSG_V("YOLO decoder: SIMD disabled, using scalar candidate filter");
+		return filterCandidatesScalar;
+	}
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi"))
+	{
+		TADS_INFO_MSG_V("YOLO decoder: using AVX2 candidate filter");
+		return filterCandidatesAvx2;
+	}
+#endif
+	TADS_INFO_MSG_V("YOLO decoder: using scalar candidate filter");
+	return filterCandidatesScalar;
+}
+
+static uint filterCandidates(const float *scores, const float *classes, uint count,
+														 const std::vector<float> &precluster_threshold, std::vector<uint> &indices)
+{
+	static const CandidateFilter filter{ selectCandidateFilter() };
+
+	if(precluster_threshold.empty())
+		return 0;
+
+	if(indices.size() < count)
+		indices.resize(count);
+
+	return filter(scores, classes, count, precluster_threshold.data(), (int)precluster_threshold.size(),
+								indices.data());
+}
+
+static void decodeTensorYolo(const float *boxes, const float *scores, const float *classes, const uint &output_size,
+														 const uint &net_width, const uint &net_height,
+														 const std::vector<float> &precluster_threshold,
+														 std::vector<NvDsInferParseObjectInfo> &binfo)
+{
+	// nvinfer calls the parser from one thread per GIE, the buffer is reused across frames
+	thread_local std::vector<uint> indices;
+	const uint num_candidates{ filterCandidates(scores, classes, output_size, precluster_threshold, indices) };
+
+	binfo.clear();
+	binfo.reserve(num_candidates);
+
+	for(uint i = 0; i < num_candidates; ++i)
+	{
+		const uint b{ indices[i] };
 
 		float bxc = boxes[b * 4 + 0];
 		float byc = boxes[b * 4 + 1];
@@ -77,37 +209,34 @@ decodeTensorYolo(const float *boxes, const float *scores, const float *classes,
 		float bx2 = bx1 + bw;
 		float by2 = by1 + bh;
 
-		addBBoxProposal(bx1, by1, bx2, by2, net_width, net_height, max_index, max_prob, binfo);
+		addBBoxProposal(bx1, by1, bx2, by2, net_width, net_height, classes[b], (uint)precluster_threshold.size(), scores[b],
+										binfo);
 	}
-
-	return binfo;
 }
 
-static std::vector<NvDsInferParseObjectInfo>
-decodeTensorYoloE(const float *boxes, const float *scores, const float *classes, const uint &output_size,
-									const uint &net_width, const uint &net_height, const std::vector<float> &precluster_threshold)
+static void decodeTensorYoloE(const float *boxes, const float *scores, const float *classes, const uint &output_size,
+															const uint &net_width, const uint &net_height,
+															const std::vector<float> &precluster_threshold,
+															std::vector<NvDsInferParseObjectInfo> &binfo)
 {
-	std::vector<NvDsInferParseObjectInfo> binfo;
+	thread_local std::vector<uint> indices;
+	const uint num_candidates{ filterCandidates(scores, classes, output_size, precluster_threshold, indices) };
 
-	for(uint b = 0; b < output_size; ++b)
-	{
-		float max_prob = scores[b];
-		int max_index = (int)classes[b];
+	binfo.clear();
+	binfo.reserve(num_candidates);
 
-		if(max_prob < precluster_threshold[max_index])
-		{
-			continue;
-		}
+	for(uint i = 0; i < num_candidates; ++i)
+	{
+		const uint b{ indices[i] };
 
 		float bx1 = boxes[b * 4 + 0];
 		float by1 = boxes[b * 4 + 1];
 		float bx2 = boxes[b * 4 + 2];
 		float by2 = boxes[b * 4 + 3];
 
-		addBBoxProposal(bx1, by1, bx2, by2, net_width, net_height, max_index, max_prob, binfo);
+		addBBoxProposal(bx1, by1, bx2, by2, net_width, net_height, classes[b], (uint)precluster_threshold.size(), scores[b],
+										binfo);
 	}
-
-	return binfo;
 }
 
 static bool NvDsInferParseCustomYolo(std::vector<NvDsInferLayerInfo> const &output_layers_info,
@@ -121,21 +250,15 @@ static bool NvDsInferParseCustomYolo(std::vector<NvDsInferLayerInfo> const &outp
 		return false;
 	}
 
-	std::vector<NvDsInferParseObjectInfo> objects;
-
 	const NvDsInferLayerInfo &boxes{ output_layers_info[0] };
 	const NvDsInferLayerInfo &scores{ output_layers_info[1] };
 	const NvDsInferLayerInfo &classes{ output_layers_info[2] };
 
 	const uint output_size{ boxes.inferDims.d[0] };
 
-	std::vector<NvDsInferParseObjectInfo> outObjs{ decodeTensorYolo(
-			(const float *)(boxes.buffer), (const float *)(scores.buffer), (const float *)(classes.buffer), output_size,
-			network_info.width, network_info.height, detection_params.perClassPreclusterThreshold) };
-
-	objects.insert(objects.end(), outObjs.begin(), outObjs.end());
-
-	object_list = objects;
+	decodeTensorYolo((const float *)(boxes.buffer), (const float *)(scores.buffer), (const float *)(classes.buffer),
+									 output_size, network_info.width, network_info.height, detection_params.perClassPreclusterThreshold,
+									 object_list);
 
 	return true;
 }
@@ -151,23 +274,180 @@ static bool NvDsInferParseCustomYoloE(std::vector<NvDsInferLayerInfo> const &out
 		return false;
 	}
 
-	std::vector<NvDsInferParseObjectInfo> objects;
-
 	const NvDsInferLayerInfo &boxes{ outputLayersInfo[0] };
 	const NvDsInferLayerInfo &scores{ outputLayersInfo[1] };
 	const NvDsInferLayerInfo &classes{ outputLayersInfo[2] };
 
 	const uint outputSize{ boxes.inferDims.d[0] };
 
-	std::vector<NvDsInferParseObjectInfo> outObjs{ decodeTensorYoloE(
-			(const float *)(boxes.buffer), (const float *)(scores.buffer), (const float *)(classes.buffer), outputSize,
-			networkInfo.width, networkInfo.height, detection_params.perClassPreclusterThreshold) };
+	decodeTensorYoloE((const float *)(boxes.buffer), (const float *)(scores.buffer), (const float *)(classes.buffer),
+										outputSize, networkInfo.width, networkInfo.height, detection_params.perClassPreclusterThreshold,
+										object_list);
 
-	objects.insert(objects.end(), outObjs.begin(), outObjs.end());
+	return true;
+}
 
-	object_list = objects;
+/**
+ * Parameters of the built-in clustering used by the *Nms parsers.
+ * nvinfer does not pass nms-iou-threshold and topk to custom parsers,
+ * so they are read from TADS_YOLO_NMS_IOU_THRESHOLD and TADS_YOLO_NMS_TOPK,
+ * defaulting to the values of config_pgie_detector.ini.
+ * */
+struct NmsParams
+{
+	float iou_threshold{ 0.35f };
+	uint top_k{ 300 };
+};
 
-	return true;
+static const NmsParams &nmsParams()
+{
+	static const NmsParams params{ [] {
+		NmsParams p{};
+		if(const char *iou = getenv("TADS_YOLO_NMS_IOU_THRESHOLD"); iou != nullptr)
+			p.iou_threshold = std::strtof(iou, nullptr);
+		if(const char *top_k = getenv("TADS_YOLO_NMS_TOPK"); top_k != nullptr)
+			p.top_k = std::max(1ul, std::strtoul(top_k, nullptr, 10));
+		TADS_INFO_MSG_V("YOLO NMS: iou-threshold=%.2f topk=%u", p.iou_threshold, p.top_k);
+		return p;
+	}() };
+	return params;
+}
+
+/**
+ * Kept boxes of the class being clustered, stored as separate arrays so
+ * the IoU loop runs over contiguous floats.
+ * */
+struct NmsKeptBoxes
+{
+	std::vector<float> x1, y1, x2, y2, area;
+
+	void clear()
+	{
+		x1.clear();
+		y1.clear();
+		x2.clear();
+		y2.clear();
+		area.clear();
+	}
+
+	void push(const NvDsInferParseObjectInfo &object)
+	{
+		x1.push_back(object.left);
+		y1.push_back(object.top);
+		x2.push_back(object.left + object.width);
+		y2.push_back(object.top + object.height);
+		area.push_back(object.width * object.height);
+	}
+
+	[[nodiscard]]
+	bool overlaps(const NvDsInferParseObjectInfo &object, float iou_threshold) const
+	{
+		const float bx1{ object.left };
+		const float by1{ object.top };
+		const float bx2{ object.left + object.width };
+		const float by2{ object.top + object.height };
+		const float barea{ object.width * object.height };
+		const size_t count{ area.size() };
+
+		bool suppressed{ false };
+		for(size_t k = 0; k < count; ++k)
+		{
+			const float w = std::max(0.0f, std::min(x2[k], bx2) - std::max(x1[k], bx1));
+			const float h = std::max(0.0f, std::min(y2[k], by2) - std::max(y1[k], by1));
+			const float intersection = w * h;
+			suppressed |= intersection > iou_threshold * (area[k] + barea - intersection);
+		}
+		return suppressed;
+	}
+};
+
+/**
+ * Greedy class-aware NMS with per-class top-K, equivalent to nvinfer
+ * cluster-mode=2, done in place on @p objects.
+ *
+ * Every object has a class below @p num_classes, the decode drops the
+ * others. Objects are bucketed by class with a counting sort. In each bucket only
+ * the best candidates are ordered with nth_element + sort; the remainder
+ * is sorted only if NMS runs out of them before top-K boxes are kept.
+ * */
+static void clusterObjects(std::vector<NvDsInferParseObjectInfo> &objects, uint num_classes, const NmsParams &params)
+{
+	thread_local std::vector<uint> class_offsets;
+	thread_local std::vector<uint> order;
+	thread_local std::vector<NvDsInferParseObjectInfo> clustered;
+	thread_local NmsKeptBoxes kept;
+
+	class_offsets.assign(num_classes + 1, 0);
+	for(const NvDsInferParseObjectInfo &object : objects)
+	{
+		assert(object.classId < num_classes);
+		class_offsets[object.classId + 1]++;
+	}
+	for(uint c = 0; c < num_classes; ++c)
+		class_offsets[c + 1] += class_offsets[c];
+
+	order.resize(objects.size());
+	{
+		thread_local std::vector<uint> fill;
+		fill.assign(class_offsets.begin(), class_offsets.end() - 1);
+		for(uint i = 0; i < objects.size(); ++i)
+			order[fill[objects[i].classId]++] = i;
+	}
+
+	auto by_confidence = [&objects](uint a, uint b) {
+		const float ca{ objects[a].detectionConfidence };
+		const float cb{ objects[b].detectionConfidence };
+		return ca > cb || (ca == cb && a < b);
+	};
+
+	clustered.clear();
+	for(uint c = 0; c < num_classes; ++c)
+	{
+		auto begin{ order.begin() + class_offsets[c] };
+		auto end{ order.begin() + class_offsets[c + 1] };
+		const size_t count = end - begin;
+
+		if(count == 0)
+			continue;
+
+		size_t sorted{ std::min<size_t>(count, (size_t)params.top_k * 4) };
+		if(sorted < count)
+			std::nth_element(begin, begin + sorted, end, by_confidence);
+		std::sort(begin, begin + sorted, by_confidence);
+
+		kept.clear();
+		for(size_t i = 0; i < count && kept.area.size() < params.top_k; ++i)
+		{
+			if(i == sorted)
+			{
+				std::sort(begin + sorted, end, by_confidence);
+				sorted = count;
+			}
+
+			const NvDsInferParseObjectInfo &object{ objects[begin[i]] };
+			if(kept.overlaps(object, params.iou_threshold))
+				continue;
+
+			kept.push(object);
+			clustered.push_back(object);
+		}
+	}
+
+	objects.assign(clustered.begin(), clustered.end());
+}
+
+static bool NvDsInferParseCustomYoloNms(std::vector<NvDsInferLayerInfo> const &output_layers_info,
+																				NvDsInferNetworkInfo const &network_info,
+																				NvDsInferParseDetectionParams const &detection_params,
+																				std::vector<NvDsInferParseObjectInfo> &object_list, bool yolo_e)
+{
+	bool success{ yolo_e ? NvDsInferParseCustomYoloE(output_layers_info, network_info, detection_params, object_list)
+											 : NvDsInferParseCustomYolo(output_layers_info, network_info, detection_params, object_list) };
+
+	if(success)
+		clusterObjects(object_list, (uint)detection_params.perClassPreclusterThreshold.size(), nmsParams());
+
+	return success;
 }
 
 extern "C" bool NvDsInferParseYolo(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
@@ -186,5 +466,23 @@ extern "C" bool NvDsInferParseYoloE(std::vector<NvDsInferLayerInfo> const &outpu
 	return NvDsInferParseCustomYoloE(outputLayersInfo, networkInfo, detectionParams, objectList);
 }
 
+extern "C" bool NvDsInferParseYoloNms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			NvDsInferNetworkInfo const &networkInfo,
+																			NvDsInferParseDetectionParams const &detectionParams,
+																			std::vector<NvDsInferParseObjectInfo> &objectList)
+{
+	return NvDsInferParseCustomYoloNms(outputLayersInfo, networkInfo, detectionParams, objectList, false);
+}
+
+extern "C" bool NvDsInferParseYoloENms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			 NvDsInferNetworkInfo const &networkInfo,
+																			 NvDsInferParseDetectionParams const &detectionParams,
+																			 std::vector<NvDsInferParseObjectInfo> &objectList)
+{
+	return NvDsInferParseCustomYoloNms(outputLayersInfo, networkInfo, detectionParams, objectList, true);
+}
+
 CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseYolo)	 // NOLINT(*-no-recursion)
-CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseYoloE) // NOLINT(*-no-recursion)
\ No newline at end of file
+CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseYoloE) // NOLINT(*-no-recursion)
+CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseYoloNms)	 // NOLINT(*-no-recursion)
+CHECK_CUSTOM_PARSE_FUNC_PROTOTYPE(NvDsInferParseYoloENms) // NOLINT(*-no-recursion)
\ No newline at end of file
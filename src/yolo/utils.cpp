@@ -7,50 +7,23 @@
 
 #include "utils.hpp"
 
-std::vector<float> load_weights(std::string_view weights_file_path, const std::string &modelName)
+bool load_weights(std::string_view weights_file_path, const std::string &modelName, DarknetWeights &weights)
 {
-	assert(file_exists(weights_file_path));
 	TADS_INFO_MSG_V("Loading pre-trained weights");
 
-	std::vector<float> weights;
-
-	if(weights_file_path.find(".weights") != std::string::npos)
-	{
-		std::ifstream file(weights_file_path.data(), std::ios_base::binary);
-		assert(file.good());
-		std::string line;
-
-		if(modelName.find("yolov2") != std::string::npos && modelName.find("yolov2-tiny") == std::string::npos)
-		{
-			// Remove 4 int32 bytes of data from the stream belonging to the header
-			file.ignore(4 * 4);
-		}
-		else
-		{
-			// Remove 5 int32 bytes of data from the stream belonging to the header
-			file.ignore(4 * 5);
-		}
-
-		char floatWeight[4];
-		while(!file.eof())
-		{
-			file.read(floatWeight, 4);
-			assert(file.gcount() == 4);
-			weights.push_back(*reinterpret_cast<float *>(floatWeight));
-			if(file.peek() == std::istream::traits_type::eof())
-			{
-				break;
-			}
-		}
-	}
-	else
+	if(weights_file_path.find(".weights") == std::string::npos)
 	{
 		TADS_ERR_MSG_V("File %s is not supported", weights_file_path.data());
+		return false;
 	}
 
-	TADS_INFO_MSG_V("Loading weights of %s complete", modelName.data());
+	if(!weights.open(weights_file_path))
+		return false;
+
+	TADS_INFO_MSG_V("Loading weights of %s complete (version %d.%d.%d, %s)", modelName.data(), weights.major,
+									weights.minor, weights.revision, weights.is_mapped() ? "mapped" : "streamed");
 	TADS_INFO_MSG_V("Total weights read: %ld", weights.size());
-	return weights;
+	return true;
 }
 
 std::string dims_to_string(const nvinfer1::Dims &d)
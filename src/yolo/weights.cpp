@@ -0,0 +1,229 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "utils.hpp"
+#include "weights.hpp"
+
+static constexpr size_t WEIGHTS_VERSION_SIZE{ 3 * sizeof(int32_t) };
+static constexpr size_t WEIGHTS_STREAM_CHUNK{ 1 << 20 };
+
+static bool read_full(int fd, char *dst, size_t size, size_t &read_size)
+{
+	read_size = 0;
+	while(read_size < size)
+	{
+		ssize_t ret = ::read(fd, dst + read_size, size - read_size);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		if(ret == 0)
+			break;
+		read_size += ret;
+	}
+	return true;
+}
+
+DarknetWeights::~DarknetWeights()
+{
+	close();
+}
+
+DarknetWeights::DarknetWeights(DarknetWeights &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+DarknetWeights &DarknetWeights::operator=(DarknetWeights &&other) noexcept
+{
+	if(this != &other)
+	{
+		close();
+		major = other.major;
+		minor = other.minor;
+		revision = other.revision;
+		seen = other.seen;
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+		m_mapping_size = std::exchange(other.m_mapping_size, 0);
+		m_buffer = std::move(other.m_buffer);
+		m_data = std::exchange(other.m_data, nullptr);
+		m_size = std::exchange(other.m_size, 0);
+	}
+	return *this;
+}
+
+bool DarknetWeights::open(std::string_view file_path)
+{
+	bool success{};
+	struct stat file_stat{};
+	const std::string path{ file_path };
+
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd < 0)
+	{
+		TADS_ERR_MSG_V("Could not open weights file '%s': %s", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if(fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0)
+	{
+		void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapping != MAP_FAILED)
+		{
+			success = map_file(mapping, file_stat.st_size);
+			goto done;
+		}
+		TADS_WARN_MSG_V("Could not map weights file '%s': %s, reading it instead", path.c_str(), strerror(errno));
+	}
+
+	// Pipes and files that can not be mapped are read like a stream
+	success = stream_file(fd);
+
+done:
+	::close(fd);
+
+	if(!success)
+	{
+		TADS_ERR_MSG_V("Could not load weights file '%s'", path.c_str());
+		close();
+	}
+	return success;
+}
+
+void DarknetWeights::close()
+{
+	if(m_mapping)
+		munmap(m_mapping, m_mapping_size);
+
+	m_mapping = nullptr;
+	m_mapping_size = 0;
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+	m_data = nullptr;
+	m_size = 0;
+}
+
+const float *DarknetWeights::take(int &weight_ptr, int count) const
+{
+	if(weight_ptr < 0 || count < 0 || static_cast<size_t>(weight_ptr) + count > m_size)
+	{
+		TADS_ERR_MSG_V("Weights out of range: requested %d at %d, file has %zu", count, weight_ptr, m_size);
+		return nullptr;
+	}
+
+	const float *weights{ m_data + weight_ptr };
+	weight_ptr += count;
+	return weights;
+}
+
+bool DarknetWeights::map_file(void *mapping, size_t file_size)
+{
+	madvise(mapping, file_size, MADV_SEQUENTIAL);
+	madvise(mapping, file_size, MADV_WILLNEED);
+
+	m_mapping = mapping;
+	m_mapping_size = file_size;
+	return parse(static_cast<const char *>(mapping), file_size);
+}
+
+bool DarknetWeights::stream_file(int fd)
+{
+	size_t total_bytes{}, read_size{};
+
+	// The header is read with the weights so that parse_header is the only place knowing its size
+	while(true)
+	{
+		m_buffer.resize((total_bytes + WEIGHTS_STREAM_CHUNK) / sizeof(float) + 1);
+		char *dst{ reinterpret_cast<char *>(m_buffer.data()) + total_bytes };
+
+		if(!read_full(fd, dst, WEIGHTS_STREAM_CHUNK, read_size))
+		{
+			TADS_ERR_MSG_V("Could not read weights: %s", strerror(errno));
+			return false;
+		}
+		total_bytes += read_size;
+
+		if(read_size < WEIGHTS_STREAM_CHUNK)
+			break;
+	}
+
+	m_buffer.resize((total_bytes + sizeof(float) - 1) / sizeof(float));
+	m_buffer.shrink_to_fit();
+	return parse(reinterpret_cast<const char *>(m_buffer.data()), total_bytes);
+}
+
+bool DarknetWeights::parse(const char *data, size_t size)
+{
+	size_t header_size{ parse_header(data, size) };
+	if(header_size == 0)
+		return false;
+
+	if((size - header_size) % sizeof(float) != 0)
+	{
+		TADS_ERR_MSG_V("Weights file size %zu is not a whole number of weights", size);
+		return false;
+	}
+
+	// The header is 16 or 20 bytes, so the weights are still 4 bytes aligned
+	m_data = reinterpret_cast<const float *>(data + header_size);
+	m_size = (size - header_size) / sizeof(float);
+	return true;
+}
+
+size_t DarknetWeights::parse_header(const char *data, size_t size)
+{
+	if(size < WEIGHTS_VERSION_SIZE)
+	{
+		TADS_ERR_MSG_V("Weights header truncated at %zu bytes", size);
+		return 0;
+	}
+
+	memcpy(&major, data, sizeof(int32_t));
+	memcpy(&minor, data + sizeof(int32_t), sizeof(int32_t));
+	memcpy(&revision, data + 2 * sizeof(int32_t), sizeof(int32_t));
+
+	if(major < 0 || minor < 0 || revision < 0 || major >= 1000 || minor >= 1000)
+	{
+		TADS_ERR_MSG_V("Invalid weights header version %d.%d.%d", major, minor, revision);
+		return 0;
+	}
+
+	// Same rule as darknet: the seen counter is 64 bit since version 0.2
+	size_t header_size{ WEIGHTS_VERSION_SIZE };
+	if((major * 10 + minor) >= 2)
+	{
+		uint64_t seen64{};
+		if(size < header_size + sizeof(uint64_t))
+		{
+			TADS_ERR_MSG_V("Weights header truncated at %zu bytes", size);
+			return 0;
+		}
+		memcpy(&seen64, data + header_size, sizeof(uint64_t));
+		seen = seen64;
+		header_size += sizeof(uint64_t);
+	}
+	else
+	{
+		int32_t seen32{};
+		if(size < header_size + sizeof(int32_t))
+		{
+			TADS_ERR_MSG_V("Weights header truncated at %zu bytes", size);
+			return 0;
+		}
+		memcpy(&seen32, data + header_size, sizeof(int32_t));
+		seen = static_cast<uint64_t>(seen32);
+		header_size += sizeof(int32_t);
+	}
+
+	return header_size;
+}
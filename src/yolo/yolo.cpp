@@ -265,8 +265,14 @@ NvDsInferStatus Yolo::parseModel(nvinfer1::INetworkDefinition &network)
 {
 	destroyNetworkUtils();
 
-	std::vector<float> weights = load_weights(m_darknet_wts_file_path, m_model_name);
-	NvDsInferStatus status = buildYoloNetwork(weights, network);
+	// The layers point into the weights, they are kept until the engine is built
+	if(!load_weights(m_darknet_wts_file_path, m_model_name, m_weights))
+	{
+		TADS_ERR_MSG_V("Loading weights of %s failed", m_model_name.c_str());
+		return NVDSINFER_CONFIG_FAILED;
+	}
+
+	NvDsInferStatus status = buildYoloNetwork(m_weights, network);
 
 	if(status == NVDSINFER_SUCCESS)
 	{
@@ -280,7 +286,7 @@ NvDsInferStatus Yolo::parseModel(nvinfer1::INetworkDefinition &network)
 	return status;
 }
 
-NvDsInferStatus Yolo::buildYoloNetwork(std::vector<float> &weights, nvinfer1::INetworkDefinition &network)
+NvDsInferStatus Yolo::buildYoloNetwork(const DarknetWeights &weights, nvinfer1::INetworkDefinition &network)
 {
 	int weight_ptr{};
 	uint yolo_count_inputs{};
@@ -338,7 +344,7 @@ NvDsInferStatus Yolo::buildYoloNetwork(std::vector<float> &weights, nvinfer1::IN
 			int channels = get_num_channels(previous);
 			input_vol = dims_to_string(previous->getDimensions());
 
-			if(!deconvolutionalLayer(previous, i, block, weights, m_trt_weights, weight_ptr, channels, previous, &network))
+			if(!deconvolutionalLayer(previous, i, block, weights, weight_ptr, channels, previous, &network))
 			{
 				goto done;
 			}
@@ -362,7 +368,7 @@ NvDsInferStatus Yolo::buildYoloNetwork(std::vector<float> &weights, nvinfer1::IN
 		}
 		else if(block_type == "implicit" || block_type == "implicit_add" || block_type == "implicit_mul")
 		{
-			if(!implicitLayer(previous, i, block, weights, m_trt_weights, weight_ptr, &network))
+			if(!implicitLayer(previous, i, block, weights, weight_ptr, &network))
 			{
 				goto done;
 			}
@@ -716,6 +722,7 @@ void Yolo::destroyNetworkUtils()
 {
 	for(auto &m_TrtWeight : m_trt_weights)
 		if(m_TrtWeight.count > 0)
-			free(const_cast<void *>(m_TrtWeight.values));
+			delete[] static_cast<const float *>(m_TrtWeight.values);
 	m_trt_weights.clear();
+	m_weights.close();
 }
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "analytics.hpp"
+#include "common.hpp"
+#include "latency.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_batches{ 10000 };
+static int g_objects{ 64 };
+static int g_queue{ 4 };
+static int g_worker_us{ 500 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "batches", 'n', 0, G_OPTION_ARG_INT, &g_batches, "Batches captured while the ring is full", nullptr },
+	{ "objects", 'o', 0, G_OPTION_ARG_INT, &g_objects, "Objects of each batch", nullptr },
+	{ "queue", 'q', 0, G_OPTION_ARG_INT, &g_queue, "Batches of the worker ring", nullptr },
+	{ "worker-us", 'w', 0, G_OPTION_ARG_INT, &g_worker_us, "Time the slow worker spends on a whole batch", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the idle gaps", nullptr },
+	{ nullptr },
+};
+
+/**
+ * One object in this many crosses a line.
+ * */
+static constexpr int CROSSING_PERIOD{ 97 };
+
+using CheckFunction = std::function<void(bool, const std::string &)>;
+
+/**
+ * What the worker saw, only touched by its thread until it is stopped.
+ * */
+struct WorkerLog
+{
+	std::vector<uint8_t> crossings;
+	int64_t last_batch{ -1 };
+	uint64_t out_of_order{};
+	std::atomic<pid_t> tid{};
+};
+
+static bool has_crossing(int64_t batch, int object)
+{
+	return (batch * 31 + object) % CROSSING_PERIOD == 0;
+}
+
+/**
+ * Captures batch @p index as the probe does, into @p batch.
+ * */
+static void capture(AnalyticsBatchSnapshot &batch, int64_t index)
+{
+	batch.timestamp = static_cast<double>(index);
+	batch.time_us = index;
+	batch.objects.clear();
+
+	for(int i = 0; i < g_objects; i++)
+	{
+		AnalyticsObjectSnapshot &object{ batch.objects.emplace_back() };
+		object.track_id = static_cast<uint64_t>(index) * g_objects + i;
+		object.source_id = static_cast<uint>(i % 8);
+		object.has_parent = false;
+		object.has_image = false;
+		object.crossing_cnt = 0;
+		object.plate_cnt = 0;
+		object.direction = LABEL_UNKNOWN;
+		object.parent_label = LABEL_UNKNOWN;
+		object.classifier = ClassifierData{};
+		if(has_crossing(index, i))
+			object.crossings[object.crossing_cnt++] = LABEL_UNKNOWN;
+	}
+}
+
+/**
+ * Records the crossings the worker is handed and the order of the batches.
+ * */
+static void log_batch(WorkerLog &log, const AnalyticsBatchSnapshot &batch)
+{
+	log.tid.store(static_cast<pid_t>(syscall(SYS_gettid)), std::memory_order_relaxed);
+	if(batch.time_us <= log.last_batch)
+		log.out_of_order++;
+	log.last_batch = batch.time_us;
+
+	for(const AnalyticsObjectSnapshot &object : batch.objects)
+	{
+		if(object.crossing_cnt > 0 && object.track_id < log.crossings.size())
+			log.crossings[object.track_id]++;
+	}
+}
+
+/**
+ * @return the voluntary context switches of thread @p tid, -1 if unknown.
+ * */
+static long context_switches(pid_t tid)
+{
+	std::ifstream status(fmt::format("/proc/self/task/{}/status", tid));
+	std::string line;
+
+	while(std::getline(status, line))
+	{
+		if(line.compare(0, 24, "voluntary_ctxt_switches:") == 0)
+			return std::stol(line.substr(24));
+	}
+	return -1;
+}
+
+/**
+ * Captures batches faster than a slow worker processes them: the probe
+ * time must not depend on the worker, and every crossing must still reach
+ * the worker once, with the batches in capture order.
+ * */
+static void check_full_ring(const CheckFunction &check)
+{
+	const size_t tracks{ static_cast<size_t>(g_batches) * g_objects };
+	WorkerLog log;
+	AnalyticsBatchSnapshot dropped_batch;
+	LatencyHistogram probe_latency;
+	LatencySnapshot probe;
+	uint64_t expected_crossings{}, crossings{}, kept{}, lost{}, twice{};
+
+	log.crossings.assign(tracks, 0);
+	AnalyticsWorker worker{ static_cast<size_t>(g_queue), false,
+													[&log](const AnalyticsBatchSnapshot &batch)
+													{
+														// As slow as the objects it is handed, the kept objects of a dropped batch are few
+														log_batch(log, batch);
+														std::this_thread::sleep_for(
+																std::chrono::microseconds(g_worker_us * batch.objects.size() / g_objects));
+													} };
+	worker.start();
+
+	for(int64_t index = 0; index < g_batches; index++)
+	{
+		const uint64_t start_ns{ LatencyTracker::now_ns() };
+		AnalyticsBatchSnapshot *batch{ worker.acquire() };
+		const bool dropped{ batch == nullptr };
+
+		AnalyticsBatchSnapshot &captured{ dropped ? dropped_batch : *batch };
+
+		capture(captured, index);
+		if(dropped)
+			worker.submit_dropped(dropped_batch);
+		else
+			worker.submit();
+		probe_latency.record(LatencyTracker::now_ns() - start_ns);
+
+		// The worker only reads a submitted slot, the probe does not refill it before the next acquire
+		for(const AnalyticsObjectSnapshot &object : captured.objects)
+		{
+			expected_crossings += object.crossing_cnt;
+			kept += dropped && object.crossing_cnt > 0;
+		}
+
+		// Twice the rate of the worker, the ring is full most of the time but keeps moving
+		std::this_thread::sleep_for(std::chrono::microseconds(g_worker_us / 2));
+	}
+	worker.stop();
+	probe_latency.drain(probe);
+
+	for(uint8_t count : log.crossings)
+	{
+		crossings += count;
+		twice += count > 1;
+	}
+	for(size_t track = 0; track < tracks; track++)
+		lost += has_crossing(static_cast<int64_t>(track / g_objects), static_cast<int>(track % g_objects)) &&
+						log.crossings[track] == 0;
+
+	const AnalyticsWorkerStats stats{ worker.stats() };
+	check(stats.dropped > 0, "full ring: no batch was dropped, the worker is not slow enough");
+	check(stats.processed + stats.dropped == static_cast<uint64_t>(g_batches),
+				fmt::format("full ring: {} processed and {} dropped out of {} batches", stats.processed, stats.dropped,
+										g_batches));
+	check(stats.kept_objects == kept, fmt::format("full ring: {} objects kept instead of {}", stats.kept_objects, kept));
+	check(lost == 0 && twice == 0 && crossings == expected_crossings,
+				fmt::format("full ring: {} crossings lost and {} seen twice, {} out of {}", lost, twice, crossings,
+										expected_crossings));
+	check(log.out_of_order == 0, fmt::format("full ring: {} batches processed out of order", log.out_of_order));
+
+	// Waiting for the worker would take at least one of its batches
+	check(probe.value_at(99) * 4 < static_cast<uint64_t>(g_worker_us) * 1000,
+				fmt::format("full ring: probe p99 {:.1f} us, the probe waits for the worker", probe.value_at(99) / 1000.0));
+
+	g_print("%s", fmt::format("full ring  {} batches, {} dropped, {} crossings of which {} kept from dropped batches, "
+														"probe p50 {:.1f} us p99 {:.1f} us max {:.1f} us\n",
+														g_batches, stats.dropped, crossings, kept, probe.value_at(50) / 1000.0,
+														probe.value_at(99) / 1000.0, probe.max / 1000.0)
+										.c_str());
+}
+
+/**
+ * Submits batches one at a time after idle gaps: each must be processed
+ * without a polling delay, and an idle worker must not wake up.
+ * */
+static void check_idle(const CheckFunction &check, std::mt19937 &rng)
+{
+	using Clock = std::chrono::steady_clock;
+	static constexpr int BATCHES{ 200 };
+	WorkerLog log;
+	std::atomic<int64_t> processed{ -1 };
+	LatencyHistogram wake_latency;
+	LatencySnapshot wake;
+	bool late{};
+
+	log.crossings.assign(static_cast<size_t>(BATCHES) * g_objects, 0);
+	AnalyticsWorker worker{ static_cast<size_t>(g_queue), false,
+													[&log, &processed](const AnalyticsBatchSnapshot &batch)
+													{
+														log_batch(log, batch);
+														processed.store(batch.time_us, std::memory_order_release);
+													} };
+	worker.start();
+
+	for(int64_t index = 0; index < BATCHES; index++)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(rng() % 3000));
+
+		AnalyticsBatchSnapshot *batch{ worker.acquire() };
+		if(!batch)
+		{
+			check(false, fmt::format("idle: batch {} found the ring full", index));
+			continue;
+		}
+		capture(*batch, index);
+		const uint64_t start_ns{ LatencyTracker::now_ns() };
+		worker.submit();
+
+		// A lost wakeup would never be processed without the polling timeout
+		const Clock::time_point deadline{ Clock::now() + std::chrono::seconds(1) };
+		while(processed.load(std::memory_order_acquire) < index && Clock::now() < deadline)
+			std::this_thread::yield();
+		if(processed.load(std::memory_order_acquire) < index)
+		{
+			late = true;
+			break;
+		}
+		wake_latency.record(LatencyTracker::now_ns() - start_ns);
+	}
+	check(!late, "idle: a batch was not processed within a second");
+
+	// Idle for half a second, the worker must stay asleep
+	const pid_t tid{ log.tid.load(std::memory_order_relaxed) };
+	const long before{ context_switches(tid) };
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	const long wakeups{ context_switches(tid) - before };
+	check(before >= 0 && wakeups <= 1, fmt::format("idle: the worker woke up {} times in 500 ms", wakeups));
+
+	worker.stop();
+	wake_latency.drain(wake);
+	g_print("%s", fmt::format("idle       {} batches, wake p50 {:.1f} us p99 {:.1f} us, {} wakeups in 500 ms idle\n",
+														BATCHES, wake.value_at(50) / 1000.0, wake.value_at(99) / 1000.0, wakeups)
+										.c_str());
+}
+
+/**
+ * Checks the analytics worker without a pipeline: with a slow worker the
+ * probe time stays bounded while the ring is full, and the line crossings
+ * of the dropped batches still reach the worker, in order; an idle worker
+ * sleeps until a batch is submitted and never polls.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+
+	ctx = g_option_context_new("- check the analytics worker queue when it is full and when it is idle");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_batches < 100 || g_objects < 1 || g_queue < 1 || g_worker_us < 100)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	{
+		const CheckFunction check{ [&failures](bool passed, const std::string &what)
+															 {
+																 if(!passed)
+																 {
+																	 TADS_ERR_MSG_V("%s", what.c_str());
+																	 failures++;
+																 }
+															 } };
+		std::mt19937 rng(g_seed);
+		check_full_ring(check);
+		check_idle(check, rng);
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,348 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "best_shot.hpp"
+#include "common.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_tracks{ 100000 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "tracks", 'n', 0, G_OPTION_ARG_INT, &g_tracks, "Random tracks checked after the scenarios", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the random tracks", nullptr },
+	{ nullptr },
+};
+
+static constexpr float FRAME_WIDTH{ 1920 };
+static constexpr float FRAME_HEIGHT{ 1080 };
+static constexpr float PEAK_TOLERANCE{ 0.1f };
+static constexpr float EDGE_MARGIN{ 0.05f };
+
+struct BestShotFrame
+{
+	BestShotBox box;
+	bool armed;
+	bool closing;
+};
+
+/**
+ * Frames of one track and the frame its crop must be scheduled on, -1 for none.
+ * */
+struct BestShotScenario
+{
+	std::string name;
+	std::vector<BestShotFrame> frames;
+	int expected;
+};
+
+/**
+ * Box of @p scale times 200x100 centered in the frame, far from the edges.
+ * */
+static BestShotBox centered_box(float scale, float confidence = 0.9f)
+{
+	const float width{ 200 * scale }, height{ 100 * scale };
+	return { (FRAME_WIDTH - width) / 2, (FRAME_HEIGHT - height) / 2, width, height, confidence };
+}
+
+static BestShotFrame armed(const BestShotBox &box, bool closing = false)
+{
+	return { box, true, closing };
+}
+
+static std::vector<BestShotScenario> scenarios()
+{
+	std::vector<BestShotScenario> list;
+
+	{
+		// Approaching vehicle, the crop waits for the window to close
+		BestShotScenario &rise = list.emplace_back(BestShotScenario{ "monotone rise", {}, 19 });
+		for(int i = 0; i < 20; i++)
+			rise.frames.push_back(armed(centered_box(1 + 0.1f * i), i == 19));
+		// Past the window the track is never scheduled again
+		rise.frames.push_back({ centered_box(1), false, false });
+		rise.frames.push_back({ centered_box(1), true, true });
+
+		BestShotScenario &open = list.emplace_back(BestShotScenario{ "monotone rise, window still open", {}, -1 });
+		for(int i = 0; i < 20; i++)
+			open.frames.push_back(armed(centered_box(1 + 0.1f * i)));
+	}
+
+	{
+		// Area grows up to frame 9, frame 10 is 5% below the peak
+		BestShotScenario &peak = list.emplace_back(BestShotScenario{ "peak then drop within tolerance", {}, 10 });
+		for(int i = 0; i < 10; i++)
+			peak.frames.push_back(armed(centered_box(1 + 0.1f * i)));
+		peak.frames.push_back(armed(centered_box(1.9f, 0.9f * 0.95f)));
+		peak.frames.push_back(armed(centered_box(1.8f)));
+		peak.frames.push_back(armed(centered_box(1.7f), true));
+
+		// A plateau is still rising, the first frame below it is scheduled
+		BestShotScenario &plateau = list.emplace_back(BestShotScenario{ "plateau then drop within tolerance", {}, 8 });
+		for(int i = 0; i < 4; i++)
+			plateau.frames.push_back(armed(centered_box(1 + 0.05f * i)));
+		for(int i = 0; i < 4; i++)
+			plateau.frames.push_back(armed(centered_box(1.3f)));
+		plateau.frames.push_back(armed(centered_box(1.3f, 0.85f)));
+	}
+
+	{
+		// Peak on frame 5, frames 6 and 7 occluded, frame 8 back within the tolerance
+		BestShotScenario &dip = list.emplace_back(BestShotScenario{ "occlusion dip then recovery", {}, 8 });
+		for(int i = 0; i < 6; i++)
+			dip.frames.push_back(armed(centered_box(1 + 0.1f * i)));
+		dip.frames.push_back(armed(centered_box(1.5f, 0.3f)));
+		dip.frames.push_back(armed(centered_box(0.5f, 0.9f)));
+		dip.frames.push_back(armed(centered_box(1.5f, 0.9f * 0.97f)));
+
+		// The object comes back larger than before the occlusion, the peak moves
+		BestShotScenario &higher = list.emplace_back(BestShotScenario{ "occlusion dip then higher peak", {}, 10 });
+		for(int i = 0; i < 6; i++)
+			higher.frames.push_back(armed(centered_box(1 + 0.1f * i)));
+		higher.frames.push_back(armed(centered_box(1.5f, 0.2f)));
+		higher.frames.push_back(armed(centered_box(1.7f)));
+		higher.frames.push_back(armed(centered_box(1.9f)));
+		higher.frames.push_back(armed(centered_box(2.0f)));
+		higher.frames.push_back(armed(centered_box(2.0f, 0.9f * 0.92f)));
+
+		// The object never recovers, the crop is taken when the window closes
+		BestShotScenario &lost = list.emplace_back(BestShotScenario{ "occlusion dip until the window closes", {}, 9 });
+		for(int i = 0; i < 6; i++)
+			lost.frames.push_back(armed(centered_box(1 + 0.1f * i)));
+		for(int i = 6; i < 10; i++)
+			lost.frames.push_back(armed(centered_box(1.5f, 0.2f), i == 9));
+	}
+
+	{
+		// Outside the window the boxes are ignored, the first ones inside would be within the tolerance of them
+		BestShotScenario &early = list.emplace_back(BestShotScenario{ "window closing before the peak", {}, 6 });
+		for(int i = 0; i < 3; i++)
+			early.frames.push_back({ centered_box(1.35f), false, false });
+		for(int i = 3; i < 7; i++)
+			early.frames.push_back(armed(centered_box(1 + 0.1f * i), i == 6));
+		for(int i = 7; i < 12; i++)
+			early.frames.push_back(armed(centered_box(1 + 0.1f * i), i == 11));
+
+		// Window of a single frame
+		BestShotScenario &single = list.emplace_back(BestShotScenario{ "window of one frame", {}, 1 });
+		single.frames.push_back({ centered_box(1), false, false });
+		single.frames.push_back(armed(centered_box(1), true));
+		single.frames.push_back(armed(centered_box(2)));
+	}
+
+	{
+		// No score at all, only the window closing schedules the crop
+		BestShotScenario &empty = list.emplace_back(BestShotScenario{ "zero area and edge boxes", {}, 10 });
+		for(int i = 0; i < 3; i++)
+			empty.frames.push_back(armed({ 100, 100, 0, 50, 0.9f }));
+		for(int i = 3; i < 6; i++)
+			empty.frames.push_back(armed({ 100, 100, 50, -1, 0.9f }));
+		for(int i = 6; i < 10; i++)
+			empty.frames.push_back(armed({ 0, 300, 400.0f + 20 * i, 200, 0.9f }));
+		empty.frames.push_back(armed({ FRAME_WIDTH - 400, 300, 400, 200, 0.9f }, true));
+
+		// Entering from the left edge and leaving on the right one, the score peaks once clear of both
+		BestShotScenario &cross = list.emplace_back(BestShotScenario{ "crossing from edge to edge", {}, -1 });
+		for(float left = -200; left < FRAME_WIDTH; left += 10)
+			cross.frames.push_back(armed({ left, 400, 400, 200, 0.9f }));
+		const BestShotSelector selector(PEAK_TOLERANCE, EDGE_MARGIN);
+		float peak{};
+		for(const BestShotFrame &frame : cross.frames)
+			peak = std::max(peak, selector.score(frame.box, FRAME_WIDTH, FRAME_HEIGHT));
+		// First frame past the plateau, the edge penalty of a 10 pixels step stays within the tolerance
+		for(size_t i = 1; i < cross.frames.size(); i++)
+		{
+			const float current{ selector.score(cross.frames[i].box, FRAME_WIDTH, FRAME_HEIGHT) };
+			const float previous{ selector.score(cross.frames[i - 1].box, FRAME_WIDTH, FRAME_HEIGHT) };
+			if(previous >= peak && current < peak)
+			{
+				cross.expected = static_cast<int>(i);
+				break;
+			}
+		}
+	}
+
+	return list;
+}
+
+/**
+ * @return frame the crop of @p scenario is scheduled on, -1 for none, -2 if scheduled twice.
+ * */
+static int run(const BestShotSelector &selector, const BestShotScenario &scenario)
+{
+	BestShotState state;
+	int scheduled{ -1 };
+
+	for(size_t i = 0; i < scenario.frames.size(); i++)
+	{
+		const BestShotFrame &frame{ scenario.frames[i] };
+		if(selector.update(state, frame.box, FRAME_WIDTH, FRAME_HEIGHT, frame.armed, frame.closing))
+		{
+			if(scheduled >= 0)
+				return -2;
+			scheduled = static_cast<int>(i);
+		}
+	}
+	return scheduled;
+}
+
+/**
+ * Checks the scores of single boxes.
+ *
+ * @return number of failed checks.
+ * */
+static int check_scores(const BestShotSelector &selector)
+{
+	struct ScoreCase
+	{
+		const char *name;
+		BestShotBox box;
+		float expected;
+	};
+	const float centered{ 400 * 200 / (FRAME_WIDTH * FRAME_HEIGHT) };
+	const float margin{ EDGE_MARGIN * FRAME_HEIGHT };
+	const ScoreCase cases[]{
+		{ "zero width", { 100, 100, 0, 100, 1 }, 0 },
+		{ "negative height", { 100, 100, 100, -5, 1 }, 0 },
+		{ "on the left edge", { 0, 400, 400, 200, 1 }, 0 },
+		{ "past the bottom edge", { 700, FRAME_HEIGHT - 100, 400, 200, 1 }, 0 },
+		{ "half the margin from the top", { 700, margin / 2, 400, 200, 1 }, centered / 2 },
+		{ "centered", { 760, 440, 400, 200, 1 }, centered },
+		{ "centered, half confidence", { 760, 440, 400, 200, 0.5f }, centered / 2 },
+		{ "confidence above 1", { 760, 440, 400, 200, 3 }, centered },
+		{ "whole frame", { 0, 0, FRAME_WIDTH, FRAME_HEIGHT, 1 }, 0 },
+	};
+	int failures{};
+
+	for(const ScoreCase &score_case : cases)
+	{
+		const float score{ selector.score(score_case.box, FRAME_WIDTH, FRAME_HEIGHT) };
+		if(std::abs(score - score_case.expected) > 1e-6f)
+		{
+			TADS_ERR_MSG_V("score of %s is %g instead of %g", score_case.name, score, score_case.expected);
+			failures++;
+		}
+	}
+	if(selector.score(centered_box(1), 0, FRAME_HEIGHT) != 0)
+	{
+		TADS_ERR_MSG_V("score in a frame of zero width is not 0");
+		failures++;
+	}
+	return failures;
+}
+
+/**
+ * Random windows of random boxes: the crop is scheduled exactly once per
+ * closed window, on a frame within the tolerance of every score before it
+ * unless the window closed then.
+ *
+ * @return number of failed checks.
+ * */
+static int check_random(const BestShotSelector &selector)
+{
+	std::mt19937 rng(static_cast<uint32_t>(g_seed));
+	std::uniform_real_distribution<float> unit(0, 1);
+	int failures{};
+
+	for(int track = 0; track < g_tracks; track++)
+	{
+		const int length{ 2 + static_cast<int>(unit(rng) * 60) };
+		const bool closes{ unit(rng) < 0.8f };
+		BestShotState state;
+		float best{};
+		int scheduled{ -1 };
+
+		for(int i = 0; i < length; i++)
+		{
+			const BestShotBox box{ unit(rng) * FRAME_WIDTH, unit(rng) * FRAME_HEIGHT, unit(rng) * FRAME_WIDTH / 2,
+														 unit(rng) * FRAME_HEIGHT / 2, unit(rng) };
+			const bool closing{ closes && i == length - 1 };
+			const float current{ selector.score(box, FRAME_WIDTH, FRAME_HEIGHT) };
+
+			if(selector.update(state, box, FRAME_WIDTH, FRAME_HEIGHT, true, closing))
+			{
+				if(scheduled >= 0 || (!closing && (current < best * (1 - PEAK_TOLERANCE) || current >= best)))
+				{
+					if(failures++ < 10)
+						TADS_ERR_MSG_V("track %d scheduled on frame %d with score %g, best %g", track, i, current, best);
+				}
+				scheduled = i;
+			}
+			if(scheduled < 0)
+				best = std::max(best, current);
+		}
+
+		if(closes && scheduled < 0 && failures++ < 10)
+			TADS_ERR_MSG_V("track %d never scheduled although its window closed", track);
+	}
+	return failures;
+}
+
+/**
+ * Drives BestShotSelector with synthetic tracks and checks on which frame
+ * the crop is scheduled: a monotone rise, a peak then a drop within the
+ * tolerance, an occlusion dip then recovery, the window closing before the
+ * peak, and zero area or edge boxes. Random tracks are then checked against
+ * the rules of the selector.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	const BestShotSelector selector(PEAK_TOLERANCE, EDGE_MARGIN);
+
+	ctx = g_option_context_new("- check the frame the best shot of a track is taken on");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_tracks < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	failures += check_scores(selector);
+
+	for(const BestShotScenario &scenario : scenarios())
+	{
+		const int scheduled{ run(selector, scenario) };
+		const bool passed{ scheduled == scenario.expected };
+
+		g_print("%s", fmt::format("{:<40} {} frames, scheduled on {}, expected {}{}\n", scenario.name,
+															scenario.frames.size(), scheduled, scenario.expected, passed ? "" : "  FAILED")
+											.c_str());
+		failures += !passed;
+	}
+
+	failures += check_random(selector);
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	g_print("%s", fmt::format("{} random tracks checked\n", g_tracks).c_str());
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
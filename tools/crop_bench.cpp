@@ -0,0 +1,174 @@
+#include <chrono>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "crop_writer.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_output_path{};
+static int g_rate{ 2000 };
+static int g_seconds{ 10 };
+static int g_crop_kb{ 48 };
+static int g_threads{ 2 };
+static int g_slabs{ 256 };
+static int g_slab_kb{ 512 };
+static int g_policy{ static_cast<int>(WriterOverflowPolicy::DROP_NEWEST) };
+static int g_sync{ static_cast<int>(CropSyncPolicy::NONE) };
+static gboolean g_direct_io{};
+static gboolean g_archive{};
+static int g_archive_mb{ 1024 };
+
+GOptionEntry entries[] = {
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output_path, "Folder of the crops (default /tmp/tads-crop-bench)",
+		nullptr },
+	{ "rate", 'r', 0, G_OPTION_ARG_INT, &g_rate, "Crops submitted per second", nullptr },
+	{ "seconds", 's', 0, G_OPTION_ARG_INT, &g_seconds, "Duration of the run", nullptr },
+	{ "crop-kb", 0, 0, G_OPTION_ARG_INT, &g_crop_kb, "Average crop size in KiB", nullptr },
+	{ "threads", 'j', 0, G_OPTION_ARG_INT, &g_threads, "Writer threads", nullptr },
+	{ "slabs", 0, 0, G_OPTION_ARG_INT, &g_slabs, "Crop slabs, i.e. queue capacity", nullptr },
+	{ "slab-kb", 0, 0, G_OPTION_ARG_INT, &g_slab_kb, "Slab size in KiB", nullptr },
+	{ "policy", 'p', 0, G_OPTION_ARG_INT, &g_policy, "Overflow policy: 0 block, 1 drop oldest, 2 drop newest", nullptr },
+	{ "sync", 0, 0, G_OPTION_ARG_INT, &g_sync, "Sync policy: 0 none, 1 fdatasync every crop", nullptr },
+	{ "direct-io", 0, 0, G_OPTION_ARG_NONE, &g_direct_io, "Write the crops with O_DIRECT", nullptr },
+	{ "archive", 'a', 0, G_OPTION_ARG_NONE, &g_archive, "Append the crops to rolling archives", nullptr },
+	{ "archive-mb", 0, 0, G_OPTION_ARG_INT, &g_archive_mb, "Archive size at which it is rolled, in MiB", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Fills @p payload with a JPEG-shaped crop: SOI marker, noise and EOI marker.
+ * */
+static void make_crop(std::vector<char> &payload, size_t size, std::mt19937 &rng)
+{
+	payload.resize(std::max<size_t>(size, 4));
+	for(size_t i = 0; i < payload.size(); i += sizeof(uint32_t))
+	{
+		const uint32_t value{ rng() };
+		memcpy(&payload[i], &value, std::min(sizeof(value), payload.size() - i));
+	}
+	payload[0] = static_cast<char>(0xFF);
+	payload[1] = static_cast<char>(0xD8);
+	payload[payload.size() - 2] = static_cast<char>(0xFF);
+	payload[payload.size() - 1] = static_cast<char>(0xD9);
+}
+
+/**
+ * Pushes synthetic crops through the crop writer at a fixed rate and
+ * reports the sustained write throughput and the queue depth, without a GPU.
+ * Running it with and without --archive compares the files created per
+ * second, i.e. the filesystem metadata operations, of both modes.
+ * */
+int main(int argc, char *argv[])
+{
+	using Clock = std::chrono::steady_clock;
+
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::string output_path;
+	std::mt19937 rng{ 42 };
+	std::vector<std::vector<char>> crops(64);
+	std::unique_ptr<CropWriter> writer;
+	CropWriterStats previous{}, stats{};
+	Clock::time_point start, next, report_time;
+	uint64_t submitted{};
+	double elapsed_s;
+
+	ctx = g_option_context_new("- benchmark the crop writer with synthetic crops");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_rate < 1 || g_seconds < 1 || g_crop_kb < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	output_path = g_output_path != nullptr ? g_output_path : "/tmp/tads-crop-bench";
+	std::filesystem::create_directories(output_path);
+
+	// Sizes spread around the average like real crops of near and far vehicles
+	for(std::vector<char> &crop : crops)
+	{
+		std::uniform_int_distribution<size_t> size(g_crop_kb * 512, g_crop_kb * 1536);
+		make_crop(crop, size(rng), rng);
+	}
+
+	writer = std::make_unique<CropWriter>(std::max(g_threads, 1), std::max(g_slabs, 1),
+																				static_cast<size_t>(std::max(g_slab_kb, 1)) * 1024,
+																				static_cast<WriterOverflowPolicy>(g_policy),
+																				static_cast<CropSyncPolicy>(g_sync), g_direct_io);
+	if(g_archive)
+	{
+		writer->set_archive(std::make_unique<CropArchiveWriter>(static_cast<uint64_t>(std::max(g_archive_mb, 1)) << 20,
+																														 0));
+	}
+	if(!writer->start())
+		goto done;
+
+	start = Clock::now();
+	next = start;
+	report_time = start + std::chrono::seconds(1);
+
+	for(uint64_t i = 0; i < static_cast<uint64_t>(g_rate) * g_seconds; ++i)
+	{
+		const std::vector<char> &crop = crops[i % crops.size()];
+		const CropInfo info{ i, 0, std::chrono::duration_cast<std::chrono::microseconds>(
+																		 std::chrono::system_clock::now().time_since_epoch())
+																		 .count() };
+		// A bounded set of names keeps the disk usage of long runs flat in the per-file mode
+		writer->submit(fmt::format("{}/crop_{}.jpg", output_path, i % 4096), info, crop.data(), crop.size());
+		submitted++;
+
+		next += std::chrono::nanoseconds(1000000000ll / g_rate);
+		std::this_thread::sleep_until(next);
+
+		if(Clock::now() >= report_time)
+		{
+			stats = writer->stats();
+			g_print("%s", fmt::format("written {}/s {:.1f} MB/s files {}/s dropped {} failed {} queue {} (max {})\n",
+																stats.written - previous.written,
+																(stats.bytes - previous.bytes) / 1048576.0, stats.files - previous.files,
+																stats.dropped - previous.dropped, stats.failed - previous.failed,
+																stats.queue_depth, stats.max_queue_depth)
+											.c_str());
+			previous = stats;
+			report_time += std::chrono::seconds(1);
+		}
+	}
+
+	writer->stop();
+	elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+	stats = writer->stats();
+
+	g_print("%s", fmt::format("Submitted {} crops in {:.3f} s ({:.0f}/s)\n", submitted, elapsed_s, submitted / elapsed_s)
+									.c_str());
+	g_print("%s", fmt::format("Written {} ({:.0f}/s, {:.1f} MB/s) dropped {} failed {} in {} batches, max queue {}\n",
+														stats.written, stats.written / elapsed_s, stats.bytes / 1048576.0 / elapsed_s,
+														stats.dropped, stats.failed, stats.batches, stats.max_queue_depth)
+									.c_str());
+	g_print("%s", fmt::format("Files created {} ({:.1f}/s)\n", stats.files, stats.files / elapsed_s).c_str());
+
+	return_value = 0;
+
+done:
+	writer.reset();
+	g_free(g_output_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
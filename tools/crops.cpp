@@ -0,0 +1,114 @@
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "crop_archive.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_root_path{};
+static gchar *g_archive_path{};
+static gchar *g_extract_path{};
+static gint64 g_track_id{ -1 };
+static int g_source_id{ -1 };
+
+GOptionEntry entries[] = {
+	{ "root", 'r', 0, G_OPTION_ARG_FILENAME, &g_root_path, "Analytics output folder (default ../output)", nullptr },
+	{ "archive", 'a', 0, G_OPTION_ARG_FILENAME, &g_archive_path, "Only this archive instead of the whole folder",
+		nullptr },
+	{ "track", 't', 0, G_OPTION_ARG_INT64, &g_track_id, "Only crops of this track", nullptr },
+	{ "source", 's', 0, G_OPTION_ARG_INT, &g_source_id, "Only crops of this source", nullptr },
+	{ "extract", 'e', 0, G_OPTION_ARG_FILENAME, &g_extract_path,
+		"Write the crops under this folder with their original names instead of listing them", nullptr },
+	{ nullptr },
+};
+
+static bool extract_crop(const std::string &folder, std::string_view name, std::string_view data)
+{
+	// Only the file name of the member, an archive cannot write outside the folder
+	const std::string path{ fmt::format("{}/{}", folder, std::filesystem::path(name).filename().string()) };
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+	if(!file.is_open() || !file.write(data.data(), static_cast<std::streamsize>(data.size())))
+	{
+		TADS_ERR_MSG_V("Could not write '%s'", path.c_str());
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Lists or extracts the crops of the rolling crop archives, found through
+ * their index without scanning the tar members.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::vector<std::string> archives;
+	uint64_t matched{}, failed{};
+
+	ctx = g_option_context_new("- list and extract archived crops");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_archive_path != nullptr)
+		archives.emplace_back(g_archive_path);
+	else
+		archives = list_crop_archives(g_root_path != nullptr ? g_root_path : "../output");
+
+	if(g_extract_path != nullptr)
+		std::filesystem::create_directories(g_extract_path);
+
+	for(const std::string &archive_path : archives)
+	{
+		CropArchiveReader reader;
+		if(!reader.open(archive_path))
+			continue;
+
+		for(size_t i = 0; i < reader.size(); ++i)
+		{
+			const CropIndexEntry &entry = reader.entry(i);
+			if(g_track_id >= 0 && entry.object_id != static_cast<uint64_t>(g_track_id))
+				continue;
+			if(g_source_id >= 0 && entry.source_id != static_cast<uint32_t>(g_source_id))
+				continue;
+
+			matched++;
+			if(g_extract_path != nullptr)
+			{
+				if(!extract_crop(g_extract_path, reader.name(i), reader.data(i)))
+					failed++;
+			}
+			else
+			{
+				g_print("%s", fmt::format("{}  source {}  track {}  {} bytes  {}:{}\n",
+																	format_date_time_str(entry.time_us), entry.source_id, entry.object_id,
+																	entry.size, archive_path, reader.name(i))
+												.c_str());
+			}
+		}
+	}
+
+	if(g_extract_path != nullptr)
+		g_print("%s", fmt::format("Extracted {} crops to '{}'\n", matched - failed, g_extract_path).c_str());
+
+	return_value = failed == 0 ? 0 : -1;
+
+done:
+	g_free(g_root_path);
+	g_free(g_archive_path);
+	g_free(g_extract_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
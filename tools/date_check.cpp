@@ -0,0 +1,303 @@
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "date_directory.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_timezones{};
+static int g_year{ 2024 };
+static int g_iterations{ 200000 };
+
+GOptionEntry entries[] = {
+	{ "timezones", 'z', 0, G_OPTION_ARG_STRING, &g_timezones,
+		"Comma separated TZ values checked in turn (default America/New_York,America/Santiago,Europe/London,UTC)",
+		nullptr },
+	{ "year", 'y', 0, G_OPTION_ARG_INT, &g_year, "Year whose DST transitions are checked", nullptr },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &g_iterations, "Timestamps formatted by the benchmark", nullptr },
+	{ nullptr },
+};
+
+static constexpr int64_t SECOND_US{ 1000000 };
+static constexpr int64_t HOUR_US{ 3600 * SECOND_US };
+static constexpr int64_t DAY_US{ 24 * HOUR_US };
+
+/**
+ * Formats that fit the 64 bytes of the strftime buffer, and one that does not.
+ * */
+static const char *const FORMATS[]{
+	"%d-%m-%YT%H:%M:%S",
+	"%Y-%m-%d %H:%M:%S %Z",
+	"%d%m%Y",
+	"%A %d %B %Y, %H hours %M minutes %S seconds, day %j of the year, week %U",
+};
+
+/**
+ * format_date_time_str as it was before the per second cache.
+ * */
+static std::string reference_format(int64_t time_us, const std::string &format)
+{
+	std::time_t seconds = time_us / SECOND_US;
+	std::tm local_tm{};
+	localtime_r(&seconds, &local_tm);
+
+	std::stringstream ss;
+	ss << std::put_time(&local_tm, format.c_str());
+	ss << fmt::format(".{:06}", time_us % SECOND_US);
+	return ss.str();
+}
+
+static std::tm local_time(int64_t time_us)
+{
+	std::time_t seconds = time_us / SECOND_US;
+	std::tm local_tm{};
+	localtime_r(&seconds, &local_tm);
+	return local_tm;
+}
+
+static bool same_day(const std::tm &a, const std::tm &b)
+{
+	return a.tm_year == b.tm_year && a.tm_yday == b.tm_yday;
+}
+
+/**
+ * ddmmyyyy of the civil day after @p local_tm, counted without mktime.
+ * */
+static std::string next_day_name(const std::tm &local_tm)
+{
+	static constexpr int DAYS[]{ 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+	int year{ local_tm.tm_year + 1900 }, month{ local_tm.tm_mon }, day{ local_tm.tm_mday + 1 };
+	const bool leap{ (year % 4 == 0 && year % 100 != 0) || year % 400 == 0 };
+
+	if(day > DAYS[month] + (month == 1 && leap))
+	{
+		day = 1;
+		if(++month == 12)
+		{
+			month = 0;
+			year++;
+		}
+	}
+	return fmt::format("{:02}{:02}{:04}", day, month + 1, year);
+}
+
+/**
+ * @return wall clock microseconds of the local UTC offset changes during @p year.
+ * */
+static std::vector<int64_t> find_transitions(int year)
+{
+	std::tm start_tm{};
+	start_tm.tm_year = year - 1900;
+	start_tm.tm_mday = 1;
+	start_tm.tm_isdst = -1;
+	const int64_t start{ static_cast<int64_t>(mktime(&start_tm)) * SECOND_US };
+	std::vector<int64_t> transitions;
+
+	long offset{ local_time(start).tm_gmtoff };
+	for(int64_t time = start; time < start + 366 * DAY_US; time += HOUR_US / 4)
+	{
+		const long next_offset{ local_time(time).tm_gmtoff };
+		if(next_offset != offset)
+			transitions.push_back(time);
+		offset = next_offset;
+	}
+	return transitions;
+}
+
+/**
+ * Checks next_midnight_us and day_path every few minutes from 3 days before
+ * to 3 days after @p center, and around each midnight found.
+ *
+ * @return number of failed checks.
+ * */
+static int check_days(int64_t center, uint64_t &checked)
+{
+	int failures{};
+	auto check = [&failures](bool passed, const std::string &what)
+	{
+		if(!passed && failures++ < 10)
+			TADS_ERR_MSG_V("%s", what.c_str());
+	};
+
+	// 7 minutes and 13 seconds apart, every minute of the hour is hit
+	for(int64_t time = center - 3 * DAY_US; time < center + 3 * DAY_US; time += 433 * SECOND_US + 250000)
+	{
+		const std::tm time_tm{ local_time(time) };
+		const int64_t midnight{ DateDirectory::next_midnight_us(time) };
+		const std::tm midnight_tm{ local_time(midnight) };
+		const std::tm before_tm{ local_time(midnight - 1) };
+		const std::string stamp{ reference_format(time, "%Y-%m-%d %H:%M:%S %Z") };
+
+		// The midnight is the first microsecond of the next local day, it may not be 00:00 if the clocks jump then
+		check(midnight > time, fmt::format("next midnight of {} is {} us before it", stamp, time - midnight));
+		check(!same_day(midnight_tm, time_tm) && same_day(before_tm, time_tm),
+					fmt::format("next midnight of {} is {}", stamp, reference_format(midnight, "%Y-%m-%d %H:%M:%S %Z")));
+		check(midnight - time <= 25 * HOUR_US, fmt::format("next midnight of {} is {} h away", stamp,
+																												(midnight - time) / static_cast<double>(HOUR_US)));
+
+		const std::string day{ DateDirectory::day_path("root", time) };
+		check(day == fmt::format("root/{:02}{:02}{:04}", time_tm.tm_mday, time_tm.tm_mon + 1, time_tm.tm_year + 1900),
+					fmt::format("day of {} is {}", stamp, day));
+		check(DateDirectory::day_path("root", midnight - 1) == day,
+					fmt::format("day of {} ends before {}", stamp, reference_format(midnight, "%H:%M:%S")));
+		check(DateDirectory::day_path("root", midnight) == "root/" + next_day_name(time_tm),
+					fmt::format("day after {} is {}", stamp, DateDirectory::day_path("root", midnight)));
+		checked++;
+	}
+	return failures;
+}
+
+/**
+ * Formats runs of timestamps crossing second, day and DST boundaries, in
+ * increasing and decreasing order and alternating formats, against the
+ * formatting without the cache.
+ *
+ * @return number of failed checks.
+ * */
+static int check_format(int64_t center, uint64_t &checked)
+{
+	int failures{};
+	// Steps below, at and above a second, and a few odd ones so the microseconds vary
+	static constexpr int64_t STEPS[]{ 1, 999999, SECOND_US, 33333, 1000001, 40 * 60 * SECOND_US + 7 };
+
+	for(const char *format : FORMATS)
+	{
+		for(int64_t step : STEPS)
+		{
+			for(int64_t direction : { 1, -1 })
+			{
+				const int64_t span{ std::min<int64_t>(step * 2000, 2 * DAY_US) };
+				for(int64_t time = center - direction * span; direction * (center + direction * span - time) > 0;
+						time += direction * step)
+				{
+					// The second format breaks the cache on every other call
+					for(const char *current : { format, FORMATS[(time / step) % 2] })
+					{
+						const std::string expected{ reference_format(time, current) };
+						const std::string actual{ format_date_time_str(time, current) };
+						if(actual != expected && failures++ < 10)
+							TADS_ERR_MSG_V("'%s' at %ld: '%s' instead of '%s'", current, static_cast<long>(time), actual.c_str(),
+														 expected.c_str());
+						checked++;
+					}
+				}
+			}
+		}
+	}
+	return failures;
+}
+
+/**
+ * Time per call of the formatting with and without the cache, on frames
+ * 40 ms apart as the analytics records are.
+ * */
+static void bench_format(int64_t start)
+{
+	using Clock = std::chrono::steady_clock;
+	const std::string format{ FORMATS[0] };
+	size_t length{};
+
+	Clock::time_point begin{ Clock::now() };
+	for(int64_t i = 0; i < g_iterations; i++)
+		length += reference_format(start + i * 40000, format).length();
+	const double reference_ns{ std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / g_iterations };
+
+	begin = Clock::now();
+	for(int64_t i = 0; i < g_iterations; i++)
+		length -= format_date_time_str(start + i * 40000, format).length();
+	const double cached_ns{ std::chrono::duration<double, std::nano>(Clock::now() - begin).count() / g_iterations };
+
+	g_print("%s", fmt::format("format   {:.0f} ns per call with put_time, {:.0f} ns with the cache ({:.1f}x){}\n",
+														reference_ns, cached_ns, reference_ns / cached_ns, length != 0 ? ", LENGTHS DIFFER" : "")
+										.c_str());
+}
+
+/**
+ * Checks the day folders of the analytics output and the formatting of the
+ * record dates under timezones with DST: DateDirectory::next_midnight_us
+ * must return the first microsecond of the next local day and day_path the
+ * day holding the time, around every UTC offset change of the year and
+ * across day boundaries, and format_date_time_str must match the uncached
+ * formatting. The formatting is then timed with and without the cache.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	std::vector<std::string> timezones;
+
+	ctx = g_option_context_new("- check the day folders and dates around DST transitions");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_year < 1971 || g_year > 2037 || g_iterations < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	timezones = split(g_timezones != nullptr ? g_timezones : "America/New_York,America/Santiago,Europe/London,UTC", ',');
+	for(const std::string &timezone : timezones)
+	{
+		uint64_t days_checked{}, formats_checked{};
+		int zone_failures{};
+
+		setenv("TZ", timezone.c_str(), 1);
+		tzset();
+		// The cached date of the previous zone would be returned for the same second
+		format_date_time_str(0, "%%");
+
+		std::vector<int64_t> centers{ find_transitions(g_year) };
+		// Zones without DST are checked around the new year
+		std::tm new_year{};
+		new_year.tm_year = g_year - 1900;
+		new_year.tm_mday = 1;
+		new_year.tm_isdst = -1;
+		centers.push_back(static_cast<int64_t>(mktime(&new_year)) * SECOND_US);
+
+		for(int64_t center : centers)
+		{
+			zone_failures += check_days(center, days_checked);
+			zone_failures += check_format(center, formats_checked);
+		}
+
+		g_print("%s", fmt::format("{:<20} {} offset changes, {} days and {} dates checked, {} failures\n", timezone,
+															centers.size() - 1, days_checked, formats_checked, zone_failures)
+											.c_str());
+		failures += zone_failures;
+
+		bench_format(centers.front());
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_free(g_timezones);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
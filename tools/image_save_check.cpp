@@ -0,0 +1,429 @@
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "image_save_scheduler.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_crops{ 200000 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "crops", 'n', 0, G_OPTION_ARG_INT, &g_crops, "Crops scheduled by the random stream", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the rules and of the stream", nullptr },
+	{ nullptr },
+};
+
+static constexpr int64_t SECOND_US{ 1000000 };
+static constexpr int64_t MINUTE_US{ 60 * SECOND_US };
+/**
+ * Midnight UTC, the checks run with TZ=UTC so the minute of the day is the one of the clock.
+ * */
+static constexpr int64_t MIDNIGHT_US{ 1700006400 * SECOND_US };
+
+using CheckFunction = std::function<void(bool, const std::string &)>;
+
+/**
+ * Writes @p content to a rules file and loads it.
+ * */
+static bool load_rules(const std::string &content, std::vector<ImageSaveRule> &rules)
+{
+	const std::string path{ fmt::format("/tmp/tads-image-save-check-{}.csv", getpid()) };
+	FILE *file{ fopen(path.c_str(), "w") };
+	bool success{ file != nullptr && fwrite(content.data(), 1, content.size(), file) == content.size() };
+
+	if(file != nullptr && fclose(file) != 0)
+		success = false;
+	success = success && load_image_save_rules(path, rules);
+	unlink(path.c_str());
+	return success;
+}
+
+/**
+ * Frames to skip as the rules file documents it, by going through every rule.
+ * */
+static uint reference_skip(const std::vector<ImageSaveRule> &rules, uint minute, int class_id)
+{
+	int class_skip{ -1 }, all_skip{ -1 };
+
+	for(const ImageSaveRule &rule : rules)
+	{
+		const bool covered{ rule.start_minute == rule.end_minute ||
+												(rule.start_minute < rule.end_minute
+														 ? minute >= rule.start_minute && minute < rule.end_minute
+														 : minute >= rule.start_minute || minute < rule.end_minute) };
+		if(!covered)
+			continue;
+		if(rule.class_id == class_id)
+			class_skip = std::max(class_skip, static_cast<int>(rule.frames_to_skip));
+		else if(rule.class_id < 0)
+			all_skip = std::max(all_skip, static_cast<int>(rule.frames_to_skip));
+	}
+	return static_cast<uint>(class_skip >= 0 ? class_skip : std::max(all_skip, 0));
+}
+
+/**
+ * Valid lines are read with their windows wrapped into the day, any
+ * malformed line rejects the file.
+ * */
+static void check_parse(const CheckFunction &check)
+{
+	std::vector<ImageSaveRule> rules;
+
+	check(load_rules("# comment\n\n 07:30 , 09:00 , 4\n22:00,06:00,10,2\n12:00,12:00,1,*\n00:00,24:00,3,0\n", rules) &&
+						rules.size() == 4,
+				fmt::format("parse: {} rules out of 4", rules.size()));
+	if(rules.size() == 4)
+	{
+		check(rules[0].start_minute == 450 && rules[0].end_minute == 540 && rules[0].frames_to_skip == 4 &&
+							rules[0].class_id == -1,
+					"parse: the first rule is wrong");
+		check(rules[1].start_minute == 1320 && rules[1].end_minute == 360 && rules[1].class_id == 2,
+					"parse: the rule wrapping midnight is wrong");
+		check(rules[2].start_minute == 720 && rules[2].end_minute == 720 && rules[2].class_id == -1,
+					"parse: the '*' class is not all classes");
+		check(rules[3].start_minute == 0 && rules[3].end_minute == 0 && rules[3].class_id == 0,
+					"parse: 24:00 is not the end of the day");
+	}
+
+	for(const char *line : { "07:30,09:00", "07:30,09:00,4,1,2", "25:00,09:00,4", "07:60,09:00,4", "07:30,09:00,-1",
+													 "07:30,09:00,4,x", "07:30,09:00,4x", "0730,09:00,4", "07:30;09:00;4" })
+	{
+		rules.clear();
+		check(!load_rules(fmt::format("00:00,01:00,1\n{}\n", line), rules),
+					fmt::format("parse: '{}' is accepted", line));
+	}
+
+	rules.clear();
+	check(!load_image_save_rules("/nonexistent/tads-rules.csv", rules), "parse: a missing file is accepted");
+}
+
+/**
+ * Every minute and class of tables of random rules must match the rules
+ * taken one by one: the largest skip of the overlapping rules, a class rule
+ * before an all-classes rule.
+ * */
+static void check_table(const CheckFunction &check, std::mt19937 &rng)
+{
+	uint64_t lookups{};
+	int failures{};
+
+	check(ImageSaveRuleTable{}.frames_to_skip(0, 0) == 0 && ImageSaveRuleTable{ {} }.empty(),
+				"table: an empty table skips frames");
+
+	for(int table = 0; table < 200; table++)
+	{
+		std::vector<ImageSaveRule> rules(1 + rng() % 6);
+		for(ImageSaveRule &rule : rules)
+		{
+			rule.start_minute = rng() % ImageSaveRuleTable::MINUTES_PER_DAY;
+			// Whole days and single minutes are as likely as any window
+			rule.end_minute = rng() % 4 == 0 ? rule.start_minute : rng() % ImageSaveRuleTable::MINUTES_PER_DAY;
+			rule.frames_to_skip = rng() % 50;
+			rule.class_id = static_cast<int>(rng() % 5) - 1;
+		}
+
+		const ImageSaveRuleTable rule_table{ rules };
+		for(uint minute = 0; minute < ImageSaveRuleTable::MINUTES_PER_DAY; minute++)
+		{
+			for(int class_id = -1; class_id < 6; class_id++, lookups++)
+			{
+				const uint expected{ reference_skip(rules, minute, class_id) };
+				const uint skip{ rule_table.frames_to_skip(minute, class_id) };
+				if(skip != expected && failures++ < 10)
+					check(false, fmt::format("table {}: minute {} class {} skips {} frames instead of {}", table, minute,
+																	 class_id, skip, expected));
+			}
+		}
+		// Minutes past the day wrap around
+		if(rule_table.frames_to_skip(ImageSaveRuleTable::MINUTES_PER_DAY + 5, 0) != reference_skip(rules, 5, 0))
+			check(false, fmt::format("table {}: minute {} does not wrap", table, ImageSaveRuleTable::MINUTES_PER_DAY + 5));
+	}
+	check(failures == 0, fmt::format("table: {} lookups differ", failures));
+
+	g_print("%s", fmt::format("table    200 tables, {} lookups checked\n", lookups).c_str());
+}
+
+/**
+ * Frame skip: after an admitted crop, the next frames up to the skip of the
+ * rule in force are dropped, per source and class.
+ * */
+static void check_frame_skip(const CheckFunction &check)
+{
+	ImageSaveScheduler scheduler{ ImageSaveRuleTable{ { { 0, 0, 5, -1 }, { 0, 0, 2, 1 }, { 600, 660, 20, -1 } } }, 0,
+																1 };
+	const int64_t time_us{ MIDNIGHT_US + 8 * 60 * MINUTE_US };
+
+	for(int64_t frame = 0; frame <= 12; frame++)
+	{
+		const ImageSaveDecision expected{ frame % 6 == 0 ? ImageSaveDecision::ADMIT : ImageSaveDecision::SKIP_RULE };
+		check(scheduler.admit(0, 0, frame, time_us) == expected,
+					fmt::format("skip: frame {} of the all-classes rule", frame));
+	}
+	for(int64_t frame = 0; frame <= 6; frame++)
+	{
+		const ImageSaveDecision expected{ frame % 3 == 0 ? ImageSaveDecision::ADMIT : ImageSaveDecision::SKIP_RULE };
+		check(scheduler.admit(0, 1, frame, time_us) == expected, fmt::format("skip: frame {} of the class rule", frame));
+	}
+
+	// Another source has its own state, and the window 10:00-11:00 skips more
+	check(scheduler.admit(1, 0, 3, time_us) == ImageSaveDecision::ADMIT, "skip: the sources share their state");
+	check(scheduler.admit(1, 0, 10, MIDNIGHT_US + 10 * 60 * MINUTE_US) == ImageSaveDecision::SKIP_RULE,
+				"skip: the 10:00 window is not applied");
+	check(scheduler.admit(1, 0, 24, MIDNIGHT_US + 10 * 60 * MINUTE_US) == ImageSaveDecision::ADMIT,
+				"skip: frame 24 of the 10:00 window is dropped");
+	check(scheduler.admit(1, 0, 30, MIDNIGHT_US + 11 * 60 * MINUTE_US) == ImageSaveDecision::ADMIT,
+				"skip: the 10:00 window is applied at 11:00");
+
+	// Frame numbers going back, e.g. a restarted source, are admitted
+	check(scheduler.admit(0, 0, 1, time_us) == ImageSaveDecision::ADMIT, "skip: a restarted source is dropped");
+	check(scheduler.admit(0, 0, 4, time_us) == ImageSaveDecision::SKIP_RULE,
+				"skip: the frames of a restarted source are not skipped");
+}
+
+/**
+ * Token bucket: a full bucket lets a burst of its capacity pass, then it
+ * refills at its rate; a clock going back only restarts the refill.
+ * */
+static void check_rate(const CheckFunction &check)
+{
+	// 3 crops per 10 s, one token every 3.33 s
+	ImageSaveScheduler scheduler{ ImageSaveRuleTable{}, 3, 10 };
+	const int64_t start_us{ MIDNIGHT_US };
+	int admitted{};
+
+	for(int64_t frame = 0; frame < 5; frame++)
+		admitted += scheduler.admit(0, 0, frame, start_us) == ImageSaveDecision::ADMIT;
+	check(admitted == 3, fmt::format("rate: {} crops of the burst admitted instead of 3", admitted));
+
+	check(scheduler.admit(0, 0, 5, start_us + 3300 * 1000) == ImageSaveDecision::SKIP_RATE,
+				"rate: admitted before a token is refilled");
+	check(scheduler.admit(0, 0, 6, start_us + 3400 * 1000) == ImageSaveDecision::ADMIT,
+				"rate: dropped after a token is refilled");
+	check(scheduler.admit(0, 0, 7, start_us + 3500 * 1000) == ImageSaveDecision::SKIP_RATE,
+				"rate: the refilled token is used twice");
+	check(scheduler.admit(1, 0, 0, start_us + 3500 * 1000) == ImageSaveDecision::ADMIT,
+				"rate: the sources share their bucket");
+	check(scheduler.admit(0, 2, 0, start_us + 3500 * 1000) == ImageSaveDecision::ADMIT,
+				"rate: the classes share their bucket");
+
+	// The bucket holds no more than its capacity after a long pause
+	admitted = 0;
+	for(int64_t frame = 100; frame < 110; frame++)
+		admitted += scheduler.admit(0, 0, frame, start_us + 3600 * SECOND_US) == ImageSaveDecision::ADMIT;
+	check(admitted == 3, fmt::format("rate: {} crops admitted after a pause instead of 3", admitted));
+
+	// Back by an hour: no token is refilled until the clock moves on from there
+	check(scheduler.admit(0, 0, 110, start_us + 10 * SECOND_US) == ImageSaveDecision::SKIP_RATE,
+				"rate: the clock going back refilled the bucket");
+	check(scheduler.admit(0, 0, 111, start_us + 13 * SECOND_US) == ImageSaveDecision::SKIP_RATE,
+				"rate: refilled from the time before the clock went back");
+	check(scheduler.admit(0, 0, 112, start_us + 14 * SECOND_US) == ImageSaveDecision::ADMIT,
+				"rate: the refill did not restart after the clock went back");
+
+	// 0 crops disables the limit
+	ImageSaveScheduler unlimited{ ImageSaveRuleTable{}, 0, 10 };
+	admitted = 0;
+	for(int64_t frame = 0; frame < 1000; frame++)
+		admitted += unlimited.admit(0, 0, frame, start_us) == ImageSaveDecision::ADMIT;
+	check(admitted == 1000, fmt::format("rate: {} crops out of 1000 admitted without a limit", admitted));
+}
+
+struct Crop
+{
+	uint source_id;
+	int class_id;
+	int64_t frame_num;
+	int64_t time_us;
+};
+
+/**
+ * Runs a random stream of crops through two schedulers: both must decide
+ * the same, the admitted crops must follow the rules and stay under the
+ * rate of every bucket, and drain and totals must count every decision.
+ * */
+static void check_stream(const CheckFunction &check, std::mt19937 &rng)
+{
+	static constexpr uint SOURCES{ 4 }, CLASSES{ 4 }, CROPS_PER_INTERVAL{ 4 }, INTERVAL_S{ 2 };
+	std::vector<ImageSaveRule> rules{ { 0, 0, 3, -1 }, { 1380, 60, 12, -1 }, { 600, 720, 8, 2 }, { 0, 0, 0, 3 } };
+	const ImageSaveRuleTable table{ rules };
+	ImageSaveScheduler scheduler{ table, CROPS_PER_INTERVAL, INTERVAL_S };
+	ImageSaveScheduler replayed{ table, CROPS_PER_INTERVAL, INTERVAL_S };
+	std::vector<Crop> crops;
+	std::vector<ImageSaveDecision> decisions;
+	std::vector<std::vector<int64_t>> admitted_times(SOURCES * CLASSES);
+	std::vector<int64_t> last_frames(SOURCES * CLASSES, -1);
+	std::vector<int64_t> frames(SOURCES);
+	ImageSaveSourceStats counted{}, drained{};
+	int64_t time_us{ MIDNIGHT_US + 22 * 60 * MINUTE_US + 30 * MINUTE_US };
+	int rule_failures{}, rate_failures{};
+
+	// A few crops per second per source, from 22:30 over midnight
+	for(int i = 0; i < g_crops; i++)
+	{
+		const uint source_id{ static_cast<uint>(rng() % SOURCES) };
+		const int64_t frame{ frames[source_id] += rng() % 3 };
+		time_us += rng() % 60000;
+		crops.push_back({ source_id, static_cast<int>(rng() % CLASSES), frame, time_us });
+	}
+
+	for(const Crop &crop : crops)
+	{
+		const size_t track{ crop.source_id * CLASSES + crop.class_id };
+		const ImageSaveDecision decision{ scheduler.admit(crop.source_id, crop.class_id, crop.frame_num, crop.time_us) };
+		const uint minute{ static_cast<uint>((crop.time_us - MIDNIGHT_US) / MINUTE_US) % ImageSaveRuleTable::MINUTES_PER_DAY };
+
+		decisions.push_back(decision);
+		if(decision == ImageSaveDecision::ADMIT)
+		{
+			counted.admitted++;
+			if(last_frames[track] >= 0 && crop.frame_num > last_frames[track] &&
+				 crop.frame_num - last_frames[track] <= reference_skip(rules, minute, crop.class_id) && rule_failures++ < 10)
+				check(false, fmt::format("stream: frame {} of source {} class {} admitted {} frames after {}",
+																 crop.frame_num, crop.source_id, crop.class_id,
+																 crop.frame_num - last_frames[track], last_frames[track]));
+			last_frames[track] = crop.frame_num;
+			admitted_times[track].push_back(crop.time_us);
+		}
+		else if(decision == ImageSaveDecision::SKIP_RULE)
+		{
+			counted.skipped_rule++;
+			if((last_frames[track] < 0 ||
+					crop.frame_num - last_frames[track] > reference_skip(rules, minute, crop.class_id)) &&
+				 rule_failures++ < 10)
+				check(false, fmt::format("stream: frame {} of source {} class {} dropped by no rule", crop.frame_num,
+																 crop.source_id, crop.class_id));
+		}
+		else
+		{
+			counted.skipped_rate++;
+		}
+	}
+	check(rule_failures == 0, fmt::format("stream: {} crops do not follow the rules", rule_failures));
+
+	// Over any span, a bucket admits at most its capacity and what it refills
+	for(const std::vector<int64_t> &times : admitted_times)
+	{
+		const double rate{ static_cast<double>(CROPS_PER_INTERVAL) / (INTERVAL_S * SECOND_US) };
+		double lowest{};
+
+		// Crops from i to j are too many if j - rate * t_j - (i - rate * t_i) + 1 > capacity
+		for(size_t last = 0; last < times.size(); last++)
+		{
+			const double slack{ static_cast<double>(last) - rate * static_cast<double>(times[last] - times[0]) };
+			lowest = last == 0 ? slack : std::min(lowest, slack);
+			if(slack - lowest + 1 > CROPS_PER_INTERVAL + 1e-6 && rate_failures++ < 10)
+				check(false, fmt::format("stream: {:.2f} crops over the rate at {} us", slack - lowest + 1 - CROPS_PER_INTERVAL,
+																 times[last]));
+		}
+	}
+	check(rate_failures == 0, fmt::format("stream: {} spans over the rate", rate_failures));
+	check(counted.skipped_rule > 0 && counted.skipped_rate > 0 && counted.admitted > 0,
+				"stream: the stream does not exercise every decision");
+
+	// The same stream gives the same decisions
+	size_t differences{};
+	for(size_t i = 0; i < crops.size(); i++)
+		differences += replayed.admit(crops[i].source_id, crops[i].class_id, crops[i].frame_num, crops[i].time_us) !=
+									 decisions[i];
+	check(differences == 0, fmt::format("stream: {} decisions differ on the same stream", differences));
+
+	for(const ImageSaveSourceStats &source : scheduler.drain())
+	{
+		drained.admitted += source.admitted;
+		drained.skipped_rule += source.skipped_rule;
+		drained.skipped_rate += source.skipped_rate;
+	}
+	const ImageSaveSourceStats totals{ scheduler.totals() };
+	check(drained.admitted == counted.admitted && drained.skipped_rule == counted.skipped_rule &&
+						drained.skipped_rate == counted.skipped_rate,
+				"stream: the drained counters differ from the decisions");
+	check(totals.admitted == counted.admitted && totals.skipped_rule == counted.skipped_rule &&
+						totals.skipped_rate == counted.skipped_rate,
+				"stream: the totals differ from the decisions");
+	for(const ImageSaveSourceStats &source : scheduler.drain())
+		check(source.admitted == 0 && source.skipped_rule == 0 && source.skipped_rate == 0,
+					"stream: the counters are not reset by drain");
+	check(image_save_drop_report(&scheduler).empty(), "stream: drops reported after the drain");
+
+	g_print("%s", fmt::format("stream   {} crops, {} admitted, {} dropped by the rules, {} by the rate\n", crops.size(),
+														counted.admitted, counted.skipped_rule, counted.skipped_rate)
+										.c_str());
+}
+
+/**
+ * Checks the image save scheduler without a pipeline: the rules files are
+ * parsed or rejected, the rule tables match the rules taken one by one, the
+ * frame skip and the token bucket decide as documented, and a random
+ * stream of crops is decided the same every time and counted by drain and
+ * totals.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+
+	ctx = g_option_context_new("- check the frame skip rules and the rate limit of the image saver");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_crops < 1000)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	// The rules are in local time
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	{
+		const CheckFunction check{ [&failures](bool passed, const std::string &what)
+															 {
+																 if(!passed)
+																 {
+																	 TADS_ERR_MSG_V("%s", what.c_str());
+																	 failures++;
+																 }
+															 } };
+		std::mt19937 rng(g_seed);
+		check_parse(check);
+		check_table(check, rng);
+		check_frame_skip(check);
+		check_rate(check);
+		check_stream(check, rng);
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
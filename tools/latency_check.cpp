@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "latency.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_samples{ 1000000 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "samples", 'n', 0, G_OPTION_ARG_INT, &g_samples, "Latencies recorded by the percentile checks", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the latencies", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Highest relative error of a bucket upper bound, one sub-bucket.
+ * */
+static constexpr double MAX_ERROR{ 1.0 / LatencySnapshot::SUB_BUCKETS };
+static constexpr uint64_t LARGEST{ (1ull << 32) - 1 };
+
+/**
+ * Checks that @p value falls into the bucket of bucket_index, i.e. that it
+ * is above the upper bound of the previous bucket and at most the upper
+ * bound of its own, within one sub-bucket.
+ * */
+static bool check_value(uint64_t value, int &failures)
+{
+	const uint index{ LatencySnapshot::bucket_index(value) };
+	const uint64_t upper{ LatencySnapshot::bucket_value(index) };
+	const uint64_t lower{ index == 0 ? 0 : LatencySnapshot::bucket_value(index - 1) + 1 };
+
+	if(index >= LatencySnapshot::NUM_BUCKETS || value < lower || value > upper ||
+		 static_cast<double>(upper - value) > MAX_ERROR * static_cast<double>(value))
+	{
+		if(failures++ < 10)
+			TADS_ERR_MSG_V("%lu is in bucket %u of [%lu, %lu]", value, index, lower, upper);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Every bucket maps back to itself and the buckets are contiguous.
+ * */
+static int check_buckets(uint64_t &checked)
+{
+	int failures{};
+
+	for(uint i = 0; i < LatencySnapshot::NUM_BUCKETS; i++)
+	{
+		const uint64_t upper{ LatencySnapshot::bucket_value(i) };
+		if(LatencySnapshot::bucket_index(upper) != i || (i > 0 && upper <= LatencySnapshot::bucket_value(i - 1)))
+		{
+			if(failures++ < 10)
+				TADS_ERR_MSG_V("Bucket %u ends at %lu, which maps to bucket %u", i, upper,
+											 LatencySnapshot::bucket_index(upper));
+		}
+		checked++;
+	}
+
+	if(LatencySnapshot::bucket_value(LatencySnapshot::NUM_BUCKETS - 1) != LARGEST)
+	{
+		failures++;
+		TADS_ERR_MSG_V("The last bucket ends at %lu", LatencySnapshot::bucket_value(LatencySnapshot::NUM_BUCKETS - 1));
+	}
+
+	// Every value below 2^20, then both sides of every power of two, then random values
+	for(uint64_t value = 0; value < (1u << 20); value++, checked++)
+		check_value(value, failures);
+	for(uint bit = 1; bit < 32; bit++)
+	{
+		for(uint64_t value : { (uint64_t{ 1 } << bit) - 1, uint64_t{ 1 } << bit, (uint64_t{ 1 } << bit) + 1 })
+		{
+			check_value(value, failures);
+			checked++;
+		}
+	}
+	std::mt19937_64 rng(g_seed);
+	for(int i = 0; i < 1000000; i++, checked++)
+		check_value(rng() & LARGEST, failures);
+
+	// Values past the last bucket are counted in it
+	for(uint64_t value : { LARGEST + 1, uint64_t{ 1 } << 40, uint64_t{ UINT64_MAX } })
+	{
+		if(LatencySnapshot::bucket_index(value) != LatencySnapshot::NUM_BUCKETS - 1 && failures++ < 10)
+			TADS_ERR_MSG_V("%lu is in bucket %u", value, LatencySnapshot::bucket_index(value));
+		checked++;
+	}
+	return failures;
+}
+
+/**
+ * @return the nearest-rank @p percentile of @p sorted, as value_at counts it.
+ * */
+static uint64_t exact_percentile(const std::vector<uint64_t> &sorted, double percentile)
+{
+	return sorted[std::max<size_t>(1, static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size()))) - 1];
+}
+
+/**
+ * value_at must be the upper bound of the bucket holding the exact
+ * nearest-rank percentile, at most one sub-bucket above it and never
+ * above the max.
+ * */
+static int check_percentiles(const std::vector<uint64_t> &sorted, const LatencySnapshot &snapshot,
+														 const char *distribution)
+{
+	int failures{};
+
+	for(double percentile : { 0.0, 0.1, 1.0, 10.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.9, 99.99, 100.0 })
+	{
+		const uint64_t exact{ exact_percentile(sorted, percentile) };
+		const uint64_t value{ snapshot.value_at(percentile) };
+		const uint64_t expected{ std::min(LatencySnapshot::bucket_value(LatencySnapshot::bucket_index(exact)),
+																			sorted.back()) };
+
+		if(value != expected || value < exact || static_cast<double>(value - exact) > MAX_ERROR * exact)
+		{
+			if(failures++ < 10)
+				TADS_ERR_MSG_V("%s p%g: %lu instead of %lu, exact %lu", distribution, percentile, value, expected, exact);
+		}
+	}
+
+	if(snapshot.max != sorted.back() || snapshot.total != sorted.size())
+	{
+		failures++;
+		TADS_ERR_MSG_V("%s: max %lu total %lu instead of %lu and %zu", distribution, snapshot.max, snapshot.total,
+									 sorted.back(), sorted.size());
+	}
+	return failures;
+}
+
+/**
+ * Records @p samples into one histogram per writer thread while another
+ * thread drains them, as the pipeline probes and the reporter do, then
+ * merges the drained snapshots.
+ * */
+static LatencySnapshot record_concurrently(const std::vector<uint64_t> &samples, uint writers)
+{
+	std::vector<LatencyHistogram> histograms(writers);
+	std::vector<std::thread> threads;
+	std::atomic<uint> running{ writers };
+	LatencySnapshot drained;
+
+	for(uint w = 0; w < writers; w++)
+	{
+		threads.emplace_back(
+				[w, writers, &samples, &histograms, &running]
+				{
+					for(size_t i = w; i < samples.size(); i += writers)
+						histograms[w].record(samples[i]);
+					running--;
+				});
+	}
+
+	// Drains as often as it can, the counts must be neither lost nor counted twice
+	do
+	{
+		for(LatencyHistogram &histogram : histograms)
+			histogram.drain(drained);
+	} while(running > 0);
+	for(std::thread &thread : threads)
+		thread.join();
+	for(LatencyHistogram &histogram : histograms)
+		histogram.drain(drained);
+
+	return drained;
+}
+
+/**
+ * Checks the latency histograms: bucket_index and bucket_value must round
+ * trip over the whole range with at most one sub-bucket of error, and the
+ * percentiles of value_at must match the exact percentiles of lognormal,
+ * uniform and bimodal latencies recorded by several threads while they
+ * are drained, and of a handful of latencies.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	uint64_t checked{};
+	std::mt19937_64 rng;
+
+	ctx = g_option_context_new("- check the buckets and percentiles of the latency histograms");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_samples < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	failures += check_buckets(checked);
+	g_print("%s", fmt::format("buckets      {} buckets and {} values checked\n", LatencySnapshot::NUM_BUCKETS, checked)
+										.c_str());
+
+	rng.seed(g_seed);
+	for(const char *distribution : { "lognormal", "uniform", "bimodal" })
+	{
+		std::lognormal_distribution<double> lognormal(std::log(8000.0), 0.8);
+		std::uniform_int_distribution<uint64_t> uniform(0, 200000);
+		std::vector<uint64_t> samples(g_samples);
+
+		for(uint64_t &sample : samples)
+		{
+			if(distribution[0] == 'l')
+				sample = std::min<uint64_t>(static_cast<uint64_t>(lognormal(rng)), LARGEST);
+			else if(distribution[0] == 'u')
+				sample = uniform(rng);
+			else
+				sample = rng() % 100 < 97 ? 30 + rng() % 10 : 40000 + rng() % 5000;
+		}
+
+		LatencySnapshot snapshot{ record_concurrently(samples, 4) };
+		uint64_t sum{};
+		for(uint64_t sample : samples)
+			sum += sample;
+		if(snapshot.sum != sum)
+		{
+			failures++;
+			TADS_ERR_MSG_V("%s: sum %lu instead of %lu", distribution, snapshot.sum, sum);
+		}
+
+		// Merging halves is the same as recording everything in one
+		LatencySnapshot merged, half;
+		for(size_t i = 0; i < samples.size(); i++)
+		{
+			LatencySnapshot &target{ i % 2 == 0 ? merged : half };
+			target.counts[LatencySnapshot::bucket_index(samples[i])]++;
+			target.total++;
+			target.max = std::max(target.max, samples[i]);
+			target.sum += samples[i];
+		}
+		merged.merge(half);
+		if(merged.counts != snapshot.counts || merged.total != snapshot.total || merged.max != snapshot.max)
+		{
+			failures++;
+			TADS_ERR_MSG_V("%s: the merged snapshot differs from the recorded one", distribution);
+		}
+
+		std::sort(samples.begin(), samples.end());
+		const int distribution_failures{ check_percentiles(samples, snapshot, distribution) };
+		g_print("%s", fmt::format("{:<12} {} latencies, p50 {} us (exact {}), p99 {} us (exact {}), {} failures\n",
+															distribution, samples.size(), snapshot.value_at(50), exact_percentile(samples, 50),
+															snapshot.value_at(99), exact_percentile(samples, 99), distribution_failures)
+											.c_str());
+		failures += distribution_failures;
+	}
+
+	// Few samples, where the rank of a percentile is rarely a whole number
+	{
+		const std::vector<uint64_t> samples{ 3, 5, 7, 9, 11, 13, 15 };
+		LatencyHistogram histogram;
+		LatencySnapshot snapshot;
+		for(uint64_t sample : samples)
+			histogram.record(sample);
+		histogram.drain(snapshot);
+		failures += check_percentiles(samples, snapshot, "seven");
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
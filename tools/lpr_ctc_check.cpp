@@ -0,0 +1,418 @@
+#include <unistd.h>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <nvdsinfer.h>
+
+#include "common.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+extern "C" bool NvDsInferParseCustomNVPlate(std::vector<NvDsInferLayerInfo> const &output_layers_info,
+																						NvDsInferNetworkInfo const &network_info, float threshold,
+																						std::vector<NvDsInferAttribute> &attributes,
+																						std::string &attribute_label);
+
+static int g_plates{ 100000 };
+static int g_threads{ 4 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "plates", 'n', 0, G_OPTION_ARG_INT, &g_plates, "Random CTC sequences checked and timed", nullptr },
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &g_threads, "Threads calling the parser at once", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the sequences", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Dictionary of the check, lower case and Q/J included so that the parser
+ * has to localize them.
+ * */
+static const char *const DICTIONARY[]{ "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "A", "B",
+																			 "C", "D", "E", "F", "G", "H", "j", "K", "L", "M", "N", "P",
+																			 "q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z", "-" };
+static constexpr int LABELS{ sizeof(DICTIONARY) / sizeof(DICTIONARY[0]) };
+static constexpr float MIN_CONFIDENCE{ 0.5f };
+static constexpr uint NET_WIDTH{ 96 };
+static constexpr size_t MAX_CHARS{ 16 };
+
+/**
+ * Output of the LPR network for one plate.
+ * */
+struct Sequence
+{
+	std::vector<int> labels;
+	std::vector<float> confidences;
+	bool with_confidences{};
+};
+
+/**
+ * What the parser must return for a sequence.
+ * */
+struct Plate
+{
+	std::string label;
+	bool has_attribute{};
+	float confidence{};
+};
+
+static std::string localized(int label)
+{
+	std::string glyph{ DICTIONARY[label] };
+	for(char &c : glyph)
+		c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+	if(glyph == "Q")
+		return "O";
+	if(glyph == "J")
+		return "1";
+	return glyph;
+}
+
+static bool digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/**
+ * Greedy CTC decode and plate fix-ups written out from their description:
+ * repeats collapse, the blank (label LABELS) splits them, out of range
+ * labels are skipped, plates of more than 16 characters are dropped, only
+ * plates of 4 characters or more get an attribute, and the attribute is
+ * kept if every character is at least MIN_CONFIDENCE sure.
+ * */
+static Plate reference_decode(const Sequence &sequence)
+{
+	Plate plate;
+	std::vector<float> confidences;
+	size_t chars{};
+	int prev{ -1 };
+
+	for(size_t i = 0; i < sequence.labels.size(); i++)
+	{
+		const int label{ sequence.labels[i] };
+		if(label < 0 || label > LABELS)
+			continue;
+		if(label != prev && label != LABELS)
+		{
+			plate.label += localized(label);
+			chars++;
+			if(sequence.with_confidences)
+				confidences.push_back(sequence.confidences[i]);
+		}
+		prev = label;
+	}
+
+	if(chars > MAX_CHARS)
+		return {};
+
+	if(confidences.size() <= 3 || plate.label.empty())
+		return plate;
+
+	std::string &text{ plate.label };
+	for(char &c : text)
+		if(!std::isalnum(static_cast<unsigned char>(c)))
+			c = '\0';
+
+	// A digit triplet after the first character means the first one is a letter read as a digit
+	if(text.size() >= 4 && digit(text[1]) && digit(text[2]) && digit(text[3]))
+	{
+		if(text[0] == '0' || text[0] == '6')
+			text[0] = 'O';
+		else if(text[0] == '8')
+			text[0] = 'B';
+		else if(text[0] == '1')
+			text[0] = 'T';
+
+		if(text.size() > 4 && (text[4] == '0' || text[4] == '8'))
+			text[4] = text[4] == '0' ? 'O' : 'B';
+
+		if(text.size() > 5 && (text[5] == '0' || text[5] == '8' || text[5] == '7'))
+			text[5] = text[5] == '0' ? 'O' : text[5] == '8' ? 'B' : 'T';
+	}
+
+	plate.confidence = 1;
+	for(float confidence : confidences)
+	{
+		if(confidence < MIN_CONFIDENCE)
+		{
+			plate.confidence = 0;
+			break;
+		}
+		plate.confidence *= confidence;
+	}
+	plate.has_attribute = plate.confidence > 0;
+	return plate;
+}
+
+/**
+ * Sequences of the network width: runs of the same label, blanks between
+ * them, a few out of range labels, plates that mimic digit misreads and
+ * plates longer than 16 characters.
+ * */
+static Sequence make_sequence(std::mt19937 &rng)
+{
+	Sequence sequence;
+	std::uniform_real_distribution<float> confidence(0.4f, 1.0f);
+	const size_t length{ NET_WIDTH / 4 };
+	const uint kind{ static_cast<uint>(rng() % 10) };
+
+	sequence.with_confidences = rng() % 8 != 0;
+	while(sequence.labels.size() < length)
+	{
+		int label;
+		const uint pick{ static_cast<uint>(rng() % 100) };
+		if(pick < 25)
+			label = LABELS;
+		else if(pick < 27)
+			label = pick == 25 ? -1 : LABELS + 1 + static_cast<int>(rng() % 3);
+		else if(kind < 4)
+			label = static_cast<int>(rng() % 10);
+		else
+			label = static_cast<int>(rng() % LABELS);
+
+		// Long runs of one label collapse, no blanks at all makes plates of more than 16 characters
+		const size_t run{ kind == 9 ? 1 : 1 + rng() % 3 };
+		for(size_t r = 0; r < run && sequence.labels.size() < length; r++)
+		{
+			sequence.labels.push_back(kind == 9 && label == LABELS ? static_cast<int>(rng() % 10) : label);
+			sequence.confidences.push_back(confidence(rng));
+		}
+	}
+	return sequence;
+}
+
+static Plate parse(const Sequence &sequence)
+{
+	std::vector<NvDsInferLayerInfo> layers(2);
+	NvDsInferNetworkInfo network_info{};
+	std::vector<NvDsInferAttribute> attributes;
+	std::string label;
+	Plate plate;
+
+	network_info.width = NET_WIDTH;
+	layers[0] = {};
+	layers[0].dataType = NvDsInferDataType::INT32;
+	layers[0].buffer = const_cast<int *>(sequence.labels.data());
+	layers[1] = {};
+	layers[1].dataType = NvDsInferDataType::FLOAT;
+	layers[1].buffer = const_cast<float *>(sequence.confidences.data());
+	if(!sequence.with_confidences)
+		layers.pop_back();
+
+	if(!NvDsInferParseCustomNVPlate(layers, network_info, 0, attributes, label))
+		return { "PARSER FAILED" };
+
+	plate.label = label;
+	plate.has_attribute = !attributes.empty();
+	if(plate.has_attribute)
+	{
+		plate.confidence = attributes[0].attributeConfidence;
+		// The attribute holds the label up to the first character the fix-ups removed
+		if(strcmp(attributes[0].attributeLabel, label.c_str()) != 0 || attributes.size() != 1)
+			plate.label = "ATTRIBUTE LABEL " + std::string(attributes[0].attributeLabel);
+		for(NvDsInferAttribute &attribute : attributes)
+			free(attribute.attributeLabel);
+	}
+	return plate;
+}
+
+static std::string printable(const std::string &label)
+{
+	std::string text{ label };
+	for(char &c : text)
+		if(c == '\0')
+			c = '_';
+	return text;
+}
+
+static bool same_plate(const Plate &parsed, const Plate &expected, size_t index)
+{
+	if(parsed.label == expected.label && parsed.has_attribute == expected.has_attribute &&
+		 (!expected.has_attribute || parsed.confidence == expected.confidence))
+		return true;
+
+	TADS_ERR_MSG_V("Plate %zu: '%s' (attribute %d, %.6f) instead of '%s' (attribute %d, %.6f)", index,
+								 printable(parsed.label).c_str(), parsed.has_attribute, parsed.confidence,
+								 printable(expected.label).c_str(), expected.has_attribute, expected.confidence);
+	return false;
+}
+
+/**
+ * Sequences whose plate is known, one per rule of the decode.
+ * */
+static std::vector<std::pair<Sequence, Plate>> fixed_cases()
+{
+	const int B{ LABELS };
+	auto sequence = [](std::vector<int> labels, float last = 0.9f)
+	{
+		Sequence s{ std::move(labels), {}, true };
+		s.confidences.assign(s.labels.size(), 0.9f);
+		if(!s.labels.empty())
+			s.confidences.back() = last;
+		// The parser always reads the width of the network
+		s.labels.resize(NET_WIDTH / 4, LABELS);
+		s.confidences.resize(NET_WIDTH / 4, 0.9f);
+		return s;
+	};
+	// Confidence of n sure characters, multiplied in the order of the parser
+	auto sure = [](int n)
+	{
+		float confidence{ 1 };
+		for(int i = 0; i < n; i++)
+			confidence *= 0.9f;
+		return confidence;
+	};
+
+	return {
+		// Nothing, only blanks
+		{ sequence({}), {} },
+		{ sequence({ B, B, B }), {} },
+		// Repeats collapse, a blank splits them
+		{ sequence({ 11, 11, 1, 1, B, 1, 2, 3 }), { "B1123", true, sure(5) } },
+		// Q and J are read as O and 1, lower case is raised
+		{ sequence({ 24, 18, 12, 13 }), { "O1CD", true, sure(4) } },
+		// Out of range labels are skipped and do not split repeats
+		{ sequence({ 10, -1, 10, 99, 11, 12, 13 }), { "ABCD", true, sure(4) } },
+		// 3 characters are too short for an attribute and keep their digits
+		{ sequence({ 0, 1, 2 }), { "012", false } },
+		// The fix-ups of digit misreads
+		{ sequence({ 0, 1, 2, 3, 0, 8 }), { "O123OB", true, sure(6) } },
+		{ sequence({ 8, 1, 2, 3, 8, 7 }), { "B123BT", true, sure(6) } },
+		{ sequence({ 1, 2, 3, 4, 10, 7 }), { "T234AT", true, sure(6) } },
+		{ sequence({ 6, 10, 2, 3 }), { "6A23", true, sure(4) } },
+		// Characters that are not alphanumeric end the attribute label
+		{ sequence({ 10, 34, 11, 12, 13 }), { std::string("A\0BCD", 5), true, sure(5) } },
+		// One unsure character drops the attribute, not the label
+		{ sequence({ 10, 11, 12, 13 }, 0.3f), { "ABCD", false } },
+		// 16 characters are a plate, 17 are not
+		{ sequence({ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 }), { "O101O10101010101", true, sure(16) } },
+		{ sequence({ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0 }), {} },
+	};
+}
+
+/**
+ * Checks the CTC decode of the LPR parser, NvDsInferParseCustomNVPlate,
+ * against a reference written from its rules: first on plates whose label
+ * is known, then on random sequences decoded by several threads at once,
+ * the first calls of which race to load the dictionary. The parser is
+ * then timed.
+ * */
+int main(int argc, char *argv[])
+{
+	using Clock = std::chrono::steady_clock;
+
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::mt19937 rng;
+	std::vector<Sequence> sequences;
+	std::vector<Plate> expected;
+	std::vector<std::thread> threads;
+	std::atomic<int> failures{};
+	std::string dict_path;
+	std::ofstream dict_file;
+	uint64_t attributes{}, dropped{};
+	size_t fixed{};
+	double parser_ns{};
+
+	ctx = g_option_context_new("- check the CTC decode of the LPR parser");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_plates < 1 || g_threads < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	// The parser reads them once, on its first call
+	dict_path = fmt::format("/tmp/tads-lpr-check-{}.txt", getpid());
+	dict_file.open(dict_path);
+	for(const char *glyph : DICTIONARY)
+		dict_file << glyph << '\n';
+	dict_file.close();
+	setenv("TADS_DICT_PATH", dict_path.c_str(), 1);
+	setenv("TADS_LPR_MIN_CONF", std::to_string(MIN_CONFIDENCE).c_str(), 1);
+
+	rng.seed(g_seed);
+	sequences.resize(g_plates);
+	expected.resize(g_plates);
+	for(int i = 0; i < g_plates; i++)
+	{
+		sequences[i] = make_sequence(rng);
+		expected[i] = reference_decode(sequences[i]);
+		attributes += expected[i].has_attribute;
+		dropped += expected[i].label.empty();
+	}
+
+	// Each thread decodes every sequence, starting at a different one
+	for(int t = 0; t < g_threads; t++)
+	{
+		threads.emplace_back(
+				[t, &sequences, &expected, &failures]
+				{
+					for(size_t n = 0; n < sequences.size() && failures < 10; n++)
+					{
+						const size_t i{ (n + t * sequences.size() / g_threads) % sequences.size() };
+						if(!same_plate(parse(sequences[i]), expected[i], i))
+							failures++;
+					}
+				});
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+
+	for(const auto &[sequence, plate] : fixed_cases())
+	{
+		if(!same_plate(parse(sequence), plate, fixed++))
+			failures++;
+		// The reference must agree with the plates written by hand
+		if(!same_plate(reference_decode(sequence), plate, fixed - 1))
+			failures++;
+	}
+
+	for(const Sequence &sequence : sequences)
+	{
+		const Clock::time_point start{ Clock::now() };
+		parse(sequence);
+		parser_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	}
+
+	g_print("%s", fmt::format("{} sequences of {} labels on {} threads and {} fixed plates, {} with an attribute, "
+														"{} empty or dropped\nparser {:.0f} ns per plate\n",
+														g_plates, NET_WIDTH / 4, g_threads, fixed, attributes, dropped,
+														parser_ns / g_plates)
+										.c_str());
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d plates differ from the reference", failures.load());
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	if(!dict_path.empty())
+		unlink(dict_path.c_str());
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,226 @@
+#include <deque>
+
+#include <glib-unix.h>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "perf.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_address{};
+static int g_sources{ 4 };
+static int g_fps{ 30 };
+static int g_sink_delay_ms{};
+static int g_queue_size{ 8 };
+
+GOptionEntry entries[] = {
+	{ "address", 'a', 0, G_OPTION_ARG_STRING, &g_address,
+		"host:port or unix:path of the metrics endpoint (default 127.0.0.1:9464)", nullptr },
+	{ "sources", 'n', 0, G_OPTION_ARG_INT, &g_sources, "Test sources", nullptr },
+	{ "fps", 'f', 0, G_OPTION_ARG_INT, &g_fps, "Frame rate of the sources", nullptr },
+	{ "sink-delay-ms", 'd', 0, G_OPTION_ARG_INT, &g_sink_delay_ms,
+		"Time spent on every frame before the sink, above 1000/fps the queues fill and drop", nullptr },
+	{ "queue-size", 'q', 0, G_OPTION_ARG_INT, &g_queue_size, "Frames held by the leaky queue of each source", nullptr },
+	{ nullptr },
+};
+
+static GMainLoop *g_loop{};
+
+/**
+ * State of one source, the probes only touch atomics.
+ * */
+struct DemoSource
+{
+	uint index;
+	std::atomic<uint64_t> *dropped;
+	std::atomic<uint64_t> queued{};
+	std::atomic<uint64_t> done{};
+	InstancePerfStruct *perf;
+	LatencyTracker *tracker;
+	LatencyTracker::Stage *queue_stage;
+	LatencyTracker::Stage *sink_stage;
+};
+
+// videotestsrc numbers its frames in the buffer offset, frames leaked by the queue leave a gap
+static GstPadProbeReturn queue_probe(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	auto *source = reinterpret_cast<DemoSource *>(data);
+	source->tracker->stamp(source->queue_stage, source->index, GST_BUFFER_OFFSET(GST_BUFFER(info->data)),
+												 LatencyTracker::now_ns());
+	source->queued.fetch_add(1, std::memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn sink_probe(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	auto *source = reinterpret_cast<DemoSource *>(data);
+	source->tracker->stamp(source->sink_stage, source->index, GST_BUFFER_OFFSET(GST_BUFFER(info->data)),
+												 LatencyTracker::now_ns());
+	source->done.fetch_add(1, std::memory_order_relaxed);
+	perf_count_frame(*source->perf, perf_now_ns());
+	return GST_PAD_PROBE_OK;
+}
+
+/**
+ * The queue is full and leaks its oldest frame.
+ * */
+static void queue_overrun(GstElement *, void *data)
+{
+	reinterpret_cast<DemoSource *>(data)->dropped->fetch_add(1, std::memory_order_relaxed);
+}
+
+static gboolean handle_interrupt(void *)
+{
+	g_main_loop_quit(g_loop);
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * Runs test sources through stock GStreamer elements and serves their
+ * metrics like the application does, so the endpoint can be tried with
+ * curl on a machine without a GPU:
+ *
+ *   tads-metrics-demo --sink-delay-ms 50 &
+ *   curl -s http://127.0.0.1:9464/metrics
+ *
+ * Each source is videotestsrc ! leaky queue ! identity ! fakesink. A sink
+ * delay above the frame period makes the queues fill and drop frames.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	GstElement *pipeline{};
+	std::string description;
+	MetricsRegistry registry;
+	std::unique_ptr<MetricsServer> server;
+	std::unique_ptr<LatencyTracker> tracker;
+	AppPerfStructInt perf_struct{};
+	std::deque<DemoSource> sources;
+	LatencyTracker::Stage *queue_stage, *sink_stage;
+
+	ctx = g_option_context_new("- serve the metrics of a test pipeline");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+	g_option_context_add_group(ctx, gst_init_get_option_group());
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_sources < 1 || g_fps < 1 || g_sink_delay_ms < 0 || g_queue_size < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	for(int i = 0; i < g_sources; ++i)
+	{
+		description += fmt::format(
+				"videotestsrc is-live=true pattern=ball ! video/x-raw,width=320,height=240,framerate={}/1 ! "
+				"queue name=queue{} max-size-buffers={} max-size-bytes=0 max-size-time=0 leaky=downstream ! "
+				"identity sleep-time={} ! fakesink name=sink{} sync=false ",
+				g_fps, i, g_queue_size, g_sink_delay_ms * 1000, i);
+	}
+
+	pipeline = gst_parse_launch(description.c_str(), &error);
+	if(!pipeline)
+	{
+		TADS_ERR_MSG_V("Could not create the test pipeline: %s", error ? error->message : "unknown error");
+		g_clear_error(&error);
+		goto done;
+	}
+
+	g_mutex_init(&perf_struct.struct_lock);
+	perf_struct.num_instances = g_sources;
+	perf_struct.dewarper_surfaces_per_frame = 1;
+	perf_struct.instance_str = std::vector<InstancePerfStruct>(g_sources);
+	perf_struct.instance_snapshot = std::vector<InstancePerfSnapshot>(g_sources);
+
+	tracker = std::make_unique<LatencyTracker>(g_sources);
+	queue_stage = tracker->add_stage("queue", true);
+	sink_stage = tracker->add_stage("sink");
+
+	for(int i = 0; i < g_sources; ++i)
+	{
+		DemoSource &source = sources.emplace_back();
+		source.index = i;
+		source.dropped = registry.counter("tads_queue_dropped_total", "Frames leaked by a full queue",
+																			 metrics_label("queue", fmt::format("queue{}", i)));
+		source.perf = &perf_struct.instance_str[i];
+		source.tracker = tracker.get();
+		source.queue_stage = queue_stage;
+		source.sink_stage = sink_stage;
+
+		GstElement *queue{ gst_bin_get_by_name(GST_BIN(pipeline), fmt::format("queue{}", i).c_str()) };
+		GstElement *sink{ gst_bin_get_by_name(GST_BIN(pipeline), fmt::format("sink{}", i).c_str()) };
+		GstPad *queue_pad{ gst_element_get_static_pad(queue, "sink") };
+		GstPad *sink_pad{ gst_element_get_static_pad(sink, "sink") };
+
+		gst_pad_add_probe(queue_pad, GST_PAD_PROBE_TYPE_BUFFER, queue_probe, &source, nullptr);
+		gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, sink_probe, &source, nullptr);
+		g_signal_connect(queue, "overrun", G_CALLBACK(queue_overrun), &source);
+
+		gst_object_unref(queue_pad);
+		gst_object_unref(sink_pad);
+		gst_object_unref(queue);
+		gst_object_unref(sink);
+	}
+
+	add_perf_metrics(&registry, &perf_struct);
+	add_latency_metrics(&registry, tracker.get());
+	registry.add_collector(
+			[&sources](MetricsWriter &writer)
+			{
+				writer.family("tads_queue_depth", "gauge", "Frames waiting in the queue");
+				for(const DemoSource &source : sources)
+				{
+					// Frames that entered and neither left nor were leaked are still queued
+					const uint64_t done{ source.done.load(std::memory_order_relaxed) +
+															 source.dropped->load(std::memory_order_relaxed) };
+					const uint64_t queued{ source.queued.load(std::memory_order_relaxed) };
+					writer.sample("tads_queue_depth", queued > done ? static_cast<double>(queued - done) : 0,
+												metrics_label("queue", fmt::format("queue{}", source.index)));
+				}
+			});
+
+	server = std::make_unique<MetricsServer>(g_address != nullptr ? g_address : "127.0.0.1:9464", &registry);
+	if(!server->start())
+		goto done;
+
+	g_loop = g_main_loop_new(nullptr, false);
+	g_unix_signal_add(SIGINT, handle_interrupt, nullptr);
+
+	if(gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		TADS_ERR_MSG_V("Could not start the test pipeline");
+		goto done;
+	}
+
+	g_main_loop_run(g_loop);
+	return_value = 0;
+
+done:
+	// The probes and collectors use the sources, the server and the pipeline go first
+	server.reset();
+	if(pipeline)
+	{
+		gst_element_set_state(pipeline, GST_STATE_NULL);
+		gst_object_unref(pipeline);
+	}
+	if(g_loop)
+		g_main_loop_unref(g_loop);
+	g_free(g_address);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
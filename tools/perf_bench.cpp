@@ -0,0 +1,211 @@
+#include <chrono>
+#include <sys/time.h>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "perf.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_producers{ 8 };
+static int g_sources{ 64 };
+static int g_seconds{ 5 };
+static int g_report_ms{ 100 };
+
+GOptionEntry entries[] = {
+	{ "producers", 'j', 0, G_OPTION_ARG_INT, &g_producers, "Threads counting frames", nullptr },
+	{ "sources", 'n', 0, G_OPTION_ARG_INT, &g_sources, "Sources, each producer counts one frame of every source per batch",
+		nullptr },
+	{ "seconds", 's', 0, G_OPTION_ARG_INT, &g_seconds, "Duration of each run", nullptr },
+	{ "report-ms", 'r', 0, G_OPTION_ARG_INT, &g_report_ms, "Interval of the reporter", nullptr },
+	{ nullptr },
+};
+
+/**
+ * The counters as they were before, one lock and one gettimeofday per frame.
+ * */
+struct LockedCounters
+{
+	struct Instance
+	{
+		uint buffer_cnt;
+		uint64_t total_buffer_cnt;
+		timeval start_fps_time;
+		timeval last_fps_time;
+	};
+
+	GMutex lock;
+	std::vector<Instance> instances;
+};
+
+struct RunResult
+{
+	uint64_t frames;
+	double elapsed_s;
+	uint64_t reports;
+	uint64_t max_report_us;
+};
+
+static void count_locked(LockedCounters &counters, uint source_count)
+{
+	g_mutex_lock(&counters.lock);
+	for(uint i{}; i < source_count; i++)
+	{
+		LockedCounters::Instance &instance = counters.instances[i];
+		gettimeofday(&instance.last_fps_time, nullptr);
+		if(instance.start_fps_time.tv_sec == 0 && instance.start_fps_time.tv_usec == 0)
+			instance.start_fps_time = instance.last_fps_time;
+		else
+			instance.buffer_cnt++;
+	}
+	g_mutex_unlock(&counters.lock);
+}
+
+static void report_locked(LockedCounters &counters)
+{
+	g_mutex_lock(&counters.lock);
+	for(LockedCounters::Instance &instance : counters.instances)
+	{
+		instance.total_buffer_cnt += instance.buffer_cnt;
+		instance.buffer_cnt = 0;
+	}
+	g_mutex_unlock(&counters.lock);
+}
+
+/**
+ * Runs the producers and the reporter for @p seconds. @p count is called with
+ * a producer index for each batch, @p report by the reporter at every interval.
+ * */
+template <typename Count, typename Report>
+static RunResult run(Count count, Report report)
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::atomic<bool> running{ true };
+	std::vector<std::thread> producers;
+	std::vector<uint64_t> batches(g_producers);
+	RunResult result{};
+
+	const Clock::time_point start{ Clock::now() };
+	for(int p{}; p < g_producers; p++)
+	{
+		producers.emplace_back(
+				[&, p]
+				{
+					uint64_t batch_cnt{};
+					while(running.load(std::memory_order_relaxed))
+					{
+						count();
+						batch_cnt++;
+					}
+					batches[p] = batch_cnt;
+				});
+	}
+
+	const Clock::time_point end{ start + std::chrono::seconds(g_seconds) };
+	for(Clock::time_point next{ start + std::chrono::milliseconds(g_report_ms) }; next < end;
+			next += std::chrono::milliseconds(g_report_ms))
+	{
+		std::this_thread::sleep_until(next);
+		const Clock::time_point report_start{ Clock::now() };
+		report();
+		const uint64_t report_us(
+				std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - report_start).count());
+		result.max_report_us = std::max(result.max_report_us, report_us);
+		result.reports++;
+	}
+
+	running = false;
+	for(std::thread &producer : producers)
+		producer.join();
+
+	result.elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+	for(uint64_t batch_cnt : batches)
+		result.frames += batch_cnt * g_sources;
+	return result;
+}
+
+static void print_result(const char *name, const RunResult &result)
+{
+	g_print("%s", fmt::format("{:<10} {:>8.1f} M frames/s  {:>7.1f} ns/frame per producer  {} reports, max {} us\n",
+														name, result.frames / result.elapsed_s / 1e6,
+														g_producers * result.elapsed_s * 1e9 / std::max<uint64_t>(result.frames, 1),
+														result.reports, result.max_report_us)
+									.c_str());
+}
+
+/**
+ * Measures the contention of the per-source fps counters: several producer
+ * threads count frames of all the sources while a reporter collects the fps,
+ * once with the lock-free counters and once with a lock and gettimeofday per
+ * frame as before.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	AppPerfStructInt perf_struct{};
+	LockedCounters locked{};
+	RunResult result;
+
+	ctx = g_option_context_new("- benchmark the per-source fps counters");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_producers < 1 || g_sources < 1 || g_seconds < 1 || g_report_ms < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	g_print("%s", fmt::format("{} producers, {} sources, {} s per run\n", g_producers, g_sources, g_seconds).c_str());
+
+	g_mutex_init(&perf_struct.struct_lock);
+	perf_struct.num_instances = g_sources;
+	perf_struct.dewarper_surfaces_per_frame = 1;
+	perf_struct.instance_str = std::vector<InstancePerfStruct>(g_sources);
+	perf_struct.instance_snapshot = std::vector<InstancePerfSnapshot>(g_sources);
+
+	result = run(
+			[&perf_struct]
+			{
+				// Like the probe, one clock read per batch
+				const int64_t now_ns{ perf_now_ns() };
+				for(InstancePerfStruct &instance : perf_struct.instance_str)
+					perf_count_frame(instance, now_ns);
+			},
+			[&perf_struct]
+			{
+				AppPerfStruct report;
+				collect_perf_measurement(&perf_struct, &report);
+			});
+	print_result("lock-free", result);
+
+	g_mutex_init(&locked.lock);
+	locked.instances.resize(g_sources);
+
+	result = run([&locked] { count_locked(locked, g_sources); }, [&locked] { report_locked(locked); });
+	print_result("locked", result);
+
+	return_value = 0;
+
+	g_mutex_clear(&locked.lock);
+	g_mutex_clear(&perf_struct.struct_lock);
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,280 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "plate_consensus.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_tracks{ 1000 };
+static int g_reads{ 40 };
+static double g_error_rate{ 0.1 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "tracks", 'n', 0, G_OPTION_ARG_INT, &g_tracks, "Synthetic tracks", nullptr },
+	{ "reads", 'r', 0, G_OPTION_ARG_INT, &g_reads, "Plate reads per synthetic track", nullptr },
+	{ "error-rate", 'e', 0, G_OPTION_ARG_DOUBLE, &g_error_rate, "Chance of a misread character", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the synthetic reads", nullptr },
+	{ nullptr },
+};
+
+struct RecordedRead
+{
+	const char *text;
+	float confidence;
+};
+
+/**
+ * Plate reads of one track as the LPR reported them, frame after frame.
+ * */
+struct RecordedTrack
+{
+	const char *name;
+	const char *plate;
+	bool settled;
+	std::vector<RecordedRead> reads;
+};
+
+/**
+ * Read sequences recorded on the roadside cameras, the noise is that of the
+ * LPR: confused characters, a dropped or doubled character, and a tracker
+ * id switch between two vehicles.
+ * */
+static const std::vector<RecordedTrack> g_recorded{
+	{ "clean", "E777KX77", true,
+		{ { "E777KX77", 0.91f }, { "E777KX77", 0.88f }, { "E777KX77", 0.93f }, { "E777KX77", 0.9f },
+			{ "E777KX77", 0.87f } } },
+	{ "misread in 6 of 10", "A123BC77", true,
+		{ { "A123BC77", 0.82f }, { "A128BC77", 0.91f }, { "A123BC71", 0.88f }, { "A123EC77", 0.86f },
+			{ "A123BC77", 0.79f }, { "4123BC77", 0.9f }, { "A123BC77", 0.84f }, { "A1Z3BC77", 0.87f },
+			{ "A123BC77", 0.8f }, { "A123B077", 0.93f } } },
+	{ "confusable characters", "M001PT99", true,
+		{ { "M0O1PT99", 0.74f }, { "M001PT99", 0.81f }, { "MO01PT99", 0.77f }, { "M001PT99", 0.85f },
+			{ "M001PT98", 0.86f }, { "M001PT99", 0.83f }, { "M001PT99", 0.8f }, { "M001PT99", 0.82f },
+			{ "M001PT99", 0.79f } } },
+	{ "dropped region digit", "K456MO777", false,
+		{ { "K456MO777", 0.85f }, { "K456MO77", 0.9f }, { "K456MO777", 0.8f }, { "K456M0777", 0.83f },
+			{ "K456MO777", 0.86f }, { "K456MO77", 0.88f }, { "K456MO777", 0.84f }, { "KK456MO777", 0.6f } } },
+	{ "three digit region", "O909AY197", true,
+		{ { "O909AY197", 0.83f }, { "O909AY19", 0.72f }, { "O909AY197", 0.87f }, { "0909AY197", 0.81f },
+			{ "O909AY197", 0.88f }, { "O909AY197", 0.9f }, { "O909AY197", 0.86f }, { "O909AY197", 0.89f },
+			{ "O909AY197", 0.85f }, { "O909AY197", 0.84f }, { "O909AY197", 0.9f }, { "O909AY197", 0.86f } } },
+	{ "too few reads", "C512YX50", false, { { "C512YX50", 0.92f }, { "C512YX50", 0.9f } } },
+	{ "tracker id switch", "T001TT01", false,
+		{ { "H777HH77", 0.9f }, { "H777HH77", 0.92f }, { "H777HH77", 0.88f }, { "H777HH77", 0.91f },
+			{ "H777HH77", 0.89f }, { "T001TT01", 0.86f }, { "T001TT01", 0.9f }, { "T001TT01", 0.87f },
+			{ "T001TT01", 0.88f }, { "T001TT01", 0.85f }, { "T001TT01", 0.89f }, { "T001TT01", 0.9f },
+			{ "T001TT01", 0.86f } } },
+};
+
+/**
+ * What the analytics did before the consensus: the read of the highest
+ * confidence among the first ten.
+ * */
+template<typename Read>
+static std::string best_confidence_read(const std::vector<Read> &reads)
+{
+	const Read *best{};
+
+	for(size_t i = 0; i < reads.size() && i < 10; i++)
+	{
+		if(!best || reads[i].confidence > best->confidence)
+			best = &reads[i];
+	}
+	return best ? std::string(best->text) : std::string();
+}
+
+/**
+ * @return number of recorded tracks whose consensus or settled flag is not the expected one.
+ * */
+static int check_recorded(const PlateConsensus &consensus)
+{
+	int failures{};
+	PlateConsensusState state;
+	PlateRead read;
+
+	for(const RecordedTrack &track : g_recorded)
+	{
+		state.reset();
+		for(const RecordedRead &recorded : track.reads)
+		{
+			if(read.assign(recorded.text, recorded.confidence))
+				consensus.add(state, read);
+		}
+
+		const bool passed{ state.view() == track.plate && state.settled == track.settled };
+		const std::string legacy{ best_confidence_read(track.reads) };
+		failures += !passed;
+
+		g_print("%s", fmt::format("{:<24} {:>2} reads  consensus {:<10} score {:.2f} {:<9} best read {:<10} {}\n",
+															track.name, track.reads.size(), state.view(), state.score,
+															state.settled ? "settled" : "unsettled",
+															legacy + (legacy == track.plate ? "" : " (wrong)"), passed ? "ok" : "FAILED")
+											.c_str());
+	}
+	return failures;
+}
+
+static constexpr std::string_view LETTERS{ "ABEKMHOPCTYX" };
+static constexpr std::string_view DIGITS{ "0123456789" };
+
+/**
+ * Characters the LPR mistakes for each other, one of them or a random character is read instead.
+ * */
+static char misread(char c, std::mt19937 &rng)
+{
+	static constexpr std::string_view PAIRS[]{ "O0", "B8", "A4", "T7", "C0", "H4", "M8", "E3" };
+
+	for(std::string_view pair : PAIRS)
+	{
+		if(pair[0] == c)
+			return pair[1];
+		if(pair[1] == c)
+			return pair[0];
+	}
+	return DIGITS[rng() % DIGITS.size()];
+}
+
+struct SyntheticRead
+{
+	uint32_t track;
+	PlateRead read;
+};
+
+/**
+ * Reads of @p g_tracks tracks interleaved frame by frame, as the analytics sees them.
+ * */
+static std::vector<SyntheticRead> make_reads(std::vector<std::string> &plates)
+{
+	std::mt19937 rng(g_seed);
+	std::uniform_real_distribution<float> confidence(0.5f, 0.95f), chance(0.0f, 1.0f);
+	std::vector<SyntheticRead> reads;
+
+	for(int t = 0; t < g_tracks; t++)
+	{
+		std::string &plate{ plates.emplace_back() };
+		plate += LETTERS[rng() % LETTERS.size()];
+		for(int i = 0; i < 3; i++)
+			plate += DIGITS[rng() % DIGITS.size()];
+		for(int i = 0; i < 2; i++)
+			plate += LETTERS[rng() % LETTERS.size()];
+		for(int i = 0, region = 2 + rng() % 2; i < region; i++)
+			plate += DIGITS[1 + rng() % 9];
+	}
+
+	reads.reserve(static_cast<size_t>(g_tracks) * g_reads);
+	for(int r = 0; r < g_reads; r++)
+	{
+		for(int t = 0; t < g_tracks; t++)
+		{
+			std::string text{ plates[t] };
+			for(char &c : text)
+			{
+				if(chance(rng) < g_error_rate)
+					c = misread(c, rng);
+			}
+			if(chance(rng) < g_error_rate)
+				text.pop_back();
+
+			SyntheticRead &read{ reads.emplace_back() };
+			read.track = t;
+			read.read.assign(text, confidence(rng));
+		}
+	}
+	return reads;
+}
+
+/**
+ * Checks the consensus against the recorded read sequences, then measures
+ * its throughput and accuracy on synthetic noisy reads of many tracks,
+ * against the best confidence read the analytics kept before.
+ * */
+int main(int argc, char *argv[])
+{
+	using Clock = std::chrono::steady_clock;
+
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures;
+	const PlateConsensus consensus;
+	std::vector<std::string> plates;
+	std::vector<SyntheticRead> reads;
+	std::vector<PlateConsensusState> states;
+	std::vector<std::vector<PlateRead>> first_reads;
+	Clock::time_point start;
+	double elapsed_ns;
+	int consensus_correct{}, legacy_correct{}, settled{}, settled_correct{};
+
+	ctx = g_option_context_new("- check and benchmark the plate consensus");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_tracks < 1 || g_reads < 1 || g_error_rate < 0 || g_error_rate > 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	failures = check_recorded(consensus);
+
+	reads = make_reads(plates);
+	states.resize(g_tracks);
+	for(PlateConsensusState &state : states)
+		state.reset();
+
+	start = Clock::now();
+	for(const SyntheticRead &read : reads)
+		consensus.add(states[read.track], read.read);
+	elapsed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	first_reads.resize(g_tracks);
+	for(const SyntheticRead &read : reads)
+	{
+		if(first_reads[read.track].size() < 10)
+			first_reads[read.track].push_back(read.read);
+	}
+	for(int t = 0; t < g_tracks; t++)
+	{
+		consensus_correct += states[t].view() == plates[t];
+		legacy_correct += best_confidence_read(first_reads[t]) == plates[t];
+		settled += states[t].settled;
+		settled_correct += states[t].settled && states[t].view() == plates[t];
+	}
+
+	g_print("%s", fmt::format("{} tracks, {} reads each, {:.0f}% misread characters, {} B per track\n"
+														"{:.1f} ns per read, {:.1f} M reads/s\n"
+														"consensus {:.1f}% correct, best read {:.1f}% correct, "
+														"{:.1f}% settled of which {:.1f}% correct\n",
+														g_tracks, g_reads, g_error_rate * 100, sizeof(PlateConsensusState),
+														elapsed_ns / reads.size(), reads.size() / elapsed_ns * 1e3,
+														100.0 * consensus_correct / g_tracks, 100.0 * legacy_correct / g_tracks,
+														100.0 * settled / g_tracks, settled > 0 ? 100.0 * settled_correct / settled : 0.0)
+										.c_str());
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d recorded tracks do not give the expected plate", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,462 @@
+#include <unistd.h>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <nvds_analytics_meta.h>
+
+#include "analytics.hpp"
+#include "app.hpp"
+#include "event_store.hpp"
+#include "meta_trace.hpp"
+#include "plate_gate.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_trace_file{};
+static int g_tracks{ 2000 };
+static int g_sources{ 4 };
+static double g_noise{ 0.08 };
+static double g_lp_gate_min_score{ 0.8 };
+static int g_lp_gate_reread_interval{ 50 };
+static int g_lp_gate_max_track_age{};
+static double g_max_mismatch{ 1.0 };
+static int g_vehicle_gie_id{ 1 };
+static int g_seed{ 1 };
+
+GOptionEntry entries[] = {
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &g_trace_file,
+		"Metadata trace captured with meta-trace-path, a synthetic trace by default", nullptr },
+	{ "tracks", 'n', 0, G_OPTION_ARG_INT, &g_tracks, "Vehicles of the synthetic trace", nullptr },
+	{ "sources", 0, 0, G_OPTION_ARG_INT, &g_sources, "Sources of the synthetic trace", nullptr },
+	{ "noise", 0, 0, G_OPTION_ARG_DOUBLE, &g_noise, "Share of the plate characters the synthetic LPR misreads",
+		nullptr },
+	{ "lp-gate-min-score", 0, 0, G_OPTION_ARG_DOUBLE, &g_lp_gate_min_score, "Score of a settled plate", nullptr },
+	{ "lp-gate-reread-interval", 0, 0, G_OPTION_ARG_INT, &g_lp_gate_reread_interval,
+		"Batches between two reads of a settled plate, 0 to never read it again", nullptr },
+	{ "lp-gate-max-track-age", 0, 0, G_OPTION_ARG_INT, &g_lp_gate_max_track_age,
+		"Batches after which a track is not read anymore, 0 for no cap", nullptr },
+	{ "max-mismatch", 0, 0, G_OPTION_ARG_DOUBLE, &g_max_mismatch,
+		"Percentage of the records whose gated plate may differ from the ungated one", nullptr },
+	{ "vehicle-gie-id", 0, 0, G_OPTION_ARG_INT, &g_vehicle_gie_id, "Unique id of the primary GIE", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the synthetic trace", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Plate characters of the synthetic tracks, those the LPR model reads.
+ * */
+static constexpr std::string_view PLATE_SYMBOLS{ "ABEKMHOPCTYX0123456789" };
+static constexpr size_t PLATE_LENGTH{ 8 };
+/**
+ * Frames a new synthetic track starts every, on each source.
+ * */
+static constexpr int TRACK_PERIOD{ 8 };
+static constexpr int LPD_GIE_ID{ 2 };
+static constexpr int LPR_GIE_ID{ 3 };
+
+using CheckFunction = std::function<void(bool, const std::string &)>;
+
+/**
+ * Records of a replay keyed by source and track, the value is the plate.
+ * */
+using PlateRecords = std::map<std::pair<uint32_t, uint64_t>, std::string>;
+
+struct SyntheticTrack
+{
+	uint64_t id;
+	uint source_id;
+	int first_frame;
+	int last_frame;
+	int line1_frame;
+	int line2_frame;
+	std::string plate;
+};
+
+static void release_analytics_obj_info(gpointer data, gpointer)
+{
+	auto *user_meta = reinterpret_cast<NvDsUserMeta *>(data);
+	delete reinterpret_cast<NvDsAnalyticsObjInfo *>(user_meta->user_meta_data);
+	user_meta->user_meta_data = nullptr;
+}
+
+static void add_line_crossing(NvDsBatchMeta *batch_meta, NvDsObjectMeta *obj_meta, const char *line)
+{
+	auto *obj_info = new NvDsAnalyticsObjInfo();
+	obj_info->lcStatus.emplace_back(line);
+	obj_info->dirStatus = "DIR:North";
+
+	NvDsUserMeta *user_meta = nvds_acquire_user_meta_from_pool(batch_meta);
+	user_meta->user_meta_data = obj_info;
+	user_meta->base_meta.meta_type = NVDS_USER_OBJ_META_NVDSANALYTICS;
+	user_meta->base_meta.release_func = release_analytics_obj_info;
+	nvds_add_user_meta_to_obj(obj_meta, user_meta);
+}
+
+/**
+ * Adds the plate the LPD found in @p vehicle and the text the LPR read on it.
+ * */
+static void add_plate_read(NvDsBatchMeta *batch_meta, NvDsFrameMeta *frame_meta, NvDsObjectMeta *vehicle,
+													 const std::string &text, float confidence)
+{
+	NvDsObjectMeta *plate = nvds_acquire_obj_meta_from_pool(batch_meta);
+	plate->unique_component_id = LPD_GIE_ID;
+	plate->object_id = UNTRACKED_OBJECT_ID;
+	plate->confidence = confidence;
+	plate->rect_params = { vehicle->rect_params.left + 40, vehicle->rect_params.top + 80, 60, 16 };
+
+	NvDsClassifierMeta *class_meta = nvds_acquire_classifier_meta_from_pool(batch_meta);
+	NvDsLabelInfo *label_info = nvds_acquire_label_info_meta_from_pool(batch_meta);
+	class_meta->unique_component_id = LPR_GIE_ID;
+	label_info->label_id = 0;
+	label_info->result_class_id = 1;
+	label_info->result_prob = confidence;
+	label_info->pResult_label = nullptr;
+	g_strlcpy(label_info->result_label, text.c_str(), sizeof(label_info->result_label));
+	nvds_add_label_info_meta_to_classifier(class_meta, label_info);
+	class_meta->num_labels = 1;
+	nvds_add_classifier_meta_to_object(plate, class_meta);
+
+	nvds_add_obj_meta_to_frame(frame_meta, plate, vehicle);
+}
+
+/**
+ * Writes a trace of @p tracks vehicles crossing both lines, the LPD finds
+ * their plate on most frames and the LPR misreads some characters of it.
+ * */
+static bool write_synthetic_trace(const std::string &path, std::vector<SyntheticTrack> &tracks, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> uniform(0, 1);
+	MetaTraceWriter writer;
+	GstBuffer *buffer;
+	int last_frame{};
+
+	for(int i = 0; i < g_tracks; i++)
+	{
+		SyntheticTrack &track{ tracks.emplace_back() };
+		const int length{ 60 + static_cast<int>(rng() % 140) };
+
+		track.id = static_cast<uint64_t>(i) + 1;
+		track.source_id = static_cast<uint>(i % g_sources);
+		track.first_frame = i / g_sources * TRACK_PERIOD;
+		track.last_frame = track.first_frame + length;
+		track.line1_frame = track.first_frame + length / 2;
+		track.line2_frame = track.first_frame + length * 3 / 4;
+		for(size_t c = 0; c < PLATE_LENGTH; c++)
+			track.plate += PLATE_SYMBOLS[rng() % PLATE_SYMBOLS.size()];
+		last_frame = std::max(last_frame, track.last_frame);
+	}
+
+	if(!writer.open(path))
+		return false;
+
+	buffer = gst_buffer_new();
+	for(int frame = 0; frame <= last_frame; frame++)
+	{
+		NvDsBatchMeta *batch_meta{ nvds_create_batch_meta(g_sources) };
+		std::vector<NvDsFrameMeta *> frames;
+
+		for(int source = 0; source < g_sources; source++)
+		{
+			NvDsFrameMeta *frame_meta{ nvds_acquire_frame_meta_from_pool(batch_meta) };
+			frame_meta->source_id = frame_meta->pad_index = frame_meta->batch_id = static_cast<uint>(source);
+			frame_meta->frame_num = frame;
+			nvds_add_frame_meta_to_batch(batch_meta, frame_meta);
+			frames.push_back(frame_meta);
+		}
+
+		// Tracks are sorted by their first frame
+		for(const SyntheticTrack &track : tracks)
+		{
+			if(track.first_frame > frame)
+				break;
+			if(track.last_frame < frame)
+				continue;
+
+			NvDsFrameMeta *frame_meta{ frames[track.source_id] };
+			NvDsObjectMeta *vehicle{ nvds_acquire_obj_meta_from_pool(batch_meta) };
+			vehicle->unique_component_id = g_vehicle_gie_id;
+			vehicle->object_id = track.id;
+			vehicle->confidence = vehicle->tracker_confidence = 0.9f;
+			vehicle->rect_params = { static_cast<float>(track.id % 16 * 100), static_cast<float>(frame - track.first_frame),
+															 160, 120 };
+			g_strlcpy(vehicle->obj_label, "car", sizeof(vehicle->obj_label));
+			nvds_add_obj_meta_to_frame(frame_meta, vehicle, nullptr);
+
+			if(frame == track.line1_frame)
+				add_line_crossing(batch_meta, vehicle, "Entry");
+			else if(frame == track.line2_frame)
+				add_line_crossing(batch_meta, vehicle, "Exit");
+
+			if(uniform(rng) < 0.3f)
+				continue;
+
+			std::string text{ track.plate };
+			for(char &symbol : text)
+			{
+				if(uniform(rng) < g_noise)
+					symbol = PLATE_SYMBOLS[rng() % PLATE_SYMBOLS.size()];
+			}
+			add_plate_read(batch_meta, frame_meta, vehicle, text, 0.5f + 0.45f * uniform(rng));
+		}
+
+		GST_BUFFER_PTS(buffer) = static_cast<uint64_t>(frame) * 40 * GST_MSECOND;
+		const bool written{ writer.write(buffer, batch_meta) };
+		nvds_destroy_batch_meta(batch_meta);
+		if(!written)
+		{
+			gst_buffer_unref(buffer);
+			return false;
+		}
+	}
+
+	gst_buffer_unref(buffer);
+	writer.close();
+	return true;
+}
+
+/**
+ * Replays @p trace_path through the analytics, behind the plate gate when
+ * @p gated, and reads back the records written to @p output_path.
+ * */
+static bool replay(const std::string &trace_path, const std::string &output_path, bool gated, PlateRecords &records,
+									 PlateGateStats &gate_stats)
+{
+	auto app_ctx = std::make_unique<AppContext>();
+	AnalyticsConfig *config{ &app_ctx->config.analytics_config };
+	AnalyticsBin *analytics{ &app_ctx->pipeline.common_elements.analytics };
+	std::unique_ptr<PlateGate> plate_gate;
+	std::vector<NvDsObjectMeta *> dropped_plates;
+	MetaTraceReader reader;
+	NvDsBatchMeta *batch_meta;
+	GstBuffer *buffer;
+	uint64_t pts, num_objects;
+
+	if(!reader.open(trace_path))
+		return false;
+
+	config->enable = true;
+	config->output_path = output_path;
+	config->lines_distance = 5;
+	config->lp_gate_enable = gated;
+	config->lp_gate_min_score = g_lp_gate_min_score;
+	config->lp_gate_reread_interval = g_lp_gate_reread_interval;
+	config->lp_gate_max_track_age = g_lp_gate_max_track_age;
+	// Block instead of dropping so that every record of the trace is written
+	config->writer_overflow_policy = WriterOverflowPolicy::BLOCK;
+	config->output_format = AnalyticsOutputFormat::SEGMENTS;
+	analytics->plate_consensus = PlateConsensus(config->lp_settle_reads, static_cast<float>(config->lp_settle_score));
+	analytics->output_path = std::make_shared<const std::string>(output_path);
+	plate_gate = create_plate_gate(config, analytics, g_vehicle_gie_id);
+
+	std::filesystem::create_directories(output_path);
+	analytics->writer = std::make_unique<AnalyticsWriter>(config->writer_queue_size, config->writer_overflow_policy,
+																												config->writer_flush_interval_ms);
+	analytics->writer->set_output(config->output_format, output_path);
+	if(!analytics->writer->start())
+		return false;
+
+	buffer = gst_buffer_new();
+	while((batch_meta = reader.next(pts, num_objects)) != nullptr)
+	{
+		GST_BUFFER_PTS(buffer) = pts;
+		if(plate_gate)
+		{
+			plate_gate->gate(batch_meta);
+			drop_gated_plates(batch_meta, dropped_plates);
+			plate_gate->observe(batch_meta);
+		}
+		parse_analytics_metadata(app_ctx.get(), buffer, batch_meta);
+		nvds_destroy_batch_meta(batch_meta);
+	}
+	gst_buffer_unref(buffer);
+	analytics->writer->stop();
+
+	if(reader.is_corrupt())
+	{
+		TADS_ERR_MSG_V("Trace %s is corrupt", trace_path.c_str());
+		return false;
+	}
+
+	if(plate_gate)
+		gate_stats = plate_gate->stats();
+
+	for(const EventSegmentInfo &segment : list_event_segments(output_path))
+	{
+		EventSegmentReader segment_reader;
+		if(!segment_reader.open(segment.base_path))
+			return false;
+		for(size_t i = 0; i < segment_reader.size(); i++)
+		{
+			const TrafficEvent event{ segment_reader.event(i) };
+			records[{ event.source_id, event.object_id }] = event.plate;
+		}
+	}
+	return true;
+}
+
+/**
+ * The gate must not change the records: every vehicle keeps its record,
+ * and its plate is the one read without the gate, while fewer vehicles
+ * go through the secondary GIEs.
+ * */
+static void check_replays(const CheckFunction &check, const std::string &trace_path, const std::string &output_path,
+													const std::vector<SyntheticTrack> &tracks)
+{
+	PlateRecords ungated, gated;
+	PlateGateStats gate_stats{};
+	uint64_t lost{}, extra{}, mismatches{}, with_plate{}, correct{}, correct_gated{};
+
+	if(!replay(trace_path, output_path + "/ungated", false, ungated, gate_stats) ||
+		 !replay(trace_path, output_path + "/gated", true, gated, gate_stats))
+	{
+		check(false, "replay failed");
+		return;
+	}
+
+	for(const auto &[key, plate] : ungated)
+	{
+		auto found = gated.find(key);
+		if(found == gated.end())
+		{
+			lost++;
+			continue;
+		}
+		with_plate += !plate.empty();
+		if(found->second != plate)
+		{
+			if(mismatches++ < 10)
+				TADS_WARN_MSG_V("Track %lu of source %u: plate '%s' gated, '%s' ungated", key.second, key.first,
+												found->second.c_str(), plate.c_str());
+		}
+	}
+	for(const auto &record : gated)
+		extra += ungated.count(record.first) == 0;
+
+	// The synthetic plates are known, records hold them localized
+	for(const SyntheticTrack &track : tracks)
+	{
+		const std::string plate{ to_cyrillic(track.plate) };
+		auto found = ungated.find({ track.source_id, track.id });
+		correct += found != ungated.end() && found->second == plate;
+		found = gated.find({ track.source_id, track.id });
+		correct_gated += found != gated.end() && found->second == plate;
+	}
+
+	const uint64_t vehicles{ gate_stats.processed + gate_stats.skipped_settled + gate_stats.skipped_age };
+	const double mismatch_pct{ ungated.empty() ? 0.0 : 100.0 * mismatches / ungated.size() };
+
+	check(!ungated.empty(), "no record was written, the trace has no vehicle crossing both lines");
+	check(lost == 0 && extra == 0,
+				fmt::format("{} records lost and {} added by the gate out of {}", lost, extra, ungated.size()));
+	check(mismatch_pct <= g_max_mismatch,
+				fmt::format("{} gated plates ({:.2f}%) differ from the ungated ones", mismatches, mismatch_pct));
+	if(!tracks.empty())
+	{
+		check(ungated.size() == tracks.size(), fmt::format("{} records for {} tracks", ungated.size(), tracks.size()));
+		check(gate_stats.skipped_settled > 0, "no vehicle was gated");
+		check(correct_gated + tracks.size() * g_max_mismatch / 100 >= correct,
+					fmt::format("{} plates read right with the gate instead of {}", correct_gated, correct));
+	}
+
+	g_print("%s", fmt::format("records    {} ungated, {} gated, {} with a plate, {} plates differ, {} lost\n",
+														ungated.size(), gated.size(), with_plate, mismatches, lost)
+										.c_str());
+	if(!tracks.empty())
+	{
+		g_print("%s", fmt::format("truth      {} of {} plates right without the gate, {} with it\n", correct,
+															tracks.size(), correct_gated)
+											.c_str());
+	}
+	g_print("%s", fmt::format("gate       {} of {} vehicles to the SGIEs, skipped {} settled {} by age ({:.0f}% saved)\n",
+														gate_stats.processed, vehicles, gate_stats.skipped_settled, gate_stats.skipped_age,
+														vehicles > 0 ? 100.0 * (vehicles - gate_stats.processed) / vehicles : 0.0)
+										.c_str());
+}
+
+/**
+ * Replays a metadata trace through the analytics twice, without and with
+ * the plate gate in front of the secondary GIEs, and compares the records:
+ * the same vehicles must be recorded with the same plates, while the gated
+ * vehicles skip the LPD and LPR. Without --trace a synthetic trace of
+ * vehicles whose plates are misread now and then is written and replayed.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	const std::string output_path{ fmt::format("/tmp/tads-plate-gate-check-{}", getpid()) };
+	std::string trace_path;
+	std::vector<SyntheticTrack> tracks;
+
+	ctx = g_option_context_new("- compare the records replayed with and without the plate gate");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+	g_option_context_add_group(ctx, gst_init_get_option_group());
+
+	GST_DEBUG_CATEGORY_INIT(NVDS_APP, "NVDS_APP", 0, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_tracks < 1 || g_sources < 1 || g_noise < 0 || g_noise > 1 || g_lp_gate_reread_interval < 0 ||
+		 g_lp_gate_max_track_age < 0 || g_max_mismatch < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	std::filesystem::create_directories(output_path);
+	if(g_trace_file != nullptr)
+	{
+		trace_path = g_trace_file;
+	}
+	else
+	{
+		std::mt19937 rng(g_seed);
+		trace_path = output_path + "/synthetic.trace";
+		if(!write_synthetic_trace(trace_path, tracks, rng))
+			goto done;
+	}
+
+	{
+		const CheckFunction check{ [&failures](bool passed, const std::string &what)
+															 {
+																 if(!passed)
+																 {
+																	 TADS_ERR_MSG_V("%s", what.c_str());
+																	 failures++;
+																 }
+															 } };
+		check_replays(check, trace_path, output_path, tracks);
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	std::filesystem::remove_all(output_path);
+	g_free(g_trace_file);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,202 @@
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "event_store.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static constexpr int64_t US_PER_HOUR{ 3600ll * 1000000 };
+
+static gchar *g_root_path{};
+static gchar *g_from{};
+static gchar *g_to{};
+static gchar *g_plate{};
+static gchar *g_export_path{};
+static int g_source_id{ -1 };
+static gboolean g_count{};
+static gboolean g_per_hour{};
+
+GOptionEntry entries[] = {
+	{ "root", 'r', 0, G_OPTION_ARG_FILENAME, &g_root_path, "Analytics output folder (default ../output)", nullptr },
+	{ "from", 'f', 0, G_OPTION_ARG_STRING, &g_from, "Start of the range of append times, 'YYYY-MM-DD[ HH:MM[:SS]]' local time", nullptr },
+	{ "to", 't', 0, G_OPTION_ARG_STRING, &g_to, "End of the range (excluded), same format as --from", nullptr },
+	{ "source", 's', 0, G_OPTION_ARG_INT, &g_source_id, "Only events of this source", nullptr },
+	{ "plate", 'p', 0, G_OPTION_ARG_STRING, &g_plate, "Only events with this license plate", nullptr },
+	{ "count", 'c', 0, G_OPTION_ARG_NONE, &g_count, "Print the number of events instead of the events", nullptr },
+	{ "per-hour", 0, 0, G_OPTION_ARG_NONE, &g_per_hour, "With --count, print the number of events of every hour",
+		nullptr },
+	{ "export", 'e', 0, G_OPTION_ARG_FILENAME, &g_export_path,
+		"Write the events as plain-text analytics files under this folder", nullptr },
+	{ nullptr },
+};
+
+static bool parse_time(const char *text, int64_t &time_us)
+{
+	static const char *FORMATS[]{ "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M",
+																"%Y-%m-%d" };
+
+	for(const char *format : FORMATS)
+	{
+		std::tm local_tm{};
+		const char *end{ strptime(text, format, &local_tm) };
+		if(end != nullptr && *end == '\0')
+		{
+			local_tm.tm_isdst = -1;
+			time_us = static_cast<int64_t>(mktime(&local_tm)) * 1000000;
+			return true;
+		}
+	}
+
+	TADS_ERR_MSG_V("Could not parse time '%s'", text);
+	return false;
+}
+
+static bool export_event(const EventSegmentInfo &segment, const TrafficEvent &event)
+{
+	const std::string day{ std::filesystem::path(segment.base_path).parent_path().filename().string() };
+	const std::filesystem::path folder{ std::filesystem::path(g_export_path) / day };
+	std::error_code ec;
+
+	std::filesystem::create_directories(folder, ec);
+	std::ofstream file(folder / fmt::format("analytics_{}.txt", event.object_id));
+	if(!file.is_open())
+	{
+		TADS_ERR_MSG_V("Could not write to '%s'", folder.c_str());
+		return false;
+	}
+
+	file << event.to_string();
+	return true;
+}
+
+static std::string format_hour(int64_t time_us)
+{
+	const std::time_t seconds = time_us / 1000000;
+	std::tm local_tm{};
+	char text[32];
+
+	localtime_r(&seconds, &local_tm);
+	strftime(text, sizeof(text), "%Y-%m-%d %H:00", &local_tm);
+	return text;
+}
+
+static void print_event(const TrafficEvent &event)
+{
+	g_print("%s", fmt::format("{}\t{}\t{}\t{}\t{}\t{}\t{}\n", format_date_time_str(event.time_us), event.source_id,
+														event.object_id, event.label, event.direction, event.plate.empty() ? "N/A" : event.plate,
+														event.speed_kmh)
+									.c_str());
+}
+
+/**
+ * Answers range, count and plate queries on the analytics event segments.
+ *
+ * The range selects events by the time they were appended to the store,
+ * which orders the segments and their records; the printed time is the
+ * time of the crossing. Segments outside the range are skipped from their
+ * names, segments whose string table lacks the plate are skipped without
+ * reading their records, and the range bounds inside a segment come from
+ * its sparse index.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int64_t from_us{ INT64_MIN }, to_us{ INT64_MAX };
+	uint64_t total{};
+	std::string root_path;
+	std::vector<EventSegmentInfo> segments;
+
+	ctx = g_option_context_new("- query analytics event segments");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	GST_DEBUG_CATEGORY_INIT(NVDS_APP, "NVDS_APP", 0, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if((g_from && !parse_time(g_from, from_us)) || (g_to && !parse_time(g_to, to_us)))
+		goto done;
+
+	root_path = g_root_path != nullptr ? g_root_path : "../output";
+	segments = list_event_segments(root_path);
+
+	for(const EventSegmentInfo &segment : segments)
+	{
+		EventSegmentReader reader;
+		uint32_t plate_id{ EVENT_NO_STRING };
+		uint64_t segment_count{};
+
+		if(segment.start_us >= to_us || segment.start_us + US_PER_HOUR <= from_us)
+			continue;
+
+		if(!reader.open(segment.base_path))
+			continue;
+
+		if(g_plate != nullptr)
+		{
+			plate_id = reader.find_string(g_plate);
+			if(plate_id == EVENT_NO_STRING)
+				continue;
+		}
+
+		const size_t begin{ g_from ? reader.lower_bound(from_us) : 0 };
+		const size_t end{ g_to ? reader.lower_bound(to_us) : reader.size() };
+
+		if(g_count && g_plate == nullptr && g_source_id < 0)
+		{
+			segment_count = end > begin ? end - begin : 0;
+		}
+		else
+		{
+			for(size_t i = begin; i < end; ++i)
+			{
+				const EventRecord &record{ reader.record(i) };
+
+				if(g_source_id >= 0 && record.source_id != static_cast<uint32_t>(g_source_id))
+					continue;
+				if(g_plate != nullptr && record.plate != plate_id)
+					continue;
+
+				segment_count++;
+				if(g_count)
+					continue;
+
+				if(g_export_path != nullptr)
+					export_event(segment, reader.event(i));
+				else
+					print_event(reader.event(i));
+			}
+		}
+
+		if(g_count && g_per_hour && segment_count > 0)
+			g_print("%s\t%lu\n", format_hour(segment.start_us).c_str(), segment_count);
+		total += segment_count;
+	}
+
+	if(g_count && !g_per_hour)
+		g_print("%lu\n", total);
+	else if(g_export_path != nullptr)
+		g_print("Exported %lu events to %s\n", total, g_export_path);
+
+	return_value = 0;
+
+done:
+	g_free(g_root_path);
+	g_free(g_from);
+	g_free(g_to);
+	g_free(g_plate);
+	g_free(g_export_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "analytics.hpp"
+#include "app.hpp"
+#include "latency.hpp"
+#include "meta_trace.hpp"
+#include "plate_gate.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_trace_file{};
+static gchar *g_output_path{};
+static int g_loops{ 1 };
+static double g_lines_distance{ 5 };
+static int g_lp_min_length{ 6 };
+static gchar *g_image_rules{};
+static int g_crops_per_interval{};
+static int g_skip_interval{ 600 };
+static int g_async_queue_size{};
+static gboolean g_lp_gate{};
+static double g_lp_gate_min_score{ 0.8 };
+static int g_lp_gate_reread_interval{ 50 };
+static int g_lp_gate_max_track_age{};
+static int g_vehicle_gie_id{ 1 };
+
+GOptionEntry entries[] = {
+	{ "trace", 't', 0, G_OPTION_ARG_FILENAME, &g_trace_file, "Metadata trace captured with meta-trace-path", nullptr },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output_path, "Analytics output folder (default /tmp/tads-replay)",
+		nullptr },
+	{ "loops", 'n', 0, G_OPTION_ARG_INT, &g_loops, "Number of times the trace is replayed", nullptr },
+	{ "lines-distance", 'd', 0, G_OPTION_ARG_DOUBLE, &g_lines_distance, "Distance between the analytics lines",
+		nullptr },
+	{ "lp-min-length", 0, 0, G_OPTION_ARG_INT, &g_lp_min_length, "Minimum license plate length", nullptr },
+	{ "image-rules", 0, 0, G_OPTION_ARG_FILENAME, &g_image_rules, "Frame skip rules to evaluate on the crops", nullptr },
+	{ "crops-per-interval", 0, 0, G_OPTION_ARG_INT, &g_crops_per_interval,
+		"Crops per source and class allowed in the skip interval", nullptr },
+	{ "skip-interval", 0, 0, G_OPTION_ARG_INT, &g_skip_interval, "Rate limit interval in seconds", nullptr },
+	{ "async", 'a', 0, G_OPTION_ARG_INT, &g_async_queue_size,
+		"Process the batches on the analytics worker thread with a queue of this many batches", nullptr },
+	{ "lp-gate", 0, 0, G_OPTION_ARG_NONE, &g_lp_gate,
+		"Gate the secondary GIEs of the vehicles with a settled plate, their plates are dropped from the trace", nullptr },
+	{ "lp-gate-min-score", 0, 0, G_OPTION_ARG_DOUBLE, &g_lp_gate_min_score, "Score of a settled plate", nullptr },
+	{ "lp-gate-reread-interval", 0, 0, G_OPTION_ARG_INT, &g_lp_gate_reread_interval,
+		"Batches between two reads of a settled plate, 0 to never read it again", nullptr },
+	{ "lp-gate-max-track-age", 0, 0, G_OPTION_ARG_INT, &g_lp_gate_max_track_age,
+		"Batches after which a track is not read anymore, 0 for no cap", nullptr },
+	{ "vehicle-gie-id", 0, 0, G_OPTION_ARG_INT, &g_vehicle_gie_id, "Unique id of the primary GIE", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Replays a metadata trace through parse_analytics_metadata and reports
+ * its throughput and per-batch latency, without decoding or inference.
+ *
+ * With --async the latency is the cost left in the probe, the capture of
+ * the batch, while the tracks are updated on the worker thread.
+ *
+ * With --lp-gate the batches go through the plate gate first, and the
+ * vehicles sent to the secondary GIEs are reported per second of the trace.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	MetaTraceReader reader;
+	LatencyHistogram batch_latency;
+	LatencySnapshot snapshot;
+	GstBuffer *buffer{};
+	NvDsBatchMeta *batch_meta;
+	uint64_t pts{}, num_objects{};
+	uint64_t total_batches{}, total_objects{}, analytics_ns{};
+	uint64_t start_ns;
+	double elapsed_s;
+	uint64_t first_pts{}, last_pts{}, stream_ns{};
+	AnalyticsWriterStats stats{};
+	AnalyticsWorkerStats worker_stats{};
+	std::unique_ptr<PlateGate> plate_gate;
+	std::vector<NvDsObjectMeta *> dropped_plates;
+
+	auto app_ctx = std::make_unique<AppContext>();
+	AnalyticsConfig *config{ &app_ctx->config.analytics_config };
+	AnalyticsBin *analytics{ &app_ctx->pipeline.common_elements.analytics };
+
+	ctx = g_option_context_new("- replay analytics metadata traces");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+	g_option_context_add_group(ctx, gst_init_get_option_group());
+
+	GST_DEBUG_CATEGORY_INIT(NVDS_APP, "NVDS_APP", 0, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_trace_file == nullptr || g_loops < 1 || g_async_queue_size < 0 || g_lp_gate_reread_interval < 0 ||
+		 g_lp_gate_max_track_age < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	if(!reader.open(g_trace_file))
+		goto done;
+
+	config->enable = true;
+	config->output_path = g_output_path != nullptr ? g_output_path : "/tmp/tads-replay";
+	config->lines_distance = g_lines_distance;
+	config->lp_min_length = g_lp_min_length;
+	config->lp_gate_enable = g_lp_gate;
+	config->lp_gate_min_score = g_lp_gate_min_score;
+	config->lp_gate_reread_interval = g_lp_gate_reread_interval;
+	config->lp_gate_max_track_age = g_lp_gate_max_track_age;
+	plate_gate = create_plate_gate(config, analytics, g_vehicle_gie_id);
+	// Block instead of dropping so that every record of the trace is written
+	config->writer_overflow_policy = WriterOverflowPolicy::BLOCK;
+	// Without an encoder context the crops only go through the image save scheduler, nothing is written
+	app_ctx->config.image_save_config.enable = g_image_rules != nullptr || g_crops_per_interval > 0;
+	if(app_ctx->config.image_save_config.enable)
+	{
+		ImageSaveConfig *image_save_config{ &app_ctx->config.image_save_config };
+		image_save_config->frame_to_skip_rules_path = g_image_rules != nullptr ? g_image_rules : "";
+		image_save_config->max_crops_per_interval = std::max(g_crops_per_interval, 0);
+		image_save_config->second_to_skip_interval = std::max(g_skip_interval, 0);
+		analytics->image_scheduler = create_image_save_scheduler(image_save_config);
+		if(!analytics->image_scheduler)
+			goto done;
+	}
+
+	std::filesystem::create_directories(config->output_path);
+
+	analytics->writer = std::make_unique<AnalyticsWriter>(config->writer_queue_size, config->writer_overflow_policy,
+																												config->writer_flush_interval_ms);
+	analytics->writer->set_output(config->output_format, config->output_path);
+	if(!analytics->writer->start())
+		goto done;
+
+	analytics->date_directory = std::make_unique<DateDirectory>(config->output_path);
+	if(!analytics->date_directory->start())
+		goto done;
+
+	if(g_async_queue_size > 0)
+	{
+		// Block instead of dropping so that every batch of the trace is processed
+		create_analytics_worker(analytics, g_async_queue_size, true, config->track_ttl_frames);
+		if(!analytics->worker->start())
+			goto done;
+	}
+
+	// Without a timer the timestamps come from the captured buffer PTS, so every run is identical
+	buffer = gst_buffer_new();
+
+	start_ns = LatencyTracker::now_ns();
+	for(int loop = 0; loop < g_loops; ++loop)
+	{
+		reader.rewind();
+		first_pts = last_pts = 0;
+		while((batch_meta = reader.next(pts, num_objects)) != nullptr)
+		{
+			GST_BUFFER_PTS(buffer) = pts;
+			if(first_pts == 0)
+				first_pts = pts;
+			last_pts = pts;
+
+			if(plate_gate)
+			{
+				plate_gate->gate(batch_meta);
+				drop_gated_plates(batch_meta, dropped_plates);
+				plate_gate->observe(batch_meta);
+			}
+
+			const uint64_t batch_start_ns{ LatencyTracker::now_ns() };
+			parse_analytics_metadata(app_ctx.get(), buffer, batch_meta);
+			const uint64_t batch_ns{ LatencyTracker::now_ns() - batch_start_ns };
+
+			batch_latency.record(batch_ns);
+			analytics_ns += batch_ns;
+			total_batches++;
+			total_objects += num_objects;
+
+			nvds_destroy_batch_meta(batch_meta);
+		}
+
+		if(reader.is_corrupt())
+		{
+			TADS_ERR_MSG_V("Trace %s is corrupt after %lu batches", g_trace_file, total_batches);
+			goto done;
+		}
+		stream_ns += last_pts - first_pts;
+	}
+
+	// The worker still pushes records for the queued batches
+	if(analytics->worker)
+	{
+		analytics->worker->stop();
+		worker_stats = analytics->worker->stats();
+	}
+	analytics->writer->stop();
+	elapsed_s = static_cast<double>(LatencyTracker::now_ns() - start_ns) / 1e9;
+	stats = analytics->writer->stats();
+	batch_latency.drain(snapshot);
+
+	g_print("%s", fmt::format("Replayed {} batches, {} objects in {:.3f} s ({} loops)\n", total_batches,
+														total_objects, elapsed_s, g_loops)
+									.c_str());
+	if(analytics_ns > 0)
+	{
+		const double analytics_s{ static_cast<double>(analytics_ns) / 1e9 };
+		g_print("%s", fmt::format("Analytics: {:.0f} batches/s, {:.0f} objects/s\n", total_batches / analytics_s,
+															total_objects / analytics_s)
+										.c_str());
+	}
+	g_print("%s", fmt::format("Batch latency (us): p50 {:.2f} p90 {:.2f} p99 {:.2f} max {:.2f}\n",
+														snapshot.value_at(50) / 1000.0, snapshot.value_at(90) / 1000.0,
+														snapshot.value_at(99) / 1000.0, snapshot.max / 1000.0)
+									.c_str());
+	if(analytics->worker)
+	{
+		g_print("%s", fmt::format("Worker: processed {} batches, max queue depth {} of {}\n", worker_stats.processed,
+															worker_stats.max_queue_depth, worker_stats.capacity)
+										.c_str());
+	}
+	g_print("%s", fmt::format("Records: written {} skipped {} failed {}\n", stats.written, stats.skipped, stats.failed)
+									.c_str());
+	if(plate_gate)
+	{
+		const PlateGateStats gate_stats{ plate_gate->stats() };
+		const uint64_t vehicles{ gate_stats.processed + gate_stats.skipped_settled + gate_stats.skipped_age };
+		const double stream_s{ static_cast<double>(stream_ns) / 1e9 };
+
+		g_print("%s", fmt::format("Plate gate: {} of {} vehicles to the SGIEs, skipped {} settled {} by age\n",
+															gate_stats.processed, vehicles, gate_stats.skipped_settled, gate_stats.skipped_age)
+										.c_str());
+		if(stream_s > 0)
+		{
+			g_print("%s", fmt::format("SGIE objects: {:.1f}/s of trace time instead of {:.1f}/s ({:.0f}% saved)\n",
+																gate_stats.processed / stream_s, vehicles / stream_s,
+																vehicles > 0 ? 100.0 * (vehicles - gate_stats.processed) / vehicles : 0.0)
+											.c_str());
+		}
+	}
+	if(analytics->image_scheduler)
+	{
+		const std::vector<ImageSaveSourceStats> crops{ analytics->image_scheduler->drain() };
+		for(size_t source_id = 0; source_id < crops.size(); ++source_id)
+		{
+			g_print("%s", fmt::format("Crops of source {}: admitted {} skipped by rule {} by rate {}\n", source_id,
+																crops[source_id].admitted, crops[source_id].skipped_rule,
+																crops[source_id].skipped_rate)
+											.c_str());
+		}
+	}
+
+	return_value = 0;
+
+done:
+	if(buffer)
+		gst_buffer_unref(buffer);
+	if(analytics->worker)
+		analytics->worker->stop();
+	if(analytics->writer)
+		analytics->writer->stop();
+	analytics->date_directory.reset();
+	reader.close();
+	g_free(g_trace_file);
+	g_free(g_output_path);
+	g_free(g_image_rules);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
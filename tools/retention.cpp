@@ -0,0 +1,162 @@
+#include <chrono>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "retention.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_root_path{};
+static int g_events_mb{};
+static int g_events_days{};
+static int g_crops_mb{};
+static int g_crops_days{};
+static int g_budget{ 10000 };
+static int g_populate{};
+static int g_days{ 7 };
+static int g_file_kb{ 64 };
+
+GOptionEntry entries[] = {
+	{ "root", 'r', 0, G_OPTION_ARG_FILENAME, &g_root_path, "Analytics output folder (default ../output)", nullptr },
+	{ "events-mb", 0, 0, G_OPTION_ARG_INT, &g_events_mb, "Quota of the event files in MiB", nullptr },
+	{ "events-days", 0, 0, G_OPTION_ARG_INT, &g_events_days, "Day folders of event files kept", nullptr },
+	{ "crops-mb", 0, 0, G_OPTION_ARG_INT, &g_crops_mb, "Quota of the crops in MiB", nullptr },
+	{ "crops-days", 0, 0, G_OPTION_ARG_INT, &g_crops_days, "Day folders of crops kept", nullptr },
+	{ "budget", 'b', 0, G_OPTION_ARG_INT, &g_budget, "Directory entries scanned per pass", nullptr },
+	{ "populate", 'p', 0, G_OPTION_ARG_INT, &g_populate,
+		"First create this many synthetic files under the root, e.g. on a tmpfs", nullptr },
+	{ "days", 'd', 0, G_OPTION_ARG_INT, &g_days, "Day folders the synthetic files are spread over", nullptr },
+	{ "file-kb", 0, 0, G_OPTION_ARG_INT, &g_file_kb, "Apparent size of the synthetic files in KiB", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Creates @p count sparse files spread over the last @p days day folders,
+ * half events and half crops, with their mtime set within their day.
+ * */
+static bool populate(const std::string &root, uint64_t count, int days, off_t file_size)
+{
+	const int64_t now{ std::chrono::duration_cast<std::chrono::seconds>(
+												 std::chrono::system_clock::now().time_since_epoch())
+												 .count() };
+
+	for(uint64_t i = 0; i < count; ++i)
+	{
+		const int day{ static_cast<int>(i % days) };
+		// Oldest first within a day, spread over the day so the deletion order is exercised
+		const std::time_t mtime = now - day * 86400ll - 3600 - static_cast<int64_t>((count - i) % 72000);
+		std::tm local_tm{};
+		localtime_r(&mtime, &local_tm);
+
+		char folder_name[16];
+		std::strftime(folder_name, sizeof(folder_name), "%d%m%Y", &local_tm);
+		const std::string folder{ fmt::format("{}/{}", root, folder_name) };
+		std::filesystem::create_directories(folder);
+
+		const std::string path{ i % 2 == 0 ? fmt::format("{}/events_{}.bin", folder, i)
+																			 : fmt::format("{}/crops_{}.tar", folder, i) };
+		const int fd{ open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) };
+		if(fd < 0 || ftruncate(fd, file_size) != 0)
+		{
+			TADS_ERR_MSG_V("Could not create '%s': %s", path.c_str(), strerror(errno));
+			if(fd >= 0)
+				close(fd);
+			return false;
+		}
+
+		const timespec times[2]{ { mtime, 0 }, { mtime, 0 } };
+		futimens(fd, times);
+		close(fd);
+	}
+	return true;
+}
+
+/**
+ * Runs the retention passes over an output folder until every day folder
+ * is known and nothing is left to free, reporting each pass. With
+ * --populate it first builds a synthetic tree, so the scan cost of a large
+ * folder can be measured without a pipeline.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::string root_path;
+	std::array<RetentionQuota, RETENTION_KIND_COUNT> quotas{};
+	std::unique_ptr<RetentionManager> manager;
+	uint64_t total_time_us{};
+
+	ctx = g_option_context_new("- enforce the retention quotas of an analytics output folder");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_budget < 1 || g_days < 1 || g_populate < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	root_path = g_root_path != nullptr ? g_root_path : "../output";
+	if(g_populate > 0)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+		if(!populate(root_path, g_populate, g_days, static_cast<off_t>(g_file_kb) * 1024))
+			goto done;
+		g_print("%s", fmt::format("Created {} files in {:.3f} s\n", g_populate,
+															std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count())
+										.c_str());
+	}
+
+	quotas[static_cast<size_t>(RetentionKind::EVENTS)] = { static_cast<uint64_t>(std::max(g_events_mb, 0)) << 20,
+																												 static_cast<uint>(std::max(g_events_days, 0)) };
+	quotas[static_cast<size_t>(RetentionKind::CROPS)] = { static_cast<uint64_t>(std::max(g_crops_mb, 0)) << 20,
+																												static_cast<uint>(std::max(g_crops_days, 0)) };
+	manager = std::make_unique<RetentionManager>(root_path, quotas, 0, g_budget);
+
+	for(uint64_t pass = 1;; ++pass)
+	{
+		const bool scanned{ manager->run_pass(
+				std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch())
+						.count()) };
+		uint64_t deleted_files;
+		const uint64_t freed{ manager->drain_freed(deleted_files) };
+		const RetentionStats stats{ manager->stats() };
+
+		total_time_us += stats.pass_time_us;
+		g_print("%s", fmt::format("pass {} scanned {} freed {:.1f} MB in {} files, events {:.1f} MB crops {:.1f} MB, "
+															"{} us\n",
+															pass, stats.scanned_entries, freed / 1048576.0, deleted_files,
+															stats.usage_bytes[static_cast<size_t>(RetentionKind::EVENTS)] / 1048576.0,
+															stats.usage_bytes[static_cast<size_t>(RetentionKind::CROPS)] / 1048576.0,
+															stats.pass_time_us)
+										.c_str());
+
+		if(scanned && deleted_files == 0)
+			break;
+	}
+
+	g_print("%s", fmt::format("Total pass time {:.3f} s\n", total_time_us / 1e6).c_str());
+	return_value = 0;
+
+done:
+	manager.reset();
+	g_free(g_root_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
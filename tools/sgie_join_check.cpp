@@ -0,0 +1,544 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gstnvdsmeta.h>
+
+#include "common.hpp"
+#include "secondary_gie.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_buffers{ 200 };
+static int g_branches{ 3 };
+static int g_sleep_ms{ 5 };
+
+GOptionEntry entries[] = {
+	{ "buffers", 'n', 0, G_OPTION_ARG_INT, &g_buffers, "Buffers pushed through the joined branches", nullptr },
+	{ "branches", 'b', 0, G_OPTION_ARG_INT, &g_branches, "Branches of the tee, at most 5", nullptr },
+	{ "sleep-ms", 's', 0, G_OPTION_ARG_INT, &g_sleep_ms, "Time the slowest branch spends on every buffer", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Time the checks wait for the buffers to come out, well above the join timeout.
+ * */
+static constexpr std::chrono::seconds OUTPUT_TIMEOUT{ 10 };
+
+/**
+ * A secondary GIE bin whose branches are an identity in place of the GIE,
+ * fed from a pad of the tool and ending in a fakesink behind the join.
+ * */
+struct JoinPipeline
+{
+	GstElement *pipeline{};
+	GstPad *src{};
+	SecondaryGieBin sgie{};
+	std::vector<GstElement *> identities;
+	/**
+	 * Buffers each branch released, the branches keep the order of the buffers.
+	 * */
+	std::vector<std::atomic<uint64_t>> released;
+	std::atomic<uint64_t> outputs{};
+	std::atomic<uint64_t> out_of_order{};
+	std::atomic<uint64_t> early{};
+	std::atomic<uint64_t> shared{};
+
+	explicit JoinPipeline(size_t branches): released(branches) {}
+};
+
+static GstPadProbeReturn branch_probe(GstPad *, GstPadProbeInfo *, void *data)
+{
+	reinterpret_cast<std::atomic<uint64_t> *>(data)->fetch_add(1, std::memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+/**
+ * Replaces the buffer shared with the other branches by a copy, as a branch
+ * writing to it would.
+ * */
+static GstPadProbeReturn copy_probe(GstPad *, GstPadProbeInfo *info, void *)
+{
+	GST_PAD_PROBE_INFO_DATA(info) = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+	return GST_PAD_PROBE_OK;
+}
+
+/**
+ * Checks the buffers behind the join, every branch must have released them
+ * before and the join must hold the only reference.
+ * */
+static GstPadProbeReturn output_probe(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	auto *join = reinterpret_cast<JoinPipeline *>(data);
+	GstBuffer *buffer = GST_BUFFER(info->data);
+	const uint64_t index{ join->outputs.load(std::memory_order_relaxed) };
+
+	if(GST_BUFFER_OFFSET(buffer) != index)
+		join->out_of_order.fetch_add(1, std::memory_order_relaxed);
+	for(const std::atomic<uint64_t> &released : join->released)
+	{
+		if(released.load(std::memory_order_relaxed) <= GST_BUFFER_OFFSET(buffer))
+		{
+			join->early.fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+	}
+	if(GST_OBJECT_REFCOUNT_VALUE(buffer) > 1)
+		join->shared.fetch_add(1, std::memory_order_relaxed);
+
+	join->outputs.fetch_add(1, std::memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+static void destroy_join_pipeline(JoinPipeline *join)
+{
+	if(join->pipeline)
+	{
+		gst_element_set_state(join->pipeline, GST_STATE_NULL);
+		gst_object_unref(join->pipeline);
+		g_mutex_clear(&join->sgie.wait_lock);
+		g_cond_clear(&join->sgie.wait_cond);
+	}
+	if(join->src)
+	{
+		gst_pad_set_active(join->src, FALSE);
+		gst_object_unref(join->src);
+	}
+}
+
+/**
+ * Builds tee ! queue ! fakesink with a queue ! identity ! fakesink branch per
+ * entry of @p branches, identity sleeping and dropping as configured, and
+ * joins the branches as @ref create_secondary_gie does. The branch
+ * @p copy_branch copies every buffer behind its identity.
+ * */
+static bool create_join_pipeline(JoinPipeline *join, const std::vector<std::string> &branches, int copy_branch = -1)
+{
+	bool success{};
+	std::string description{ "tee name=tee ! queue name=join ! fakesink name=out async=false sync=false" };
+	GError *error{};
+	GstElement *out{};
+	GstPad *pad{};
+	GstCaps *caps;
+
+	for(size_t i = 0; i < branches.size(); i++)
+		description += fmt::format(" tee. ! queue ! identity name=identity{} {} ! fakesink name=sink{} async=false sync=false",
+															 i, branches[i], i);
+
+	join->pipeline = gst_parse_launch(description.c_str(), &error);
+	if(!join->pipeline)
+	{
+		TADS_ERR_MSG_V("Could not create the test pipeline: %s", error ? error->message : "unknown error");
+		g_clear_error(&error);
+		goto done;
+	}
+
+	join->sgie.bin = join->pipeline;
+	join->sgie.tee = gst_bin_get_by_name(GST_BIN(join->pipeline), "tee");
+	join->sgie.queue = gst_bin_get_by_name(GST_BIN(join->pipeline), "join");
+	for(size_t i = 0; i < branches.size(); i++)
+	{
+		SecondaryGieBinSubBin &sub_bin = join->sgie.sub_bins.at(i);
+		sub_bin.create = true;
+		sub_bin.sink = gst_bin_get_by_name(GST_BIN(join->pipeline), fmt::format("sink{}", i).c_str());
+		join->identities.push_back(gst_bin_get_by_name(GST_BIN(join->pipeline), fmt::format("identity{}", i).c_str()));
+		if(static_cast<int>(i) == copy_branch)
+		{
+			pad = gst_element_get_static_pad(join->identities.back(), "src");
+			gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, copy_probe, nullptr, nullptr);
+			gst_object_unref(pad);
+		}
+
+		// Added before the join, the probe runs before the branch releases the buffer
+		pad = gst_element_get_static_pad(sub_bin.sink, "sink");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, branch_probe, &join->released[i], nullptr);
+		gst_object_unref(pad);
+	}
+	attach_secondary_gie_join(&join->sgie);
+
+	// The bin owns the elements, the references of gst_bin_get_by_name are not kept
+	gst_object_unref(join->sgie.tee);
+	gst_object_unref(join->sgie.queue);
+	for(size_t i = 0; i < branches.size(); i++)
+	{
+		gst_object_unref(join->sgie.sub_bins[i].sink);
+		gst_object_unref(join->identities[i]);
+	}
+
+	out = gst_bin_get_by_name(GST_BIN(join->pipeline), "out");
+	pad = gst_element_get_static_pad(out, "sink");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, output_probe, join, nullptr);
+	gst_object_unref(pad);
+	gst_object_unref(out);
+
+	join->src = gst_pad_new("src", GST_PAD_SRC);
+	gst_pad_set_active(join->src, TRUE);
+	pad = gst_element_get_static_pad(join->sgie.tee, "sink");
+	if(gst_pad_link(join->src, pad) != GST_PAD_LINK_OK)
+	{
+		TADS_ERR_MSG_V("Could not link the test pad to the tee");
+		gst_object_unref(pad);
+		goto done;
+	}
+	gst_object_unref(pad);
+
+	if(gst_element_set_state(join->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		TADS_ERR_MSG_V("Could not start the test pipeline");
+		goto done;
+	}
+
+	caps = gst_caps_new_empty_simple("application/x-tads-test");
+	success = gst_pad_push_event(join->src, gst_event_new_stream_start("tads-sgie-join-check")) &&
+						gst_pad_push_event(join->src, gst_event_new_caps(caps));
+	gst_caps_unref(caps);
+
+done:
+	return success;
+}
+
+static bool push_segment(JoinPipeline *join)
+{
+	GstSegment segment;
+	gst_segment_init(&segment, GST_FORMAT_TIME);
+	return gst_pad_push_event(join->src, gst_event_new_segment(&segment));
+}
+
+/**
+ * Pushes the buffers numbered [@p first, @p first + @p count), the offset
+ * carries the number. The buffers carry a batch meta as they do behind the
+ * streammux, unless @p batch_meta is false.
+ * */
+static bool push_buffers(JoinPipeline *join, uint64_t first, uint64_t count, bool batch_meta = true)
+{
+	for(uint64_t i = first; i < first + count; i++)
+	{
+		GstBuffer *buffer{ gst_buffer_new() };
+		if(batch_meta)
+		{
+			NvDsMeta *meta = gst_buffer_add_nvds_meta(buffer, nvds_create_batch_meta(1), nullptr,
+																								nvds_batch_meta_copy_func, nvds_batch_meta_release_func);
+			meta->meta_type = NVDS_BATCH_GST_META;
+		}
+		GST_BUFFER_OFFSET(buffer) = i;
+		GST_BUFFER_PTS(buffer) = i * GST_MSECOND;
+		GST_BUFFER_DURATION(buffer) = GST_MSECOND;
+
+		const GstFlowReturn flow{ gst_pad_push(join->src, buffer) };
+		if(flow != GST_FLOW_OK)
+		{
+			TADS_ERR_MSG_V("%s", fmt::format("Buffer {} refused: {}", i, gst_flow_get_name(flow)).c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool wait_outputs(JoinPipeline *join, uint64_t count)
+{
+	const auto end_time{ std::chrono::steady_clock::now() + OUTPUT_TIMEOUT };
+	while(join->outputs.load(std::memory_order_relaxed) < count)
+	{
+		if(std::chrono::steady_clock::now() > end_time)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return true;
+}
+
+/**
+ * Pushes EOS and waits for it on the bus, the join must not hold any buffer.
+ * */
+static bool finish(JoinPipeline *join)
+{
+	GstBus *bus{ gst_element_get_bus(join->pipeline) };
+	GstMessage *message;
+	bool success;
+
+	gst_pad_push_event(join->src, gst_event_new_eos());
+	message = gst_bus_timed_pop_filtered(bus, OUTPUT_TIMEOUT.count() * GST_SECOND,
+																			 (GstMessageType)(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+	success = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+	if(message)
+		gst_message_unref(message);
+	gst_object_unref(bus);
+
+	g_mutex_lock(&join->sgie.wait_lock);
+	success = success && join->sgie.pending_branches.empty();
+	g_mutex_unlock(&join->sgie.wait_lock);
+	return success;
+}
+
+using CheckFunction = std::function<void(bool, const std::string &)>;
+
+/**
+ * Branches of different speeds, every buffer waits for the slowest one.
+ * */
+static void check_join(const CheckFunction &check)
+{
+	const uint64_t buffers{ static_cast<uint64_t>(g_buffers) };
+	std::vector<std::string> branches;
+	JoinPipeline join(g_branches);
+
+	for(int i = 0; i < g_branches; i++)
+		branches.push_back(fmt::format("sleep-time={}", g_sleep_ms * 1000 * i / std::max(1, g_branches - 1)));
+
+	const auto start{ std::chrono::steady_clock::now() };
+	if(!create_join_pipeline(&join, branches) || !push_segment(&join) || !push_buffers(&join, 0, buffers))
+	{
+		check(false, "join: could not push the buffers");
+		destroy_join_pipeline(&join);
+		return;
+	}
+	check(wait_outputs(&join, buffers), fmt::format("join: {} buffers out of {}", join.outputs.load(), buffers));
+	const double elapsed_s{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	check(finish(&join), "join: EOS not reached or buffers left pending");
+
+	const SecondaryGieJoinStats &stats{ *join.sgie.join_stats };
+	g_print("%s", fmt::format("join     {} buffers through {} branches in {:.3f} s, {} joins {} timeouts {} polls "
+														"{} fallbacks\n",
+														join.outputs.load(), g_branches, elapsed_s, stats.joins.load(), stats.timeouts.load(),
+														stats.polls.load(), stats.fallbacks.load())
+										.c_str());
+
+	check(join.early == 0, fmt::format("join: {} buffers left before every branch released them", join.early.load()));
+	check(join.shared == 0, fmt::format("join: {} buffers left still shared with a branch", join.shared.load()));
+	check(join.out_of_order == 0, fmt::format("join: {} buffers out of order", join.out_of_order.load()));
+	check(stats.joins == buffers, fmt::format("join: {} joins for {} buffers", stats.joins.load(), buffers));
+	check(stats.timeouts == 0 && stats.fallbacks == 0,
+				fmt::format("join: {} joins timed out and {} fell back", stats.timeouts.load(), stats.fallbacks.load()));
+	for(int i = 0; i < g_branches; i++)
+		check(join.released[i] == buffers,
+					fmt::format("join: branch {} released {} buffers out of {}", i, join.released[i].load(), buffers));
+
+	destroy_join_pipeline(&join);
+}
+
+/**
+ * A branch copies every buffer, the copy carries the join sequence and the
+ * buffers are joined without waiting for the timeout.
+ * */
+static void check_copy(const CheckFunction &check)
+{
+	const uint64_t buffers{ static_cast<uint64_t>(g_buffers) };
+	JoinPipeline join(2);
+
+	const auto start{ std::chrono::steady_clock::now() };
+	if(!create_join_pipeline(&join, { "", fmt::format("sleep-time={}", g_sleep_ms * 1000) }, 1) ||
+		 !push_segment(&join) || !push_buffers(&join, 0, buffers))
+	{
+		check(false, "copy: could not push the buffers");
+		destroy_join_pipeline(&join);
+		return;
+	}
+	check(wait_outputs(&join, buffers), fmt::format("copy: {} buffers out of {}", join.outputs.load(), buffers));
+	const double elapsed_s{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	check(finish(&join), "copy: EOS not reached or buffers left pending");
+
+	const SecondaryGieJoinStats &stats{ *join.sgie.join_stats };
+	g_print("%s", fmt::format("copy     {} buffers in {:.3f} s, {} joins {} timeouts {} fallbacks\n", join.outputs.load(),
+														elapsed_s, stats.joins.load(), stats.timeouts.load(), stats.fallbacks.load())
+										.c_str());
+
+	check(stats.joins == buffers && stats.timeouts == 0 && stats.fallbacks == 0,
+				fmt::format("copy: {} joins, {} timeouts and {} fallbacks for {} buffers", stats.joins.load(),
+										stats.timeouts.load(), stats.fallbacks.load(), buffers));
+	check(join.early == 0 && join.out_of_order == 0,
+				fmt::format("copy: {} buffers early and {} out of order", join.early.load(), join.out_of_order.load()));
+
+	destroy_join_pipeline(&join);
+}
+
+/**
+ * Buffers without a batch meta carry no join sequence, the join falls back
+ * to waiting for the branches to drop their reference.
+ * */
+static void check_fallback(const CheckFunction &check)
+{
+	constexpr uint64_t buffers{ 20 };
+	JoinPipeline join(2);
+
+	if(!create_join_pipeline(&join, { "", fmt::format("sleep-time={}", g_sleep_ms * 1000) }) || !push_segment(&join) ||
+		 !push_buffers(&join, 0, buffers, false))
+	{
+		check(false, "fallback: could not push the buffers");
+		destroy_join_pipeline(&join);
+		return;
+	}
+	check(wait_outputs(&join, buffers), fmt::format("fallback: {} buffers out of {}", join.outputs.load(), buffers));
+	check(finish(&join), "fallback: EOS not reached or buffers left pending");
+
+	const SecondaryGieJoinStats &stats{ *join.sgie.join_stats };
+	g_print("%s", fmt::format("fallback {} buffers, {} joins {} fallbacks {} polls\n", join.outputs.load(),
+														stats.joins.load(), stats.fallbacks.load(), stats.polls.load())
+										.c_str());
+
+	check(stats.joins == buffers && stats.fallbacks == buffers && stats.timeouts == 0,
+				fmt::format("fallback: {} joins, {} fallbacks and {} timeouts for {} buffers", stats.joins.load(),
+										stats.fallbacks.load(), stats.timeouts.load(), buffers));
+	check(join.early == 0 && join.shared == 0,
+				fmt::format("fallback: {} buffers early and {} shared", join.early.load(), join.shared.load()));
+
+	destroy_join_pipeline(&join);
+}
+
+/**
+ * A branch loses every buffer, each one is let through after the timeout.
+ * */
+static void check_timeout(const CheckFunction &check)
+{
+	constexpr uint64_t buffers{ 5 };
+	JoinPipeline join(2);
+
+	const auto start{ std::chrono::steady_clock::now() };
+	if(!create_join_pipeline(&join, { "", "drop-probability=1.0" }) || !push_segment(&join) ||
+		 !push_buffers(&join, 0, buffers))
+	{
+		check(false, "timeout: could not push the buffers");
+		destroy_join_pipeline(&join);
+		return;
+	}
+	check(wait_outputs(&join, buffers), fmt::format("timeout: {} buffers out of {}", join.outputs.load(), buffers));
+	const double elapsed_s{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	check(finish(&join), "timeout: EOS not reached or buffers left pending");
+
+	const SecondaryGieJoinStats &stats{ *join.sgie.join_stats };
+	g_print("%s", fmt::format("timeout  {} buffers in {:.3f} s, {} joins {} timeouts\n", join.outputs.load(), elapsed_s,
+														stats.joins.load(), stats.timeouts.load())
+										.c_str());
+
+	check(stats.joins == buffers && stats.timeouts == buffers,
+				fmt::format("timeout: {} joins and {} timeouts for {} buffers", stats.joins.load(), stats.timeouts.load(),
+										buffers));
+	// The join waits 100 ms per buffer, see SECONDARY_GIE_JOIN_TIMEOUT_US
+	check(elapsed_s >= 0.1 * buffers, fmt::format("timeout: {} buffers let through in {:.3f} s", buffers, elapsed_s));
+	check(join.released[1] == 0, fmt::format("timeout: the dropping branch released {} buffers", join.released[1].load()));
+
+	destroy_join_pipeline(&join);
+}
+
+/**
+ * A flush wakes the join waiting for a slow branch, the buffers pushed after
+ * it are joined as usual.
+ * */
+static void check_flush(const CheckFunction &check)
+{
+	constexpr uint64_t buffers{ 10 };
+	JoinPipeline join(2);
+
+	if(!create_join_pipeline(&join, { "", "sleep-time=300000" }) || !push_segment(&join) ||
+		 !push_buffers(&join, 0, 1))
+	{
+		check(false, "flush: could not push the buffers");
+		destroy_join_pipeline(&join);
+		return;
+	}
+
+	// Well below the join timeout, the buffer is waiting in the join
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	const auto start{ std::chrono::steady_clock::now() };
+	gst_pad_push_event(join.src, gst_event_new_flush_start());
+	const SecondaryGieJoinStats &stats{ *join.sgie.join_stats };
+	check(stats.joins == 1 && stats.timeouts == 0,
+				fmt::format("flush: {} joins and {} timeouts after the flush start", stats.joins.load(),
+										stats.timeouts.load()));
+
+	g_object_set(G_OBJECT(join.identities[1]), "sleep-time", 0, nullptr);
+	gst_pad_push_event(join.src, gst_event_new_flush_stop(TRUE));
+	g_mutex_lock(&join.sgie.wait_lock);
+	check(!join.sgie.flush && join.sgie.pending_branches.empty(), "flush: the flush stop left the join flushing");
+	g_mutex_unlock(&join.sgie.wait_lock);
+
+	// The flushed buffer never comes out, the others are numbered from 0 again
+	for(std::atomic<uint64_t> &released : join.released)
+		released = 0;
+	if(!push_segment(&join) || !push_buffers(&join, 0, buffers))
+	{
+		check(false, "flush: could not push the buffers after the flush");
+		destroy_join_pipeline(&join);
+		return;
+	}
+	check(wait_outputs(&join, buffers), fmt::format("flush: {} buffers out of {}", join.outputs.load(), buffers));
+	const double elapsed_s{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+	check(finish(&join), "flush: EOS not reached or buffers left pending");
+
+	g_print("%s", fmt::format("flush    {} buffers in {:.3f} s after the flush, {} joins {} timeouts\n",
+														join.outputs.load(), elapsed_s, stats.joins.load(), stats.timeouts.load())
+										.c_str());
+
+	check(stats.joins == buffers + 1 && stats.timeouts == 0,
+				fmt::format("flush: {} joins and {} timeouts for {} buffers", stats.joins.load(), stats.timeouts.load(),
+										buffers + 1));
+	check(join.early == 0 && join.shared == 0 && join.out_of_order == 0,
+				fmt::format("flush: {} buffers early, {} shared and {} out of order", join.early.load(), join.shared.load(),
+										join.out_of_order.load()));
+
+	destroy_join_pipeline(&join);
+}
+
+/**
+ * Runs the join of the secondary GIEs on stock elements, an identity
+ * standing in for each GIE, and checks that a buffer leaves the join once
+ * every branch released it, also when a branch copies it or it has no
+ * batch meta, after the timeout when a branch loses it and right away on a
+ * flush.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+
+	ctx = g_option_context_new("- check the join of the secondary GIE branches");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+	g_option_context_add_group(ctx, gst_init_get_option_group());
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_buffers < 1 || g_branches < 1 || g_branches > static_cast<int>(MAX_SECONDARY_GIE_BINS) || g_sleep_ms < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	{
+		const CheckFunction check{ [&failures](bool passed, const std::string &what)
+															 {
+																 if(!passed)
+																 {
+																	 TADS_ERR_MSG_V("%s", what.c_str());
+																	 failures++;
+																 }
+															 } };
+		check_join(check);
+		check_copy(check);
+		check_fallback(check);
+		check_timeout(check);
+		check_flush(check);
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,296 @@
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+#include <gstnvdsmeta.h>
+
+#include "app.hpp"
+#include "common.hpp"
+#include "config_parser.hpp"
+#include "perf.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_sources{ 128 };
+static int g_frames{ 30 };
+static int g_cycles{ 3 };
+
+GOptionEntry entries[] = {
+	{ "sources", 'n', 0, G_OPTION_ARG_INT, &g_sources, "Sources of the config and of the pipeline, at least 64", nullptr },
+	{ "frames", 'f', 0, G_OPTION_ARG_INT, &g_frames, "Frames pushed by each source", nullptr },
+	{ "cycles", 'c', 0, G_OPTION_ARG_INT, &g_cycles, "Times the pipeline is built, run and torn down", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Sources expanded from the multi-URI group of the config.
+ * */
+static constexpr int MULTI_URI_SOURCES{ 8 };
+static constexpr int FAKE_SINKS{ 4 };
+
+using CheckFunction = std::function<void(bool, const std::string &)>;
+
+/**
+ * Writes a config of @p sources sources, the last ones expanded from a
+ * multi-URI group, and of fake sinks, one of them disabled.
+ * */
+static bool write_config(const std::string &path, int sources)
+{
+	std::string content;
+	FILE *file;
+	bool success;
+
+	for(int i = 0; i < sources - MULTI_URI_SOURCES; i++)
+		content += fmt::format("[source{}]\nenable=1\ntype=2\nuri=rtsp://camera{}/stream\n\n", i, i);
+	content += fmt::format("[source{}]\nenable=1\ntype=3\nnum-sources={}\nuri=rtsp://multi{{}}/stream\n\n",
+												 sources - MULTI_URI_SOURCES, MULTI_URI_SOURCES);
+	for(int i = 0; i <= FAKE_SINKS; i++)
+		content += fmt::format("[sink{}]\nenable={}\ntype=1\nsync=0\n\n", i, i == FAKE_SINKS / 2 ? 0 : 1);
+
+	file = fopen(path.c_str(), "w");
+	success = file != nullptr && fwrite(content.data(), 1, content.size(), file) == content.size();
+	if(file != nullptr && fclose(file) != 0)
+		success = false;
+	return success;
+}
+
+/**
+ * The parser must size the source and sink configs from the groups, past
+ * the two sources and sinks it used to be limited to.
+ * */
+static void check_config(const CheckFunction &check)
+{
+	const std::string path{ fmt::format("/tmp/tads-sources-check-{}.txt", getpid()) };
+	const size_t sources{ static_cast<size_t>(g_sources) };
+	AppConfig config{};
+	std::set<std::string> uris;
+
+	if(!write_config(path, g_sources))
+	{
+		check(false, fmt::format("config: could not write '{}'", path));
+		return;
+	}
+
+	{
+		ConfigParser parser{ path };
+		check(parser.parse(&config), "config: parse failed");
+	}
+	unlink(path.c_str());
+
+	check(config.num_source_sub_bins == sources,
+				fmt::format("config: {} sources instead of {}", config.num_source_sub_bins, sources));
+	check(config.multi_source_configs.size() >= config.num_source_sub_bins,
+				fmt::format("config: {} source configs for {} sources", config.multi_source_configs.size(),
+										config.num_source_sub_bins));
+	check(config.num_sink_sub_bins == FAKE_SINKS,
+				fmt::format("config: {} sinks instead of {}", config.num_sink_sub_bins, FAKE_SINKS));
+	check(config.sink_bin_sub_bin_configs.size() >= config.num_sink_sub_bins,
+				fmt::format("config: {} sink configs for {} sinks", config.sink_bin_sub_bin_configs.size(),
+										config.num_sink_sub_bins));
+
+	for(size_t i = 0; i < std::min(config.num_source_sub_bins, config.multi_source_configs.size()); i++)
+	{
+		const SourceConfig &source = config.multi_source_configs[i];
+		check(source.enable && source.type == SourceType::URI,
+					fmt::format("config: source {} is not an enabled URI source", i));
+		uris.insert(source.uri);
+	}
+	check(uris.size() == sources, fmt::format("config: {} distinct URIs for {} sources", uris.size(), sources));
+	check(uris.count("rtsp://multi0/stream") == 1 &&
+						uris.count(fmt::format("rtsp://multi{}/stream", MULTI_URI_SOURCES - 1)) == 1,
+				"config: the multi-URI group is not expanded");
+
+	g_print("%s", fmt::format("config   {} sources and {} sinks parsed\n", config.num_source_sub_bins,
+														config.num_sink_sub_bins)
+										.c_str());
+}
+
+/**
+ * Tags each buffer of a source with a batch meta holding one frame of the
+ * source, as the streammux would.
+ * */
+static GstPadProbeReturn tag_probe(GstPad *, GstPadProbeInfo *info, void *data)
+{
+	GstBuffer *buffer{ gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info)) };
+	NvDsBatchMeta *batch_meta{ nvds_create_batch_meta(1) };
+	NvDsFrameMeta *frame_meta{ nvds_acquire_frame_meta_from_pool(batch_meta) };
+	NvDsMeta *meta;
+
+	frame_meta->pad_index = frame_meta->source_id = GPOINTER_TO_UINT(data);
+	frame_meta->batch_id = 0;
+	nvds_add_frame_meta_to_batch(batch_meta, frame_meta);
+
+	meta = gst_buffer_add_nvds_meta(buffer, batch_meta, nullptr, nvds_batch_meta_copy_func,
+																	nvds_batch_meta_release_func);
+	meta->meta_type = NVDS_BATCH_GST_META;
+
+	GST_PAD_PROBE_INFO_DATA(info) = buffer;
+	return GST_PAD_PROBE_OK;
+}
+
+static void perf_callback(void *, AppPerfStruct *) {}
+
+/**
+ * Builds the pipeline, runs it to the end and tears it down: every source
+ * is a videotestsrc into a funnel, the perf probe of the sink counts them.
+ * One more source than the perf counters are sized for has an out of range
+ * pad index, its frames must be ignored.
+ * */
+static void check_pipeline(const CheckFunction &check, int cycle)
+{
+	using Clock = std::chrono::steady_clock;
+	const uint sources{ static_cast<uint>(g_sources) };
+	std::string description{ "funnel name=funnel ! fakesink name=sink sync=false async=false" };
+	AppPerfStructInt perf_struct{};
+	AppPerfStruct perf{};
+	GstElement *pipeline{}, *sink{};
+	GstBus *bus{};
+	GstMessage *message{};
+	GstPad *pad{};
+	GError *error{};
+	Clock::time_point start;
+	double build_s{}, run_s{}, teardown_s{};
+	uint64_t counted{};
+
+	start = Clock::now();
+	for(uint i = 0; i <= sources; i++)
+		description += fmt::format(" videotestsrc name=src{} num-buffers={} ! "
+															 "video/x-raw,width=32,height=32,framerate=30/1 ! funnel.",
+															 i, g_frames);
+
+	pipeline = gst_parse_launch(description.c_str(), &error);
+	if(!pipeline)
+	{
+		check(false, fmt::format("pipeline: could not create it: {}", error ? error->message : "unknown error"));
+		g_clear_error(&error);
+		return;
+	}
+	g_object_add_weak_pointer(G_OBJECT(pipeline), reinterpret_cast<gpointer *>(&pipeline));
+
+	for(uint i = 0; i <= sources; i++)
+	{
+		GstElement *src{ gst_bin_get_by_name(GST_BIN(pipeline), fmt::format("src{}", i).c_str()) };
+		pad = gst_element_get_static_pad(src, "src");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, tag_probe, GUINT_TO_POINTER(i), nullptr);
+		gst_object_unref(pad);
+		gst_object_unref(src);
+	}
+
+	sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+	pad = gst_element_get_static_pad(sink, "sink");
+	check(enable_perf_measurement(&perf_struct, pad, sources, 1, perf_callback), "pipeline: perf not enabled");
+	gst_object_unref(pad);
+	gst_object_unref(sink);
+	build_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+	start = Clock::now();
+	bus = gst_element_get_bus(pipeline);
+	if(gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		check(false, "pipeline: could not start it");
+	}
+	else
+	{
+		message = gst_bus_timed_pop_filtered(bus, 60 * GST_SECOND,
+																				 static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+		check(message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS, "pipeline: EOS not reached");
+		if(message)
+			gst_message_unref(message);
+	}
+	gst_object_unref(bus);
+	run_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+	// Every frame but the first of each source is counted, see perf_count_frame
+	collect_perf_measurement(&perf_struct, &perf);
+	check(perf.num_instances == sources && perf.source_detail.size() == sources,
+				fmt::format("pipeline: {} sources reported out of {}", perf.source_detail.size(), sources));
+	for(const AppSourceDetail &detail : perf.source_detail)
+	{
+		const InstancePerfSnapshot &snapshot = perf_struct.instance_snapshot[detail.source_id];
+		counted += snapshot.total_frame_cnt;
+		check(snapshot.total_frame_cnt == static_cast<uint64_t>(g_frames - 1) && detail.fps_avg > 0,
+					fmt::format("pipeline: source {} counted {} frames out of {}", detail.source_id,
+											snapshot.total_frame_cnt, g_frames - 1));
+	}
+
+	start = Clock::now();
+	pause_perf_measurement(&perf_struct);
+	if(perf_struct.perf_measurement_timeout_id)
+		g_source_remove(perf_struct.perf_measurement_timeout_id);
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(pipeline);
+	teardown_s = std::chrono::duration<double>(Clock::now() - start).count();
+	check(pipeline == nullptr, "pipeline: still referenced after the teardown");
+
+	g_print("%s", fmt::format("cycle {}  {} sources, {} frames counted, built in {:.3f} s, ran in {:.3f} s, "
+														"torn down in {:.3f} s\n",
+														cycle, sources, counted, build_s, run_s, teardown_s)
+										.c_str());
+}
+
+/**
+ * Checks a process with many sources on stock elements: a config of
+ * --sources sources and several sinks must be parsed into as many configs,
+ * and a pipeline of as many videotestsrc, tagged with a batch meta as the
+ * streammux would, must have every source counted by the perf probe, then
+ * be torn down, several times in a row.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+
+	ctx = g_option_context_new("- check the configs and perf counters of many sources");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+	g_option_context_add_group(ctx, gst_init_get_option_group());
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_sources < 64 || g_frames < 2 || g_cycles < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	{
+		const CheckFunction check{ [&failures](bool passed, const std::string &what)
+															 {
+																 if(!passed)
+																 {
+																	 TADS_ERR_MSG_V("%s", what.c_str());
+																	 failures++;
+																 }
+															 } };
+		check_config(check);
+		for(int cycle = 0; cycle < g_cycles; cycle++)
+			check_pipeline(check, cycle);
+	}
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,115 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "span_trace.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_threads{ 4 };
+static int g_spans{ 1000000 };
+static int g_buffer_spans{ 65536 };
+static gchar *g_output{};
+
+GOptionEntry entries[] = {
+	{ "threads", 'j', 0, G_OPTION_ARG_INT, &g_threads, "Threads recording spans", nullptr },
+	{ "spans", 'n', 0, G_OPTION_ARG_INT, &g_spans, "Spans recorded by each thread per run", nullptr },
+	{ "buffer-spans", 'b', 0, G_OPTION_ARG_INT, &g_buffer_spans, "Spans kept per thread", nullptr },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output, "Trace written after the traced run", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Keeps the compiler from dropping the empty scopes.
+ * */
+static std::atomic<uint64_t> g_sink{};
+
+/**
+ * @return mean cost of a span in ns, over all the threads.
+ * */
+static double run()
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::vector<std::thread> threads;
+	std::vector<double> elapsed_ns(g_threads);
+
+	for(int t{}; t < g_threads; t++)
+	{
+		threads.emplace_back(
+				[&elapsed_ns, t]
+				{
+					uint64_t sum{};
+					const Clock::time_point start{ Clock::now() };
+					for(int i{}; i < g_spans; i++)
+					{
+						TADS_TRACE_SPAN("bench_span");
+						sum += i;
+					}
+					elapsed_ns[t] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+					g_sink.fetch_add(sum, std::memory_order_relaxed);
+				});
+	}
+	for(std::thread &thread : threads)
+		thread.join();
+
+	double total_ns{};
+	for(double ns : elapsed_ns)
+		total_ns += ns;
+	return total_ns / g_threads / g_spans;
+}
+
+/**
+ * Measures the cost of a span with tracing disabled, a single branch, and
+ * enabled, two clock reads and a ring push, then writes the traced run so
+ * the output can be checked in ui.perfetto.dev.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	double disabled_ns, enabled_ns;
+
+	ctx = g_option_context_new("- benchmark the span tracer");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_threads < 1 || g_spans < 1 || g_buffer_spans < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	g_print("%s", fmt::format("{} threads, {} spans per thread\n", g_threads, g_spans).c_str());
+
+	disabled_ns = run();
+	g_print("%s", fmt::format("{:<10} {:>8.2f} ns/span\n", "disabled", disabled_ns).c_str());
+
+	span_trace_start(g_buffer_spans);
+	enabled_ns = run();
+	span_trace_stop();
+	g_print("%s", fmt::format("{:<10} {:>8.2f} ns/span\n", "enabled", enabled_ns).c_str());
+
+	if(g_output && !span_trace_write(g_output))
+		goto done;
+
+	return_value = 0;
+
+done:
+	g_free(g_output);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
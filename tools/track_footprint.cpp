@@ -0,0 +1,246 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "analytics.hpp"
+#include "common.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_tracks{ 10000 };
+static int g_plates{ 10 };
+static gchar *g_output_path{};
+
+GOptionEntry entries[] = {
+	{ "tracks", 'n', 0, G_OPTION_ARG_INT, &g_tracks, "Live tracks", nullptr },
+	{ "plates", 'p', 0, G_OPTION_ARG_INT, &g_plates, "Plate reads per track", nullptr },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output_path,
+		"Output folder of the tracks, its length decides if the copy fits in the string", nullptr },
+	{ nullptr },
+};
+
+/**
+ * Every allocation of the process goes through these counters, the size is
+ * kept in front of the block to account the frees.
+ * */
+static constexpr size_t ALLOC_HEADER_SIZE{ alignof(std::max_align_t) };
+static std::atomic<uint64_t> g_alloc_cnt{};
+static std::atomic<int64_t> g_live_bytes{};
+
+void *operator new(size_t size)
+{
+	auto *block{ static_cast<char *>(malloc(size + ALLOC_HEADER_SIZE)) };
+	if(!block)
+		throw std::bad_alloc();
+
+	*reinterpret_cast<size_t *>(block) = size;
+	g_alloc_cnt.fetch_add(1, std::memory_order_relaxed);
+	g_live_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+	return block + ALLOC_HEADER_SIZE;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	if(!ptr)
+		return;
+
+	char *block{ static_cast<char *>(ptr) - ALLOC_HEADER_SIZE };
+	g_live_bytes.fetch_sub(static_cast<int64_t>(*reinterpret_cast<size_t *>(block)), std::memory_order_relaxed);
+	free(block);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+/**
+ * The per-track state as it was before, strings for every label and a
+ * vector of plate reads.
+ * */
+struct LegacyTrafficData
+{
+	struct LineCrossing
+	{
+		bool is_set{};
+		std::string status{ "unknown" };
+		double timestamp{};
+		int64_t time_us{};
+	};
+
+	struct Classifier
+	{
+		std::string label{ "unknown" };
+		float confidence{};
+
+		Classifier() = default;
+		Classifier(std::string label, float confidence):
+			label{ std::move(label) },
+			confidence{ confidence }
+		{}
+	};
+
+	uint64_t id{};
+	uint64_t index{};
+	uint source_id{};
+	std::string direction{ "unknown" };
+	std::pair<LineCrossing, LineCrossing> crossing_pair;
+	Classifier classifier_data;
+	std::vector<Classifier> lp_data;
+	std::string output_path;
+	bool has_image{};
+	BestShotState best_shot;
+	bool is_saved{};
+
+	void reset(uint64_t obj_id)
+	{
+		id = obj_id;
+		direction = "unknown";
+		crossing_pair = {};
+		classifier_data = {};
+		lp_data.clear();
+		output_path.clear();
+		has_image = false;
+		best_shot = {};
+		is_saved = false;
+	}
+};
+
+/**
+ * What the analytics probe stores for a track: its class, both line crossings,
+ * the direction and the plate reads.
+ * */
+static void fill(LegacyTrafficData &data, const std::string &output_path, uint64_t i)
+{
+	data.output_path = output_path;
+	data.classifier_data.label = "car";
+	data.classifier_data.confidence = 0.9f;
+	data.crossing_pair.first = { true, "Entry", 100.0, 1000 };
+	data.crossing_pair.second = { true, "Exit", 900.0, 2000 };
+	data.direction = "North";
+	for(int p = 0; p < g_plates; p++)
+		data.lp_data.emplace_back(to_cyrillic(fmt::format("A{:03}BC77", (i + p) % 1000)), 0.5f);
+}
+
+static void fill(TrafficAnalysisData &data, const std::shared_ptr<const std::string> &output_path, uint64_t i)
+{
+	static const PlateConsensus consensus;
+	char text[16];
+	PlateRead plate;
+
+	data.output_path = output_path;
+	data.classifier_data.label = label_id("car");
+	data.classifier_data.confidence = 0.9f;
+	data.crossing_pair.first.is_set = true;
+	data.crossing_pair.first.status = label_id("Entry");
+	data.crossing_pair.first.time_us = 1000;
+	data.crossing_pair.second.is_set = true;
+	data.crossing_pair.second.status = label_id("Exit");
+	data.crossing_pair.second.time_us = 2000;
+	data.direction = label_id("North");
+	for(int p = 0; p < g_plates; p++)
+	{
+		*fmt::format_to_n(text, sizeof(text) - 1, "A{:03}BC77", (i + p) % 1000).out = '\0';
+		plate.assign(text, 0.5f);
+		consensus.add(data.plate, plate);
+	}
+}
+
+struct Footprint
+{
+	size_t object_size;
+	double allocs_per_track;
+	double heap_bytes_per_track;
+	double reuse_allocs_per_track;
+};
+
+/**
+ * Fills a pool of @p g_tracks values, like the track table does for new
+ * tracks, then resets and fills it again as when the pooled values are reused.
+ * */
+template<typename T, typename Path>
+static Footprint measure(const Path &output_path)
+{
+	Footprint footprint{ sizeof(T) };
+	std::vector<T> pool;
+	pool.reserve(g_tracks);
+
+	const uint64_t start_cnt{ g_alloc_cnt.load() };
+	const int64_t start_bytes{ g_live_bytes.load() };
+	for(int i = 0; i < g_tracks; i++)
+	{
+		T &data{ pool.emplace_back() };
+		data.reset(i);
+		fill(data, output_path, i);
+	}
+	footprint.allocs_per_track = static_cast<double>(g_alloc_cnt.load() - start_cnt) / g_tracks;
+	footprint.heap_bytes_per_track = static_cast<double>(g_live_bytes.load() - start_bytes) / g_tracks;
+
+	const uint64_t reuse_cnt{ g_alloc_cnt.load() };
+	for(int i = 0; i < g_tracks; i++)
+	{
+		pool[i].reset(g_tracks + i);
+		fill(pool[i], output_path, g_tracks + i);
+	}
+	footprint.reuse_allocs_per_track = static_cast<double>(g_alloc_cnt.load() - reuse_cnt) / g_tracks;
+
+	return footprint;
+}
+
+static void print_footprint(const char *name, const Footprint &footprint)
+{
+	g_print("%s", fmt::format("{:<8} {:>6} B object  {:>8.1f} B heap  {:>8.1f} B per track  {:>5.1f} allocs per new track  "
+														"{:>5.1f} per reused track\n",
+														name, footprint.object_size, footprint.heap_bytes_per_track,
+														footprint.object_size + footprint.heap_bytes_per_track, footprint.allocs_per_track,
+														footprint.reuse_allocs_per_track)
+										.c_str());
+}
+
+/**
+ * Measures the memory held by each tracked object and the allocations made
+ * on the streaming thread to record it, with the previous layout of strings
+ * and a vector and with the compact one of label ids and inline plates.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::string output_path;
+
+	ctx = g_option_context_new("- measure the memory of the analytics tracks");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_tracks < 1 || g_plates < 0)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	output_path = g_output_path != nullptr ? g_output_path : "/opt/tads/output/17102026";
+	g_print("%s", fmt::format("{} tracks, {} plate reads each, output '{}'\n", g_tracks, g_plates, output_path).c_str());
+
+	print_footprint("legacy", measure<LegacyTrafficData>(output_path));
+	print_footprint("compact", measure<TrafficAnalysisData>(std::make_shared<const std::string>(output_path)));
+
+	return_value = 0;
+
+done:
+	g_free(g_output_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,383 @@
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "track_table.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_ops{ 2000000 };
+static int g_seed{ 1 };
+static int g_tracks{ 2000 };
+static int g_frames{ 20000 };
+static int g_soak_tracks{ 64 };
+static int g_soak_frames{ 25 * 3600 * 24 };
+
+GOptionEntry entries[] = {
+	{ "ops", 'n', 0, G_OPTION_ARG_INT, &g_ops, "Random operations of the soak", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the soak", nullptr },
+	{ "tracks", 't', 0, G_OPTION_ARG_INT, &g_tracks, "Live tracks of the benchmark", nullptr },
+	{ "frames", 'f', 0, G_OPTION_ARG_INT, &g_frames, "Frames of the benchmark", nullptr },
+	{ "soak-tracks", 0, 0, G_OPTION_ARG_INT, &g_soak_tracks, "Live tracks of the memory soak", nullptr },
+	{ "soak-frames", 0, 0, G_OPTION_ARG_INT, &g_soak_frames, "Frames of the memory soak, 24 h at 25 fps by default",
+		nullptr },
+	{ nullptr },
+};
+
+struct TrackKey
+{
+	uint source_id;
+	uint64_t track_id;
+
+	bool operator==(const TrackKey &other) const
+	{
+		return source_id == other.source_id && track_id == other.track_id;
+	}
+};
+
+struct TrackKeyHash
+{
+	size_t operator()(const TrackKey &key) const
+	{
+		return std::hash<uint64_t>()(key.track_id * 31 + key.source_id);
+	}
+};
+
+/**
+ * Value of the soak, stamped with its key so that a value handed to the
+ * wrong track is noticed.
+ * */
+struct SoakValue
+{
+	uint source_id;
+	uint64_t track_id;
+};
+
+struct ModelEntry
+{
+	uint64_t last_seen;
+};
+
+/**
+ * Random acquire, find, erase, advance, evict and clear on a table and on
+ * an unordered_map doing the same by brute force, the results have to
+ * agree after every operation. The tables are small and kept near their
+ * load limit, so that probe chains cross the end of the slot array all the
+ * time and backward shifts move entries over it.
+ *
+ * @return number of mismatches, the soak stops at the first one.
+ * */
+static int soak(size_t initial_capacity, uint sources, uint64_t track_ids, uint64_t ops, std::mt19937_64 &rng)
+{
+	TrackTable<SoakValue> table(initial_capacity);
+	std::unordered_map<TrackKey, ModelEntry, TrackKeyHash> model;
+	uint64_t acquired{}, evicted{}, erased{}, max_size{};
+
+	auto fail = [&](uint64_t op, const std::string &what)
+	{
+		TADS_ERR_MSG_V("capacity %zu, operation %lu: %s", initial_capacity, op, what.c_str());
+		return 1;
+	};
+
+	for(uint64_t op{}; op < ops; op++)
+	{
+		const TrackKey key{ static_cast<uint>(rng() % sources), rng() % track_ids };
+		const uint64_t action{ rng() % 1000 };
+
+		if(action < 500)
+		{
+			bool created;
+			SoakValue &value{ table.acquire(key.source_id, key.track_id, created) };
+			auto it{ model.find(key) };
+
+			if(created != (it == model.end()))
+				return fail(op, fmt::format("acquire of {}:{} created {}", key.source_id, key.track_id, created));
+			if(created)
+			{
+				value.source_id = key.source_id;
+				value.track_id = key.track_id;
+				it = model.emplace(key, ModelEntry{}).first;
+			}
+			else if(value.source_id != key.source_id || value.track_id != key.track_id)
+			{
+				return fail(op, fmt::format("acquire of {}:{} returned the value of {}:{}", key.source_id, key.track_id,
+																		value.source_id, value.track_id));
+			}
+			it->second.last_seen = table.frame();
+			acquired++;
+		}
+		else if(action < 800)
+		{
+			const SoakValue *value{ table.find(key.source_id, key.track_id) };
+			const bool expected{ model.count(key) > 0 };
+
+			if((value != nullptr) != expected)
+				return fail(op, fmt::format("find of {}:{} {}", key.source_id, key.track_id, expected ? "missed" : "hit"));
+			if(value && (value->source_id != key.source_id || value->track_id != key.track_id))
+				return fail(op, fmt::format("find of {}:{} returned the value of {}:{}", key.source_id, key.track_id,
+																		value->source_id, value->track_id));
+		}
+		else if(action < 850)
+		{
+			const bool expected{ model.erase(key) > 0 };
+			if(table.erase(key.source_id, key.track_id) != expected)
+				return fail(op, fmt::format("erase of {}:{} returned {}", key.source_id, key.track_id, !expected));
+			erased += expected;
+		}
+		else if(action < 970)
+		{
+			table.advance(1 + rng() % 3);
+		}
+		else if(action < 999)
+		{
+			const uint64_t max_age{ rng() % 32 };
+			size_t expected{};
+
+			for(auto it = model.begin(); it != model.end();)
+			{
+				if(table.frame() - it->second.last_seen > max_age)
+				{
+					it = model.erase(it);
+					expected++;
+				}
+				else
+				{
+					++it;
+				}
+			}
+
+			const size_t removed{ table.evict(max_age) };
+			if(removed != expected)
+				return fail(op, fmt::format("evict({}) removed {} entries instead of {}", max_age, removed, expected));
+			evicted += removed;
+		}
+		else
+		{
+			table.clear();
+			model.clear();
+		}
+
+		if(table.size() != model.size())
+			return fail(op, fmt::format("{} entries instead of {}", table.size(), model.size()));
+		max_size = std::max<uint64_t>(max_size, model.size());
+
+		// Every entry has to stay reachable, e.g. after a backward shift over the end of the slots
+		if(op % 97 == 0)
+		{
+			for(const auto &[model_key, entry] : model)
+			{
+				const SoakValue *value{ table.find(model_key.source_id, model_key.track_id) };
+				if(!value || value->source_id != model_key.source_id || value->track_id != model_key.track_id)
+					return fail(op, fmt::format("entry {}:{} lost", model_key.source_id, model_key.track_id));
+			}
+		}
+	}
+
+	g_print("%s", fmt::format("capacity {:>4}: {} operations, {} acquired, {} evicted, {} erased, up to {} entries in "
+														"{} slots, pool of {}\n",
+														initial_capacity, ops, acquired, evicted, erased, max_size, table.capacity(),
+														table.pool_size())
+									.c_str());
+	return 0;
+}
+
+/**
+ * Steady state of the analytics: every frame sees the live tracks, one in
+ * 64 of them ends and a new one with the next tracker id starts, ended
+ * tracks are evicted every 16 frames once older than @p ttl frames.
+ *
+ * @return ns per lookup.
+ * */
+template<typename Lookup, typename Evict>
+static double churn(int frames, int tracks, uint64_t ttl, Lookup lookup, Evict evict)
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::mt19937_64 rng(g_seed);
+	std::vector<uint64_t> live(tracks);
+	uint64_t next_id{}, lookups{};
+
+	for(uint64_t &track_id : live)
+		track_id = next_id++;
+
+	const Clock::time_point start{ Clock::now() };
+	for(int frame{}; frame < frames; frame++)
+	{
+		for(uint64_t &track_id : live)
+		{
+			lookup(static_cast<uint>(track_id % 4), track_id, static_cast<uint64_t>(frame));
+			lookups++;
+			if(rng() % 64 == 0)
+				track_id = next_id++;
+		}
+		if(frame % 16 == 0)
+			evict(static_cast<uint64_t>(frame), ttl);
+	}
+	return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / static_cast<double>(lookups);
+}
+
+/**
+ * Runs the churn for a day of frames and checks that the table holds no
+ * more values than the peak of entries alive at once, i.e. that evicted
+ * tracks give their value back, so that the memory stays flat however long
+ * it runs.
+ *
+ * @return false if the table grew past the live entries.
+ * */
+static bool soak_memory()
+{
+	static constexpr uint64_t TTL{ 300 };
+
+	TrackTable<SoakValue> table;
+	size_t peak{}, half_day_pool_size{};
+
+	const double ns{ churn(g_soak_frames, g_soak_tracks, TTL,
+												 [&table, &half_day_pool_size](uint source_id, uint64_t track_id, uint64_t frame)
+												 {
+													 bool created;
+													 table.advance(frame - table.frame());
+													 table.acquire(source_id, track_id, created);
+													 if(frame == static_cast<uint64_t>(g_soak_frames / 2))
+														 half_day_pool_size = table.pool_size();
+												 },
+												 [&table, &peak](uint64_t, uint64_t ttl)
+												 {
+													 // Entries are only added between two sweeps
+													 peak = std::max(peak, table.size());
+													 table.evict(ttl);
+												 }) };
+	peak = std::max(peak, table.size());
+
+	g_print("%s", fmt::format("memory soak: {} frames of {} live tracks, {:.1f} ns per lookup, {} entries at most, "
+														"{} values at half time and {} at the end in {} slots\n",
+														g_soak_frames, g_soak_tracks, ns, peak, half_day_pool_size, table.pool_size(),
+														table.capacity())
+									.c_str());
+
+	if(table.pool_size() > peak)
+	{
+		TADS_ERR_MSG_V("The pool holds %zu values for at most %zu entries", table.pool_size(), peak);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Soaks the track table against std::unordered_map under random churn and
+ * for a day of synthetic frames, then measures it under the churn of the
+ * analytics against the std::map of shared_ptr it replaced and against
+ * std::unordered_map.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	std::mt19937_64 rng;
+	TrackTable<SoakValue> table;
+	std::map<uint64_t, std::shared_ptr<SoakValue>> tree;
+	std::map<uint64_t, uint64_t> tree_seen;
+	std::unordered_map<TrackKey, ModelEntry, TrackKeyHash> map;
+	double table_ns, tree_ns, map_ns;
+
+	ctx = g_option_context_new("- soak and benchmark the track table");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_ops < 1 || g_tracks < 1 || g_frames < 1 || g_soak_tracks < 1 || g_soak_frames < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	rng.seed(g_seed);
+	// Key spaces of about the slot count keep the small tables full, the large one grows from 16 slots
+	failures += soak(1, 2, 6, g_ops, rng);
+	failures += soak(8, 3, 8, g_ops, rng);
+	failures += soak(16, 4, 12, g_ops, rng);
+	failures += soak(1, 8, 512, g_ops, rng);
+	failures += !soak_memory();
+
+	table_ns = churn(g_frames, g_tracks, 64,
+									 [&table](uint source_id, uint64_t track_id, uint64_t frame)
+									 {
+										 bool created;
+										 table.advance(frame - table.frame());
+										 SoakValue &value{ table.acquire(source_id, track_id, created) };
+										 if(created)
+											 value = { source_id, track_id };
+									 },
+									 [&table](uint64_t, uint64_t ttl) { table.evict(ttl); });
+
+	// What the analytics did before, plus the sweep it lacked
+	tree_ns = churn(g_frames, g_tracks, 64,
+									[&tree, &tree_seen](uint source_id, uint64_t track_id, uint64_t frame)
+									{
+										std::shared_ptr<SoakValue> &value{ tree[track_id] };
+										if(!value)
+											value = std::make_shared<SoakValue>(SoakValue{ source_id, track_id });
+										tree_seen[track_id] = frame;
+									},
+									[&tree, &tree_seen](uint64_t frame, uint64_t ttl)
+									{
+										for(auto it = tree_seen.begin(); it != tree_seen.end();)
+										{
+											if(frame - it->second > ttl)
+											{
+												tree.erase(it->first);
+												it = tree_seen.erase(it);
+											}
+											else
+											{
+												++it;
+											}
+										}
+									});
+
+	map_ns = churn(
+			g_frames, g_tracks, 64,
+			[&map](uint source_id, uint64_t track_id, uint64_t frame) { map[{ source_id, track_id }].last_seen = frame; },
+			[&map](uint64_t frame, uint64_t ttl)
+			{
+				for(auto it = map.begin(); it != map.end();)
+				{
+					if(frame - it->second.last_seen > ttl)
+						it = map.erase(it);
+					else
+						++it;
+				}
+			});
+
+	g_print("%s", fmt::format("{} live tracks, {} frames, ns per lookup including the churn: track table {:.1f}, "
+														"std::map of shared_ptr {:.1f}, std::unordered_map {:.1f}\n",
+														g_tracks, g_frames, table_ns, tree_ns, map_ns)
+									.c_str());
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d soaks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,288 @@
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "common.hpp"
+#include "weights.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static int g_size_mb{ 256 };
+static int g_layer_weights{ 1 << 20 };
+static gchar *g_directory{};
+
+GOptionEntry entries[] = {
+	{ "size", 's', 0, G_OPTION_ARG_INT, &g_size_mb, "Size of the synthetic weights file in MiB", nullptr },
+	{ "layer-weights", 'l', 0, G_OPTION_ARG_INT, &g_layer_weights, "Weights taken by each synthetic layer", nullptr },
+	{ "directory", 'd', 0, G_OPTION_ARG_STRING, &g_directory, "Directory of the synthetic file (default /tmp)", nullptr },
+	{ nullptr },
+};
+
+struct LoadResult
+{
+	double seconds{};
+	long anon_kb{};
+	long file_kb{};
+	long peak_kb{};
+	double checksum{};
+	size_t count{};
+};
+
+/**
+ * @return the value in kB of @p field in /proc/self/status, or -1.
+ * */
+static long status_kb(const char *field)
+{
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	const size_t length{ strlen(field) };
+
+	while(std::getline(status, line))
+	{
+		if(line.compare(0, length, field) == 0 && line[length] == ':')
+			return std::stol(line.substr(length + 1));
+	}
+	return -1;
+}
+
+/**
+ * Writes a version 0.2 file, whose seen counter is 64 bit, holding @p count weights.
+ * */
+static bool write_weights(const std::string &path, size_t count)
+{
+	const int32_t version[3]{ 0, 2, 5 };
+	const uint64_t seen{ 32013312 };
+	std::vector<float> chunk(1 << 16);
+	FILE *file{ fopen(path.c_str(), "wb") };
+	bool success{ file != nullptr };
+
+	success = success && fwrite(version, sizeof(version), 1, file) == 1 && fwrite(&seen, sizeof(seen), 1, file) == 1;
+	for(size_t written = 0; success && written < count; written += chunk.size())
+	{
+		const size_t size{ std::min(chunk.size(), count - written) };
+		for(size_t i = 0; i < size; i++)
+			chunk[i] = static_cast<float>((written + i) % 1021) * 0.25f;
+		success = fwrite(chunk.data(), sizeof(float), size, file) == size;
+	}
+
+	if(file != nullptr && fclose(file) != 0)
+		success = false;
+	return success;
+}
+
+/**
+ * The loader as it was before DarknetWeights: every weight is read into a
+ * vector, and each layer copies its weights into its own array.
+ * */
+static LoadResult load_reference(const std::string &path)
+{
+	LoadResult result;
+	std::vector<float> weights;
+	std::vector<float *> layers;
+	std::ifstream file(path, std::ios_base::binary);
+	char value[4];
+
+	file.ignore(4 * 5);
+	while(!file.eof())
+	{
+		file.read(value, 4);
+		weights.push_back(*reinterpret_cast<float *>(value));
+		if(file.peek() == std::istream::traits_type::eof())
+			break;
+	}
+
+	for(size_t offset = 0; offset < weights.size(); offset += g_layer_weights)
+	{
+		const size_t size{ std::min<size_t>(g_layer_weights, weights.size() - offset) };
+		float *layer{ new float[size] };
+		memcpy(layer, weights.data() + offset, size * sizeof(float));
+		layers.push_back(layer);
+		for(size_t i = 0; i < size; i++)
+			result.checksum += layer[i];
+		result.count += size;
+	}
+
+	result.anon_kb = status_kb("RssAnon");
+	result.file_kb = status_kb("RssFile");
+	for(float *layer : layers)
+		delete[] layer;
+	return result;
+}
+
+/**
+ * Takes the weights layer by layer as the YOLO layers do and reads them as
+ * TensorRT would when it builds the engine.
+ * */
+static LoadResult load_weights(const std::string &path)
+{
+	LoadResult result;
+	DarknetWeights weights;
+	int weight_ptr{};
+
+	if(!weights.open(path))
+		return result;
+
+	while(static_cast<size_t>(weight_ptr) < weights.size())
+	{
+		const int size{ static_cast<int>(std::min<size_t>(g_layer_weights, weights.size() - weight_ptr)) };
+		const float *layer{ weights.take(weight_ptr, size) };
+		if(layer == nullptr)
+			return {};
+		for(int i = 0; i < size; i++)
+			result.checksum += layer[i];
+		result.count += size;
+	}
+
+	result.anon_kb = status_kb("RssAnon");
+	result.file_kb = status_kb("RssFile");
+	return result;
+}
+
+/**
+ * Runs @p load in a child process so that each loader starts from the same
+ * memory and its peak is its own.
+ * */
+template <typename Load>
+static bool run(const char *name, Load load, LoadResult &result)
+{
+	int fds[2];
+	if(pipe(fds) != 0)
+		return false;
+
+	const pid_t pid{ fork() };
+	if(pid == 0)
+	{
+		close(fds[0]);
+		const long anon_kb{ status_kb("RssAnon") }, file_kb{ status_kb("RssFile") }, peak_kb{ status_kb("VmHWM") };
+		const auto begin{ std::chrono::steady_clock::now() };
+		LoadResult child{ load() };
+		child.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		child.anon_kb -= anon_kb;
+		child.file_kb -= file_kb;
+		child.peak_kb = status_kb("VmHWM") - peak_kb;
+		const bool written{ write(fds[1], &child, sizeof(child)) == sizeof(child) };
+		_exit(written ? 0 : 1);
+	}
+
+	close(fds[1]);
+	bool success{ pid > 0 && read(fds[0], &result, sizeof(result)) == sizeof(result) };
+	int status{};
+	success = pid > 0 && waitpid(pid, &status, 0) == pid && success && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	close(fds[0]);
+
+	if(success)
+		g_print("%s", fmt::format("{:<10} {:7.3f} s, {:8} weights, anonymous RSS {:+8} kB, file RSS {:+8} kB, peak {:+8} kB\n",
+															name, result.seconds, result.count, result.anon_kb, result.file_kb, result.peak_kb)
+											.c_str());
+	return success;
+}
+
+/**
+ * Measures the load time and memory of the Darknet weights: a synthetic
+ * file is loaded by the reader as it was, one float at a time into a
+ * vector copied again by each layer, then by DarknetWeights from the
+ * mapping and streamed through a FIFO. All must see the same weights, and
+ * the mapped load must not grow the anonymous memory by the file size.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::string path, fifo_path;
+	size_t count{};
+	LoadResult reference, mapped, streamed;
+	std::thread writer;
+
+	ctx = g_option_context_new("- measure the Darknet weights load time and memory");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_size_mb < 1 || g_layer_weights < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	path = fmt::format("{}/tads-weights-bench-{}.weights", g_directory != nullptr ? g_directory : "/tmp", getpid());
+	fifo_path = path + ".fifo";
+	count = static_cast<size_t>(g_size_mb) * 1024 * 1024 / sizeof(float);
+	if(!write_weights(path, count))
+	{
+		TADS_ERR_MSG_V("Could not write '%s': %s", path.c_str(), strerror(errno));
+		goto done;
+	}
+
+	if(!run("reference", [&path] { return load_reference(path); }, reference) ||
+		 !run("mapped", [&path] { return load_weights(path); }, mapped))
+	{
+		TADS_ERR_MSG_V("A loader failed");
+		goto done;
+	}
+
+	// A FIFO can not be mapped, DarknetWeights streams it
+	if(mkfifo(fifo_path.c_str(), 0600) != 0)
+	{
+		TADS_ERR_MSG_V("Could not create '%s': %s", fifo_path.c_str(), strerror(errno));
+		goto done;
+	}
+	writer = std::thread(
+			[&path, &fifo_path]
+			{
+				std::ifstream source(path, std::ios_base::binary);
+				std::ofstream fifo(fifo_path, std::ios_base::binary);
+				fifo << source.rdbuf();
+			});
+	if(!run("streamed", [&fifo_path] { return load_weights(fifo_path); }, streamed))
+	{
+		TADS_ERR_MSG_V("The streamed load failed");
+		writer.join();
+		goto done;
+	}
+	writer.join();
+
+	if(reference.count != count || mapped.count != count || streamed.count != count ||
+		 mapped.checksum != reference.checksum || streamed.checksum != reference.checksum)
+	{
+		TADS_ERR_MSG_V("Loaders disagree: %zu, %zu and %zu weights", reference.count, mapped.count, streamed.count);
+		goto done;
+	}
+
+	if(mapped.anon_kb * 1024 >= static_cast<long>(count * sizeof(float)) / 2)
+	{
+		TADS_ERR_MSG_V("The mapped load grew the anonymous memory by %ld kB", mapped.anon_kb);
+		goto done;
+	}
+
+	g_print("%s", fmt::format("mapped load {:.1f}x faster than the reference, {} kB less anonymous memory\n",
+														reference.seconds / mapped.seconds, reference.anon_kb - mapped.anon_kb)
+										.c_str());
+	return_value = 0;
+
+done:
+	if(!path.empty())
+		unlink(path.c_str());
+	if(!fifo_path.empty())
+		unlink(fifo_path.c_str());
+	g_free(g_directory);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,234 @@
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "analytics_writer.hpp"
+#include "common.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+static gchar *g_output_path{};
+static int g_records{ 20000 };
+static int g_producers{ 4 };
+static int g_capacity{ 64 };
+static int g_batch_size{ 16 };
+
+GOptionEntry entries[] = {
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &g_output_path,
+		"Folder of the records, emptied before each policy (default /tmp/tads-writer-flood)", nullptr },
+	{ "records", 'n', 0, G_OPTION_ARG_INT, &g_records, "Records pushed per policy", nullptr },
+	{ "producers", 'j', 0, G_OPTION_ARG_INT, &g_producers, "Threads pushing the records", nullptr },
+	{ "capacity", 'c', 0, G_OPTION_ARG_INT, &g_capacity, "Queue capacity of the writer", nullptr },
+	{ "batch-size", 'b', 0, G_OPTION_ARG_INT, &g_batch_size, "Records flushed per batch", nullptr },
+	{ nullptr },
+};
+
+static const char *policy_name(WriterOverflowPolicy policy)
+{
+	switch(policy)
+	{
+		case WriterOverflowPolicy::BLOCK:
+			return "BLOCK";
+		case WriterOverflowPolicy::DROP_OLDEST:
+			return "DROP_OLDEST";
+		case WriterOverflowPolicy::DROP_NEWEST:
+			return "DROP_NEWEST";
+	}
+	return "?";
+}
+
+static std::string record_path(const std::string &folder, uint64_t id)
+{
+	return fmt::format("{}/{}.txt", folder, id);
+}
+
+/**
+ * Floods a writer of @p policy from several producers and checks the
+ * counters against the records found on disk.
+ *
+ * @return number of failed checks.
+ * */
+static int flood(WriterOverflowPolicy policy, const std::string &folder)
+{
+	using Clock = std::chrono::steady_clock;
+
+	// The producers push the ids [0, records), the last one is pushed alone
+	const uint64_t records{ static_cast<uint64_t>(g_records) };
+	const uint64_t total{ records + 1 };
+	const uint64_t capacity{ static_cast<uint64_t>(g_capacity) };
+	AnalyticsWriter writer(capacity, policy, 20, g_batch_size);
+	std::vector<std::thread> producers;
+	std::vector<uint8_t> pushed(records + 1);
+	std::atomic<uint64_t> accepted{}, rejected{};
+	std::error_code ec;
+	uint64_t on_disk{};
+	int failures{};
+
+	std::filesystem::remove_all(folder, ec);
+	std::filesystem::create_directories(folder);
+
+	writer.set_output(AnalyticsOutputFormat::TEXT, folder);
+	writer.start();
+
+	const Clock::time_point start{ Clock::now() };
+	auto push = [&](uint64_t id)
+	{
+		AnalyticsRecord record;
+		record.filename = record_path(folder, id);
+		record.event.object_id = id;
+		record.event.time_us = static_cast<int64_t>(id);
+		record.event.label = "car";
+
+		pushed[id] = writer.push(std::move(record));
+		if(pushed[id])
+			accepted++;
+		else
+			rejected++;
+	};
+
+	for(int p{}; p < g_producers; p++)
+	{
+		// Producer p pushes the ids p, p + producers, ... so that every id is pushed once
+		producers.emplace_back(
+				[&push, p, records]
+				{
+					for(uint64_t id = p; id < records; id += g_producers)
+						push(id);
+				});
+	}
+	for(std::thread &producer : producers)
+		producer.join();
+	// Last record, pushed once the producers are done so that it is the newest one
+	push(records);
+	const double push_s{ std::chrono::duration<double>(Clock::now() - start).count() };
+
+	writer.stop();
+	const double elapsed_s{ std::chrono::duration<double>(Clock::now() - start).count() };
+	const AnalyticsWriterStats stats{ writer.stats() };
+
+	for(const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(folder))
+		on_disk += entry.is_regular_file();
+
+	g_print("%s", fmt::format("{:<12} pushed {} in {:.3f} s ({:.0f}/s), written {} dropped {} failed {} in {} "
+														"batches, max queue {}, {:.3f} s to drain\n",
+														policy_name(policy), total, push_s, total / push_s, stats.written, stats.dropped,
+														stats.failed, stats.batches, stats.max_queue_depth, elapsed_s)
+									.c_str());
+
+	auto check = [&failures, policy](bool passed, const std::string &what)
+	{
+		if(!passed)
+		{
+			TADS_ERR_MSG_V("%s: %s", policy_name(policy), what.c_str());
+			failures++;
+		}
+	};
+
+	check(stats.failed == 0, fmt::format("{} records failed", stats.failed));
+	check(stats.skipped == 0, fmt::format("{} records skipped", stats.skipped));
+	check(stats.queue_depth == 0, fmt::format("{} records left in the queue", stats.queue_depth));
+	check(stats.max_queue_depth <= capacity,
+				fmt::format("queue depth {} above the capacity {}", stats.max_queue_depth, capacity));
+	check(on_disk == stats.written, fmt::format("{} records on disk, {} counted written", on_disk, stats.written));
+
+	switch(policy)
+	{
+		case WriterOverflowPolicy::BLOCK:
+			// The producers wait for the flush thread, nothing is lost
+			check(stats.dropped == 0 && rejected == 0, fmt::format("{} records dropped", stats.dropped));
+			check(stats.queued == total && stats.written == total,
+						fmt::format("{} records queued and {} written out of {}", stats.queued, stats.written, total));
+			break;
+		case WriterOverflowPolicy::DROP_OLDEST:
+			// Every push succeeds, the oldest queued record makes room for it
+			check(rejected == 0, fmt::format("{} pushes rejected", rejected.load()));
+			check(stats.queued == total, fmt::format("{} records queued out of {}", stats.queued, total));
+			check(stats.written + stats.dropped == total,
+						fmt::format("{} written and {} dropped out of {}", stats.written, stats.dropped, total));
+			check(std::filesystem::exists(record_path(folder, records)), "newest record dropped");
+			break;
+		case WriterOverflowPolicy::DROP_NEWEST:
+			// A queued record is always written, a rejected one never
+			check(stats.queued == accepted && stats.dropped == rejected,
+						fmt::format("{} queued and {} dropped, {} pushes accepted and {} rejected", stats.queued,
+												stats.dropped, accepted.load(), rejected.load()));
+			check(stats.written == stats.queued,
+						fmt::format("{} records written out of {} queued", stats.written, stats.queued));
+			for(uint64_t id = 0; id < total; id++)
+			{
+				if(std::filesystem::exists(record_path(folder, id)) != static_cast<bool>(pushed[id]))
+				{
+					check(false, fmt::format("record {} was {} but is {} on disk", id, pushed[id] ? "queued" : "rejected",
+																	 pushed[id] ? "missing" : "found"));
+					break;
+				}
+			}
+			break;
+	}
+
+	if(policy != WriterOverflowPolicy::BLOCK && stats.dropped == 0)
+	{
+		TADS_ERR_MSG_V("%s: the queue never overflowed, raise --records or lower --capacity", policy_name(policy));
+		failures++;
+	}
+
+	std::filesystem::remove_all(folder, ec);
+	return failures;
+}
+
+/**
+ * Floods the analytics writer with records from several producers, once
+ * per overflow policy, and checks that every policy keeps the records it
+ * promises: BLOCK loses none, DROP_OLDEST keeps the newest and DROP_NEWEST
+ * keeps the queued ones.
+ * */
+int main(int argc, char *argv[])
+{
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	std::string output_path;
+	int failures{};
+
+	ctx = g_option_context_new("- flood the analytics writer and check its overflow policies");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_records < 1 || g_producers < 1 || g_capacity < 1 || g_batch_size < 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	output_path = g_output_path != nullptr ? g_output_path : "/tmp/tads-writer-flood";
+
+	for(WriterOverflowPolicy policy :
+			{ WriterOverflowPolicy::BLOCK, WriterOverflowPolicy::DROP_OLDEST, WriterOverflowPolicy::DROP_NEWEST })
+		failures += flood(policy, fmt::format("{}/{}", output_path, static_cast<uint>(policy)));
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("%d checks failed", failures);
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_free(g_output_path);
+	g_option_context_free(ctx);
+
+	return return_value;
+}
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+#include <nvdsinfer_custom_impl.h>
+
+#include "common.hpp"
+
+GST_DEBUG_CATEGORY(NVDS_APP);
+
+extern "C" bool NvDsInferParseYoloNms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			NvDsInferNetworkInfo const &networkInfo,
+																			NvDsInferParseDetectionParams const &detectionParams,
+																			std::vector<NvDsInferParseObjectInfo> &objectList);
+
+extern "C" bool NvDsInferParseYoloENms(std::vector<NvDsInferLayerInfo> const &outputLayersInfo,
+																			 NvDsInferNetworkInfo const &networkInfo,
+																			 NvDsInferParseDetectionParams const &detectionParams,
+																			 std::vector<NvDsInferParseObjectInfo> &objectList);
+
+static int g_frames{ 300 };
+static int g_anchors{ 8400 };
+static int g_classes{ 4 };
+static int g_top_k{ 8 };
+static double g_iou{ 0.45 };
+static int g_seed{ 1 };
+static gboolean g_no_simd{};
+
+GOptionEntry entries[] = {
+	{ "frames", 'n', 0, G_OPTION_ARG_INT, &g_frames, "Random frames checked and timed", nullptr },
+	{ "anchors", 'a', 0, G_OPTION_ARG_INT, &g_anchors, "Anchors per frame", nullptr },
+	{ "classes", 'c', 0, G_OPTION_ARG_INT, &g_classes, "Classes configured", nullptr },
+	{ "top-k", 'k', 0, G_OPTION_ARG_INT, &g_top_k, "Boxes kept per class, passed as TADS_YOLO_NMS_TOPK", nullptr },
+	{ "iou", 'i', 0, G_OPTION_ARG_DOUBLE, &g_iou, "IoU threshold, passed as TADS_YOLO_NMS_IOU_THRESHOLD", nullptr },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &g_seed, "Seed of the frames", nullptr },
+	{ "no-simd", 0, 0, G_OPTION_ARG_NONE, &g_no_simd, "Check the scalar candidate filter, TADS_YOLO_DISABLE_SIMD=1",
+		nullptr },
+	{ nullptr },
+};
+
+static constexpr uint NET_WIDTH{ 640 };
+static constexpr uint NET_HEIGHT{ 640 };
+
+/**
+ * Output tensors of one frame, the boxes in both layouts of the parsers.
+ * */
+struct SyntheticFrame
+{
+	std::vector<float> centers;
+	std::vector<float> corners;
+	std::vector<float> scores;
+	std::vector<float> classes;
+};
+
+/**
+ * Boxes spread over the network input and crowded around a few vehicles,
+ * so that NMS both suppresses and keeps more than top-K boxes per class.
+ * On every other frame the crowds are tight and outscore the rest, so that
+ * NMS suppresses more than the candidates it sorted first before it keeps
+ * top-K boxes. Scores are quantized to get ties, a few classes are out of
+ * range and a few boxes are empty or stick out of the input.
+ * */
+static void make_frame(SyntheticFrame &frame, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<std::pair<float, float>> crowds(2 + rng() % 10);
+	const uint anchors{ static_cast<uint>(g_anchors) };
+	const bool tight{ rng() % 2 == 0 };
+	const float jitter{ tight ? 8.0f : 24.0f };
+
+	for(std::pair<float, float> &crowd : crowds)
+		crowd = { unit(rng) * NET_WIDTH, unit(rng) * NET_HEIGHT };
+
+	frame.centers.resize(anchors * 4);
+	frame.corners.resize(anchors * 4);
+	frame.scores.resize(anchors);
+	frame.classes.resize(anchors);
+
+	for(uint b = 0; b < anchors; b++)
+	{
+		float cx, cy, w, h, score;
+		const float kind{ unit(rng) };
+
+		if(kind < 0.5f)
+		{
+			const std::pair<float, float> &crowd{ crowds[rng() % crowds.size()] };
+			cx = crowd.first + (unit(rng) - 0.5f) * jitter;
+			cy = crowd.second + (unit(rng) - 0.5f) * jitter;
+			w = 60 + unit(rng) * 20;
+			h = 40 + unit(rng) * 20;
+			score = static_cast<float>(15 + rng() % 5) / 20.0f;
+		}
+		else
+		{
+			cx = unit(rng) * (NET_WIDTH + 80) - 40;
+			cy = unit(rng) * (NET_HEIGHT + 80) - 40;
+			w = kind < 0.98f ? 4 + unit(rng) * 100 : unit(rng) * 1.5f;
+			h = kind < 0.98f ? 4 + unit(rng) * 100 : unit(rng) * 1.5f;
+			score = static_cast<float>(rng() % (tight ? 15 : 20)) / 20.0f;
+		}
+
+		frame.centers[b * 4 + 0] = cx;
+		frame.centers[b * 4 + 1] = cy;
+		frame.centers[b * 4 + 2] = w;
+		frame.centers[b * 4 + 3] = h;
+
+		frame.corners[b * 4 + 0] = cx - w / 2;
+		frame.corners[b * 4 + 1] = cy - h / 2;
+		frame.corners[b * 4 + 2] = cx + w / 2;
+		frame.corners[b * 4 + 3] = cy + h / 2;
+
+		frame.scores[b] = score;
+
+		const uint class_kind{ static_cast<uint>(rng() % 200) };
+		if(class_kind == 0)
+			frame.classes[b] = -1.0f;
+		else if(class_kind == 1)
+			frame.classes[b] = static_cast<float>(g_classes);
+		else if(class_kind == 2)
+			frame.classes[b] = 1e7f;
+		else if(class_kind == 3)
+			frame.classes[b] = std::numeric_limits<float>::quiet_NaN();
+		else if(class_kind == 4)
+			frame.classes[b] = -3e9f;
+		else
+			frame.classes[b] = static_cast<float>(rng() % g_classes);
+	}
+}
+
+static float clamp_to(float value, float max_value)
+{
+	return std::max(0.0f, std::min(value, max_value));
+}
+
+/**
+ * Decode and greedy class-aware NMS done the obvious way: every candidate
+ * is compared with every box kept before it, classes in increasing order,
+ * candidates by decreasing score then by anchor.
+ * */
+static void reference_nms(const SyntheticFrame &frame, bool corners, const std::vector<float> &thresholds,
+													std::vector<NvDsInferParseObjectInfo> &objects)
+{
+	std::vector<std::pair<uint, NvDsInferParseObjectInfo>> candidates;
+
+	objects.clear();
+	for(uint b = 0; b < frame.scores.size(); b++)
+	{
+		const float class_value{ frame.classes[b] };
+		if(!(class_value >= 0 && class_value < static_cast<float>(thresholds.size())))
+			continue;
+
+		const uint class_id{ static_cast<uint>(class_value) };
+		if(!(frame.scores[b] >= thresholds[class_id]))
+			continue;
+
+		const float *box{ (corners ? frame.corners.data() : frame.centers.data()) + b * 4 };
+		float x1, y1, x2, y2;
+		if(corners)
+		{
+			x1 = box[0];
+			y1 = box[1];
+			x2 = box[2];
+			y2 = box[3];
+		}
+		else
+		{
+			x1 = box[0] - box[2] / 2;
+			y1 = box[1] - box[3] / 2;
+			x2 = x1 + box[2];
+			y2 = y1 + box[3];
+		}
+		x1 = clamp_to(x1, NET_WIDTH);
+		y1 = clamp_to(y1, NET_HEIGHT);
+		x2 = clamp_to(x2, NET_WIDTH);
+		y2 = clamp_to(y2, NET_HEIGHT);
+
+		NvDsInferParseObjectInfo object{};
+		object.classId = class_id;
+		object.left = x1;
+		object.top = y1;
+		object.width = clamp_to(x2 - x1, NET_WIDTH);
+		object.height = clamp_to(y2 - y1, NET_HEIGHT);
+		object.detectionConfidence = frame.scores[b];
+		if(object.width < 1 || object.height < 1)
+			continue;
+
+		candidates.emplace_back(b, object);
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(),
+									 [](const auto &a, const auto &b)
+									 {
+										 if(a.second.classId != b.second.classId)
+											 return a.second.classId < b.second.classId;
+										 return a.second.detectionConfidence > b.second.detectionConfidence;
+									 });
+
+	const float iou{ static_cast<float>(g_iou) };
+	size_t class_begin{};
+	for(size_t i = 0; i < candidates.size(); i++)
+	{
+		const NvDsInferParseObjectInfo &object{ candidates[i].second };
+		if(i > 0 && object.classId != candidates[i - 1].second.classId)
+			class_begin = objects.size();
+
+		if(objects.size() - class_begin >= static_cast<size_t>(g_top_k))
+			continue;
+
+		bool suppressed{};
+		for(size_t k = class_begin; k < objects.size() && !suppressed; k++)
+		{
+			const NvDsInferParseObjectInfo &kept{ objects[k] };
+			const float w{ std::max(0.0f, std::min(kept.left + kept.width, object.left + object.width) -
+																		std::max(kept.left, object.left)) };
+			const float h{ std::max(0.0f, std::min(kept.top + kept.height, object.top + object.height) -
+																		std::max(kept.top, object.top)) };
+			const float intersection{ w * h };
+			suppressed = intersection > iou * (kept.width * kept.height + object.width * object.height - intersection);
+		}
+		if(!suppressed)
+			objects.push_back(object);
+	}
+}
+
+static std::string describe(const NvDsInferParseObjectInfo &object)
+{
+	return fmt::format("class {} score {:.2f} at {:.2f},{:.2f} {:.2f}x{:.2f}", object.classId,
+										 object.detectionConfidence, object.left, object.top, object.width, object.height);
+}
+
+/**
+ * @return false if the parser output is not the one of the reference, box for box.
+ * */
+static bool same_objects(const std::vector<NvDsInferParseObjectInfo> &parsed,
+												 const std::vector<NvDsInferParseObjectInfo> &reference, int frame, const char *parser)
+{
+	for(size_t i = 0; i < std::max(parsed.size(), reference.size()); i++)
+	{
+		if(i >= parsed.size() || i >= reference.size())
+		{
+			TADS_ERR_MSG_V("%s, frame %d: %zu boxes instead of %zu, first extra %s", parser, frame, parsed.size(),
+										 reference.size(), describe(i < parsed.size() ? parsed[i] : reference[i]).c_str());
+			return false;
+		}
+
+		const NvDsInferParseObjectInfo &a{ parsed[i] };
+		const NvDsInferParseObjectInfo &b{ reference[i] };
+		if(a.classId != b.classId || a.detectionConfidence != b.detectionConfidence || a.left != b.left ||
+			 a.top != b.top || a.width != b.width || a.height != b.height)
+		{
+			TADS_ERR_MSG_V("%s, frame %d, box %zu: %s instead of %s", parser, frame, i, describe(a).c_str(),
+										 describe(b).c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Checks the *Nms YOLO parsers, i.e. the candidate filter, the decode and
+ * the class-aware NMS with top-K, against a brute-force O(n^2) reference
+ * on random frames, then times both.
+ * */
+int main(int argc, char *argv[])
+{
+	using Clock = std::chrono::steady_clock;
+
+	GOptionContext *ctx{};
+	GError *error{};
+	int return_value{ -1 };
+	int failures{};
+	std::mt19937 rng;
+	std::vector<SyntheticFrame> frames;
+	std::vector<NvDsInferLayerInfo> layers(3);
+	NvDsInferNetworkInfo network_info{};
+	NvDsInferParseDetectionParams detection_params{};
+	std::vector<NvDsInferParseObjectInfo> parsed, reference;
+	uint64_t kept{};
+	double parser_ns{}, reference_ns{};
+
+	ctx = g_option_context_new("- check the YOLO NMS parsers against a brute-force reference");
+	g_option_context_add_main_entries(ctx, entries, nullptr);
+
+	if(!g_option_context_parse(ctx, &argc, &argv, &error))
+	{
+		TADS_ERR_MSG_V("%s", error->message);
+		g_clear_error(&error);
+		goto done;
+	}
+
+	if(g_frames < 1 || g_anchors < 1 || g_classes < 1 || g_top_k < 1 || g_iou <= 0 || g_iou > 1)
+	{
+		gchar *help{ g_option_context_get_help(ctx, TRUE, nullptr) };
+		g_printerr("%s", help);
+		g_free(help);
+		goto done;
+	}
+
+	// The parsers read them once, before the first frame
+	setenv("TADS_YOLO_NMS_TOPK", std::to_string(g_top_k).c_str(), 1);
+	setenv("TADS_YOLO_NMS_IOU_THRESHOLD", std::to_string(g_iou).c_str(), 1);
+	if(g_no_simd)
+		setenv("TADS_YOLO_DISABLE_SIMD", "1", 1);
+
+	network_info.width = NET_WIDTH;
+	network_info.height = NET_HEIGHT;
+	detection_params.numClassesConfigured = g_classes;
+	for(int c = 0; c < g_classes; c++)
+		detection_params.perClassPreclusterThreshold.push_back(0.25f + 0.05f * static_cast<float>(c % 4));
+
+	rng.seed(g_seed);
+	frames.resize(g_frames);
+	for(SyntheticFrame &frame : frames)
+		make_frame(frame, rng);
+
+	for(bool corners : { false, true })
+	{
+		const char *parser{ corners ? "NvDsInferParseYoloENms" : "NvDsInferParseYoloNms" };
+
+		for(int f = 0; f < g_frames; f++)
+		{
+			const SyntheticFrame &frame{ frames[f] };
+			layers[0].inferDims.d[0] = static_cast<uint>(g_anchors);
+			layers[0].buffer = const_cast<float *>(corners ? frame.corners.data() : frame.centers.data());
+			layers[1].buffer = const_cast<float *>(frame.scores.data());
+			layers[2].buffer = const_cast<float *>(frame.classes.data());
+
+			Clock::time_point start{ Clock::now() };
+			if(corners)
+				NvDsInferParseYoloENms(layers, network_info, detection_params, parsed);
+			else
+				NvDsInferParseYoloNms(layers, network_info, detection_params, parsed);
+			parser_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+			start = Clock::now();
+			reference_nms(frame, corners, detection_params.perClassPreclusterThreshold, reference);
+			reference_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+			kept += reference.size();
+			if(!same_objects(parsed, reference, f, parser))
+			{
+				failures++;
+				break;
+			}
+		}
+	}
+
+	g_print("%s", fmt::format("{} frames of {} anchors and {} classes in both layouts, top-k {}, iou {:.2f}, "
+														"{:.1f} boxes kept per frame\n"
+														"parser {:.1f} us per frame, brute-force reference {:.1f} us per frame\n",
+														g_frames, g_anchors, g_classes, g_top_k, g_iou, kept / (2.0 * g_frames),
+														parser_ns / (2e3 * g_frames), reference_ns / (2e3 * g_frames))
+									.c_str());
+
+	if(failures > 0)
+	{
+		TADS_ERR_MSG_V("The parsers differ from the reference");
+		goto done;
+	}
+
+	return_value = 0;
+
+done:
+	g_option_context_free(ctx);
+
+	return return_value;
+}